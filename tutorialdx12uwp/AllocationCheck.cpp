@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+#include "AssetLoader.h"
+#include "FrameUpdate.h"
+#include "UploadBackend.h"
+
+// Console check that steady frames of FrameUpdate::WriteInstances do not touch the heap, as Game::Tick asserts of
+// Update in debug builds, built by CMakeLists.txt with _COUNT_ALLOCATIONS. Cubes all around the camera, on the
+// null upload backend, turned a full circle per c_framesPerTurn frames: the first turn lets the ring, the buckets
+// and the scratch reach their size, the next ones must not allocate. Exits with 1 when a frame allocates.
+
+namespace {
+	const UINT c_shapeCount = 4;
+	const int c_gridHalfSize = 16;
+	const int c_framesPerTurn = 60;
+	const int c_checkedTurns = 2;
+	const UINT64 c_framesInFlight = 2;
+	const float c_fovY = 0.25f * XM_PI;
+	const float c_height = 720.0f;
+
+	void report(const wchar_t* format, ...) {
+		wchar_t msgbuff[512];
+		va_list args;
+		va_start(args, format);
+		vswprintf(msgbuff, 512, format, args);
+		va_end(args);
+		MYTRACE(msgbuff);
+	}
+
+	// A square grid of cubes on the ground around the camera, the shapes in turn, so every view sees a part of them.
+	InstanceStore makeScene() {
+		InstanceStore store;
+		store.Clear(c_shapeCount);
+		const XMFLOAT4 rotation(0.0f, 0.0f, 0.0f, 1.0f);
+		const XMFLOAT3 scale(1.0f, 1.0f, 1.0f);
+		UINT shape = 0;
+		for (int z = -c_gridHalfSize; z <= c_gridHalfSize; z++) {
+			for (int x = -c_gridHalfSize; x <= c_gridHalfSize; x++) {
+				if (x == 0 && z == 0)
+					continue;
+				store.Add(shape, XMFLOAT3(4.0f * x, -2.0f, 4.0f * z), rotation, scale, shape);
+				shape = (shape + 1) % c_shapeCount;
+			}
+		}
+		return store;
+	}
+}
+
+int main() {
+	std::vector<std::shared_ptr<Mesh>> meshes;
+	for (UINT shape = 0; shape < c_shapeCount; shape++)
+		meshes.push_back(std::make_shared<Mesh>());
+	InstanceStore store = makeScene();
+	// Built without _COUNT_ALLOCATIONS, every frame would pass.
+	if (AllocationCounter::Count() == 0) {
+		report(L"Heap allocations are not counted: build with _COUNT_ALLOCATIONS\n");
+		return 1;
+	}
+
+	UploadRing ring;
+	ring.Create(std::make_shared<NullUploadBackend>(), 64 * 1024);
+	JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+	std::vector<std::vector<InstanceUpdate::LodBucket>> buckets;
+	InstanceUpdate::Scratch scratch;
+	XMMATRIX view = XMMatrixLookAtLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(c_fovY, 16.0f / 9.0f, 0.5f, 1000.0f);
+
+	size_t failed = 0;
+	size_t visible = 0;
+	UINT64 fenceValue = 0;
+	for (int f = 0; f < (1 + c_checkedTurns) * c_framesPerTurn; f++) {
+		size_t allocations = AllocationCounter::Count();
+		// The GPU is c_framesInFlight frames behind.
+		ring.BeginFrame(fenceValue > c_framesInFlight ? fenceValue - c_framesInFlight : 0);
+		float spin = XM_2PI * (f % c_framesPerTurn) / c_framesPerTurn;
+		InstanceUpdate::Frame frame = FrameUpdate::MakeFrame(XMMatrixRotationY(spin), view, projection, c_fovY, c_height, 1.0f);
+		Culling::Stats stats = {};
+		FrameUpdate::WriteInstances(jobs, meshes, store, frame, true, ring, buckets, scratch, stats);
+		ring.EndFrame(++fenceValue);
+		allocations = AllocationCounter::Count() - allocations;
+		visible += stats.visible;
+
+		if (f >= c_framesPerTurn && allocations > 0) {
+			report(L"Frame %d made %zu heap allocations\n", f, allocations);
+			failed++;
+		}
+	}
+
+	report(L"Update allocations: %zu instances over %u shapes, %d frames checked after a turn of %d, %zu visible per frame, "
+		L"%zu frames allocated\n", store.Size(), c_shapeCount, c_checkedTurns * c_framesPerTurn, c_framesPerTurn,
+		visible / ((1 + c_checkedTurns) * c_framesPerTurn), failed);
+	return failed > 0 ? 1 : 0;
+}
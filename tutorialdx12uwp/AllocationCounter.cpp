@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+
+#ifdef _COUNT_ALLOCATIONS
+
+namespace {
+	std::atomic<size_t> g_allocations(0);
+	thread_local bool t_ignored = false;
+}
+
+// The array and nothrow forms of the runtime call this one, and the sized deletes call the unsized one.
+void* operator new(size_t size) {
+	if (!t_ignored)
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (size == 0)
+		size = 1;
+	for (;;) {
+		void* memory = malloc(size);
+		if (memory != nullptr)
+			return memory;
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+namespace AllocationCounter {
+
+	size_t Count() {
+		return g_allocations.load(std::memory_order_relaxed);
+	}
+
+	void IgnoreCurrentThread() {
+		t_ignored = true;
+	}
+}
+
+#else
+
+namespace AllocationCounter {
+
+	size_t Count() {
+		return 0;
+	}
+
+	void IgnoreCurrentThread() {
+	}
+}
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+#include "pch.h"
+
+// Counts the heap allocations made through operator new when _COUNT_ALLOCATIONS is defined (pch.h).
+// Game::Tick uses it to check that Update does not allocate once its containers have reached their size.
+// Only this module's operator new is replaced: allocations inside system and driver DLLs are not seen.
+
+namespace AllocationCounter {
+
+	// Allocations since the program started, from every thread not ignored. Always 0 when counting is off.
+	size_t Count();
+
+	// Leaves the calling thread's allocations out of Count, for threads that run alongside the code being
+	// checked, such as the render thread during Update.
+	void IgnoreCurrentThread();
+}
@@ -0,0 +1,33 @@
+#include "pch.h"
+#include "AssetLoader.h"
+#include "FileSystem.h"
+
+namespace AssetLoader {
+
+	unsigned int DefaultThreadCount() {
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	std::vector<std::shared_ptr<Mesh>> LoadMeshes(const std::vector<std::string>& fileNames,
+		JobSystem& jobs, bool useCache) {
+
+		// Must happen on the calling (UI) thread.
+		FileSystem::Initialize();
+
+		std::vector<std::shared_ptr<Mesh>> meshes(fileNames.size());
+		if (fileNames.empty())
+			return meshes;
+
+		// Jobs do not start jobs of their own, so the meshes of several files are welded on the thread loading them.
+		// Exceptions reach the caller once every file is done (JobSystem::ParallelFor).
+		if (fileNames.size() == 1) {
+			meshes[0] = std::make_shared<Mesh>(fileNames[0], &jobs, useCache);
+			return meshes;
+		}
+		jobs.ParallelFor(fileNames.size(), 1, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				meshes[i] = std::make_shared<Mesh>(fileNames[i], nullptr, useCache);
+		});
+		return meshes;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+
+// Parallel loading of the meshes needed before the first frame.
+namespace AssetLoader {
+
+	// Loads the files on the threads of jobs, a file per job. Results are in the order of fileNames whatever the
+	// number of threads, and meshes are identical to the ones loaded serially.
+	// A single file is welded in chunks on jobs instead (Mesh).
+	std::vector<std::shared_ptr<Mesh>> LoadMeshes(const std::vector<std::string>& fileNames,
+		JobSystem& jobs, bool useCache = true);
+
+	unsigned int DefaultThreadCount();
+}
@@ -0,0 +1,660 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "FileSystem.h"
+#include "AssetLoader.h"
+#include "VertexPacking.h"
+#include "Culling.h"
+#include "TransformBatch.h"
+#include "InstanceUpdate.h"
+#include "InstanceStore.h"
+#include "UploadRing.h"
+#include "FrameUpdate.h"
+#include "StepTimer.h"
+#include "SoftwareRasterizer.h"
+#include "RenderQueue.h"
+#include <random>
+
+namespace {
+	// OBJ text of a faceted grid of gridSize x gridSize quads. Every quad has its own normal, so each grid point
+	// is split into up to four vertices.
+	std::string gridObj(unsigned int gridSize) {
+		std::ostringstream obj;
+		unsigned int rowVertices = gridSize + 1;
+		for (unsigned int j = 0; j < rowVertices; j++) {
+			for (unsigned int i = 0; i < rowVertices; i++) {
+				obj << "v " << i << " " << ((i * 7 + j * 3) % 5) * 0.1f << " " << j << "\n";
+				obj << "vt " << float(i) / gridSize << " " << float(j) / gridSize << "\n";
+			}
+		}
+		for (unsigned int q = 0; q < gridSize * gridSize; q++) {
+			obj << "vn 0 1 " << (q % 3) * 0.1f << "\n";
+		}
+		for (unsigned int j = 0; j < gridSize; j++) {
+			for (unsigned int i = 0; i < gridSize; i++) {
+				unsigned int a = j * rowVertices + i + 1;
+				unsigned int b = a + 1;
+				unsigned int c = a + rowVertices + 1;
+				unsigned int d = a + rowVertices;
+				unsigned int n = j * gridSize + i + 1;
+				obj << "f " << a << "/" << a << "/" << n << " " << b << "/" << b << "/" << n << " "
+					<< c << "/" << c << "/" << n << " " << d << "/" << d << "/" << n << "\n";
+			}
+		}
+		return obj.str();
+	}
+
+	size_t failedChecks = 0;
+
+	// Counts a failed check: an output that should match another and does not.
+	bool check(bool passed) {
+		if (!passed)
+			failedChecks++;
+		return passed;
+	}
+
+	const float c_fovY = 0.25f * XM_PI;
+
+	// Scene of the instance benchmarks: count instances spread over shapes shapes, at random positions within 200
+	// units of the camera on every axis and with random rotations; the material of an instance is its shape.
+	// The sequence is always the same, so a bigger scene starts with the instances of a smaller one. handles, when
+	// given, receives the handle of every instance in the order they were added.
+	InstanceStore makeRandomStore(size_t count, size_t shapes, std::vector<InstanceStore::Handle>* handles = nullptr) {
+		std::mt19937 gen(1);
+		std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+		std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+		std::uniform_int_distribution<UINT> shape(0, static_cast<UINT>(shapes - 1));
+		InstanceStore store;
+		store.Clear(shapes);
+		store.Reserve(count);
+		if (handles != nullptr)
+			handles->resize(count);
+		for (size_t k = 0; k < count; k++) {
+			// Declarators are evaluated in order, function arguments are not: every compiler gets the same scene.
+			float x = position(gen), y = position(gen), z = position(gen);
+			float pitch = angle(gen), yaw = angle(gen), roll = angle(gen);
+			UINT s = shape(gen);
+			XMFLOAT4 q;
+			XMStoreFloat4(&q, XMQuaternionRotationRollPitchYaw(pitch, yaw, roll));
+			InstanceStore::Handle handle = store.Add(s, XMFLOAT3(x, y, z), q, XMFLOAT3(1.0f, 1.0f, 1.0f), s);
+			if (handles != nullptr)
+				(*handles)[k] = handle;
+		}
+		return store;
+	}
+
+	// Camera of the instance benchmarks: at the origin looking down +z, with the model turned spin radians around x
+	// as in Game::Update, a vertical field of view of c_fovY and LODs within one pixel.
+	InstanceUpdate::Frame benchmarkFrame(float spin = 0.5f, float viewportWidth = 1920.0f, float viewportHeight = 1080.0f) {
+		XMMATRIX view = XMMatrixLookAtLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(c_fovY, viewportWidth / viewportHeight, 0.5f, 1000.0f);
+		return FrameUpdate::MakeFrame(XMMatrixRotationX(spin), view, projection, c_fovY, viewportHeight, 1.0f);
+	}
+}
+
+namespace Benchmark {
+
+	void Report(const wchar_t* format, ...) {
+		wchar_t msgbuff[512];
+		va_list args;
+		va_start(args, format);
+		vswprintf(msgbuff, 512, format, args);
+		va_end(args);
+		MYTRACE(msgbuff);
+	}
+
+	size_t FailedChecks() {
+		return failedChecks;
+	}
+
+	void MeshLoad(std::string const fileName, int iterations) {
+		// Makes sure the cache exists before timing it.
+		Mesh reference(fileName);
+		uint64_t sourceHash = MeshCache::HashFile(fileName);
+		std::string cacheFileName = MeshCache::LocalCacheFileName(fileName);
+
+		Timer timer;
+		for (int i = 0; i < iterations; i++) {
+			Mesh mesh;
+			mesh.readObjFile(fileName);
+		}
+		double objTime = timer.ElapsedMilliseconds() / iterations;
+
+		timer.Reset();
+		for (int i = 0; i < iterations; i++) {
+			Mesh mesh;
+			MeshCache::HashFile(fileName);
+			mesh.readCacheFile(cacheFileName, sourceHash);
+		}
+		double cacheTime = timer.ElapsedMilliseconds() / iterations;
+
+		std::wstring wFileName(fileName.begin(), fileName.end());
+		Report(L"MeshLoad %ls: %u vertices, %u indices. OBJ %.3f ms, cache %.3f ms (x%.1f)\n",
+			wFileName.c_str(), reference.GetVertexCount(), reference.GetIndexCount(),
+			objTime, cacheTime, cacheTime > 0.0 ? objTime / cacheTime : 0.0);
+	}
+
+	void LargeMeshLoad(unsigned int gridSize, int iterations) {
+		std::string fileName = FileSystem::LocalFileName("grid" + std::to_string(gridSize) + ".obj");
+		std::string objText = gridObj(gridSize);
+		// The same text every run: the hash stays the same and the cache of a previous run stays valid.
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		file.write(objText.data(), objText.size());
+		file.close();
+		if (!file.good()) {
+			Report(L"LargeMeshLoad: cannot write the grid OBJ\n");
+			return;
+		}
+		MeshLoad(fileName, iterations);
+	}
+
+	void ObjWeld(unsigned int gridSize) {
+		std::string objText = gridObj(gridSize);
+
+		double faces = 2.0 * gridSize * gridSize;
+		Mesh serial;
+		serial.readObjString(objText);
+		for (unsigned int threads = 1; threads <= AssetLoader::DefaultThreadCount(); threads++) {
+			JobSystem jobs(threads - 1);
+			Mesh mesh;
+			Timer timer;
+			mesh.readObjString(objText, &jobs);
+			double time = timer.ElapsedMilliseconds();
+
+			bool identical = mesh.indices == serial.indices && mesh.vertices.size() == serial.vertices.size() &&
+				memcmp(mesh.vertices.data(), serial.vertices.data(), mesh.vertices.size() * sizeof(Vertex)) == 0;
+			Report(L"ObjWeld %.0f faces, %.1f MB, %u threads: %u vertices, %.3f ms, %.2f Mfaces/s%ls\n",
+				faces, objText.size() / (1024.0 * 1024.0), threads, mesh.GetVertexCount(), time,
+				faces / (time * 1000.0), check(identical) ? L"" : L" MISMATCH");
+		}
+	}
+
+	void LoadMeshes(const std::vector<std::string>& fileNames) {
+		for (unsigned int threads = 1; threads <= AssetLoader::DefaultThreadCount(); threads++) {
+			JobSystem jobs(threads - 1);
+			Timer timer;
+			AssetLoader::LoadMeshes(fileNames, jobs, false);
+			double objTime = timer.ElapsedMilliseconds();
+			timer.Reset();
+			AssetLoader::LoadMeshes(fileNames, jobs, true);
+			double cacheTime = timer.ElapsedMilliseconds();
+			Report(L"LoadMeshes %u files, %u threads: OBJ %.3f ms, cache %.3f ms\n",
+				static_cast<unsigned int>(fileNames.size()), threads, objTime, cacheTime);
+		}
+	}
+
+	void VertexPacking(const std::vector<std::shared_ptr<Mesh>>& meshes, int iterations) {
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const Mesh& mesh = *meshes[m];
+			size_t count = mesh.GetVertexCount();
+			std::vector<PackedVertex> packed(count);
+			std::vector<Vertex> decoded(count);
+
+			Timer timer;
+			for (int i = 0; i < iterations; i++)
+				VertexPacking::Encode(mesh.GetVertexData(), count, mesh.GetBoundingBox(), packed.data());
+			double encodeTime = timer.ElapsedMilliseconds() / iterations;
+			timer.Reset();
+			for (int i = 0; i < iterations; i++)
+				VertexPacking::Decode(packed.data(), count, mesh.GetBoundingBox(), decoded.data());
+			double decodeTime = timer.ElapsedMilliseconds() / iterations;
+
+			VertexPacking::ErrorReport error = VertexPacking::MeasureError(mesh.GetVertexData(), count, mesh.GetBoundingBox());
+			Report(L"VertexPacking mesh %u: %u vertices, %u -> %u bytes. Encode %.3f ms, decode %.3f ms\n",
+				static_cast<unsigned int>(m), static_cast<unsigned int>(count),
+				static_cast<unsigned int>(count * sizeof(Vertex)), static_cast<unsigned int>(count * sizeof(PackedVertex)),
+				encodeTime, decodeTime);
+			Report(L"VertexPacking mesh %u max error: position %g (%g of the box), normal %.3f deg, uv %g, color %g\n",
+				static_cast<unsigned int>(m), error.position, error.positionRelative, error.normalDegrees, error.uv, error.color);
+		}
+	}
+
+	void Culling(const Mesh& mesh, size_t instanceCount, int iterations) {
+		InstanceStore store = makeRandomStore(instanceCount, 1);
+		const XMFLOAT4X4* worlds = store.Worlds();
+		InstanceUpdate::Frame frame = benchmarkFrame();
+		XMMATRIX view = frame.view;
+		XMMATRIX projection = frame.projection;
+		const BoundingFrustum& frustum = frame.frustum;
+		std::vector<XMFLOAT4X4> transforms(instanceCount * 2);
+
+		// Per instance work of Update: transform and normal transform.
+		auto instanceData = [&](size_t slot, FXMMATRIX worldview) {
+			XMStoreFloat4x4(&transforms[2 * slot], XMMatrixTranspose(worldview * projection));
+			XMStoreFloat4x4(&transforms[2 * slot + 1], XMMatrixInverse(nullptr, worldview));
+		};
+
+		Timer timer;
+		for (int i = 0; i < iterations; i++)
+			for (size_t k = 0; k < instanceCount; k++)
+				instanceData(k, XMLoadFloat4x4(&worlds[k]) * view);
+		double allTime = timer.ElapsedMilliseconds() / iterations;
+
+		Culling::Stats stats = {};
+		timer.Reset();
+		for (int i = 0; i < iterations; i++) {
+			stats = {};
+			for (size_t k = 0; k < instanceCount; k++) {
+				XMMATRIX worldview = XMLoadFloat4x4(&worlds[k]) * view;
+				stats.tested++;
+				if (Culling::IsVisible(frustum, mesh.GetBoundingSphere(), mesh.GetBoundingBox(), worldview))
+					instanceData(stats.visible++, worldview);
+			}
+		}
+		double cullTime = timer.ElapsedMilliseconds() / iterations;
+
+		Report(L"Culling %zu instances: %zu visible, %zu culled. Without culling %.3f ms, with culling %.3f ms\n",
+			stats.tested, stats.visible, stats.tested - stats.visible, allTime, cullTime);
+	}
+
+	void InstanceTransforms(size_t instanceCount, int iterations) {
+		using Instance = FrameUpdate::Instance;
+		InstanceStore store = makeRandomStore(instanceCount, 1);
+		const XMFLOAT4X4* worlds = store.Worlds();
+		InstanceUpdate::Frame frame = benchmarkFrame();
+		XMMATRIX view = frame.view;
+		XMMATRIX projection = frame.projection;
+		XMMATRIX pre = XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(-1.0f, -1.0f, -1.0f);
+		std::vector<Instance> reference(instanceCount), batch(instanceCount);
+		std::vector<XMFLOAT4X4> worldviews(instanceCount);
+
+		Timer timer;
+		for (int i = 0; i < iterations; i++) {
+			for (size_t k = 0; k < instanceCount; k++) {
+				XMMATRIX world = XMLoadFloat4x4(&worlds[k]);
+				XMMATRIX rotation = XMMatrixRotationX(0.5f);
+				XMMATRIX translation = XMMatrixTranslation(0.0, 0.0, 0.0);
+				world = rotation * translation * world;
+				XMMATRIX worldview = world * view;
+				XMMATRIX transform = pre * worldview * projection;
+				XMMATRIX normaltransform = XMMatrixTranspose(XMMatrixInverse(nullptr, worldview));
+				XMStoreFloat4x4(&reference[k].normalTransform, XMMatrixTranspose(normaltransform));
+				XMStoreFloat4x4(&reference[k].transform, XMMatrixTranspose(transform));
+			}
+		}
+		double referenceTime = timer.ElapsedMilliseconds() / iterations;
+
+		// The worlds are rigid: every pass runs once with the general inverse and once with the rigid path.
+		std::vector<TransformBatch::TransformKind> kinds(instanceCount, TransformBatch::TransformKind::Rigid);
+		bool avx2 = TransformBatch::UsesAvx2();
+		for (int pass = 0; pass < (avx2 ? 4 : 2); pass++) {
+			bool rigid = (pass & 1) != 0;
+			TransformBatch::EnableAvx2(pass >= 2);
+			timer.Reset();
+			for (int i = 0; i < iterations; i++) {
+				XMMATRIX model = XMMatrixRotationX(0.5f) * XMMatrixTranslation(0.0, 0.0, 0.0);
+				TransformBatch::WorldView(worlds, instanceCount, sizeof(XMFLOAT4X4), model, view, worldviews.data());
+				TransformBatch::InstanceTransforms(worldviews.data(), rigid ? kinds.data() : nullptr, instanceCount, pre, projection,
+					&batch[0].transform, &batch[0].normalTransform, sizeof(Instance));
+			}
+			double batchTime = timer.ElapsedMilliseconds() / iterations;
+
+			bool identical = true;
+			float normalError = 0.0f;
+			for (size_t k = 0; k < instanceCount; k++) {
+				identical = identical && memcmp(&reference[k].transform, &batch[k].transform, sizeof(XMFLOAT4X4)) == 0;
+				for (int e = 0; e < 16; e++)
+					normalError = std::max(normalError, std::abs((&reference[k].normalTransform._11)[e] - (&batch[k].normalTransform._11)[e]));
+			}
+			Report(L"InstanceTransforms %zu instances, %ls, %ls inverse: per instance %.3f ms (%.2f M/s), batch %.3f ms (%.2f M/s). Transforms %ls, normal max difference %g\n",
+				instanceCount, pass >= 2 ? L"AVX2" : L"scalar", rigid ? L"rigid" : L"general",
+				referenceTime, instanceCount / (referenceTime * 1000.0), batchTime, instanceCount / (batchTime * 1000.0),
+				check(identical) ? L"identical" : L"DIFFERENT", normalError);
+		}
+		TransformBatch::EnableAvx2(avx2);
+	}
+
+	void JobScaling(const Mesh& mesh, size_t instanceCount, int iterations) {
+		using Instance = FrameUpdate::Instance;
+		// Laid out like the per shape ObjectData vectors Game had before InstanceStore.
+		struct SceneInstance {
+			XMFLOAT4X4 world;
+			TransformBatch::TransformKind kind;
+			UINT material;
+		};
+		InstanceStore store = makeRandomStore(instanceCount, 1);
+		std::vector<SceneInstance> scene(instanceCount);
+		for (size_t k = 0; k < instanceCount; k++) {
+			scene[k].world = store.Worlds()[k];
+			scene[k].kind = store.Kinds()[k];
+			scene[k].material = static_cast<UINT>(k);
+		}
+
+		InstanceUpdate::Frame frame = benchmarkFrame();
+		XMMATRIX pre = VertexPacking::DequantizeMatrix(mesh.GetBoundingBox());
+
+		InstanceUpdate::Input input = { &scene[0].world, &scene[0].kind, &scene[0].material, instanceCount,
+			sizeof(SceneInstance), sizeof(SceneInstance), sizeof(SceneInstance) };
+		std::vector<Instance> reference(instanceCount), instances(instanceCount);
+		std::vector<InstanceUpdate::LodBucket> buckets;
+		InstanceUpdate::Scratch scratch;
+		size_t visible = 0;
+		double singleTime = 0.0;
+		unsigned int maxThreads = AssetLoader::DefaultThreadCount();
+		for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+			JobSystem jobs(threads - 1);
+			std::vector<Instance>& target = threads == 1 ? reference : instances;
+			InstanceUpdate::Output output = { &target[0].transform, &target[0].normalTransform, &target[0].material, sizeof(Instance) };
+			Culling::Stats stats = {};
+			Timer timer;
+			for (int i = 0; i < iterations; i++) {
+				stats = {};
+				visible = InstanceUpdate::Run(jobs, mesh, frame, pre, input, output, buckets, scratch, stats);
+			}
+			double time = timer.ElapsedMilliseconds() / iterations;
+			if (threads == 1)
+				singleTime = time;
+
+			bool identical = memcmp(reference.data(), target.data(), visible * sizeof(Instance)) == 0;
+			Report(L"JobScaling %zu instances, %u threads: %zu visible, %.3f ms per frame, speedup %.2f. Output %ls\n",
+				instanceCount, threads, visible, time, singleTime / time, check(identical) ? L"identical" : L"DIFFERENT");
+		}
+	}
+
+	void InstanceLayout(size_t instanceCount, size_t shapeCount, int iterations) {
+		struct ObjectData {
+			bool isInstanced;
+			XMFLOAT4X4 matrixWorld;
+			TransformBatch::TransformKind kind;
+			UINT matind;
+		};
+		std::vector<InstanceStore::Handle> handles;
+		InstanceStore store = makeRandomStore(instanceCount, shapeCount, &handles);
+		std::vector<std::vector<ObjectData>> objects(shapeCount);
+		for (size_t k = 0; k < instanceCount; k++) {
+			size_t index = store.IndexOf(handles[k]);
+			UINT s = store.Shapes()[index];
+			objects[s].push_back(ObjectData{ true, store.Worlds()[index], store.Kinds()[index], store.Materials()[index] });
+		}
+		InstanceUpdate::Frame frame = benchmarkFrame();
+		XMMATRIX model = frame.model;
+		XMMATRIX view = frame.view;
+		std::vector<XMFLOAT4X4> worldviews(instanceCount);
+		const float radius2 = 100.0f * 100.0f;
+
+		Timer timer;
+		for (int i = 0; i < iterations; i++)
+			for (const std::vector<ObjectData>& instances : objects)
+				if (!instances.empty())
+					TransformBatch::WorldView(&instances[0].matrixWorld, instances.size(), sizeof(ObjectData), model, view, worldviews.data());
+		double aosWorldTime = timer.ElapsedMilliseconds() / iterations;
+		timer.Reset();
+		for (int i = 0; i < iterations; i++)
+			for (UINT s = 0; s < shapeCount; s++)
+				if (store.ShapeCount(s) > 0)
+					TransformBatch::WorldView(store.Worlds() + store.ShapeFirst(s), store.ShapeCount(s), sizeof(XMFLOAT4X4), model, view, worldviews.data());
+		double soaWorldTime = timer.ElapsedMilliseconds() / iterations;
+
+		size_t aosNear = 0, soaNear = 0;
+		timer.Reset();
+		for (int i = 0; i < iterations; i++) {
+			aosNear = 0;
+			for (const std::vector<ObjectData>& instances : objects)
+				for (const ObjectData& object : instances) {
+					const XMFLOAT4X4& m = object.matrixWorld;
+					aosNear += m._41 * m._41 + m._42 * m._42 + m._43 * m._43 < radius2;
+				}
+		}
+		double aosPositionTime = timer.ElapsedMilliseconds() / iterations;
+		timer.Reset();
+		for (int i = 0; i < iterations; i++) {
+			soaNear = 0;
+			const XMFLOAT3* positions = store.Positions();
+			for (size_t k = 0; k < store.Size(); k++)
+				soaNear += positions[k].x * positions[k].x + positions[k].y * positions[k].y + positions[k].z * positions[k].z < radius2;
+		}
+		double soaPositionTime = timer.ElapsedMilliseconds() / iterations;
+
+		// Half of the instances removed and added back through their handles.
+		timer.Reset();
+		for (size_t k = 0; k < instanceCount; k += 2) {
+			size_t index = store.IndexOf(handles[k]);
+			XMFLOAT3 p = store.Positions()[index];
+			XMFLOAT4 q = store.Rotations()[index];
+			UINT s = store.Shapes()[index];
+			store.Remove(handles[k]);
+			handles[k] = store.Add(s, p, q, XMFLOAT3(1.0f, 1.0f, 1.0f), s);
+		}
+		double churnTime = timer.ElapsedMilliseconds();
+
+		Report(L"InstanceLayout %zu instances, %zu shapes: worldview AoS %.3f ms (%.2f M/s), SoA %.3f ms (%.2f M/s); positions AoS %.3f ms (%.2f M/s), SoA %.3f ms (%.2f M/s), %ls; remove and add %zu in %.3f ms\n",
+			instanceCount, shapeCount, aosWorldTime, instanceCount / (aosWorldTime * 1000.0), soaWorldTime, instanceCount / (soaWorldTime * 1000.0),
+			aosPositionTime, instanceCount / (aosPositionTime * 1000.0), soaPositionTime, instanceCount / (soaPositionTime * 1000.0),
+			check(aosNear == soaNear) ? L"same result" : L"DIFFERENT result", (instanceCount + 1) / 2, churnTime);
+	}
+
+	void InstanceScaling(const std::shared_ptr<Mesh>& mesh, size_t maxInstances, int iterations) {
+		const UINT64 startSize = 64 * 1024;
+		const UINT64 framesInFlight = 4; // Swap chain buffers and one more, as Game sizes the ring
+		InstanceUpdate::Frame frame = benchmarkFrame();
+
+		// One ring for every step, as in Game: each step starts with the frames of the previous one in flight.
+		std::vector<std::shared_ptr<Mesh>> meshes = { mesh };
+		std::shared_ptr<NullUploadBackend> backend = std::make_shared<NullUploadBackend>();
+		UploadRing ring;
+		ring.Create(backend, startSize);
+		UINT64 fenceValue = 0;
+		JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+		std::vector<std::vector<InstanceUpdate::LodBucket>> buckets;
+		InstanceUpdate::Scratch scratch;
+		for (size_t instanceCount = 1000; instanceCount <= maxInstances; instanceCount *= 10) {
+			// The scene of the previous step and more instances.
+			InstanceStore store = makeRandomStore(instanceCount, 1);
+			size_t grows = ring.GetGrowCount();
+			size_t released = backend->GetStats().buffersReleased;
+			Culling::Stats stats = {};
+			UploadRing::Allocation allocation = {};
+			Timer timer;
+			for (int i = 0; i < iterations; i++) {
+				// The GPU is framesInFlight frames behind: buffers the ring grew out of stay alive until it catches up.
+				ring.BeginFrame(fenceValue > framesInFlight ? fenceValue - framesInFlight : 0);
+				stats = {};
+				allocation = FrameUpdate::WriteInstances(jobs, meshes, store, frame, true, ring, buckets, scratch, stats);
+				ring.EndFrame(++fenceValue);
+			}
+			double time = timer.ElapsedMilliseconds() / iterations;
+			grows = ring.GetGrowCount() - grows;
+			released = backend->GetStats().buffersReleased - released;
+
+			// Once the GPU passes the last frame, only the current buffer is left.
+			ring.BeginFrame(fenceValue);
+			const NullUploadBackend::Stats& backendStats = backend->GetStats();
+			size_t pending = backendStats.buffersCreated - backendStats.buffersReleased - 1;
+			assert(pending == 0);
+			Report(L"InstanceScaling %zu instances, %u threads: %zu visible, %.3f ms per frame, %.1f ns per instance, %llu KB per frame, "
+				L"ring %llu KB, %zu grows, %zu retired buffers released in flight, %ls after the fence\n",
+				instanceCount, jobs.ThreadCount(), stats.visible, time, time * 1e6 / instanceCount, allocation.size / 1024,
+				ring.GetSize() / 1024, grows, released, check(pending == 0) ? L"all released" : L"NOT released");
+		}
+	}
+
+	void HeadlessFrames(const std::vector<std::shared_ptr<Mesh>>& meshes, size_t instanceCount, int frames, UINT64 framesInFlight) {
+		InstanceStore store = makeRandomStore(instanceCount, meshes.size());
+
+		std::shared_ptr<NullUploadBackend> backend = std::make_shared<NullUploadBackend>();
+		UploadRing ring;
+		ring.Create(backend, 64 * 1024); // Grows to the scene in the first frames, as it would on a device
+		JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+		std::vector<std::vector<InstanceUpdate::LodBucket>> buckets;
+		InstanceUpdate::Scratch scratch;
+		Culling::Stats stats = {};
+
+		DX::StepTimer timer;
+		timer.SetFixedTimeStep(true);
+		UINT64 fenceValue = 0;
+		Timer wallClock;
+		for (int f = 0; f < frames; f++) {
+			timer.Advance(DX::StepTimer::TicksPerSecond / 60, [&]() {
+				// The GPU is framesInFlight frames behind.
+				ring.BeginFrame(fenceValue > framesInFlight ? fenceValue - framesInFlight : 0);
+				UploadRing::Allocation pass = ring.Allocate(sizeof(XMFLOAT4X4), 256);
+				XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(pass.cpuAddress), XMMatrixIdentity());
+				float spin = static_cast<float>(timer.GetTotalSeconds() * 0.1 * XM_2PI);
+				InstanceUpdate::Frame frame = benchmarkFrame(spin);
+				stats = {};
+				FrameUpdate::WriteInstances(jobs, meshes, store, frame, true, ring, buckets, scratch, stats);
+				ring.EndFrame(++fenceValue);
+			});
+		}
+		double time = wallClock.ElapsedMilliseconds() / frames;
+		const NullUploadBackend::Stats& backendStats = backend->GetStats();
+		Report(L"HeadlessFrames %zu instances over %zu meshes, %u threads, %llu frames in flight: %.3f ms per frame, %zu visible, "
+			L"ring %llu KB after %zu grows, %zu buffers created, peak %llu KB\n",
+			instanceCount, meshes.size(), jobs.ThreadCount(), framesInFlight, time, stats.visible, ring.GetSize() / 1024,
+			ring.GetGrowCount(), backendStats.buffersCreated, backendStats.bytesPeak / 1024);
+	}
+
+	void SoftwareRendering(const std::vector<std::shared_ptr<Mesh>>& meshes, const std::string& textureFileName,
+		size_t instanceCount, UINT width, UINT height, int iterations) {
+		InstanceStore store = makeRandomStore(instanceCount, meshes.size());
+
+		// Packed vertices, as Game draws them.
+		std::vector<SoftwareRasterizer::Geometry> geometries(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const Mesh& mesh = *meshes[i];
+			std::vector<BYTE> indices(static_cast<size_t>(mesh.GetIndexCountAllLods()) * mesh.GetIndexStride());
+			mesh.CopyIndices(indices.data());
+			std::vector<PackedVertex> packed(mesh.GetVertexCount());
+			VertexPacking::Encode(mesh.GetVertexData(), mesh.GetVertexCount(), mesh.GetBoundingBox(), packed.data());
+			geometries[i] = SoftwareRasterizer::MakeGeometry(packed.data(), mesh.GetVertexCount(), indices.data(),
+				mesh.GetIndexCountAllLods(), mesh.GetIndexStride());
+		}
+		SoftwareRasterizer::Texture texture = SoftwareRasterizer::LoadDDS(textureFileName);
+
+		// One frame of instances, culled and sorted in LOD buckets.
+		UploadRing ring;
+		ring.Create(std::make_shared<NullUploadBackend>(), 64 * 1024);
+		JobSystem updateJobs(AssetLoader::DefaultThreadCount() - 1);
+		std::vector<std::vector<InstanceUpdate::LodBucket>> buckets;
+		InstanceUpdate::Scratch scratch;
+		Culling::Stats cullStats = {};
+		InstanceUpdate::Frame frame = benchmarkFrame(0.5f, static_cast<float>(width), static_cast<float>(height));
+		ring.BeginFrame(0);
+		UploadRing::Allocation allocation = FrameUpdate::WriteInstances(updateJobs, meshes, store, frame, true, ring, buckets,
+			scratch, cullStats);
+		ring.EndFrame(1);
+		const FrameUpdate::Instance* instances = reinterpret_cast<const FrameUpdate::Instance*>(allocation.cpuAddress);
+
+		std::vector<SoftwareRasterizer::Draw> draws;
+		for (UINT i = 0; i < meshes.size(); i++) {
+			for (UINT lod = 0; lod < buckets[i].size(); lod++) {
+				if (buckets[i][lod].instanceCount == 0)
+					continue;
+				const Mesh::Lod& meshLod = meshes[i]->GetLod(lod);
+				draws.push_back({ &geometries[i], meshLod.indexCount, meshLod.firstIndex, 0,
+					instances + buckets[i][lod].firstInstance, buckets[i][lod].instanceCount });
+			}
+		}
+
+		const float clearColor[4] = { 0.392156899f, 0.584313750f, 0.929411829f, 1.0f }; // CornflowerBlue
+		SoftwareRasterizer::Rasterizer rasterizer;
+		rasterizer.Create(width, height);
+		auto render = [&](JobSystem& jobs) {
+			rasterizer.Clear(clearColor, 1.0f);
+			rasterizer.SetTexture(&texture);
+			for (const SoftwareRasterizer::Draw& draw : draws)
+				rasterizer.DrawIndexedInstanced(draw);
+			rasterizer.Execute(jobs);
+		};
+
+		SoftwareRasterizer::Image reference;
+		double singleTime = 0.0;
+		unsigned int maxThreads = AssetLoader::DefaultThreadCount();
+		for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+			JobSystem jobs(threads - 1);
+			render(jobs); // Warm up
+			Timer timer;
+			for (int i = 0; i < iterations; i++)
+				render(jobs);
+			double time = timer.ElapsedMilliseconds() / iterations;
+			if (threads == 1) {
+				singleTime = time;
+				reference = rasterizer.GetImage();
+			}
+			const SoftwareRasterizer::Stats& stats = rasterizer.GetStats();
+			bool identical = SoftwareRasterizer::Compare(reference, rasterizer.GetImage()).pixels == 0;
+			Report(L"SoftwareRendering %zu instances, %zu visible in %zu draws, %ux%u, %u threads: %zu triangles, "
+				L"%zu pixels shaded, %.3f ms per frame, speedup %.2f. Image %ls\n",
+				instanceCount, cullStats.visible, draws.size(), width, height, threads, stats.triangles, stats.pixelsShaded,
+				time, singleTime / time, check(identical) ? L"identical" : L"DIFFERENT");
+		}
+	}
+
+	void DrawSorting(size_t maxItems, int iterations) {
+		struct Item {
+			UINT64 key;
+			RenderQueue::Draw draw;
+		};
+		const size_t itemCounts[] = { 10000, 25000, 50000, 100000, 250000, 500000, 1000000 };
+		for (size_t itemCount : itemCounts) {
+			if (itemCount > maxItems)
+				break;
+			std::mt19937 gen(1);
+			std::uniform_int_distribution<UINT> pipeline(0, 3);
+			std::uniform_int_distribution<UINT> material(0, 15);
+			std::uniform_int_distribution<UINT> mesh(0, 63);
+			std::uniform_int_distribution<UINT> drawsPerObject(1, 8);
+			std::uniform_real_distribution<float> depth(0.5f, 1000.0f);
+
+			// Every object owns consecutive instances, two per draw.
+			std::vector<std::vector<Item>> objects;
+			UINT instance = 0;
+			for (size_t added = 0; added < itemCount;) {
+				RenderQueue::Draw draw = { pipeline(gen), material(gen), mesh(gen), 300, 2, 0, 0, 0 };
+				UINT64 key = RenderQueue::MakeKey(RenderQueue::Pass::Opaque, draw.pipeline, draw.material, draw.mesh, depth(gen));
+				objects.emplace_back();
+				for (UINT d = drawsPerObject(gen); d > 0 && added < itemCount; d--, added++) {
+					draw.firstInstance = instance;
+					instance += draw.instanceCount;
+					objects.back().push_back(Item{ key, draw });
+				}
+			}
+			std::vector<Item> items;
+			items.reserve(itemCount);
+			for (size_t pass = 0; items.size() < itemCount; pass++) {
+				for (const std::vector<Item>& object : objects) {
+					if (pass < object.size())
+						items.push_back(object[pass]);
+				}
+			}
+
+			RenderQueue queue;
+			queue.Reserve(itemCount);
+			Timer timer;
+			for (int i = 0; i < iterations; i++) {
+				queue.Clear();
+				for (const Item& item : items)
+					queue.Add(item.key, item.draw);
+				queue.Sort();
+			}
+			double queueTime = timer.ElapsedMilliseconds() / iterations;
+
+			std::vector<Item> sorted;
+			timer.Reset();
+			for (int i = 0; i < iterations; i++) {
+				sorted = items;
+				std::stable_sort(sorted.begin(), sorted.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+			}
+			double stableSortTime = timer.ElapsedMilliseconds() / iterations;
+
+			// Merged draws start where their first item does in the comparison order and cover the items after it.
+			bool identical = true;
+			size_t next = 0;
+			for (const RenderQueue::Draw& draw : queue.GetDraws()) {
+				identical = identical && next < sorted.size() && sorted[next].draw.firstInstance == draw.firstInstance;
+				for (UINT covered = 0; covered < draw.instanceCount && next < sorted.size(); next++)
+					covered += sorted[next].draw.instanceCount;
+			}
+			identical = identical && next == sorted.size();
+
+			const RenderQueue::Stats& stats = queue.GetStats();
+			Report(L"DrawSorting %zu items: %zu draws after merging, %.3f ms per frame (%.1f ns per item, %u radix passes), "
+				L"std::stable_sort %.3f ms. Order %ls. State changes %u -> %u (pipelines %u -> %u, materials %u -> %u, meshes %u -> %u)\n",
+				itemCount, stats.draws, queueTime, queueTime * 1e6 / itemCount, stats.radixPasses, stableSortTime,
+				check(identical) ? L"identical" : L"DIFFERENT", stats.submitted.Total(), stats.sorted.Total(),
+				stats.submitted.pipelines, stats.sorted.pipelines, stats.submitted.materials, stats.sorted.materials,
+				stats.submitted.meshes, stats.sorted.meshes);
+		}
+	}
+}
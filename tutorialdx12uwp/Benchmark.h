@@ -0,0 +1,96 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+
+// Micro benchmarks of the CPU side of the renderer.
+// They are compiled in when _BENCHMARK is defined in pch.h and report through MYTRACE.
+
+namespace Benchmark {
+
+	// Wall clock timer in milliseconds.
+	class Timer {
+	public:
+		Timer() : m_start(std::chrono::steady_clock::now()) {}
+		void Reset() { m_start = std::chrono::steady_clock::now(); }
+		double ElapsedMilliseconds() const {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+		}
+	private:
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	void Report(const wchar_t* format, ...);
+
+	// Checks of the benchmarks that failed so far: outputs that should be identical and are not. The console
+	// driver (BenchmarkMain.cpp) fails when there is any.
+	size_t FailedChecks();
+
+	// Load time of an OBJ file: parsing with tinyobj against mapping its binary cache.
+	void MeshLoad(std::string const fileName, int iterations);
+
+	// MeshLoad of the grid ObjWeld parses (2 x gridSize x gridSize triangles), written to the local folder first:
+	// the tutorial meshes are too small to show what the cache saves.
+	void LargeMeshLoad(unsigned int gridSize, int iterations);
+
+	// Parse and weld throughput on a synthetic faceted grid of gridSize x gridSize quads (two triangles each),
+	// welding with 1 to hardware_concurrency threads. Chunked welds are checked against the serial one.
+	void ObjWeld(unsigned int gridSize);
+
+	// Startup time of the parallel mesh loading stage from 1 to hardware_concurrency threads, with and without cache.
+	void LoadMeshes(const std::vector<std::string>& fileNames);
+
+	// Encode and decode throughput of the packed vertex format, vertex buffer sizes and round trip precision.
+	void VertexPacking(const std::vector<std::shared_ptr<Mesh>>& meshes, int iterations);
+
+	// Frustum culling of instanceCount random instances of mesh around the camera: time per frame and visible
+	// count, against building the instance data of every instance without culling.
+	void Culling(const Mesh& mesh, size_t instanceCount, int iterations);
+
+	// Instance transforms per frame and per second: the per instance loop Update had before against TransformBatch
+	// with and without AVX2, and with the general or the rigid normal matrix. Reports whether transforms are bit
+	// identical and the largest normal matrix difference.
+	void InstanceTransforms(size_t instanceCount, int iterations);
+
+	// InstanceUpdate::Run on a headless scene of instanceCount random instances of mesh, with a JobSystem of
+	// 1 to hardware_concurrency threads: time per frame, speedup over one thread and whether the output matches it.
+	void JobScaling(const Mesh& mesh, size_t instanceCount, int iterations);
+
+	// Iteration throughput of instanceCount instances spread over shapeCount shapes, stored as the per shape
+	// vectors of ObjectData structs Game used before against InstanceStore: worldview batch per shape and a pass
+	// over positions only. Also times removing and adding back half of the instances through handles.
+	void InstanceLayout(size_t instanceCount, size_t shapeCount, int iterations);
+
+	// Update cost as the scene grows: FrameUpdate::WriteInstances over an InstanceStore of 1000, 10000, ... up to
+	// maxInstances instances of mesh on every hardware thread, into one UploadRing on the null backend that starts
+	// at 64 KB, with the GPU four frames behind. Reports time per frame and per instance, bytes written per frame,
+	// the grows of the ring and the buffers it released while frames were in flight; asserts that no retired buffer
+	// is left once the fence passes the last frame.
+	void InstanceScaling(const std::shared_ptr<Mesh>& mesh, size_t maxInstances, int iterations);
+
+	// The CPU side of whole frames without a device, as Game::Update runs it: per frame camera and LOD parameters,
+	// then FrameUpdate::WriteInstances of instanceCount random instances spread over meshes into an UploadRing on
+	// the null backend (UploadBackend.h), with the GPU framesInFlight frames behind. Frames are stepped by
+	// DX::StepTimer at a fixed 60 Hz. Reports time per frame, visible instances and the ring's buffers.
+	void HeadlessFrames(const std::vector<std::shared_ptr<Mesh>>& meshes, size_t instanceCount, int frames, UINT64 framesInFlight);
+
+#ifndef _HEADLESS
+	// Recording time of drawCount indexed draws of indexCount indices, each with its own first instance root
+	// constant, split over 1 to hardware_concurrency threads with CommandRecorder. Every list sets the state Game
+	// sets first. The lists are closed but never executed, so only the CPU side is measured.
+	void CommandRecording(ID3D12Device* device, ID3D12RootSignature* rootSignature, ID3D12PipelineState* pso,
+		const D3D12_VERTEX_BUFFER_VIEW& vertexBuffer, const D3D12_INDEX_BUFFER_VIEW& indexBuffer, UINT indexCount,
+		size_t drawCount, int iterations);
+#endif
+
+	// A frame of instanceCount random instances spread over meshes, as HeadlessFrames writes them, drawn by the
+	// software rasterizer (SoftwareRasterizer.h) at width x height with the texture of textureFileName, on 1 to
+	// hardware_concurrency threads: time per frame, speedup over one thread and whether the image matches it.
+	void SoftwareRendering(const std::vector<std::shared_ptr<Mesh>>& meshes, const std::string& textureFileName,
+		size_t instanceCount, UINT width, UINT height, int iterations);
+
+	// RenderQueue on 10000 to maxItems draws of random pipelines, materials, meshes and depths. Objects split in
+	// several draws of consecutive instances are added round robin, as per object passes would add them. Reports
+	// time to sort and merge against std::stable_sort of the keys, whether the orders match, draws left after
+	// merging and the state changes sorting saves.
+	void DrawSorting(size_t maxItems, int iterations);
+}
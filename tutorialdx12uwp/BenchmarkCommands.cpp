@@ -0,0 +1,49 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "AssetLoader.h"
+#include "CommandRecorder.h"
+
+// The benchmarks that need a device: the app runs them, the console tools of the CMake build cannot.
+
+namespace Benchmark {
+
+	void CommandRecording(ID3D12Device* device, ID3D12RootSignature* rootSignature, ID3D12PipelineState* pso,
+		const D3D12_VERTEX_BUFFER_VIEW& vertexBuffer, const D3D12_INDEX_BUFFER_VIEW& indexBuffer, UINT indexCount,
+		size_t drawCount, int iterations) {
+		auto record = [&](ID3D12GraphicsCommandList* commandList, UINT, size_t first, size_t last) {
+			commandList->SetGraphicsRootSignature(rootSignature);
+			commandList->IASetVertexBuffers(0, 1, &vertexBuffer);
+			commandList->IASetIndexBuffer(&indexBuffer);
+			commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			for (size_t d = first; d < last; d++) {
+				commandList->SetGraphicsRoot32BitConstant(4, static_cast<UINT>(d), 0); // gInstanceBase, as in Game
+				commandList->DrawIndexedInstanced(indexCount, 1, 0, 0, 0);
+			}
+		};
+
+		double singleTime = 0.0;
+		unsigned int maxThreads = AssetLoader::DefaultThreadCount();
+		for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+			JobSystem jobs(threads - 1);
+			CommandRecorder recorder;
+			recorder.Create(device, threads);
+			// Nothing is executed: an allocator is free again as soon as the frame that used it ends.
+			UINT64 frame = 0;
+			recorder.BeginFrame(frame);
+			recorder.Record(jobs, drawCount, 1, pso, record); // Warm up
+			recorder.EndFrame(frame);
+			Timer timer;
+			for (int i = 0; i < iterations; i++) {
+				recorder.BeginFrame(frame);
+				recorder.Record(jobs, drawCount, 1, pso, record);
+				recorder.EndFrame(++frame);
+			}
+			double time = timer.ElapsedMilliseconds() / iterations;
+			if (threads == 1)
+				singleTime = time;
+			Report(L"CommandRecording %zu draws, %u threads: %u lists, %.3f ms per frame, %.1f ns per draw, speedup %.2f, %zu allocators\n",
+				drawCount, threads, recorder.FrameStats().lists, time, time * 1e6 / drawCount, singleTime / time,
+				recorder.FrameStats().allocatorsCreated);
+		}
+	}
+}
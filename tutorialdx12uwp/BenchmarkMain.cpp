@@ -0,0 +1,59 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "AssetLoader.h"
+
+// Console driver of the device-free benchmarks (Benchmark.h), built by CMakeLists.txt on the core library.
+// benchmarks [--quick] [assetFolder]
+// Runs what Game::LoadMeshes runs with _BENCHMARK, on the meshes and texture of assetFolder (the Assets folder of
+// the source tree by default). --quick runs small sizes and few iterations, for CI. Files written at run time go
+// to the working directory. Exits with 1 when a benchmark check fails.
+
+int main(int argc, char* argv[]) {
+	bool quick = false;
+	std::string assetFolder = TUTORIAL_ASSET_FOLDER;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--quick")
+			quick = true;
+		else
+			assetFolder = argument;
+	}
+
+	std::vector<std::string> fileNames;
+	for (int i = 1; i <= 5; i++)
+		fileNames.push_back(assetFolder + "/mesh" + std::to_string(i) + ".obj");
+	std::string textureFileName = assetFolder + "/tex1.dds";
+
+	try {
+		JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+		std::vector<std::shared_ptr<Mesh>> meshes = AssetLoader::LoadMeshes(fileNames, jobs);
+
+		int iterations = quick ? 2 : 10;
+		for (const std::string& fileName : fileNames)
+			Benchmark::MeshLoad(fileName, iterations);
+		Benchmark::LargeMeshLoad(quick ? 128 : 1024, quick ? 1 : 3);
+		Benchmark::ObjWeld(quick ? 128 : 1024);
+		Benchmark::LoadMeshes(fileNames);
+		Benchmark::VertexPacking(meshes, iterations);
+		Benchmark::Culling(*meshes[0], quick ? 10000 : 100000, iterations);
+		Benchmark::InstanceTransforms(quick ? 10000 : 100000, iterations);
+		Benchmark::JobScaling(*meshes[0], quick ? 10000 : 1000000, iterations);
+		Benchmark::InstanceLayout(quick ? 10000 : 100000, meshes.size(), iterations);
+		Benchmark::InstanceScaling(meshes[0], quick ? 10000 : 1000000, iterations);
+		Benchmark::HeadlessFrames(meshes, quick ? 10000 : 100000, quick ? 60 : 600, 3); // Frames in flight: the swap chain buffers of Game
+		Benchmark::DrawSorting(quick ? 25000 : 100000, quick ? 2 : 20);
+		Benchmark::SoftwareRendering(meshes, textureFileName, quick ? 1000 : 10000, quick ? 320 : 1280, quick ? 180 : 720, iterations);
+	}
+	catch (const std::exception& exception) {
+		std::string message = exception.what();
+		Benchmark::Report(L"Benchmarks stopped: %ls\n", std::wstring(message.begin(), message.end()).c_str());
+		return 1;
+	}
+
+	size_t failed = Benchmark::FailedChecks();
+	if (failed > 0) {
+		Benchmark::Report(L"%zu benchmark checks FAILED\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,171 @@
+#include "pch.h"
+#include "AssetLoader.h"
+#include "CommandTrace.h"
+#include "FrameCommands.h"
+#include "FrameUpdate.h"
+#include "ReferenceScene.h"
+#include "StateCache.h"
+#include "UploadBackend.h"
+#include "VertexPacking.h"
+
+// Console check of the commands Game::Render records for a frame (FrameCommands.h), built by CMakeLists.txt on the
+// core library. frame_commands [--write] [referenceFile]
+// Records the frame of ReferenceScene.h on RecordingCommandEncoder alone, the null device: stand-ins for the device
+// objects, the null upload backend, and the draw lists split and filtered as Game splits and filters them. The frame
+// is compared with referenceFile (Reference/frame_commands_reference.bin of the source tree by default), addresses and
+// descriptor handles left out. --write makes the frame the new reference; do it when the commands change on
+// purpose. Exits with 1 when the frame differs from the reference or does not replay to the same trace.
+
+namespace {
+	using namespace ReferenceScene;
+
+	const size_t c_drawLists = 2; // Recording threads of Render
+
+	void report(const wchar_t* format, ...) {
+		wchar_t msgbuff[512];
+		va_list args;
+		va_start(args, format);
+		vswprintf(msgbuff, 512, format, args);
+		va_end(args);
+		MYTRACE(msgbuff);
+	}
+
+	std::wstring wide(const std::string& text) {
+		return std::wstring(text.begin(), text.end());
+	}
+
+	// Stand-ins for the device objects: traces only keep their ids (CommandTrace::ObjectTable).
+	template <typename T>
+	T* fakeObject(UINT id) {
+		return reinterpret_cast<T*>(static_cast<uintptr_t>(id) << 8);
+	}
+
+	// Records the frame, one trace per command list in submission order.
+	std::vector<CommandTrace::Trace> recordFrame(CommandTrace::ObjectTable& objects) {
+		std::vector<std::shared_ptr<Mesh>> meshes = MakeMeshes();
+		InstanceStore store = MakeStore();
+
+		// Update: the pass constants and the visible instances in the upload ring.
+		UploadRing ring;
+		ring.Create(std::make_shared<NullUploadBackend>(), 64 * 1024);
+		JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+		std::vector<std::vector<InstanceUpdate::LodBucket>> buckets;
+		InstanceUpdate::Scratch scratch;
+		Culling::Stats cullStats = {};
+		InstanceUpdate::Frame frame = MakeFrame();
+		ring.BeginFrame(0);
+		UploadRing::Allocation pass = ring.Allocate(256, 256); // vConstants of Game, as a constant buffer
+		XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(pass.cpuAddress), XMMatrixIdentity());
+		UploadRing::Allocation instances = FrameUpdate::WriteInstances(jobs, meshes, store, frame, true, ring, buckets,
+			scratch, cullStats);
+		ring.EndFrame(1);
+
+		// The views of Game::CreateMainInputFlowResources and the state of Game::GetDrawState.
+		FrameCommands::DrawState state = {};
+		state.renderTarget.ptr = 0x1000;
+		state.depthStencil.ptr = 0x2000;
+		state.width = c_width;
+		state.height = c_height;
+		state.rootSignature = fakeObject<ID3D12RootSignature>(2);
+		state.descriptorHeaps[0] = fakeObject<ID3D12DescriptorHeap>(3);
+		state.descriptorHeaps[1] = fakeObject<ID3D12DescriptorHeap>(4);
+		state.textureTable.ptr = 0x3000;
+		state.samplerTable.ptr = 0x4000;
+		state.vertexBufferView.BufferLocation = 0x1000000;
+		state.vertexBufferView.StrideInBytes = sizeof(PackedVertex);
+		std::vector<D3D12_INDEX_BUFFER_VIEW> indexBufferViews(meshes.size());
+		UINT indexOffset = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			state.vertexBufferView.SizeInBytes += meshes[i]->GetVertexCount() * sizeof(PackedVertex);
+			UINT indexBytes = meshes[i]->GetIndexCountAllLods() * meshes[i]->GetIndexStride();
+			indexBufferViews[i] = { 0x2000000 + indexOffset, indexBytes, meshes[i]->GetIndexFormat() };
+			indexOffset += (indexBytes + 3) & ~3u;
+		}
+		ID3D12Resource* backBuffer = fakeObject<ID3D12Resource>(1);
+		ID3D12PipelineState* pso = fakeObject<ID3D12PipelineState>(5);
+
+		// Render: every list through the state filter, then the recorder (Game::ListEncoders). The draws are split
+		// in ranges as CommandRecorder splits them.
+		std::vector<CommandTrace::Trace> lists(1);
+		RenderQueue queue;
+		{
+			CommandTrace::RecordingCommandEncoder recorder(lists[0], &objects);
+			StateCachingCommandEncoder encoder(recorder, pso);
+			FrameCommands::BeginFrame(encoder, backBuffer, state, pass.gpuAddress, pass.size);
+			FrameCommands::QueueDraws(meshes, buckets, queue);
+			encoder.Upload(instances.gpuAddress, instances.size);
+		}
+		const std::vector<RenderQueue::Draw>& draws = queue.GetDraws();
+		size_t drawsPerList = (draws.size() + c_drawLists - 1) / c_drawLists;
+		for (size_t first = 0; first < draws.size(); first += drawsPerList) {
+			lists.emplace_back();
+			CommandTrace::RecordingCommandEncoder recorder(lists.back(), &objects);
+			StateCachingCommandEncoder encoder(recorder, pso);
+			FrameCommands::RecordDraws(encoder, state, pass.gpuAddress, instances.gpuAddress, indexBufferViews.data(), draws,
+				first, std::min(first + drawsPerList, draws.size()));
+		}
+
+		report(L"Frame: %zu instances over %u shapes, %zu visible in %zu draws\n", store.Size(), c_shapeCount,
+			cullStats.visible, draws.size());
+		return lists;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	bool write = false;
+	std::string referenceFileName = TUTORIAL_REFERENCE_FOLDER "/frame_commands_reference.bin";
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--write")
+			write = true;
+		else
+			referenceFileName = argument;
+	}
+
+	try {
+		CommandTrace::ObjectTable objects;
+		std::vector<CommandTrace::Trace> lists = recordFrame(objects);
+		CommandTrace::Trace trace;
+		for (const CommandTrace::Trace& list : lists)
+			trace.insert(trace.end(), list.begin(), list.end());
+
+		// Replaying a list into a recorder gives the same bytes back, or the trace lost something on the way.
+		bool replayed = true;
+		for (const CommandTrace::Trace& list : lists) {
+			CommandTrace::Trace replay;
+			CommandTrace::RecordingCommandEncoder recorder(replay, &objects);
+			CommandTrace::Replay(list, recorder, &objects);
+			replayed = replayed && replay == list;
+		}
+
+		CommandTrace::Stats stats = CommandTrace::Analyze(trace);
+		report(L"Commands: %zu lists, %zu commands in %zu bytes, %zu draws, %zu redundant state sets, replay %ls\n",
+			stats.lists, stats.commands, stats.bytes, stats.draws, stats.redundant, replayed ? L"matches" : L"DIFFERS");
+
+		if (write) {
+			if (!CommandTrace::Write(referenceFileName, trace)) {
+				report(L"Could not write %ls\n", wide(referenceFileName).c_str());
+				return 1;
+			}
+			report(L"Reference written to %ls\n", wide(referenceFileName).c_str());
+			return replayed ? 0 : 1;
+		}
+
+		CommandTrace::Trace reference;
+		if (!CommandTrace::Read(referenceFileName, reference)) {
+			report(L"No reference trace in %ls; --write makes one\n", wide(referenceFileName).c_str());
+			return 1;
+		}
+		CommandTrace::Difference difference = CommandTrace::Diff(reference, trace, true);
+		if (difference.equal)
+			report(L"Commands match %ls\n", wide(referenceFileName).c_str());
+		else
+			report(L"Commands DIFFER from %ls at command %zu\n  reference: %ls\n  frame:     %ls\n", wide(referenceFileName).c_str(),
+				difference.command, wide(difference.first).c_str(), wide(difference.second).c_str());
+		return replayed && difference.equal ? 0 : 1;
+	}
+	catch (const std::exception& exception) {
+		report(L"Command check stopped: %ls\n", wide(exception.what()).c_str());
+		return 1;
+	}
+}
@@ -0,0 +1,103 @@
+#include "pch.h"
+#include "CommandEncoder.h"
+
+void D3D12CommandEncoder::ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) {
+	m_commandList->ResourceBarrier(count, barriers);
+}
+
+void D3D12CommandEncoder::CopyBufferRegion(ID3D12Resource* destination, UINT64 destinationOffset, ID3D12Resource* source, UINT64 sourceOffset, UINT64 bytes) {
+	m_commandList->CopyBufferRegion(destination, destinationOffset, source, sourceOffset, bytes);
+}
+
+void D3D12CommandEncoder::Upload(D3D12_GPU_VIRTUAL_ADDRESS, UINT64) {
+	// The data is already in the mapped buffer.
+}
+
+void D3D12CommandEncoder::SetPipelineState(ID3D12PipelineState* pipelineState) {
+	m_commandList->SetPipelineState(pipelineState);
+}
+
+void D3D12CommandEncoder::SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) {
+	m_commandList->SetDescriptorHeaps(count, heaps);
+}
+
+void D3D12CommandEncoder::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) {
+	m_commandList->SetGraphicsRootSignature(rootSignature);
+}
+
+void D3D12CommandEncoder::SetGraphicsRootDescriptorTable(UINT parameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor) {
+	m_commandList->SetGraphicsRootDescriptorTable(parameter, baseDescriptor);
+}
+
+void D3D12CommandEncoder::SetGraphicsRoot32BitConstant(UINT parameter, UINT value, UINT offset) {
+	m_commandList->SetGraphicsRoot32BitConstant(parameter, value, offset);
+}
+
+void D3D12CommandEncoder::SetGraphicsRootConstantBufferView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	m_commandList->SetGraphicsRootConstantBufferView(parameter, address);
+}
+
+void D3D12CommandEncoder::SetGraphicsRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	m_commandList->SetGraphicsRootShaderResourceView(parameter, address);
+}
+
+void D3D12CommandEncoder::SetComputeRootSignature(ID3D12RootSignature* rootSignature) {
+	m_commandList->SetComputeRootSignature(rootSignature);
+}
+
+void D3D12CommandEncoder::SetComputeRoot32BitConstants(UINT parameter, UINT count, const void* values, UINT offset) {
+	m_commandList->SetComputeRoot32BitConstants(parameter, count, values, offset);
+}
+
+void D3D12CommandEncoder::SetComputeRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	m_commandList->SetComputeRootShaderResourceView(parameter, address);
+}
+
+void D3D12CommandEncoder::SetComputeRootUnorderedAccessView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	m_commandList->SetComputeRootUnorderedAccessView(parameter, address);
+}
+
+void D3D12CommandEncoder::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) {
+	m_commandList->IASetPrimitiveTopology(topology);
+}
+
+void D3D12CommandEncoder::IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) {
+	m_commandList->IASetVertexBuffers(startSlot, count, views);
+}
+
+void D3D12CommandEncoder::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) {
+	m_commandList->IASetIndexBuffer(view);
+}
+
+void D3D12CommandEncoder::RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) {
+	m_commandList->RSSetViewports(count, viewports);
+}
+
+void D3D12CommandEncoder::RSSetScissorRects(UINT count, const D3D12_RECT* rects) {
+	m_commandList->RSSetScissorRects(count, rects);
+}
+
+void D3D12CommandEncoder::OMSetRenderTargets(UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL singleHandle,
+	const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil) {
+	m_commandList->OMSetRenderTargets(count, renderTargets, singleHandle, depthStencil);
+}
+
+void D3D12CommandEncoder::ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4]) {
+	m_commandList->ClearRenderTargetView(renderTarget, color, 0, nullptr);
+}
+
+void D3D12CommandEncoder::ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil) {
+	m_commandList->ClearDepthStencilView(depthStencil, flags, depth, stencil, 0, nullptr);
+}
+
+void D3D12CommandEncoder::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT firstIndex, INT baseVertex, UINT firstInstance) {
+	m_commandList->DrawIndexedInstanced(indexCount, instanceCount, firstIndex, baseVertex, firstInstance);
+}
+
+void D3D12CommandEncoder::Dispatch(UINT x, UINT y, UINT z) {
+	m_commandList->Dispatch(x, y, z);
+}
+
+void D3D12CommandEncoder::ExecuteIndirect(ID3D12CommandSignature* signature, UINT maxCommands, ID3D12Resource* arguments, UINT64 argumentOffset) {
+	m_commandList->ExecuteIndirect(signature, maxCommands, arguments, argumentOffset, nullptr, 0);
+}
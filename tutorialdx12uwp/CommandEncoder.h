@@ -0,0 +1,93 @@
+#pragma once
+#include "pch.h"
+
+// The command list calls the renderer makes, behind an interface, so the command stream of a frame can be
+// captured and checked without a GPU (CommandTrace.h). D3D12CommandEncoder passes every call on to a graphics
+// command list; opening, closing and submitting lists stays with their owner.
+// Methods have the names and arguments of ID3D12GraphicsCommandList, but for Upload.
+
+class CommandEncoder
+{
+public:
+	virtual ~CommandEncoder() = default;
+
+	virtual void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) = 0;
+	virtual void CopyBufferRegion(ID3D12Resource* destination, UINT64 destinationOffset, ID3D12Resource* source, UINT64 sourceOffset, UINT64 bytes) = 0;
+	// size bytes the CPU wrote at gpuAddress of a mapped buffer for the commands that follow. Not a GPU command:
+	// it only shows in captures.
+	virtual void Upload(D3D12_GPU_VIRTUAL_ADDRESS gpuAddress, UINT64 size) = 0;
+
+	virtual void SetPipelineState(ID3D12PipelineState* pipelineState) = 0;
+	virtual void SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) = 0;
+
+	virtual void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) = 0;
+	virtual void SetGraphicsRootDescriptorTable(UINT parameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor) = 0;
+	virtual void SetGraphicsRoot32BitConstant(UINT parameter, UINT value, UINT offset) = 0;
+	virtual void SetGraphicsRootConstantBufferView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) = 0;
+	virtual void SetGraphicsRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) = 0;
+
+	virtual void SetComputeRootSignature(ID3D12RootSignature* rootSignature) = 0;
+	virtual void SetComputeRoot32BitConstants(UINT parameter, UINT count, const void* values, UINT offset) = 0;
+	virtual void SetComputeRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) = 0;
+	virtual void SetComputeRootUnorderedAccessView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) = 0;
+
+	virtual void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) = 0;
+	virtual void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) = 0;
+	virtual void RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) = 0;
+	virtual void RSSetScissorRects(UINT count, const D3D12_RECT* rects) = 0;
+	virtual void OMSetRenderTargets(UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL singleHandle,
+		const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil) = 0;
+
+	virtual void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4]) = 0;
+	virtual void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil) = 0;
+
+	virtual void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT firstIndex, INT baseVertex, UINT firstInstance) = 0;
+	virtual void Dispatch(UINT x, UINT y, UINT z) = 0;
+	virtual void ExecuteIndirect(ID3D12CommandSignature* signature, UINT maxCommands, ID3D12Resource* arguments, UINT64 argumentOffset) = 0;
+};
+
+// Passes calls on to an open command list.
+class D3D12CommandEncoder : public CommandEncoder
+{
+public:
+	explicit D3D12CommandEncoder(ID3D12GraphicsCommandList* commandList) : m_commandList(commandList) {}
+
+	void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) override;
+	void CopyBufferRegion(ID3D12Resource* destination, UINT64 destinationOffset, ID3D12Resource* source, UINT64 sourceOffset, UINT64 bytes) override;
+	void Upload(D3D12_GPU_VIRTUAL_ADDRESS gpuAddress, UINT64 size) override;
+
+	void SetPipelineState(ID3D12PipelineState* pipelineState) override;
+	void SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) override;
+
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetGraphicsRootDescriptorTable(UINT parameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor) override;
+	void SetGraphicsRoot32BitConstant(UINT parameter, UINT value, UINT offset) override;
+	void SetGraphicsRootConstantBufferView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+	void SetGraphicsRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+
+	void SetComputeRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetComputeRoot32BitConstants(UINT parameter, UINT count, const void* values, UINT offset) override;
+	void SetComputeRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+	void SetComputeRootUnorderedAccessView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) override;
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) override;
+	void RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) override;
+	void RSSetScissorRects(UINT count, const D3D12_RECT* rects) override;
+	void OMSetRenderTargets(UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL singleHandle,
+		const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil) override;
+
+	void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4]) override;
+	void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil) override;
+
+	void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT firstIndex, INT baseVertex, UINT firstInstance) override;
+	void Dispatch(UINT x, UINT y, UINT z) override;
+	void ExecuteIndirect(ID3D12CommandSignature* signature, UINT maxCommands, ID3D12Resource* arguments, UINT64 argumentOffset) override;
+
+	ID3D12GraphicsCommandList* GetCommandList() const { return m_commandList; }
+
+private:
+	ID3D12GraphicsCommandList* m_commandList;
+};
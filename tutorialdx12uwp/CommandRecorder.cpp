@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "CommandRecorder.h"
+
+CommandRecorder::CommandRecorder() : m_listCount(0), m_completedFenceValue(0), m_allocatorsCreated(0), m_stats{}
+{
+}
+
+void CommandRecorder::Create(ID3D12Device* device, UINT contextCount) {
+	m_device = device;
+	m_contexts.clear();
+	m_contexts.resize(std::max(contextCount, 1u));
+	m_allocatorsCreated = 0;
+	for (Context& context : m_contexts) {
+		// A list is created open on an allocator: that allocator starts the pool, free once the list is closed.
+		Allocator first = {};
+		DX::ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(first.allocator.GetAddressOf())));
+		DX::ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, first.allocator.Get(), nullptr,
+			IID_PPV_ARGS(context.commandList.GetAddressOf())));
+		DX::ThrowIfFailed(context.commandList->Close());
+		context.allocators.push_back(first);
+		context.current = 0;
+		m_allocatorsCreated++;
+	}
+	m_lists.assign(m_contexts.size() + 1, nullptr);
+	m_listCount = 0;
+	m_completedFenceValue = 0;
+	m_stats = {};
+}
+
+void CommandRecorder::BeginFrame(UINT64 completedFenceValue) {
+	m_completedFenceValue = completedFenceValue;
+	m_listCount = 0;
+	m_stats = {};
+}
+
+UINT CommandRecorder::record(JobSystem& jobs, size_t itemCount, size_t minItemsPerList, ID3D12PipelineState* initialState,
+	RecordFunction function, const void* context) {
+	assert(m_listCount == 0);
+	if (itemCount == 0)
+		return 0;
+
+	size_t lists = std::min(m_contexts.size(), std::max<size_t>(itemCount / std::max<size_t>(minItemsPerList, 1), 1));
+	size_t itemsPerList = (itemCount + lists - 1) / lists;
+	lists = (itemCount + itemsPerList - 1) / itemsPerList; // No empty list at the end
+
+	// One job per list: a list is recorded by a single thread, and the threads of jobs share out the lists.
+	jobs.ParallelFor(lists, 1, [&](size_t firstList, size_t lastList) {
+		for (size_t list = firstList; list < lastList; list++) {
+			Context& recording = m_contexts[list];
+			DX::ThrowIfFailed(recording.commandList->Reset(acquireAllocator(recording), initialState));
+			size_t first = list * itemsPerList;
+			function(context, recording.commandList.Get(), static_cast<UINT>(list), first, std::min(first + itemsPerList, itemCount));
+			DX::ThrowIfFailed(recording.commandList->Close());
+		}
+	});
+
+	m_listCount = static_cast<UINT>(lists);
+	for (UINT list = 0; list < m_listCount; list++)
+		m_lists[list + 1] = m_contexts[list].commandList.Get();
+	m_stats.lists = m_listCount;
+	m_stats.itemsPerList = itemsPerList;
+	return m_listCount;
+}
+
+void CommandRecorder::Submit(ID3D12CommandQueue* queue, ID3D12CommandList* first, UINT64 fenceValue) {
+	m_lists[0] = first;
+	UINT count = m_listCount + (first != nullptr ? 1 : 0);
+	if (count > 0)
+		queue->ExecuteCommandLists(count, first != nullptr ? m_lists.data() : m_lists.data() + 1);
+	EndFrame(fenceValue);
+}
+
+void CommandRecorder::EndFrame(UINT64 fenceValue) {
+	for (UINT list = 0; list < m_listCount; list++) {
+		Context& context = m_contexts[list];
+		context.allocators[context.current].fenceValue = fenceValue;
+	}
+	m_stats.allocatorsCreated = m_allocatorsCreated;
+}
+
+ID3D12CommandAllocator* CommandRecorder::acquireAllocator(Context& context) {
+	for (size_t a = 0; a < context.allocators.size(); a++) {
+		Allocator& candidate = context.allocators[a];
+		if (candidate.fenceValue <= m_completedFenceValue) {
+			DX::ThrowIfFailed(candidate.allocator->Reset());
+			candidate.fenceValue = c_inUse;
+			context.current = a;
+			return candidate.allocator.Get();
+		}
+	}
+
+	// Every allocator is in flight: one more frame than the pool has seen so far.
+	Allocator added = {};
+	DX::ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(added.allocator.GetAddressOf())));
+	added.fenceValue = c_inUse;
+	context.allocators.push_back(added);
+	context.current = context.allocators.size() - 1;
+	m_allocatorsCreated++;
+	return added.allocator.Get();
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "pch.h"
+#include "JobSystem.h"
+
+// Records the draws of a frame on several threads into direct command lists.
+// Every recording context owns a command list and a pool of allocators. An allocator goes back to the pool once
+// the GPU completes the fence value of the frame that used it, so a pool ends up with one allocator per frame in
+// flight and steady frames create none. Draws are split in contiguous ranges, one per list, and the lists are
+// submitted in range order after the caller's own list, so the GPU sees the draws in the order they were given.
+// Direct command lists inherit no state: each one has to set the root signature, heaps, targets and viewport
+// before it draws. Bundles would inherit them, but they pay off for draws repeated across frames, and these
+// change every frame.
+
+class CommandRecorder
+{
+public:
+	// Counters of the last frame.
+	struct Stats {
+		UINT lists;
+		size_t itemsPerList; // Largest range
+		size_t allocatorsCreated; // Since Create
+	};
+
+	CommandRecorder();
+	CommandRecorder(const CommandRecorder&) = delete;
+	CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+	// contextCount: lists a frame may be split in, usually the threads of the JobSystem given to Record.
+	void Create(ID3D12Device* device, UINT contextCount);
+
+	// Starts a frame. Allocators of the frames whose fence value the GPU has reached can be reset.
+	void BeginFrame(UINT64 completedFenceValue);
+
+	// Records function(commandList, list, first, last) over [0, itemCount) on the threads of jobs, in at most
+	// contextCount lists of minItemsPerList items or more: splitting a few draws costs more than it saves.
+	// Lists start with initialState and are closed on return. Called once per frame; returns the number of lists.
+	template <typename Function>
+	UINT Record(JobSystem& jobs, size_t itemCount, size_t minItemsPerList, ID3D12PipelineState* initialState, const Function& function) {
+		return record(jobs, itemCount, minItemsPerList, initialState, [](const void* context, ID3D12GraphicsCommandList* commandList,
+			UINT list, size_t first, size_t last) {
+			(*static_cast<const Function*>(context))(commandList, list, first, last);
+		}, &function);
+	}
+
+	// Lists recorded this frame, in range order.
+	UINT GetListCount() const { return m_listCount; }
+	ID3D12CommandList* const* GetLists() const { return m_lists.data() + 1; }
+
+	// Executes first (when not null) and the lists of the frame in one ExecuteCommandLists, then ends the frame.
+	void Submit(ID3D12CommandQueue* queue, ID3D12CommandList* first, UINT64 fenceValue);
+	// Ends the frame without submitting: the allocators it used are kept until fenceValue is completed.
+	void EndFrame(UINT64 fenceValue);
+
+	const Stats& FrameStats() const { return m_stats; }
+
+private:
+	using RecordFunction = void (*)(const void* context, ID3D12GraphicsCommandList* commandList, UINT list, size_t first, size_t last);
+
+	static const UINT64 c_inUse = ~0ull; // Fence value of an allocator recording the current frame
+
+	struct Allocator {
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator;
+		UINT64 fenceValue;
+	};
+
+	struct Context {
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList;
+		std::vector<Allocator> allocators;
+		size_t current; // Allocator of the current frame
+	};
+
+	UINT record(JobSystem& jobs, size_t itemCount, size_t minItemsPerList, ID3D12PipelineState* initialState,
+		RecordFunction function, const void* context);
+	// Only touches the context, so lists of different contexts can be reset at the same time.
+	ID3D12CommandAllocator* acquireAllocator(Context& context);
+
+	Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+	std::vector<Context> m_contexts;
+	// Room for the caller's list first, then the lists of the frame; sized in Create so frames do not allocate.
+	std::vector<ID3D12CommandList*> m_lists;
+	UINT m_listCount;
+	UINT64 m_completedFenceValue;
+	std::atomic<size_t> m_allocatorsCreated;
+	Stats m_stats;
+};
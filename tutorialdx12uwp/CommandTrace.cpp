@@ -0,0 +1,856 @@
+#include "pch.h"
+#include "CommandTrace.h"
+
+namespace CommandTrace {
+
+	namespace {
+		const uint32_t c_magic = 0x54444D43; // "CMDT"
+		const uint32_t c_version = 1;
+
+		struct FileHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t size;
+		};
+
+		const char* const c_opNames[c_opCount] = {
+			"List",
+			"ResourceBarrier",
+			"CopyBufferRegion",
+			"Upload",
+			"SetPipelineState",
+			"SetDescriptorHeaps",
+			"SetGraphicsRootSignature",
+			"SetGraphicsRootDescriptorTable",
+			"SetGraphicsRoot32BitConstant",
+			"SetGraphicsRootConstantBufferView",
+			"SetGraphicsRootShaderResourceView",
+			"SetComputeRootSignature",
+			"SetComputeRoot32BitConstants",
+			"SetComputeRootShaderResourceView",
+			"SetComputeRootUnorderedAccessView",
+			"IASetPrimitiveTopology",
+			"IASetVertexBuffers",
+			"IASetIndexBuffer",
+			"RSSetViewports",
+			"RSSetScissorRects",
+			"OMSetRenderTargets",
+			"ClearRenderTargetView",
+			"ClearDepthStencilView",
+			"DrawIndexedInstanced",
+			"Dispatch",
+			"ExecuteIndirect"
+		};
+
+		void writeVarint(Trace& trace, UINT64 value) {
+			while (value >= 0x80) {
+				trace.push_back(static_cast<BYTE>(value | 0x80));
+				value >>= 7;
+			}
+			trace.push_back(static_cast<BYTE>(value));
+		}
+
+		UINT64 zigzag(INT64 value) {
+			return (static_cast<UINT64>(value) << 1) ^ static_cast<UINT64>(value >> 63);
+		}
+
+		INT64 unzigzag(UINT64 value) {
+			return static_cast<INT64>(value >> 1) ^ -static_cast<INT64>(value & 1);
+		}
+
+		UINT64 floatBits(float value) {
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		float bitsFloat(UINT64 value) {
+			uint32_t bits = static_cast<uint32_t>(value);
+			float result;
+			memcpy(&result, &bits, sizeof(result));
+			return result;
+		}
+
+		// Reads the fields of a command in order.
+		class Fields
+		{
+		public:
+			Fields(const Command& command, const ObjectTable* objects) : m_command(command), m_objects(objects), m_next(0) {}
+
+			UINT64 Value() {
+				if (m_next >= m_command.fields.size())
+					throw std::runtime_error("CommandTrace: command with too few fields");
+				return m_command.fields[m_next++];
+			}
+			UINT Uint() { return static_cast<UINT>(Value()); }
+			INT64 Signed() { return unzigzag(Value()); }
+			float Float() { return bitsFloat(Value()); }
+
+			template <typename T>
+			T* Object() {
+				UINT64 id = Value();
+				const void* object = m_objects != nullptr ? m_objects->Object(id) : reinterpret_cast<const void*>(static_cast<uintptr_t>(id));
+				return static_cast<T*>(const_cast<void*>(object));
+			}
+
+		private:
+			const Command& m_command;
+			const ObjectTable* m_objects;
+			size_t m_next;
+		};
+
+		bool isGraphicsRootArgument(Op op) {
+			return op == Op::SetGraphicsRootDescriptorTable || op == Op::SetGraphicsRoot32BitConstant ||
+				op == Op::SetGraphicsRootConstantBufferView || op == Op::SetGraphicsRootShaderResourceView;
+		}
+
+		bool isComputeRootArgument(Op op) {
+			return op == Op::SetComputeRoot32BitConstants || op == Op::SetComputeRootShaderResourceView ||
+				op == Op::SetComputeRootUnorderedAccessView;
+		}
+
+		// Slot a state command binds, for redundancy: root arguments per parameter (and offset for constants),
+		// vertex buffers per start slot, the rest one slot per command. false for commands that are not state.
+		bool stateKey(const Command& command, UINT64& key) {
+			UINT64 slot = 0;
+			switch (command.op) {
+			case Op::SetPipelineState:
+			case Op::SetDescriptorHeaps:
+			case Op::SetGraphicsRootSignature:
+			case Op::SetComputeRootSignature:
+			case Op::IASetPrimitiveTopology:
+			case Op::IASetIndexBuffer:
+			case Op::RSSetViewports:
+			case Op::RSSetScissorRects:
+			case Op::OMSetRenderTargets:
+				break;
+			case Op::SetGraphicsRootDescriptorTable:
+			case Op::SetGraphicsRootConstantBufferView:
+			case Op::SetGraphicsRootShaderResourceView:
+			case Op::SetComputeRootShaderResourceView:
+			case Op::SetComputeRootUnorderedAccessView:
+			case Op::IASetVertexBuffers:
+				slot = command.fields[0];
+				break;
+			case Op::SetGraphicsRoot32BitConstant:
+				slot = command.fields[0] | (command.fields[2] << 16);
+				break;
+			case Op::SetComputeRoot32BitConstants:
+				slot = command.fields[0] | (command.fields.back() << 16);
+				break;
+			default:
+				return false;
+			}
+			key = (static_cast<UINT64>(command.op) << 48) | slot;
+			return true;
+		}
+
+		void forget(std::unordered_map<UINT64, std::vector<UINT64>>& bound, bool (*predicate)(Op)) {
+			for (auto i = bound.begin(); i != bound.end();) {
+				if (predicate(static_cast<Op>(i->first >> 48)))
+					i = bound.erase(i);
+				else
+					++i;
+			}
+		}
+	}
+
+	const char* OpName(Op op) {
+		size_t index = static_cast<size_t>(op);
+		return index < c_opCount ? c_opNames[index] : "Unknown";
+	}
+
+	Reader::Reader(const Trace& trace) : m_position(trace.data()), m_end(trace.data() + trace.size())
+	{
+	}
+
+	UINT64 Reader::varint() {
+		UINT64 value = 0;
+		for (UINT shift = 0; shift < 64; shift += 7) {
+			if (m_position == m_end)
+				throw std::runtime_error("CommandTrace: truncated trace");
+			BYTE byte = *m_position++;
+			value |= static_cast<UINT64>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+		throw std::runtime_error("CommandTrace: varint too long");
+	}
+
+	bool Reader::Next(Command& command) {
+		if (m_position == m_end)
+			return false;
+		BYTE op = *m_position++;
+		if (op >= c_opCount)
+			throw std::runtime_error("CommandTrace: unknown command");
+		command.op = static_cast<Op>(op);
+		UINT64 count = varint();
+		command.addressMask = varint();
+		// Every field takes a byte at least: a count past the end is a broken trace, not a huge allocation.
+		if (count > static_cast<UINT64>(m_end - m_position))
+			throw std::runtime_error("CommandTrace: truncated trace");
+		command.fields.resize(static_cast<size_t>(count));
+		for (UINT64& field : command.fields)
+			field = varint();
+		return true;
+	}
+
+	UINT64 ObjectTable::Id(const void* object) {
+		if (object == nullptr)
+			return 0;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto inserted = m_ids.emplace(object, m_objects.size() + 1);
+		if (inserted.second)
+			m_objects.push_back(object);
+		return inserted.first->second;
+	}
+
+	const void* ObjectTable::Object(UINT64 id) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return id > 0 && id <= m_objects.size() ? m_objects[static_cast<size_t>(id - 1)] : nullptr;
+	}
+
+	RecordingCommandEncoder::RecordingCommandEncoder(Trace& trace, ObjectTable* objects, CommandEncoder* next) :
+		m_trace(trace), m_objects(objects), m_next(next)
+	{
+		begin(Op::List);
+		end();
+	}
+
+	void RecordingCommandEncoder::begin(Op op) {
+		m_command.op = op;
+		m_command.addressMask = 0;
+		m_command.fields.clear();
+	}
+
+	void RecordingCommandEncoder::value(UINT64 value) {
+		m_command.fields.push_back(value);
+	}
+
+	void RecordingCommandEncoder::signedValue(INT64 value) {
+		m_command.fields.push_back(zigzag(value));
+	}
+
+	void RecordingCommandEncoder::floatValue(float value) {
+		m_command.fields.push_back(floatBits(value));
+	}
+
+	void RecordingCommandEncoder::address(UINT64 address) {
+		assert(m_command.fields.size() < 64);
+		m_command.addressMask |= 1ull << m_command.fields.size();
+		m_command.fields.push_back(address);
+	}
+
+	void RecordingCommandEncoder::object(const void* object) {
+		m_command.fields.push_back(m_objects != nullptr ? m_objects->Id(object) : static_cast<UINT64>(reinterpret_cast<uintptr_t>(object)));
+	}
+
+	void RecordingCommandEncoder::end() {
+		m_trace.push_back(static_cast<BYTE>(m_command.op));
+		writeVarint(m_trace, m_command.fields.size());
+		writeVarint(m_trace, m_command.addressMask);
+		for (UINT64 field : m_command.fields)
+			writeVarint(m_trace, field);
+	}
+
+	void RecordingCommandEncoder::ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) {
+		begin(Op::ResourceBarrier);
+		value(count);
+		for (UINT i = 0; i < count; i++) {
+			const D3D12_RESOURCE_BARRIER& barrier = barriers[i];
+			value(barrier.Type);
+			value(barrier.Flags);
+			switch (barrier.Type) {
+			case D3D12_RESOURCE_BARRIER_TYPE_TRANSITION:
+				object(barrier.Transition.pResource);
+				value(barrier.Transition.Subresource);
+				value(barrier.Transition.StateBefore);
+				value(barrier.Transition.StateAfter);
+				break;
+			case D3D12_RESOURCE_BARRIER_TYPE_ALIASING:
+				object(barrier.Aliasing.pResourceBefore);
+				object(barrier.Aliasing.pResourceAfter);
+				break;
+			case D3D12_RESOURCE_BARRIER_TYPE_UAV:
+				object(barrier.UAV.pResource);
+				break;
+			}
+		}
+		end();
+		if (m_next)
+			m_next->ResourceBarrier(count, barriers);
+	}
+
+	void RecordingCommandEncoder::CopyBufferRegion(ID3D12Resource* destination, UINT64 destinationOffset, ID3D12Resource* source, UINT64 sourceOffset, UINT64 bytes) {
+		begin(Op::CopyBufferRegion);
+		object(destination);
+		value(destinationOffset);
+		object(source);
+		value(sourceOffset);
+		value(bytes);
+		end();
+		if (m_next)
+			m_next->CopyBufferRegion(destination, destinationOffset, source, sourceOffset, bytes);
+	}
+
+	void RecordingCommandEncoder::Upload(D3D12_GPU_VIRTUAL_ADDRESS gpuAddress, UINT64 size) {
+		begin(Op::Upload);
+		address(gpuAddress);
+		value(size);
+		end();
+		if (m_next)
+			m_next->Upload(gpuAddress, size);
+	}
+
+	void RecordingCommandEncoder::SetPipelineState(ID3D12PipelineState* pipelineState) {
+		begin(Op::SetPipelineState);
+		object(pipelineState);
+		end();
+		if (m_next)
+			m_next->SetPipelineState(pipelineState);
+	}
+
+	void RecordingCommandEncoder::SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) {
+		begin(Op::SetDescriptorHeaps);
+		value(count);
+		for (UINT i = 0; i < count; i++)
+			object(heaps[i]);
+		end();
+		if (m_next)
+			m_next->SetDescriptorHeaps(count, heaps);
+	}
+
+	void RecordingCommandEncoder::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) {
+		begin(Op::SetGraphicsRootSignature);
+		object(rootSignature);
+		end();
+		if (m_next)
+			m_next->SetGraphicsRootSignature(rootSignature);
+	}
+
+	void RecordingCommandEncoder::SetGraphicsRootDescriptorTable(UINT parameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor) {
+		begin(Op::SetGraphicsRootDescriptorTable);
+		value(parameter);
+		address(baseDescriptor.ptr);
+		end();
+		if (m_next)
+			m_next->SetGraphicsRootDescriptorTable(parameter, baseDescriptor);
+	}
+
+	void RecordingCommandEncoder::SetGraphicsRoot32BitConstant(UINT parameter, UINT value, UINT offset) {
+		begin(Op::SetGraphicsRoot32BitConstant);
+		this->value(parameter);
+		this->value(value);
+		this->value(offset);
+		end();
+		if (m_next)
+			m_next->SetGraphicsRoot32BitConstant(parameter, value, offset);
+	}
+
+	void RecordingCommandEncoder::SetGraphicsRootConstantBufferView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+		begin(Op::SetGraphicsRootConstantBufferView);
+		value(parameter);
+		this->address(address);
+		end();
+		if (m_next)
+			m_next->SetGraphicsRootConstantBufferView(parameter, address);
+	}
+
+	void RecordingCommandEncoder::SetGraphicsRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+		begin(Op::SetGraphicsRootShaderResourceView);
+		value(parameter);
+		this->address(address);
+		end();
+		if (m_next)
+			m_next->SetGraphicsRootShaderResourceView(parameter, address);
+	}
+
+	void RecordingCommandEncoder::SetComputeRootSignature(ID3D12RootSignature* rootSignature) {
+		begin(Op::SetComputeRootSignature);
+		object(rootSignature);
+		end();
+		if (m_next)
+			m_next->SetComputeRootSignature(rootSignature);
+	}
+
+	void RecordingCommandEncoder::SetComputeRoot32BitConstants(UINT parameter, UINT count, const void* values, UINT offset) {
+		begin(Op::SetComputeRoot32BitConstants);
+		value(parameter);
+		value(count);
+		const UINT* dwords = static_cast<const UINT*>(values);
+		for (UINT i = 0; i < count; i++)
+			value(dwords[i]);
+		value(offset);
+		end();
+		if (m_next)
+			m_next->SetComputeRoot32BitConstants(parameter, count, values, offset);
+	}
+
+	void RecordingCommandEncoder::SetComputeRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+		begin(Op::SetComputeRootShaderResourceView);
+		value(parameter);
+		this->address(address);
+		end();
+		if (m_next)
+			m_next->SetComputeRootShaderResourceView(parameter, address);
+	}
+
+	void RecordingCommandEncoder::SetComputeRootUnorderedAccessView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+		begin(Op::SetComputeRootUnorderedAccessView);
+		value(parameter);
+		this->address(address);
+		end();
+		if (m_next)
+			m_next->SetComputeRootUnorderedAccessView(parameter, address);
+	}
+
+	void RecordingCommandEncoder::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) {
+		begin(Op::IASetPrimitiveTopology);
+		value(topology);
+		end();
+		if (m_next)
+			m_next->IASetPrimitiveTopology(topology);
+	}
+
+	void RecordingCommandEncoder::IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) {
+		begin(Op::IASetVertexBuffers);
+		value(startSlot);
+		value(count);
+		for (UINT i = 0; i < count; i++) {
+			address(views[i].BufferLocation);
+			value(views[i].SizeInBytes);
+			value(views[i].StrideInBytes);
+		}
+		end();
+		if (m_next)
+			m_next->IASetVertexBuffers(startSlot, count, views);
+	}
+
+	void RecordingCommandEncoder::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) {
+		begin(Op::IASetIndexBuffer);
+		value(view != nullptr);
+		if (view != nullptr) {
+			address(view->BufferLocation);
+			value(view->SizeInBytes);
+			value(view->Format);
+		}
+		end();
+		if (m_next)
+			m_next->IASetIndexBuffer(view);
+	}
+
+	void RecordingCommandEncoder::RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) {
+		begin(Op::RSSetViewports);
+		value(count);
+		for (UINT i = 0; i < count; i++) {
+			floatValue(viewports[i].TopLeftX);
+			floatValue(viewports[i].TopLeftY);
+			floatValue(viewports[i].Width);
+			floatValue(viewports[i].Height);
+			floatValue(viewports[i].MinDepth);
+			floatValue(viewports[i].MaxDepth);
+		}
+		end();
+		if (m_next)
+			m_next->RSSetViewports(count, viewports);
+	}
+
+	void RecordingCommandEncoder::RSSetScissorRects(UINT count, const D3D12_RECT* rects) {
+		begin(Op::RSSetScissorRects);
+		value(count);
+		for (UINT i = 0; i < count; i++) {
+			signedValue(rects[i].left);
+			signedValue(rects[i].top);
+			signedValue(rects[i].right);
+			signedValue(rects[i].bottom);
+		}
+		end();
+		if (m_next)
+			m_next->RSSetScissorRects(count, rects);
+	}
+
+	void RecordingCommandEncoder::OMSetRenderTargets(UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL singleHandle,
+		const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil) {
+		begin(Op::OMSetRenderTargets);
+		value(count);
+		value(singleHandle ? 1 : 0);
+		// A single handle is the first of count consecutive descriptors.
+		UINT handles = count == 0 ? 0 : singleHandle ? 1 : count;
+		for (UINT i = 0; i < handles; i++)
+			address(renderTargets[i].ptr);
+		value(depthStencil != nullptr);
+		if (depthStencil != nullptr)
+			address(depthStencil->ptr);
+		end();
+		if (m_next)
+			m_next->OMSetRenderTargets(count, renderTargets, singleHandle, depthStencil);
+	}
+
+	void RecordingCommandEncoder::ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4]) {
+		begin(Op::ClearRenderTargetView);
+		address(renderTarget.ptr);
+		for (UINT i = 0; i < 4; i++)
+			floatValue(color[i]);
+		end();
+		if (m_next)
+			m_next->ClearRenderTargetView(renderTarget, color);
+	}
+
+	void RecordingCommandEncoder::ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil) {
+		begin(Op::ClearDepthStencilView);
+		address(depthStencil.ptr);
+		value(flags);
+		floatValue(depth);
+		value(stencil);
+		end();
+		if (m_next)
+			m_next->ClearDepthStencilView(depthStencil, flags, depth, stencil);
+	}
+
+	void RecordingCommandEncoder::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT firstIndex, INT baseVertex, UINT firstInstance) {
+		begin(Op::DrawIndexedInstanced);
+		value(indexCount);
+		value(instanceCount);
+		value(firstIndex);
+		signedValue(baseVertex);
+		value(firstInstance);
+		end();
+		if (m_next)
+			m_next->DrawIndexedInstanced(indexCount, instanceCount, firstIndex, baseVertex, firstInstance);
+	}
+
+	void RecordingCommandEncoder::Dispatch(UINT x, UINT y, UINT z) {
+		begin(Op::Dispatch);
+		value(x);
+		value(y);
+		value(z);
+		end();
+		if (m_next)
+			m_next->Dispatch(x, y, z);
+	}
+
+	void RecordingCommandEncoder::ExecuteIndirect(ID3D12CommandSignature* signature, UINT maxCommands, ID3D12Resource* arguments, UINT64 argumentOffset) {
+		begin(Op::ExecuteIndirect);
+		object(signature);
+		value(maxCommands);
+		object(arguments);
+		value(argumentOffset);
+		end();
+		if (m_next)
+			m_next->ExecuteIndirect(signature, maxCommands, arguments, argumentOffset);
+	}
+
+	void Replay(const Trace& trace, CommandEncoder& encoder, const ObjectTable* objects) {
+		Reader reader(trace);
+		Command command;
+		std::vector<D3D12_RESOURCE_BARRIER> barriers;
+		std::vector<ID3D12DescriptorHeap*> heaps;
+		std::vector<UINT> dwords;
+		std::vector<D3D12_VERTEX_BUFFER_VIEW> vertexBuffers;
+		std::vector<D3D12_VIEWPORT> viewports;
+		std::vector<D3D12_RECT> rects;
+		std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> handles;
+		while (reader.Next(command)) {
+			Fields fields(command, objects);
+			switch (command.op) {
+			case Op::List:
+				break;
+			case Op::ResourceBarrier: {
+				barriers.resize(fields.Uint());
+				for (D3D12_RESOURCE_BARRIER& barrier : barriers) {
+					barrier = {};
+					barrier.Type = static_cast<D3D12_RESOURCE_BARRIER_TYPE>(fields.Uint());
+					barrier.Flags = static_cast<D3D12_RESOURCE_BARRIER_FLAGS>(fields.Uint());
+					switch (barrier.Type) {
+					case D3D12_RESOURCE_BARRIER_TYPE_TRANSITION:
+						barrier.Transition.pResource = fields.Object<ID3D12Resource>();
+						barrier.Transition.Subresource = fields.Uint();
+						barrier.Transition.StateBefore = static_cast<D3D12_RESOURCE_STATES>(fields.Uint());
+						barrier.Transition.StateAfter = static_cast<D3D12_RESOURCE_STATES>(fields.Uint());
+						break;
+					case D3D12_RESOURCE_BARRIER_TYPE_ALIASING:
+						barrier.Aliasing.pResourceBefore = fields.Object<ID3D12Resource>();
+						barrier.Aliasing.pResourceAfter = fields.Object<ID3D12Resource>();
+						break;
+					case D3D12_RESOURCE_BARRIER_TYPE_UAV:
+						barrier.UAV.pResource = fields.Object<ID3D12Resource>();
+						break;
+					}
+				}
+				encoder.ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+				break;
+			}
+			case Op::CopyBufferRegion: {
+				ID3D12Resource* destination = fields.Object<ID3D12Resource>();
+				UINT64 destinationOffset = fields.Value();
+				ID3D12Resource* source = fields.Object<ID3D12Resource>();
+				UINT64 sourceOffset = fields.Value();
+				encoder.CopyBufferRegion(destination, destinationOffset, source, sourceOffset, fields.Value());
+				break;
+			}
+			case Op::Upload: {
+				UINT64 address = fields.Value();
+				encoder.Upload(address, fields.Value());
+				break;
+			}
+			case Op::SetPipelineState:
+				encoder.SetPipelineState(fields.Object<ID3D12PipelineState>());
+				break;
+			case Op::SetDescriptorHeaps:
+				heaps.resize(fields.Uint());
+				for (ID3D12DescriptorHeap*& heap : heaps)
+					heap = fields.Object<ID3D12DescriptorHeap>();
+				encoder.SetDescriptorHeaps(static_cast<UINT>(heaps.size()), heaps.data());
+				break;
+			case Op::SetGraphicsRootSignature:
+				encoder.SetGraphicsRootSignature(fields.Object<ID3D12RootSignature>());
+				break;
+			case Op::SetGraphicsRootDescriptorTable: {
+				UINT parameter = fields.Uint();
+				D3D12_GPU_DESCRIPTOR_HANDLE handle = { fields.Value() };
+				encoder.SetGraphicsRootDescriptorTable(parameter, handle);
+				break;
+			}
+			case Op::SetGraphicsRoot32BitConstant: {
+				UINT parameter = fields.Uint();
+				UINT value = fields.Uint();
+				encoder.SetGraphicsRoot32BitConstant(parameter, value, fields.Uint());
+				break;
+			}
+			case Op::SetGraphicsRootConstantBufferView: {
+				UINT parameter = fields.Uint();
+				encoder.SetGraphicsRootConstantBufferView(parameter, fields.Value());
+				break;
+			}
+			case Op::SetGraphicsRootShaderResourceView: {
+				UINT parameter = fields.Uint();
+				encoder.SetGraphicsRootShaderResourceView(parameter, fields.Value());
+				break;
+			}
+			case Op::SetComputeRootSignature:
+				encoder.SetComputeRootSignature(fields.Object<ID3D12RootSignature>());
+				break;
+			case Op::SetComputeRoot32BitConstants: {
+				UINT parameter = fields.Uint();
+				dwords.resize(fields.Uint());
+				for (UINT& dword : dwords)
+					dword = fields.Uint();
+				encoder.SetComputeRoot32BitConstants(parameter, static_cast<UINT>(dwords.size()), dwords.data(), fields.Uint());
+				break;
+			}
+			case Op::SetComputeRootShaderResourceView: {
+				UINT parameter = fields.Uint();
+				encoder.SetComputeRootShaderResourceView(parameter, fields.Value());
+				break;
+			}
+			case Op::SetComputeRootUnorderedAccessView: {
+				UINT parameter = fields.Uint();
+				encoder.SetComputeRootUnorderedAccessView(parameter, fields.Value());
+				break;
+			}
+			case Op::IASetPrimitiveTopology:
+				encoder.IASetPrimitiveTopology(static_cast<D3D12_PRIMITIVE_TOPOLOGY>(fields.Uint()));
+				break;
+			case Op::IASetVertexBuffers: {
+				UINT startSlot = fields.Uint();
+				vertexBuffers.resize(fields.Uint());
+				for (D3D12_VERTEX_BUFFER_VIEW& view : vertexBuffers) {
+					view.BufferLocation = fields.Value();
+					view.SizeInBytes = fields.Uint();
+					view.StrideInBytes = fields.Uint();
+				}
+				encoder.IASetVertexBuffers(startSlot, static_cast<UINT>(vertexBuffers.size()), vertexBuffers.data());
+				break;
+			}
+			case Op::IASetIndexBuffer: {
+				if (fields.Value() == 0) {
+					encoder.IASetIndexBuffer(nullptr);
+					break;
+				}
+				D3D12_INDEX_BUFFER_VIEW view;
+				view.BufferLocation = fields.Value();
+				view.SizeInBytes = fields.Uint();
+				view.Format = static_cast<DXGI_FORMAT>(fields.Uint());
+				encoder.IASetIndexBuffer(&view);
+				break;
+			}
+			case Op::RSSetViewports:
+				viewports.resize(fields.Uint());
+				for (D3D12_VIEWPORT& viewport : viewports) {
+					viewport.TopLeftX = fields.Float();
+					viewport.TopLeftY = fields.Float();
+					viewport.Width = fields.Float();
+					viewport.Height = fields.Float();
+					viewport.MinDepth = fields.Float();
+					viewport.MaxDepth = fields.Float();
+				}
+				encoder.RSSetViewports(static_cast<UINT>(viewports.size()), viewports.data());
+				break;
+			case Op::RSSetScissorRects:
+				rects.resize(fields.Uint());
+				for (D3D12_RECT& rect : rects) {
+					rect.left = static_cast<LONG>(fields.Signed());
+					rect.top = static_cast<LONG>(fields.Signed());
+					rect.right = static_cast<LONG>(fields.Signed());
+					rect.bottom = static_cast<LONG>(fields.Signed());
+				}
+				encoder.RSSetScissorRects(static_cast<UINT>(rects.size()), rects.data());
+				break;
+			case Op::OMSetRenderTargets: {
+				UINT count = fields.Uint();
+				BOOL singleHandle = fields.Uint() != 0 ? TRUE : FALSE;
+				handles.resize(count == 0 ? 0 : singleHandle ? 1 : count);
+				for (D3D12_CPU_DESCRIPTOR_HANDLE& handle : handles)
+					handle.ptr = static_cast<SIZE_T>(fields.Value());
+				D3D12_CPU_DESCRIPTOR_HANDLE depthStencil = {};
+				bool hasDepthStencil = fields.Value() != 0;
+				if (hasDepthStencil)
+					depthStencil.ptr = static_cast<SIZE_T>(fields.Value());
+				encoder.OMSetRenderTargets(count, handles.data(), singleHandle, hasDepthStencil ? &depthStencil : nullptr);
+				break;
+			}
+			case Op::ClearRenderTargetView: {
+				D3D12_CPU_DESCRIPTOR_HANDLE renderTarget = { static_cast<SIZE_T>(fields.Value()) };
+				FLOAT color[4];
+				for (FLOAT& channel : color)
+					channel = fields.Float();
+				encoder.ClearRenderTargetView(renderTarget, color);
+				break;
+			}
+			case Op::ClearDepthStencilView: {
+				D3D12_CPU_DESCRIPTOR_HANDLE depthStencil = { static_cast<SIZE_T>(fields.Value()) };
+				D3D12_CLEAR_FLAGS flags = static_cast<D3D12_CLEAR_FLAGS>(fields.Uint());
+				FLOAT depth = fields.Float();
+				encoder.ClearDepthStencilView(depthStencil, flags, depth, static_cast<UINT8>(fields.Uint()));
+				break;
+			}
+			case Op::DrawIndexedInstanced: {
+				UINT indexCount = fields.Uint();
+				UINT instanceCount = fields.Uint();
+				UINT firstIndex = fields.Uint();
+				INT baseVertex = static_cast<INT>(fields.Signed());
+				encoder.DrawIndexedInstanced(indexCount, instanceCount, firstIndex, baseVertex, fields.Uint());
+				break;
+			}
+			case Op::Dispatch: {
+				UINT x = fields.Uint();
+				UINT y = fields.Uint();
+				encoder.Dispatch(x, y, fields.Uint());
+				break;
+			}
+			case Op::ExecuteIndirect: {
+				ID3D12CommandSignature* signature = fields.Object<ID3D12CommandSignature>();
+				UINT maxCommands = fields.Uint();
+				ID3D12Resource* arguments = fields.Object<ID3D12Resource>();
+				encoder.ExecuteIndirect(signature, maxCommands, arguments, fields.Value());
+				break;
+			}
+			default:
+				throw std::runtime_error("CommandTrace: unknown command");
+			}
+		}
+	}
+
+	Stats Analyze(const Trace& trace) {
+		Stats stats = {};
+		stats.bytes = trace.size();
+		// Fields of the last set of every state slot in the current list.
+		std::unordered_map<UINT64, std::vector<UINT64>> bound;
+		Reader reader(trace);
+		Command command;
+		while (reader.Next(command)) {
+			size_t op = static_cast<size_t>(command.op);
+			if (command.op == Op::List) {
+				stats.lists++;
+				bound.clear();
+				continue;
+			}
+			stats.commands++;
+			stats.perOp[op]++;
+			if (command.op == Op::DrawIndexedInstanced || command.op == Op::ExecuteIndirect)
+				stats.draws++;
+			if (command.op == Op::ExecuteIndirect) {
+				// The command signature may set root arguments and the index buffer.
+				forget(bound, isGraphicsRootArgument);
+				bound.erase(static_cast<UINT64>(Op::IASetIndexBuffer) << 48);
+			}
+
+			UINT64 key;
+			if (command.fields.empty() || !stateKey(command, key))
+				continue;
+			auto last = bound.find(key);
+			if (last != bound.end() && last->second == command.fields) {
+				stats.redundant++;
+				stats.redundantPerOp[op]++;
+				continue;
+			}
+			if (command.op == Op::SetGraphicsRootSignature)
+				forget(bound, isGraphicsRootArgument);
+			else if (command.op == Op::SetComputeRootSignature)
+				forget(bound, isComputeRootArgument);
+			bound[key] = command.fields;
+		}
+		return stats;
+	}
+
+	Difference Diff(const Trace& first, const Trace& second, bool ignoreAddresses) {
+		Difference difference = {};
+		Reader firstReader(first);
+		Reader secondReader(second);
+		Command firstCommand;
+		Command secondCommand;
+		for (size_t index = 0;; index++) {
+			bool firstMore = firstReader.Next(firstCommand);
+			bool secondMore = secondReader.Next(secondCommand);
+			if (!firstMore && !secondMore)
+				break;
+
+			bool same = firstMore && secondMore && firstCommand.op == secondCommand.op &&
+				firstCommand.addressMask == secondCommand.addressMask && firstCommand.fields.size() == secondCommand.fields.size();
+			for (size_t i = 0; same && i < firstCommand.fields.size(); i++) {
+				bool isAddress = i < 64 && (firstCommand.addressMask & (1ull << i)) != 0;
+				same = (ignoreAddresses && isAddress) || firstCommand.fields[i] == secondCommand.fields[i];
+			}
+			if (!same) {
+				difference.command = index;
+				difference.first = firstMore ? Format(firstCommand) : std::string();
+				difference.second = secondMore ? Format(secondCommand) : std::string();
+				return difference;
+			}
+		}
+		difference.equal = true;
+		return difference;
+	}
+
+	std::string Format(const Command& command) {
+		std::string text = OpName(command.op);
+		char field[24];
+		for (size_t i = 0; i < command.fields.size(); i++) {
+			bool isAddress = i < 64 && (command.addressMask & (1ull << i)) != 0;
+			snprintf(field, sizeof(field), isAddress ? " 0x%llx" : " %llu", static_cast<unsigned long long>(command.fields[i]));
+			text += field;
+		}
+		return text;
+	}
+
+	bool Write(const std::string& fileName, const Trace& trace) {
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		if (!file.good())
+			return false;
+		FileHeader header = { c_magic, c_version, trace.size() };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(trace.data()), trace.size());
+		return file.good();
+	}
+
+	bool Read(const std::string& fileName, Trace& trace) {
+		std::ifstream file(fileName, std::ios::binary);
+		FileHeader header;
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			return false;
+		if (header.magic != c_magic || header.version != c_version)
+			return false;
+		trace.resize(static_cast<size_t>(header.size));
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(trace.data()), trace.size()));
+	}
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include "pch.h"
+#include "CommandEncoder.h"
+#include <unordered_map>
+
+// Capture of the command stream behind CommandEncoder, so the commands of a frame can be counted, replayed and
+// compared without a GPU. RecordingCommandEncoder writes every call to a trace, and passes it on to another
+// encoder when it has one; without one it is a null device.
+// A trace is a byte stream of commands: an opcode byte, the number of fields, a mask of the fields that hold a GPU
+// address or descriptor handle, then the fields; counts and fields are LEB128 varints, so most take a byte or two.
+// Fields are the arguments in call order with arrays flattened; floats are stored as their bits, signed integers
+// zigzagged and objects as ids (ObjectTable). Addresses and handles change from run to run, objects ids do not as
+// long as objects are first used in the same order; Diff can ignore addresses.
+// Every recording encoder starts its trace with a List command: state is per command list, so traces of the
+// lists of a frame can be concatenated in submission order.
+
+namespace CommandTrace {
+
+	enum class Op : BYTE {
+		List,
+		ResourceBarrier,
+		CopyBufferRegion,
+		Upload,
+		SetPipelineState,
+		SetDescriptorHeaps,
+		SetGraphicsRootSignature,
+		SetGraphicsRootDescriptorTable,
+		SetGraphicsRoot32BitConstant,
+		SetGraphicsRootConstantBufferView,
+		SetGraphicsRootShaderResourceView,
+		SetComputeRootSignature,
+		SetComputeRoot32BitConstants,
+		SetComputeRootShaderResourceView,
+		SetComputeRootUnorderedAccessView,
+		IASetPrimitiveTopology,
+		IASetVertexBuffers,
+		IASetIndexBuffer,
+		RSSetViewports,
+		RSSetScissorRects,
+		OMSetRenderTargets,
+		ClearRenderTargetView,
+		ClearDepthStencilView,
+		DrawIndexedInstanced,
+		Dispatch,
+		ExecuteIndirect,
+		Count
+	};
+	const size_t c_opCount = static_cast<size_t>(Op::Count);
+
+	const char* OpName(Op op);
+
+	using Trace = std::vector<BYTE>;
+
+	// A decoded command.
+	struct Command {
+		Op op;
+		UINT64 addressMask; // Bit i set: fields[i] is a GPU address or a descriptor handle
+		std::vector<UINT64> fields;
+	};
+
+	// Decodes a trace command by command; the Command given to Next is reused, so steady reading does not allocate.
+	class Reader
+	{
+	public:
+		explicit Reader(const Trace& trace);
+		// False at the end of the trace. Throws std::runtime_error when the trace is malformed.
+		bool Next(Command& command);
+
+	private:
+		UINT64 varint();
+
+		const BYTE* m_position;
+		const BYTE* m_end;
+	};
+
+	// Ids of the objects a trace refers to: 1, 2, ... in first use order, 0 for null. Recording threads share a
+	// table, so it locks. Objects are not referenced: a table lasts as long as the objects of its captures.
+	class ObjectTable
+	{
+	public:
+		UINT64 Id(const void* object);
+		// nullptr for ids the table did not hand out.
+		const void* Object(UINT64 id) const;
+
+	private:
+		mutable std::mutex m_mutex;
+		std::unordered_map<const void*, UINT64> m_ids;
+		std::vector<const void*> m_objects;
+	};
+
+	class RecordingCommandEncoder : public CommandEncoder
+	{
+	public:
+		// Appends to trace. objects: ids of the objects, nullptr to store the pointers themselves (Replay does
+		// the same, so a trace replayed into a recorder without table gives the same trace back).
+		// next: receives every call after it is recorded, nullptr to record only.
+		RecordingCommandEncoder(Trace& trace, ObjectTable* objects, CommandEncoder* next = nullptr);
+
+		void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) override;
+		void CopyBufferRegion(ID3D12Resource* destination, UINT64 destinationOffset, ID3D12Resource* source, UINT64 sourceOffset, UINT64 bytes) override;
+		void Upload(D3D12_GPU_VIRTUAL_ADDRESS gpuAddress, UINT64 size) override;
+
+		void SetPipelineState(ID3D12PipelineState* pipelineState) override;
+		void SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) override;
+
+		void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) override;
+		void SetGraphicsRootDescriptorTable(UINT parameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor) override;
+		void SetGraphicsRoot32BitConstant(UINT parameter, UINT value, UINT offset) override;
+		void SetGraphicsRootConstantBufferView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+		void SetGraphicsRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+
+		void SetComputeRootSignature(ID3D12RootSignature* rootSignature) override;
+		void SetComputeRoot32BitConstants(UINT parameter, UINT count, const void* values, UINT offset) override;
+		void SetComputeRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+		void SetComputeRootUnorderedAccessView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+
+		void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) override;
+		void IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) override;
+		void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) override;
+		void RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) override;
+		void RSSetScissorRects(UINT count, const D3D12_RECT* rects) override;
+		void OMSetRenderTargets(UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL singleHandle,
+			const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil) override;
+
+		void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4]) override;
+		void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil) override;
+
+		void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT firstIndex, INT baseVertex, UINT firstInstance) override;
+		void Dispatch(UINT x, UINT y, UINT z) override;
+		void ExecuteIndirect(ID3D12CommandSignature* signature, UINT maxCommands, ID3D12Resource* arguments, UINT64 argumentOffset) override;
+
+	private:
+		void begin(Op op);
+		void value(UINT64 value);
+		void signedValue(INT64 value);
+		void floatValue(float value);
+		void address(UINT64 address);
+		void object(const void* object);
+		void end();
+
+		Trace& m_trace;
+		ObjectTable* m_objects;
+		CommandEncoder* m_next;
+		Command m_command; // Being recorded; fields are reused
+	};
+
+	// Calls encoder with the commands of trace, but List. objects: the table the trace was recorded with, to
+	// replay on the objects it refers to; nullptr when the trace stored pointers, or to replay to a recorder.
+	void Replay(const Trace& trace, CommandEncoder& encoder, const ObjectTable* objects);
+
+	// Counters of a trace.
+	struct Stats {
+		size_t lists;
+		size_t commands; // Lists excluded
+		size_t bytes;
+		size_t draws; // DrawIndexedInstanced and ExecuteIndirect
+		// State set to what is already bound in the list: same pipeline state, root signature, heaps, topology,
+		// views, viewports, targets or root argument (per parameter) as the last set. Root arguments are
+		// forgotten when the root signature changes and after ExecuteIndirect, which may change them.
+		size_t redundant;
+		size_t perOp[c_opCount];
+		size_t redundantPerOp[c_opCount];
+	};
+	Stats Analyze(const Trace& trace);
+
+	// First command two traces differ in.
+	struct Difference {
+		bool equal;
+		size_t command; // Index, List commands included
+		std::string first; // The commands (Format), empty past the end of a trace
+		std::string second;
+	};
+	// ignoreAddresses: fields in the address mask only have to be addresses in both.
+	Difference Diff(const Trace& first, const Trace& second, bool ignoreAddresses);
+
+	// "DrawIndexedInstanced 36 12 0 0 0"; addresses in hexadecimal.
+	std::string Format(const Command& command);
+
+	// Files start with a magic number and a version, then the trace.
+	bool Write(const std::string& fileName, const Trace& trace);
+	bool Read(const std::string& fileName, Trace& trace);
+}
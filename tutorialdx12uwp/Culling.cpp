@@ -0,0 +1,24 @@
+#include "pch.h"
+#include "Culling.h"
+
+namespace Culling {
+
+	BoundingFrustum ViewFrustum(FXMMATRIX projection) {
+		BoundingFrustum frustum;
+		BoundingFrustum::CreateFromMatrix(frustum, projection);
+		return frustum;
+	}
+
+	bool IsVisible(const BoundingFrustum& frustum, const BoundingSphere& sphere, const BoundingBox& box, FXMMATRIX worldview) {
+		BoundingSphere viewSphere;
+		sphere.Transform(viewSphere, worldview);
+		ContainmentType containment = frustum.Contains(viewSphere);
+		if (containment != INTERSECTS)
+			return containment == CONTAINS;
+
+		BoundingOrientedBox viewBox;
+		BoundingOrientedBox::CreateFromBoundingBox(viewBox, box);
+		viewBox.Transform(viewBox, worldview);
+		return frustum.Contains(viewBox) != DISJOINT;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "pch.h"
+#include <DirectXCollision.h>
+
+// View frustum culling of instances on the CPU.
+// Bounds are tested in view space, with the worldview matrix Update already computes for every instance.
+
+namespace Culling {
+
+	struct Stats {
+		size_t tested;
+		size_t visible;
+	};
+
+	// View space frustum of a left handed perspective projection.
+	BoundingFrustum ViewFrustum(FXMMATRIX projection);
+
+	// Bounding sphere first, which is cheap and settles most instances; the box only when the sphere straddles a plane.
+	bool IsVisible(const BoundingFrustum& frustum, const BoundingSphere& sphere, const BoundingBox& box, FXMMATRIX worldview);
+}
@@ -0,0 +1,33 @@
+#include "pch.h"
+#include "D3D12UploadBackend.h"
+
+D3D12UploadBackend::D3D12UploadBackend(ID3D12Device* device) : m_device(device)
+{
+}
+
+UploadBackend::Buffer D3D12UploadBackend::CreateBuffer(UINT64 size) {
+	Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+	CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC resourceDescription = CD3DX12_RESOURCE_DESC::Buffer(size);
+	DX::ThrowIfFailed(m_device->CreateCommittedResource(
+		&heapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&resourceDescription,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(resource.GetAddressOf())));
+
+	// The CPU never reads it: empty read range.
+	Buffer buffer;
+	CD3DX12_RANGE readRange(0, 0);
+	DX::ThrowIfFailed(resource->Map(0, &readRange, reinterpret_cast<void**>(&buffer.cpuAddress)));
+	buffer.gpuAddress = resource->GetGPUVirtualAddress();
+	buffer.size = size;
+	buffer.resource = resource.Detach(); // ReleaseBuffer gives the reference back
+	return buffer;
+}
+
+void D3D12UploadBackend::ReleaseBuffer(const Buffer& buffer) {
+	buffer.resource->Unmap(0, nullptr);
+	buffer.resource->Release();
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "pch.h"
+#include "UploadBackend.h"
+
+// Upload heap buffers on a D3D12 device, mapped once when they are created.
+
+class D3D12UploadBackend : public UploadBackend
+{
+public:
+	explicit D3D12UploadBackend(ID3D12Device* device);
+
+	Buffer CreateBuffer(UINT64 size) override;
+	void ReleaseBuffer(const Buffer& buffer) override;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+};
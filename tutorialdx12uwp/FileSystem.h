@@ -0,0 +1,43 @@
+#pragma once
+#include "pch.h"
+
+// The file access of asset loading that depends on the platform: read-only memory mapped files, the writable local
+// folder and the errors a failed load throws. FileSystemWinRT.cpp implements it for the app, FileSystemPosix.cpp for
+// the console tools of the CMake build (CMakeLists.txt).
+
+namespace FileSystem {
+
+	// Read-only memory mapped file. The view keeps the file open, so only the view is kept.
+	class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// false when the file cannot be read or is empty.
+		bool Open(std::string const fileName);
+		void Close();
+		const BYTE* Data() const { return m_view; }
+		size_t Size() const { return m_size; }
+
+	private:
+		const BYTE* m_view;
+		size_t m_size;
+	};
+
+	// Resolves the local folder: the app local folder, or the working directory of a console tool. The app has to
+	// call it from the UI thread before files are loaded on worker threads.
+	void Initialize();
+	// Writable location for files generated at run time (the install folder of the app is read only): the name of
+	// fileName in the local folder.
+	std::string LocalFileName(std::string const fileName);
+
+	enum class LoadError {
+		NotFound,
+		WrongFormat
+	};
+
+	// Traces message and throws: winrt::hresult_error in the app, std::runtime_error in the console tools.
+	[[noreturn]] void ThrowLoadError(LoadError error, std::wstring const message);
+}
@@ -0,0 +1,57 @@
+#include "pch.h"
+#include "FileSystem.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FileSystem {
+
+	MappedFile::MappedFile() : m_view(nullptr), m_size(0)
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(std::string const fileName) {
+		Close();
+		int file = open(fileName.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat status;
+		void* view = MAP_FAILED;
+		if (fstat(file, &status) == 0 && status.st_size > 0)
+			view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (view == MAP_FAILED)
+			return false;
+		m_view = static_cast<const BYTE*>(view);
+		m_size = static_cast<size_t>(status.st_size);
+		return true;
+	}
+
+	void MappedFile::Close() {
+		if (m_view != nullptr)
+			munmap(const_cast<BYTE*>(m_view), m_size);
+		m_view = nullptr;
+		m_size = 0;
+	}
+
+	void Initialize() {
+	}
+
+	std::string LocalFileName(std::string const fileName) {
+		size_t slash = fileName.find_last_of("/\\");
+		return slash != std::string::npos ? fileName.substr(slash + 1) : fileName;
+	}
+
+	void ThrowLoadError(LoadError error, std::wstring const message) {
+		MYTRACE((message + L"\n").c_str());
+		std::string text(message.begin(), message.end());
+		throw std::runtime_error(error == LoadError::NotFound ? "File not found: " + text : "Wrong format: " + text);
+	}
+}
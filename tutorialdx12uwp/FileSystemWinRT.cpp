@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "FileSystem.h"
+#include "Error.h"
+
+namespace FileSystem {
+
+	MappedFile::MappedFile() : m_view(nullptr), m_size(0)
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(std::string const fileName) {
+		Close();
+		std::wstring wFileName(fileName.begin(), fileName.end());
+		HANDLE file = CreateFile2(wFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart != 0)
+			mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+		if (mapping != nullptr) {
+			m_view = reinterpret_cast<const BYTE*>(MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0));
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		if (m_view == nullptr)
+			return false;
+		m_size = static_cast<size_t>(fileSize.QuadPart);
+		return true;
+	}
+
+	void MappedFile::Close() {
+		if (m_view != nullptr)
+			UnmapViewOfFile(m_view);
+		m_view = nullptr;
+		m_size = 0;
+	}
+
+	static std::string localFolder;
+
+	void Initialize() {
+		if (localFolder.empty())
+			localFolder = winrt::to_string(
+				winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+	}
+
+	std::string LocalFileName(std::string const fileName) {
+		Initialize();
+		std::string name = fileName;
+		size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos)
+			name = name.substr(slash + 1);
+		return localFolder + "\\" + name;
+	}
+
+	void ThrowLoadError(LoadError error, std::wstring const message) {
+		winrt::hresult_error exception{ error == LoadError::NotFound ? HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) : E_INVALIDARG,
+			message };
+		ShowWinRTError(exception);
+		throw exception; // ShowWinRTError rethrows the code; this only tells the compiler
+	}
+}
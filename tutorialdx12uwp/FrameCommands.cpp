@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "FrameCommands.h"
+
+namespace FrameCommands {
+
+	void DrawStats::Add(const DrawStats& other) {
+		draws += other.draws;
+		instanceBufferBinds += other.instanceBufferBinds;
+		rootConstantSets += other.rootConstantSets;
+		indexBufferSets += other.indexBufferSets;
+	}
+
+	void SetDrawState(CommandEncoder& commandList, const DrawState& state) {
+		commandList.OMSetRenderTargets(1, &state.renderTarget, FALSE, &state.depthStencil);
+
+		D3D12_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(state.width), static_cast<float>(state.height), D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
+		D3D12_RECT scissorRect = { 0, 0, static_cast<LONG>(state.width), static_cast<LONG>(state.height) };
+		commandList.RSSetViewports(1, &viewport);
+		commandList.RSSetScissorRects(1, &scissorRect);
+
+		// The root signature, the heaps its descriptor tables point into, then where the tables start in them.
+		commandList.SetGraphicsRootSignature(state.rootSignature);
+		commandList.SetDescriptorHeaps(static_cast<UINT>(std::size(state.descriptorHeaps)), state.descriptorHeaps);
+		commandList.SetGraphicsRootDescriptorTable(2, state.textureTable);
+		commandList.SetGraphicsRootDescriptorTable(3, state.samplerTable);
+
+		// The index buffer view is set per mesh (RecordDraws).
+		commandList.IASetVertexBuffers(0, 1, &state.vertexBufferView);
+		commandList.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	}
+
+	void BeginFrame(CommandEncoder& commandList, ID3D12Resource* backBuffer, const DrawState& state,
+		D3D12_GPU_VIRTUAL_ADDRESS passAddress, UINT64 passSize) {
+		D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		commandList.ResourceBarrier(1, &barrier);
+
+		commandList.ClearRenderTargetView(state.renderTarget, Colors::CornflowerBlue);
+		commandList.ClearDepthStencilView(state.depthStencil, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0);
+		SetDrawState(commandList, state);
+
+		commandList.Upload(passAddress, passSize);
+		commandList.SetGraphicsRootConstantBufferView(0, passAddress);
+	}
+
+	void QueueDraws(const std::vector<std::shared_ptr<Mesh>>& meshes,
+		const std::vector<std::vector<InstanceUpdate::LodBucket>>& buckets, RenderQueue& queue) {
+		queue.Clear();
+		UINT vertexStart = 0;
+		for (UINT ishape = 0; ishape < meshes.size(); ishape++) {
+			// The root constant tells the shader where the instances of a draw start.
+			const std::vector<InstanceUpdate::LodBucket>& shapeBuckets = buckets[ishape];
+			for (UINT lod = 0; lod < shapeBuckets.size(); lod++) {
+				if (shapeBuckets[lod].instanceCount == 0)
+					continue;
+				const Mesh::Lod& meshLod = meshes[ishape]->GetLod(lod);
+				RenderQueue::Draw draw = { 0, 0, ishape, meshLod.indexCount, shapeBuckets[lod].instanceCount, meshLod.firstIndex,
+					static_cast<INT>(vertexStart), shapeBuckets[lod].firstInstance };
+				queue.Add(RenderQueue::MakeKey(RenderQueue::Pass::Opaque, draw.pipeline, draw.material, draw.mesh,
+					shapeBuckets[lod].minDepth), draw);
+			}
+			vertexStart += meshes[ishape]->GetVertexCount();
+		}
+		queue.Sort();
+	}
+
+	DrawStats RecordDraws(CommandEncoder& commandList, const DrawState& state, D3D12_GPU_VIRTUAL_ADDRESS passAddress,
+		D3D12_GPU_VIRTUAL_ADDRESS instanceAddress, const D3D12_INDEX_BUFFER_VIEW* indexBufferViews,
+		const std::vector<RenderQueue::Draw>& draws, size_t first, size_t last) {
+		DrawStats stats = {};
+		SetDrawState(commandList, state);
+		commandList.SetGraphicsRootConstantBufferView(0, passAddress);
+		commandList.SetGraphicsRootShaderResourceView(1, instanceAddress);
+		stats.instanceBufferBinds++;
+		UINT mesh = UINT_MAX;
+		for (size_t d = first; d < last; d++) {
+			const RenderQueue::Draw& item = draws[d];
+			if (item.mesh != mesh) {
+				commandList.IASetIndexBuffer(&indexBufferViews[item.mesh]);
+				mesh = item.mesh;
+				stats.indexBufferSets++;
+			}
+			commandList.SetGraphicsRoot32BitConstant(4, item.firstInstance, 0);
+			commandList.DrawIndexedInstanced(item.indexCount, item.instanceCount, item.firstIndex, item.baseVertex, 0);
+			stats.rootConstantSets++;
+			stats.draws++;
+		}
+		return stats;
+	}
+}
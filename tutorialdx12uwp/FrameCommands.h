@@ -0,0 +1,60 @@
+#pragma once
+#include "pch.h"
+#include "CommandEncoder.h"
+#include "InstanceUpdate.h"
+#include "Mesh.h"
+#include "RenderQueue.h"
+
+// The commands of a frame on the CPU culling path, recorded on any CommandEncoder: the list that clears the
+// targets, then the lists of the sorted draws. Game::Render records them on its command lists and CommandCheck.cpp
+// on a RecordingCommandEncoder alone, to compare the commands of a frame with a reference trace without a device.
+
+namespace FrameCommands {
+
+	// What every draw binds but its index buffer and instances.
+	struct DrawState {
+		D3D12_CPU_DESCRIPTOR_HANDLE renderTarget;
+		D3D12_CPU_DESCRIPTOR_HANDLE depthStencil;
+		UINT width;
+		UINT height;
+		ID3D12RootSignature* rootSignature;
+		ID3D12DescriptorHeap* descriptorHeaps[2]; // CBV/SRV/UAV, then samplers
+		D3D12_GPU_DESCRIPTOR_HANDLE textureTable; // Root parameter 2
+		D3D12_GPU_DESCRIPTOR_HANDLE samplerTable; // Root parameter 3
+		D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+	};
+
+	// Command list calls of the draws, to watch the cost of submitting them.
+	struct DrawStats {
+		UINT draws;
+		UINT instanceBufferBinds;
+		UINT rootConstantSets;
+		UINT indexBufferSets;
+
+		void Add(const DrawStats& other);
+	};
+
+	// Sets the targets, viewport, root signature, descriptor heaps and input assembler state of the draws.
+	// Direct command lists inherit none of it, so every list that draws starts here.
+	void SetDrawState(CommandEncoder& commandList, const DrawState& state);
+
+	// Start of the first list of a frame: backBuffer from present to render target, the targets cleared, the draw
+	// state and the pass constants, which passSize bytes at passAddress hold.
+	void BeginFrame(CommandEncoder& commandList, ID3D12Resource* backBuffer, const DrawState& state,
+		D3D12_GPU_VIRTUAL_ADDRESS passAddress, UINT64 passSize);
+
+	// Fills queue with one draw per LOD bucket of every shape, then sorts it (RenderQueue.h). The vertices of the
+	// meshes follow each other in the vertex buffer and every mesh has its own index buffer view, so indices start
+	// at 0 and only the vertex base moves. Every draw uses the one pipeline state and texture table, so keys differ
+	// in their mesh and the nearest instance of the bucket: the draws stay in shape order, the LODs of a shape front
+	// to back.
+	void QueueDraws(const std::vector<std::shared_ptr<Mesh>>& meshes,
+		const std::vector<std::vector<InstanceUpdate::LodBucket>>& buckets, RenderQueue& queue);
+
+	// Records draws [first, last) on a list of their own: the draw state, the pass constants and the instance
+	// buffer, shared by every draw, then per draw its index buffer view (indexBufferViews, one per mesh) when
+	// the mesh changes and the root constant with its first instance.
+	DrawStats RecordDraws(CommandEncoder& commandList, const DrawState& state, D3D12_GPU_VIRTUAL_ADDRESS passAddress,
+		D3D12_GPU_VIRTUAL_ADDRESS instanceAddress, const D3D12_INDEX_BUFFER_VIEW* indexBufferViews,
+		const std::vector<RenderQueue::Draw>& draws, size_t first, size_t last);
+}
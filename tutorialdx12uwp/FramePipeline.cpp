@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "FramePipeline.h"
+
+FramePipeline::FramePipeline(size_t slotCount, RenderFunction render) :
+	m_render(std::move(render)),
+	m_slots(std::max<size_t>(slotCount, 1), SlotState::Free),
+	m_slotFrames(m_slots.size(), 0),
+	m_queue(m_slots.size(), 0),
+	m_queueFront(0),
+	m_queueCount(0),
+	m_nextSlot(0),
+	m_frame(0),
+	m_simulationBegin(0.0),
+	m_stop(false),
+	m_start(std::chrono::steady_clock::now()),
+	m_timeline{},
+	m_timelineCount(0)
+{
+	m_thread = std::thread(&FramePipeline::renderLoop, this);
+}
+
+FramePipeline::~FramePipeline()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_changed.notify_all();
+	m_thread.join();
+}
+
+size_t FramePipeline::BeginSimulation() {
+	double begin = now();
+	size_t slot;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		slot = m_nextSlot;
+		m_changed.wait(lock, [&] { return m_slots[slot] == SlotState::Free || m_error; });
+		if (m_error) {
+			std::exception_ptr error = m_error;
+			m_error = nullptr;
+			std::rethrow_exception(error);
+		}
+		m_slots[slot] = SlotState::Simulating;
+		m_nextSlot = (slot + 1) % m_slots.size();
+		m_slotFrames[slot] = ++m_frame;
+	}
+	stamp(Stage::WaitForSlot, m_frame, begin, now());
+	m_simulationBegin = now();
+	return slot;
+}
+
+void FramePipeline::EndSimulation(size_t slot, bool render) {
+	stamp(Stage::Simulate, m_slotFrames[slot], m_simulationBegin, now());
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(m_slots[slot] == SlotState::Simulating);
+		if (render) {
+			m_slots[slot] = SlotState::Queued;
+			m_queue[(m_queueFront + m_queueCount) % m_queue.size()] = slot;
+			m_queueCount++;
+		}
+		else {
+			m_slots[slot] = SlotState::Free;
+		}
+	}
+	m_changed.notify_all();
+}
+
+void FramePipeline::Flush() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_changed.wait(lock, [&] {
+		return m_error || std::all_of(m_slots.begin(), m_slots.end(), [](SlotState state) {
+			return state == SlotState::Free || state == SlotState::Simulating;
+		});
+	});
+	if (m_error) {
+		std::exception_ptr error = m_error;
+		m_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+FramePipeline::Scope::Scope(FramePipeline& pipeline, Stage stage, UINT64 frame) :
+	m_pipeline(pipeline), m_stage(stage), m_frame(frame), m_begin(pipeline.now())
+{
+}
+
+FramePipeline::Scope::~Scope()
+{
+	m_pipeline.stamp(m_stage, m_frame, m_begin, m_pipeline.now());
+}
+
+size_t FramePipeline::CopyTimeline(Event* events, size_t capacity) const {
+	std::lock_guard<std::mutex> lock(m_timelineMutex);
+	size_t count = std::min({ m_timelineCount, c_timelineCapacity, capacity });
+	size_t first = m_timelineCount - count;
+	for (size_t e = 0; e < count; e++)
+		events[e] = m_timeline[(first + e) % c_timelineCapacity];
+	return count;
+}
+
+double FramePipeline::AverageOverlapMilliseconds() const {
+	std::vector<Event> events(c_timelineCapacity);
+	events.resize(CopyTimeline(events.data(), events.size()));
+
+	// Simulation of frame N against the recording of frame N-1.
+	double overlap = 0.0;
+	size_t pairs = 0;
+	for (const Event& simulate : events) {
+		if (simulate.stage != Stage::Simulate)
+			continue;
+		for (const Event& record : events) {
+			if (record.stage != Stage::Record || record.frame + 1 != simulate.frame)
+				continue;
+			overlap += std::max(0.0, std::min(simulate.end, record.end) - std::max(simulate.begin, record.begin));
+			pairs++;
+		}
+	}
+	return pairs > 0 ? overlap / pairs : 0.0;
+}
+
+void FramePipeline::WriteChromeTrace(const std::string& fileName) const {
+	std::vector<Event> events(c_timelineCapacity);
+	events.resize(CopyTimeline(events.data(), events.size()));
+
+	std::ofstream file(fileName, std::ios::trunc);
+	if (!file)
+		throw std::runtime_error("FramePipeline: cannot write the timeline");
+	file << "{\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Simulation\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"Render\"}}";
+	for (const Event& event : events) {
+		bool simulation = event.stage == Stage::WaitForSlot || event.stage == Stage::Simulate;
+		char name[32];
+		size_t length = 0;
+		for (const wchar_t* c = StageName(event.stage); *c != 0 && length + 1 < sizeof(name); c++)
+			name[length++] = static_cast<char>(*c);
+		name[length] = 0;
+		// Microseconds, as the format expects.
+		file << ",\n{\"name\":\"" << name << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (simulation ? 1 : 2) <<
+			",\"ts\":" << event.begin * 1000.0 << ",\"dur\":" << (event.end - event.begin) * 1000.0 <<
+			",\"args\":{\"frame\":" << event.frame << "}}";
+	}
+	file << "\n]}\n";
+}
+
+const wchar_t* FramePipeline::StageName(Stage stage) {
+	switch (stage) {
+	case Stage::WaitForSlot: return L"WaitForSlot";
+	case Stage::Simulate: return L"Simulate";
+	case Stage::Record: return L"Record";
+	case Stage::Present: return L"Present";
+	default: return L"Unknown";
+	}
+}
+
+double FramePipeline::now() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void FramePipeline::stamp(Stage stage, UINT64 frame, double begin, double end) {
+	std::lock_guard<std::mutex> lock(m_timelineMutex);
+	m_timeline[m_timelineCount % c_timelineCapacity] = Event{ frame, stage, begin, end };
+	m_timelineCount++;
+}
+
+void FramePipeline::renderLoop() {
+	for (;;) {
+		size_t slot;
+		UINT64 frame;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_changed.wait(lock, [&] { return m_queueCount > 0 || m_stop; });
+			if (m_queueCount == 0)
+				return; // Stopping, and every frame handed over is rendered
+			slot = m_queue[m_queueFront];
+			m_queueFront = (m_queueFront + 1) % m_queue.size();
+			m_queueCount--;
+			m_slots[slot] = SlotState::Rendering;
+			frame = m_slotFrames[slot];
+		}
+
+		std::exception_ptr error;
+		try {
+			Scope scope(*this, Stage::Record, frame);
+			m_render(slot, frame);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_slots[slot] = SlotState::Free;
+			if (error && !m_error)
+				m_error = error;
+		}
+		m_changed.notify_all();
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "pch.h"
+
+// Two stage frame pipeline: the calling thread simulates frame N+1 while a render thread records and submits
+// frame N. The data a frame hands from one stage to the other lives in slots, each owned by a single stage
+// at a time: the simulation takes a free slot and fills it, the render thread reads it and gives it back
+// once the frame has been submitted. The GPU memory a frame refers to is not part of its slot; it is kept
+// alive by fence values (UploadRing.h).
+// Both stages stamp their work on a timeline of the last frames, to see how much they overlap.
+
+class FramePipeline
+{
+public:
+	enum class Stage : uint8_t {
+		WaitForSlot, // Simulation thread, waiting for the render thread to give a slot back
+		Simulate,
+		Record,      // Render thread, the whole frame
+		Present,     // Render thread, Present and the wait for a free back buffer
+		Count
+	};
+
+	struct Event {
+		UINT64 frame;
+		Stage stage;
+		double begin; // Milliseconds since the pipeline started
+		double end;
+	};
+
+	// Called on the render thread for every frame handed over.
+	using RenderFunction = std::function<void(size_t slot, UINT64 frame)>;
+
+	FramePipeline(size_t slotCount, RenderFunction render);
+	// Renders the frames already handed over, then stops the render thread.
+	~FramePipeline();
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	// Waits for a free slot for the next frame; the caller owns it until EndSimulation.
+	// An exception thrown by the render thread is rethrown here.
+	size_t BeginSimulation();
+	// Hands the slot to the render thread, or gives it back unused when render is false.
+	void EndSimulation(size_t slot, bool render);
+
+	// Waits until every frame handed over has been rendered: the render thread is idle and every slot is free.
+	void Flush();
+
+	// Frame the caller is simulating, or the last one it simulated.
+	UINT64 GetFrame() const { return m_frame; }
+
+	// Stamps stage of frame on the timeline for the lifetime of the scope.
+	class Scope {
+	public:
+		Scope(FramePipeline& pipeline, Stage stage, UINT64 frame);
+		~Scope();
+	private:
+		FramePipeline& m_pipeline;
+		Stage m_stage;
+		UINT64 m_frame;
+		double m_begin;
+	};
+
+	// Copies the timeline, oldest event first; returns the number of events.
+	size_t CopyTimeline(Event* events, size_t capacity) const;
+	// Average time the simulation of a frame ran while the previous one was being recorded, over the timeline.
+	double AverageOverlapMilliseconds() const;
+	// The timeline in the Trace Event Format of chrome://tracing and Perfetto, one track per thread.
+	void WriteChromeTrace(const std::string& fileName) const;
+
+	static const wchar_t* StageName(Stage stage);
+
+	static const size_t c_timelineCapacity = 1024;
+
+private:
+	enum class SlotState : uint8_t { Free, Simulating, Queued, Rendering };
+
+	double now() const;
+	void stamp(Stage stage, UINT64 frame, double begin, double end);
+	void renderLoop();
+
+	RenderFunction m_render;
+	std::vector<SlotState> m_slots;
+	std::vector<UINT64> m_slotFrames;
+	// Slots handed over, in order; fixed ring of m_slots.size() entries, so frames do not allocate.
+	std::vector<size_t> m_queue;
+	size_t m_queueFront;
+	size_t m_queueCount;
+	size_t m_nextSlot;
+	UINT64 m_frame;
+	double m_simulationBegin; // Of the frame being simulated
+	bool m_stop;
+	std::exception_ptr m_error;
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+	std::thread m_thread;
+
+	std::chrono::steady_clock::time_point m_start;
+	mutable std::mutex m_timelineMutex;
+	Event m_timeline[c_timelineCapacity];
+	size_t m_timelineCount; // Events stamped since the start; the last c_timelineCapacity are kept
+};
@@ -0,0 +1,50 @@
+#include "pch.h"
+#include "FrameUpdate.h"
+#include "VertexPacking.h"
+
+namespace FrameUpdate {
+
+	InstanceUpdate::Frame MakeFrame(FXMMATRIX model, CXMMATRIX view, CXMMATRIX projection, float fovY, float viewportHeight,
+		float lodPixelError) {
+		InstanceUpdate::Frame frame;
+		frame.frustum = Culling::ViewFrustum(projection);
+		// LOD selection: the coarsest level whose error projects to less than lodPixelError pixels.
+		frame.pixelsPerUnit = viewportHeight / (2.0f * std::tan(0.5f * fovY)); // At depth 1
+		frame.lodPixelError = lodPixelError;
+		frame.model = model;
+		frame.view = view;
+		frame.projection = projection;
+		return frame;
+	}
+
+	UploadRing::Allocation WriteInstances(JobSystem& jobs, const std::vector<std::shared_ptr<Mesh>>& meshes,
+		const InstanceStore& instances, const InstanceUpdate::Frame& frame, bool packedVertices, UploadRing& ring,
+		std::vector<std::vector<InstanceUpdate::LodBucket>>& buckets, InstanceUpdate::Scratch& scratch, Culling::Stats& stats) {
+		buckets.resize(instances.GetShapeCount());
+
+		// Room for every instance of every shape; what culling leaves unused goes back to the ring.
+		UploadRing::Allocation allocation = ring.Allocate(instances.Size() * sizeof(Instance), c_instanceAlignment);
+		Instance* written = reinterpret_cast<Instance*>(allocation.cpuAddress);
+		size_t instanceCount = 0;
+
+		for (UINT i = 0; i < instances.GetShapeCount(); i++) {
+			size_t first = instances.ShapeFirst(i);
+			size_t count = instances.ShapeCount(i);
+			buckets[i].clear();
+			if (count == 0)
+				continue;
+			XMMATRIX dequantize = packedVertices ? VertexPacking::DequantizeMatrix(meshes[i]->GetBoundingBox()) : XMMatrixIdentity();
+			InstanceUpdate::Input input = { instances.Worlds() + first, instances.Kinds() + first, instances.Materials() + first, count,
+				sizeof(XMFLOAT4X4), sizeof(TransformBatch::TransformKind), sizeof(UINT) };
+			Instance* shapeInstances = written + instanceCount;
+			InstanceUpdate::Output output = { &shapeInstances[0].transform, &shapeInstances[0].normalTransform, &shapeInstances[0].material, sizeof(Instance) };
+			size_t visible = InstanceUpdate::Run(jobs, *meshes[i], frame, dequantize, input, output, buckets[i], scratch, stats);
+			// Buckets count from the start of the shared buffer.
+			for (InstanceUpdate::LodBucket& bucket : buckets[i])
+				bucket.firstInstance += static_cast<UINT>(instanceCount);
+			instanceCount += visible;
+		}
+		ring.ShrinkLast(allocation, instanceCount * sizeof(Instance));
+		return allocation;
+	}
+}
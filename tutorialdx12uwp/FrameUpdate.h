@@ -0,0 +1,37 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+#include "InstanceUpdate.h"
+#include "InstanceStore.h"
+#include "UploadRing.h"
+
+// The part of a frame's CPU work that needs no device or window: frustum and LOD parameters of the camera,
+// then culling, LOD selection and the transforms of every instance, written straight into the upload ring.
+// Game::Update runs it on the D3D12 upload backend and Benchmark::HeadlessFrames on the null one
+// (UploadBackend.h), so the same code is timed with and without a GPU.
+
+namespace FrameUpdate {
+
+	// Layout of InstanceData in Header.hlsli.
+	struct Instance {
+		XMFLOAT4X4 transform;
+		XMFLOAT4X4 normalTransform;
+		UINT material;
+		UINT pad[3];
+	};
+
+	static const UINT64 c_instanceAlignment = 16; // D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT, for a structured buffer root SRV
+
+	// Frustum and LOD selection of a camera: fovY is vertical, viewportHeight in pixels and lodPixelError the
+	// largest LOD error on screen, in pixels.
+	InstanceUpdate::Frame MakeFrame(FXMMATRIX model, CXMMATRIX view, CXMMATRIX projection, float fovY, float viewportHeight,
+		float lodPixelError);
+
+	// Writes the visible instances of every shape in one allocation of ring, the shapes one after the other.
+	// buckets gets one entry per shape, its LOD buckets counting from the start of the allocation.
+	// packedVertices: meshes store positions relative to their bounding box (VertexPacking.h).
+	// Returns the allocation, shrunk to the instances written.
+	UploadRing::Allocation WriteInstances(JobSystem& jobs, const std::vector<std::shared_ptr<Mesh>>& meshes,
+		const InstanceStore& instances, const InstanceUpdate::Frame& frame, bool packedVertices, UploadRing& ring,
+		std::vector<std::vector<InstanceUpdate::LodBucket>>& buckets, InstanceUpdate::Scratch& scratch, Culling::Stats& stats);
+}
@@ -5,6 +5,11 @@
 #include "pch.h"
 #include "Game.h"
 #include "GameGeo.h"
+#include "Benchmark.h"
+#include "AssetLoader.h"
+#include "AllocationCounter.h"
+#include "GpuCullingCheck.h"
+#include "D3D12UploadBackend.h"
 
 extern void ExitGame();
 
@@ -23,32 +28,56 @@ Game::Game() noexcept :
     m_backBufferIndex(0),
     m_rtvDescriptorSize(0),
     m_fenceValues{},
+    m_lastFenceValue(0),
+    m_deviceLost(false),
     m_score(0)
 {
 }
 
+Game::~Game()
+{
+    // The render thread finishes the frames handed to it, then the GPU finishes them.
+    m_pipeline.reset();
+    if (m_fence)
+        WaitForGpu();
+}
+
 void Game::LoadMeshes() {
     m_NumberOfMeshes = GameStatics::ObjFileNames.size();
-    assert(m_NumberOfMeshes <= c_NumberOfObjects);
     m_meshes.resize(m_NumberOfMeshes);
-    m_objects.resize(m_NumberOfMeshes);
+    m_instances.Clear(m_NumberOfMeshes);
 
+    // Meshes are parsed and welded in parallel; m_meshes keeps the ShapeName order.
+    std::vector<std::string> fileNames(m_NumberOfMeshes);
     for (auto it = GameStatics::ObjFileNames.begin(); it != GameStatics::ObjFileNames.end();it++) {
-        const std::string fileName = it->second;
-        //std::shared_ptr<Mesh> ptrMesh = std::make_shared<Mesh>(); //Mesh constructor with std::string parameter tries to load the file
-        std::shared_ptr<Mesh> ptrMesh = std::make_shared<Mesh>(fileName); //Mesh constructor with std::string parameter tries to load the file
-        m_meshes[static_cast<unsigned int>(it->first)]=ptrMesh;
-     }
+        fileNames[static_cast<unsigned int>(it->first)] = it->second;
+    }
+    // m_jobs has nothing else to run before the first Update.
+    m_meshes = AssetLoader::LoadMeshes(fileNames, *m_jobs);
+
+#ifdef _BENCHMARK
+    for (auto it = GameStatics::ObjFileNames.begin(); it != GameStatics::ObjFileNames.end(); it++)
+        Benchmark::MeshLoad(it->second, 10);
+    Benchmark::LargeMeshLoad(1024, 3);
+    Benchmark::ObjWeld(1024);
+    Benchmark::LoadMeshes(fileNames);
+    Benchmark::VertexPacking(m_meshes, 10);
+    Benchmark::Culling(*m_meshes[0], 100000, 10);
+    Benchmark::InstanceTransforms(100000, 10);
+    Benchmark::JobScaling(*m_meshes[0], 1000000, 10);
+    Benchmark::InstanceLayout(100000, m_NumberOfMeshes, 10);
+    Benchmark::InstanceScaling(m_meshes[0], 1000000, 10);
+    Benchmark::HeadlessFrames(m_meshes, 100000, 600, c_swapBufferCount);
+    Benchmark::DrawSorting(100000, 20);
+    Benchmark::SoftwareRendering(m_meshes, winrt::to_string(GameStatics::TexFileNames.begin()->second), 10000, 1280, 720, 10);
+#endif
 }
 
 
 void Game::InitializeObjects(const std::vector<int> &ninstances, const std::vector<int> &matIndex, const float r, const float minDistance, const float maxDistance) {
-    assert(m_NumberOfMeshes <= c_NumberOfObjects);
-    
     if (matIndex.size() != ninstances.size())
         return;
-    m_objects.clear();
-    m_objects.resize(m_NumberOfMeshes);
+    m_instances.Clear(m_NumberOfMeshes);
     
     XMMATRIX projection =XMLoadFloat4x4(&m_projection);
     XMMATRIX view = XMLoadFloat4x4(&m_view);
@@ -59,21 +88,17 @@ void Game::InitializeObjects(const std::vector<int> &ninstances, const std::vect
         else
             ninst = 0;
         
-        assert(ninst <= c_NumberOfInstancesPerObject);
-        
-        m_objects[i].clear();
-        m_objects[i].resize(ninst);
         for (int j = 0; j < ninst;j++) {
             
             
-            ObjectData &objectData=m_objects[i][j];
-            objectData.isInstanced = true;
-            objectData.matind = matIndex[i];
-
             XMMATRIX tMat = Geo::GetRandomPointInsideFrustum(projection, view, r, minDistance, maxDistance);
             XMMATRIX rMat = Geo::GetRandomRotationMatrix();
-            XMMATRIX world = rMat * tMat;
-            XMStoreFloat4x4(&objectData.matrixWorld,world);
+            XMFLOAT3 position;
+            XMFLOAT4 rotation;
+            XMStoreFloat3(&position, tMat.r[3]);
+            XMStoreFloat4(&rotation, XMQuaternionRotationMatrix(rMat));
+            // Rotation and translation only: the store marks it Rigid (InstanceStore.h).
+            m_instances.Add(i, position, rotation, XMFLOAT3(1.0f, 1.0f, 1.0f), matIndex[i]);
             
         }
 
@@ -82,6 +107,13 @@ void Game::InitializeObjects(const std::vector<int> &ninstances, const std::vect
 }
 void Game::Initialize(::IUnknown* window, int width, int height, DXGI_MODE_ROTATION rotation)
 {
+    // Worker threads for Update; the thread calling Update is one more and the render thread another one.
+    m_jobs = std::make_unique<JobSystem>(std::max(AssetLoader::DefaultThreadCount(), 2u) - 2);
+    // The render thread records draws with its own workers: m_jobs is busy with the next frame meanwhile.
+    m_recordJobs = std::make_unique<JobSystem>(std::min(c_recordThreads, AssetLoader::DefaultThreadCount()) - 1);
+    m_listDrawStats.resize(m_recordJobs->ThreadCount());
+    m_listStateCounters.resize(m_recordJobs->ThreadCount());
+
     // Load Assets
     LoadMeshes();
    
@@ -129,6 +161,26 @@ void Game::Initialize(::IUnknown* window, int width, int height, DXGI_MODE_ROTAT
 
     PSO(); // Creamos un estado del pipeline bsico.
 
+#ifdef _BENCHMARK
+    Benchmark::CommandRecording(m_d3dDevice.Get(), m_rootSignature.Get(), m_pso.Get(), m_vBufferView, m_iBufferViews[0],
+        m_meshes[0]->GetLod(0).indexCount, 10000, 20);
+#endif
+
+    // Root parameter 4 is the gInstanceBase root constant the indirect draws set (CreateMainInputFlowResources).
+    if (c_gpuCulling)
+        m_gpuCuller.Create(m_d3dDevice.Get(), m_rootSignature.Get(), 4);
+#ifdef _VALIDATE_GPU_CULLING
+    // The culling pass must agree with its CPU reference; the queue is idle here (GpuCullingCheck.h).
+    bool gpuCullingMatches = GpuCullingCheck::Run(m_d3dDevice.Get(), m_commandQueue.Get(), m_rootSignature.Get(), 4);
+    assert(gpuCullingMatches);
+#endif
+
+    // From here on Render runs on its own thread, one frame behind Update (see Tick).
+    m_pipeline = std::make_unique<FramePipeline>(c_frameSlots, [this](size_t slot, UINT64 frame) {
+        AllocationCounter::IgnoreCurrentThread(); // Tick only checks Update
+        Render(m_frames[slot], frame);
+    });
+
    
 
 
@@ -139,16 +191,52 @@ void Game::Initialize(::IUnknown* window, int width, int height, DXGI_MODE_ROTAT
 // Executes the basic game loop.
 void Game::Tick()
 {
+    // Present finds device removal on the render thread; the device is rebuilt here, with the pipeline idle.
+    if (m_deviceLost) {
+        m_pipeline->Flush();
+        m_deviceLost = false;
+        OnDeviceLost();
+    }
+
+    // Update fills a free frame slot while the render thread records and submits the previous frame.
+    // A tick without Update (fixed time step) hands nothing over, so nothing is rendered before the first Update.
+    size_t slot = m_pipeline->BeginSimulation();
+    bool updated = false;
     m_timer.Tick([&]()
     {
-        Update(m_timer);
+#ifdef _COUNT_ALLOCATIONS
+        size_t allocations = AllocationCounter::Count();
+#endif
+        Update(m_timer, m_frames[slot]);
+        updated = true;
+#ifdef _COUNT_ALLOCATIONS
+        // Once every frame resource has been used, Update must not touch the heap.
+        allocations = AllocationCounter::Count() - allocations;
+        if (allocations > 0 && m_timer.GetFrameCount() > c_allocationWarmupFrames) {
+            wchar_t msgbuff[100];
+            swprintf_s(msgbuff, 100, L"Update made %zu heap allocations in frame %u\n", allocations, m_timer.GetFrameCount());
+            MYTRACE(msgbuff);
+            assert(allocations == 0);
+        }
+#endif
     });
-
-    Render();
+    m_pipeline->EndSimulation(slot, updated);
+
+#ifdef _TRACE_FRAME_TIMELINE
+    if (m_pipeline->GetFrame() == c_timelineTraceFrame) {
+        m_pipeline->Flush();
+        wchar_t msgbuff[100];
+        swprintf_s(msgbuff, 100, L"Frame timeline: Update overlapped the previous Render by %.3f ms on average\n",
+            m_pipeline->AverageOverlapMilliseconds());
+        MYTRACE(msgbuff);
+        m_pipeline->WriteChromeTrace(winrt::to_string(
+            winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path()) + "\\frame_timeline.json");
+    }
+#endif
 }
 
 
-void Game::Update(DX::StepTimer const& timer)
+void Game::Update(DX::StepTimer const& timer, FrameResources& resources)
 {
     float elapsedTime = float(timer.GetElapsedSeconds());
 
@@ -172,7 +260,8 @@ void Game::Update(DX::StepTimer const& timer)
     //XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
     //XMMATRIX view = XMMatrixLookAtLH(location, target, up);
     float r = static_cast<float>(m_outputWidth / m_outputHeight);
-    XMMATRIX projection = XMMatrixPerspectiveFovLH(0.25 * XM_PI, r, 0.5f, 1000.0f);
+    float fovY = 0.25f * XM_PI;
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(fovY, r, 0.5f, 1000.0f);
     XMStoreFloat4x4(&m_view, view);
 
     static float delta = 0.0;
@@ -181,76 +270,47 @@ void Game::Update(DX::StepTimer const& timer)
 
     // Update data to be uploaded:
 
-    // First, update of pass constants
+    // Space of the frames the GPU has finished goes back to the ring (UploadRing.h). Frames are submitted in
+    // the order they are simulated, so the fence value the render thread signals after this one is known now.
+    m_uploadRing.BeginFrame(m_fence->GetCompletedValue());
+    resources.fenceValue = ++m_lastFenceValue;
+
+    // First, pass constants.
+    UploadRing::Allocation passAllocation = m_uploadRing.Allocate(CalcConstantBufferByteSize(sizeof(vConstants)),
+        D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
     XMFLOAT4X4 passTransform;
     XMStoreFloat4x4(&passTransform, XMMatrixIdentity());
-
-    // Second, update of per object constants
-    m_vInstances[m_backBufferIndex].clear();
-    m_vInstances[m_backBufferIndex].resize(m_objects.size());
-
-    for (int i = 0; i < m_objects.size();i++) {
-        std::vector objInstances = m_objects[i];
-        m_vInstances[m_backBufferIndex][i].clear();
-        m_vInstances[m_backBufferIndex][i].resize(objInstances.size());
-        int count = 0;
-        for (auto &obj : objInstances) {
-            XMMATRIX world = XMLoadFloat4x4(&obj.matrixWorld);
-            XMMATRIX rotation = XMMatrixRotationX(delta);
-            XMMATRIX translation = XMMatrixTranslation(0.0, 0.0, 0.0);
-            world = rotation * translation*world;
-
-
-            XMMATRIX worldview = world * view;
-            XMFLOAT4X4 wv;
-            XMStoreFloat4x4(&wv, worldview);
-            float x = wv._41;
-            float y = wv._42;
-            float z = wv._43;
-
-            //float d = x * x + y * y + z * z;
-
-
-            XMMATRIX transform = worldview * projection;
-            XMMATRIX normaltransform = XMMatrixTranspose(XMMatrixInverse(nullptr, worldview));
-            XMStoreFloat4x4(&m_vInstances[m_backBufferIndex][i][count].NormalTransform, XMMatrixTranspose(normaltransform));
-            XMStoreFloat4x4(&m_vInstances[m_backBufferIndex][i][count].Transform, XMMatrixTranspose(transform));
-            m_vInstances[m_backBufferIndex][i][count].MaterialIndex = obj.matind;
-            count++;
-         
-        }
-        
+    memcpy(passAllocation.cpuAddress, &passTransform, sizeof(passTransform));
+    resources.passAddress = passAllocation.gpuAddress;
+    resources.passSize = passAllocation.size;
+
+    // Only instances inside the view frustum are written; the visible instances of each shape follow the previous shape.
+    // Culling, LOD selection and transforms run over m_jobs and are complete before Render (InstanceUpdate.h).
+    // With c_gpuCulling every instance is written and the compute pass of Render culls them (UpdateGpuCulling).
+    // The spin is the same for every instance, so it is built once and applied in the batch (TransformBatch.h).
+    XMMATRIX rotation = XMMatrixRotationX(delta);
+    XMMATRIX translation = XMMatrixTranslation(0.0, 0.0, 0.0);
+    InstanceUpdate::Frame frame = FrameUpdate::MakeFrame(rotation * translation, view, projection, fovY,
+        static_cast<float>(m_outputHeight), c_lodPixelError);
+    resources.cullStats = {};
+
+    if (c_gpuCulling) {
+        UpdateGpuCulling(frame, resources);
+        resources.instances = nullptr;
     }
-
-    // upload de las constantes
-    BYTE* data;
-
-    // First, upload of pass constants.
-    m_vConstantBuffer[m_backBufferIndex]->Map(0, nullptr, reinterpret_cast<void**>(&data)); // realizamos el mapeo
-    //auto elementSizeConstants= CalcConstantBufferByteSize(sizeof(vConstants));
-    
-    memcpy(data, reinterpret_cast<const void*>(&passTransform), sizeof(vConstants));
-    if (m_vConstantBuffer[m_backBufferIndex] != nullptr)
-        m_vConstantBuffer[m_backBufferIndex]->Unmap(0, nullptr);
-
-    // upload del buffer estructurado
-    size_t elementSizeInstance = sizeof(vInstance);
-    for(int i=0;i<m_objects.size();i++){
-        size_t numberOfInstances = m_objects[i].size();
-        if (numberOfInstances > 0) {
-            m_vInstanceBuffer[m_backBufferIndex][i]->Map(0, nullptr, reinterpret_cast<void**>(&data)); // realizamos el mapeo
-            //memcpy(&data[i * c_NumberOfInstancesPerObject * elementSizeInstance], reinterpret_cast<const void*>(m_vInstances[m_backBufferIndex][i].data()), numberOfInstances*elementSizeInstance); //Copia de la transformacin
-            memcpy(data, reinterpret_cast<const void*>(&m_vInstances[m_backBufferIndex][i][0]), numberOfInstances * elementSizeInstance); //Copia de la transformacin
-            if (m_vInstanceBuffer[m_backBufferIndex][i] != nullptr)
-                m_vInstanceBuffer[m_backBufferIndex][i]->Unmap(0, nullptr);
-        }
-       
+    else {
+        // Second, update of per object constants (FrameUpdate.h)
+        UploadRing::Allocation instanceAllocation = FrameUpdate::WriteInstances(*m_jobs, m_meshes, m_instances, frame,
+            c_packedVertices, m_uploadRing, resources.lodBuckets, m_instanceScratch, resources.cullStats);
+        resources.instanceAddress = instanceAllocation.gpuAddress;
+        resources.instances = reinterpret_cast<const FrameUpdate::Instance*>(instanceAllocation.cpuAddress);
+        resources.instanceSize = instanceAllocation.size;
     }
-    
-
-    
-    
 
+    // The space stays in use until the GPU passes the fence MoveToNextFrame signals after this frame.
+    m_uploadRing.EndFrame(resources.fenceValue);
+    resources.uploadStats = m_uploadRing.FrameStats();
+    resources.uploadRingSize = m_uploadRing.GetSize();
 
     elapsedTime;
 }
@@ -266,107 +326,316 @@ XMMATRIX Game::UpdateView() {
 
 }
 
-void Game::Render()
-{
-    // Don't try to render anything before the first Update.
-    if (m_timer.GetFrameCount() == 0)
-    {
-        return;
-    }
-
-    // Prepare the command list to render a new frame.
-    Clear();
-
-    // TODO: Add your rendering code here.
-    // First, we re-connect root parameters for the currente m_backBufferIndex.
-    CD3DX12_GPU_DESCRIPTOR_HANDLE cHandle(m_cDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-    cHandle.Offset(2*m_backBufferIndex , m_cDescriptorSize);
-    m_commandList->SetGraphicsRootDescriptorTable(0, // nmero de root parameter
-            cHandle); //manejador a la posicin del heap donde comenzara el rango de descriptores
-    cHandle.Offset(1, m_cDescriptorSize);
-    m_commandList->SetGraphicsRootDescriptorTable(1, // nmero de root parameter
-        cHandle);
-
-    D3D12_VERTEX_BUFFER_VIEW vView[1] = { m_vBufferView };
-    D3D12_INDEX_BUFFER_VIEW iView[1] = { m_iBufferView };
-    m_commandList->IASetVertexBuffers(0, 1, vView);
-    m_commandList->IASetIndexBuffer(iView);
-    //--------------------------------------------------------------------------------------
-    // Now Draw IndexedInstanced Data
-    UINT indexStart = 0;
+void Game::UpdateGpuCulling(const InstanceUpdate::Frame& frame, FrameResources& resources) {
+    GpuCullingFrame& cull = resources.gpuCulling;
+
+    UINT shapeCount = static_cast<UINT>(m_instances.GetShapeCount());
+    UINT commandCount = 0;
+    for (UINT i = 0; i < shapeCount; i++)
+        commandCount += static_cast<UINT>(m_meshes[i]->GetLodCount());
+
+    cull.instances = m_uploadRing.Allocate(m_instances.Size() * sizeof(GpuCulling::CullInstance), D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+    cull.shapes = m_uploadRing.Allocate(shapeCount * sizeof(GpuCulling::CullShape), D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+    cull.commands = m_uploadRing.Allocate(commandCount * sizeof(GpuCulling::DrawCommand), D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+    cull.commandCount = commandCount;
+    GpuCulling::CullInstance* instances = reinterpret_cast<GpuCulling::CullInstance*>(cull.instances.cpuAddress);
+    GpuCulling::CullShape* shapes = reinterpret_cast<GpuCulling::CullShape*>(cull.shapes.cpuAddress);
+    GpuCulling::DrawCommand* commands = reinterpret_cast<GpuCulling::DrawCommand*>(cull.commands.cpuAddress);
+
+    // One draw per shape and LOD. Every draw has a region of the output for all the instances of its shape,
+    // so the pass can append to it without running out of room.
+    UINT command = 0;
+    UINT outputCount = 0;
     UINT vertexStart = 0;
+    for (UINT i = 0; i < shapeCount; i++) {
+        size_t first = m_instances.ShapeFirst(i);
+        size_t count = m_instances.ShapeCount(i);
+        shapes[i] = GpuCulling::MakeShape(*m_meshes[i], command);
+        for (UINT lod = 0; lod < m_meshes[i]->GetLodCount(); lod++) {
+            const Mesh::Lod& meshLod = m_meshes[i]->GetLod(lod);
+            GpuCulling::DrawCommand draw = {};
+            draw.indexBuffer = m_iBufferViews[i];
+            draw.firstInstance = outputCount;
+            draw.draw.IndexCountPerInstance = meshLod.indexCount;
+            draw.draw.StartIndexLocation = meshLod.firstIndex;
+            draw.draw.BaseVertexLocation = vertexStart;
+            commands[command++] = draw;
+            outputCount += static_cast<UINT>(count);
+        }
+        vertexStart += m_meshes[i]->GetVertexCount();
+        if (count == 0)
+            continue;
 
-    UINT startInDescriptorHeap = static_cast<UINT>((1 + c_NumberOfObjects) * m_backBufferIndex);
-    CD3DX12_GPU_DESCRIPTOR_HANDLE cbHandle(m_cDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-    cbHandle.Offset(startInDescriptorHeap, m_cDescriptorSize);
-    m_commandList->SetGraphicsRootDescriptorTable(0, // para pass constant
-        cbHandle);
+        // Packed meshes store positions relative to their bounding box (VertexPacking.h).
+        XMMATRIX dequantize = c_packedVertices ? VertexPacking::DequantizeMatrix(m_meshes[i]->GetBoundingBox()) : XMMatrixIdentity();
+        InstanceUpdate::Input input = { m_instances.Worlds() + first, m_instances.Kinds() + first, m_instances.Materials() + first, count,
+            sizeof(XMFLOAT4X4), sizeof(TransformBatch::TransformKind), sizeof(UINT) };
+        GpuCulling::WriteInstances(*m_jobs, frame, dequantize, input, i, static_cast<UINT>(first), instances + first, m_instanceScratch);
+    }
 
-    for (int ishape = 0; ishape < m_meshes.size();ishape++) {
-        UINT numberOfIndex = static_cast<UINT>(m_meshes[ishape]->indices.size());
-        UINT numberOfInstances = static_cast<UINT>(m_objects[ishape].size());
-        UINT numberOfVertices = static_cast<UINT>(m_meshes[ishape]->vertices.size());
-        if (m_objects[ishape].size() > 0) { // If there are instances
+    cull.constants = GpuCulling::MakeConstants(frame.projection, static_cast<UINT>(m_instances.Size()), frame.pixelsPerUnit, frame.lodPixelError);
+    cull.outputCount = outputCount; // The culler's buffers belong to the render thread, which makes room
 
+    // The visible count stays on the GPU: every instance is a candidate.
+    resources.cullStats.tested = m_instances.Size();
+    resources.cullStats.visible = m_instances.Size();
+}
 
-            CD3DX12_GPU_DESCRIPTOR_HANDLE saHandle(m_cDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-            saHandle.Offset(startInDescriptorHeap + 1 + ishape, m_cDescriptorSize);
-            m_commandList->SetGraphicsRootDescriptorTable(1, // para instance constant
-                saHandle);
+void Game::Render(const FrameResources& resources, UINT64 frame)
+{
+    // Only frames Update has filled get here (see Tick).
+
+    // Commands go through encoders (see ListEncoders): redundant state changes are dropped, and on the capture
+    // frame the commands are recorded on their way to the list.
+    bool capture = false;
+#ifdef _CAPTURE_COMMANDS
+    capture = frame == c_captureFrame;
+    if (capture)
+        m_captureTraces.assign(1 + m_listDrawStats.size(), CommandTrace::Trace());
+#endif
+    ListEncoders mainEncoders(m_commandList.Get(), m_pso.Get(), c_filterRedundantState,
+        capture ? &m_captureTraces[0] : nullptr, &m_captureObjects);
+    CommandEncoder* encoder = mainEncoders.encoder;
 
-            //TODO: reconexin de las texturas por objeto
+    // Prepare the command list to render a new frame.
+    // Pass constants and instances of this frame live in the upload ring (see Update); all the shapes share
+    // the instance buffer and every draw only changes the root constant with its first instance.
+    m_recorder.BeginFrame(m_fence->GetCompletedValue());
+    Clear(*encoder, resources);
 
-            if (m_objects[ishape].size() > 0) {
-                m_commandList->DrawIndexedInstanced(numberOfIndex, 
-                    numberOfInstances, indexStart, vertexStart, 0);
-            }
+    // TODO: Add your rendering code here.
 
-        }
-        
-        indexStart += numberOfIndex ;
-        vertexStart += numberOfVertices;
-    
-    
+    //--------------------------------------------------------------------------------------
+    // Now Draw IndexedInstanced Data
+    m_drawStats = {};
+    m_renderQueue.Clear();
+    if (c_gpuCulling) {
+        // The compute pass fills the draws and their instances (see UpdateGpuCulling); it changes the pipeline
+        // state, and the draw commands set the index buffer and the first instance themselves.
+        const GpuCullingFrame& cull = resources.gpuCulling;
+        m_gpuCuller.ReleaseRetired(m_fence->GetCompletedValue());
+        m_gpuCuller.Reserve(cull.outputCount, cull.commandCount, resources.fenceValue);
+        m_gpuCuller.Record(*encoder, cull.constants, cull.instances, cull.shapes, cull.commands, cull.commandCount);
+        encoder->SetPipelineState(m_pso.Get());
+        encoder->SetGraphicsRootShaderResourceView(1, m_gpuCuller.OutputAddress());
+        m_drawStats.instanceBufferBinds++;
+        m_gpuCuller.ExecuteDraws(*encoder, cull.commandCount);
+        m_drawStats.draws = cull.commandCount;
+    }
+    else {
+        // The draws of every shape and LOD bucket (see Update) go through the render queue, which sorts them by
+        // state and merges neighbours (FrameCommands.h), then are recorded in contiguous ranges on the threads of
+        // m_recordJobs, one command list per range (CommandRecorder.h).
+        FrameCommands::QueueDraws(m_meshes, resources.lodBuckets, m_renderQueue);
+        const std::vector<RenderQueue::Draw>& draws = m_renderQueue.GetDraws();
+#ifdef _SOFTWARE_REFERENCE
+        if (frame == c_referenceFrame)
+            RenderSoftwareReference(resources);
+#endif
+
+        encoder->Upload(resources.instanceAddress, resources.instanceSize);
+        FrameCommands::DrawState drawState = GetDrawState();
+        m_recorder.Record(*m_recordJobs, draws.size(), c_minDrawsPerList, m_pso.Get(),
+            [&](ID3D12GraphicsCommandList* commandList, UINT list, size_t first, size_t last) {
+            AllocationCounter::IgnoreCurrentThread(); // Recording threads run alongside Update too
+            ListEncoders listEncoders(commandList, m_pso.Get(), c_filterRedundantState,
+                capture ? &m_captureTraces[1 + list] : nullptr, &m_captureObjects);
+            m_listDrawStats[list] = FrameCommands::RecordDraws(*listEncoders.encoder, drawState, resources.passAddress,
+                resources.instanceAddress, m_iBufferViews.data(), draws, first, last);
+            m_listStateCounters[list] = listEncoders.stateCache.GetCounters();
+        });
+        for (UINT list = 0; list < m_recorder.GetListCount(); list++)
+            m_drawStats.Add(m_listDrawStats[list]);
     }
 
     // Transition the render target to the state that allows it to be presented to the display.
     //D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_backBufferIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
     //m_commandList->ResourceBarrier(1, &barrier);
     // Send the command list off to the GPU for processing.
+    // The lists of the draws follow the one that cleared the targets, in a single submission.
+    m_stateCounters = mainEncoders.stateCache.GetCounters();
+    for (UINT list = 0; list < m_recorder.GetListCount(); list++)
+        m_stateCounters.Add(m_listStateCounters[list]);
     DX::ThrowIfFailed(m_commandList->Close());
-    m_commandQueue->ExecuteCommandLists(1, CommandListCast(m_commandList.GetAddressOf()));
+    m_recorder.Submit(m_commandQueue.Get(), m_commandList.Get(), resources.fenceValue);
+#ifdef _CAPTURE_COMMANDS
+    if (capture) {
+        m_captureTraces.resize(1 + m_recorder.GetListCount());
+        ReportCommandCapture();
+    }
+#endif
     // Now RenderUI
-    RenderUI();
+    RenderUI(resources);
     m_d3d11DeviceContext->Flush(); // comming back to d3d12 requires flush
     
      // Show the new frame.
      
    
-    Present();
+    FramePipeline::Scope presentScope(*m_pipeline, FramePipeline::Stage::Present, frame);
+    Present(resources.fenceValue);
 }
+
+Game::ListEncoders::ListEncoders(ID3D12GraphicsCommandList* commandList, ID3D12PipelineState* initialState, bool filterState,
+    CommandTrace::Trace* captureTrace, CommandTrace::ObjectTable* captureObjects) :
+    direct(commandList),
+    capture(captureTrace != nullptr ? std::make_unique<CommandTrace::RecordingCommandEncoder>(*captureTrace, captureObjects, &direct) : nullptr),
+    stateCache(capture ? static_cast<CommandEncoder&>(*capture) : direct, initialState)
+{
+    CommandEncoder* list = capture ? static_cast<CommandEncoder*>(capture.get()) : &direct;
+    encoder = filterState ? &stateCache : list;
+}
+
+#ifdef _CAPTURE_COMMANDS
+// Writes the commands of the capture frame to the local folder and reports their counts, and the first command
+// that differs from the reference capture when there is one. Addresses and descriptor handles are left out of the
+// comparison, they change from run to run. Rename a capture to frame_commands_reference.bin to make it the reference.
+void Game::ReportCommandCapture()
+{
+    CommandTrace::Trace trace;
+    for (const CommandTrace::Trace& list : m_captureTraces)
+        trace.insert(trace.end(), list.begin(), list.end());
+
+    // Replaying a list into a recorder gives the same bytes back, or the trace lost something on the way.
+    bool replayed = true;
+    for (const CommandTrace::Trace& list : m_captureTraces) {
+        CommandTrace::Trace replay;
+        CommandTrace::RecordingCommandEncoder recorder(replay, &m_captureObjects);
+        CommandTrace::Replay(list, recorder, &m_captureObjects);
+        replayed = replayed && replay == list;
+    }
+
+    CommandTrace::Stats stats = CommandTrace::Analyze(trace);
+    wchar_t msgbuff[200];
+    swprintf_s(msgbuff, 200, L"Command capture: %zu lists, %zu commands in %zu bytes, %zu draws, %zu redundant state sets, replay %s\n",
+        stats.lists, stats.commands, stats.bytes, stats.draws, stats.redundant, replayed ? L"matches" : L"DIFFERS");
+    MYTRACE(msgbuff);
+    for (size_t op = 0; op < CommandTrace::c_opCount; op++) {
+        if (stats.perOp[op] == 0)
+            continue;
+        swprintf_s(msgbuff, 200, L"  %hs: %zu, %zu redundant\n", CommandTrace::OpName(static_cast<CommandTrace::Op>(op)),
+            stats.perOp[op], stats.redundantPerOp[op]);
+        MYTRACE(msgbuff);
+    }
+    // The state filter sits before the capture: what it dropped never shows as redundant above.
+    swprintf_s(msgbuff, 200, L"State filter: %u of %u calls dropped\n", m_stateCounters.filtered, m_stateCounters.calls);
+    MYTRACE(msgbuff);
+    for (size_t state = 0; state < StateCachingCommandEncoder::c_stateCount; state++) {
+        swprintf_s(msgbuff, 200, L"  %s: %u of %u\n", StateCachingCommandEncoder::StateName(static_cast<StateCachingCommandEncoder::State>(state)),
+            m_stateCounters.filteredStateCalls[state], m_stateCounters.stateCalls[state]);
+        MYTRACE(msgbuff);
+    }
+
+    std::string folder = winrt::to_string(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+    if (!CommandTrace::Write(folder + "\\frame_commands.bin", trace))
+        MYTRACE(L"Command capture: cannot write frame_commands.bin\n");
+    CommandTrace::Trace reference;
+    if (!CommandTrace::Read(folder + "\\frame_commands_reference.bin", reference))
+        return;
+    CommandTrace::Difference difference = CommandTrace::Diff(reference, trace, true);
+    if (difference.equal) {
+        MYTRACE(L"Command capture: same commands as the reference\n");
+        return;
+    }
+    swprintf_s(msgbuff, 200, L"Command capture: command %zu differs from the reference\n", difference.command);
+    MYTRACE(msgbuff);
+    std::wstring first(difference.first.begin(), difference.first.end());
+    std::wstring second(difference.second.begin(), difference.second.end());
+    MYTRACE((L"  reference: " + first + L"\n  frame:     " + second + L"\n").c_str());
+}
+#endif
+
+#ifdef _SOFTWARE_REFERENCE
+// Draws the draws of m_renderQueue again with the software rasterizer, writes the image to the local folder and
+// reports how much it differs from the golden image when there is one. Rename a frame_reference.ppm to
+// frame_reference_golden.ppm to make it the golden image.
+void Game::RenderSoftwareReference(const FrameResources& resources)
+{
+    // Every shape gets its own vertices, so draws start at vertex 0 instead of the shape's place in m_vBuffer.
+    std::vector<SoftwareRasterizer::Geometry> geometries(m_meshes.size());
+    for (size_t i = 0; i < m_meshes.size(); i++) {
+        const Mesh& mesh = *m_meshes[i];
+        std::vector<BYTE> indices(static_cast<size_t>(mesh.GetIndexCountAllLods()) * mesh.GetIndexStride());
+        mesh.CopyIndices(indices.data());
+        if (c_packedVertices) {
+            std::vector<PackedVertex> packed(mesh.GetVertexCount());
+            VertexPacking::Encode(mesh.GetVertexData(), mesh.GetVertexCount(), mesh.GetBoundingBox(), packed.data());
+            geometries[i] = SoftwareRasterizer::MakeGeometry(packed.data(), mesh.GetVertexCount(), indices.data(),
+                mesh.GetIndexCountAllLods(), mesh.GetIndexStride());
+        }
+        else {
+            geometries[i] = SoftwareRasterizer::MakeGeometry(mesh.GetVertexData(), mesh.GetVertexCount(), indices.data(),
+                mesh.GetIndexCountAllLods(), mesh.GetIndexStride());
+        }
+    }
+    // The texture table holds the first texture only (see CreateMainInputFlowResources).
+    SoftwareRasterizer::Texture texture = SoftwareRasterizer::LoadDDS(winrt::to_string(GameStatics::TexFileNames.begin()->second));
+
+    SoftwareRasterizer::Rasterizer rasterizer;
+    rasterizer.Create(m_outputWidth, m_outputHeight);
+    rasterizer.Clear(Colors::CornflowerBlue, 1.0f);
+    rasterizer.SetTexture(&texture);
+    const std::vector<RenderQueue::Draw>& draws = m_renderQueue.GetDraws();
+    for (const RenderQueue::Draw& item : draws) {
+        SoftwareRasterizer::Draw draw = { &geometries[item.mesh], item.indexCount, item.firstIndex, 0,
+            resources.instances + item.firstInstance, item.instanceCount };
+        rasterizer.DrawIndexedInstanced(draw);
+    }
+
+    // Update runs meanwhile and Tick counts its heap allocations: the workers of the rasterizer are left out of the
+    // count before they start, every one holding its first job until all the others have taken theirs.
+    JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+    std::atomic<unsigned int> ignoredThreads(0);
+    jobs.ParallelFor(jobs.ThreadCount(), 1, [&](size_t, size_t) {
+        AllocationCounter::IgnoreCurrentThread();
+        ignoredThreads++;
+        while (ignoredThreads.load() < jobs.ThreadCount())
+            std::this_thread::yield();
+    });
+    auto start = std::chrono::steady_clock::now();
+    rasterizer.Execute(jobs);
+    double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const SoftwareRasterizer::Stats& stats = rasterizer.GetStats();
+    wchar_t msgbuff[200];
+    swprintf_s(msgbuff, 200, L"Software reference: %zu draws in %.1f ms on %u threads, %zu triangles, %zu culled, %zu clipped, %zu pixels shaded\n",
+        draws.size(), time, jobs.ThreadCount(), stats.triangles, stats.culled, stats.clipped, stats.pixelsShaded);
+    MYTRACE(msgbuff);
+
+    std::string folder = winrt::to_string(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+    if (!SoftwareRasterizer::WritePPM(folder + "\\frame_reference.ppm", rasterizer.GetImage()))
+        MYTRACE(L"Software reference: cannot write frame_reference.ppm\n");
+    SoftwareRasterizer::Image golden;
+    if (!SoftwareRasterizer::ReadPPM(folder + "\\frame_reference_golden.ppm", golden))
+        return;
+    SoftwareRasterizer::ImageDifference difference = SoftwareRasterizer::Compare(golden, rasterizer.GetImage());
+    swprintf_s(msgbuff, 200, L"Software reference: %zu pixels differ from the golden image, by up to %u\n",
+        difference.pixels, difference.largest);
+    MYTRACE(msgbuff);
+}
+#endif
+
 // Helper method to prepare the command list for rendering and clear the back buffers.
-void Game::Clear()
+// commandList is the encoder of m_commandList, which Clear resets; the frame starts as FrameCommands::BeginFrame
+// records it.
+void Game::Clear(CommandEncoder& commandList, const FrameResources& resources)
 {
     // Reset command list and allocator.
     DX::ThrowIfFailed(m_commandAllocators[m_backBufferIndex]->Reset());
     DX::ThrowIfFailed(m_commandList->Reset(m_commandAllocators[m_backBufferIndex].Get(), m_pso.Get())); // Nota: establecer el PSO.
 
-    // Transition the render target into the correct state to allow for drawing into it.
-    D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_backBufferIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    m_commandList->ResourceBarrier(1, &barrier);
-
-    // Clear the views.
-    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor(m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), m_backBufferIndex, m_rtvDescriptorSize);
-    CD3DX12_CPU_DESCRIPTOR_HANDLE dsvDescriptor(m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-    m_commandList->OMSetRenderTargets(1, &rtvDescriptor, FALSE, &dsvDescriptor);
-    m_commandList->ClearRenderTargetView(rtvDescriptor, Colors::CornflowerBlue, 0, nullptr);
-    m_commandList->ClearDepthStencilView(dsvDescriptor, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+    // Transition the render target into the correct state to allow for drawing into it, then clear the views.
+    FrameCommands::BeginFrame(commandList, m_renderTargets[m_backBufferIndex].Get(), GetDrawState(), resources.passAddress,
+        resources.passSize);
+}
 
-    // Set the viewport and scissor rect.
-    D3D12_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(m_outputWidth), static_cast<float>(m_outputHeight), D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
-    D3D12_RECT scissorRect = { 0, 0, m_outputWidth, m_outputHeight };
-    m_commandList->RSSetViewports(1, &viewport);
-    m_commandList->RSSetScissorRects(1, &scissorRect);
+// Targets, viewport, root signature, descriptor heaps and vertex buffer of the draws (FrameCommands::SetDrawState).
+FrameCommands::DrawState Game::GetDrawState() const
+{
+    FrameCommands::DrawState state = {};
+    state.renderTarget = CD3DX12_CPU_DESCRIPTOR_HANDLE(m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), m_backBufferIndex, m_rtvDescriptorSize);
+    state.depthStencil = m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    state.width = static_cast<UINT>(m_outputWidth);
+    state.height = static_cast<UINT>(m_outputHeight);
 
     /*  Establecemos en el pipeline la root signauture:
     La utilizacin de la root signature lleva tres acciones en la lista de comandos:
@@ -378,46 +647,23 @@ void Game::Clear()
     La lista de comandos que haga el Draw debe establecer la root signature
     */
     // Subtarea a: Establecer la root signature
-    m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
+    state.rootSignature = m_rootSignature.Get();
 
     // Subtarea b: b Establecer un array de descriptor heaps
-    ID3D12DescriptorHeap* arrayHeaps[] = { m_cDescriptorHeap.Get(), m_sDescriptorHeap.Get()};
-    m_commandList->SetDescriptorHeaps(_countof(arrayHeaps), arrayHeaps);
+    state.descriptorHeaps[0] = m_cDescriptorHeap.Get();
+    state.descriptorHeaps[1] = m_sDescriptorHeap.Get(); // Descriptor HEap de Samplers
 
     // Subtarea c Establece el punto de comienzo del rango de descriptores.
+    state.textureTable = m_cDescriptorHeap->GetGPUDescriptorHandleForHeapStart(); // para SRV Textura
+    state.samplerTable = m_sDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
 
-   
-    CD3DX12_GPU_DESCRIPTOR_HANDLE srvHandle(m_cDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-    srvHandle.Offset((1+static_cast<UINT>(c_NumberOfObjects))*c_swapBufferCount, m_cDescriptorSize);
-    m_commandList->SetGraphicsRootDescriptorTable(2, // para SRV Textura
-        srvHandle);
-
-    CD3DX12_GPU_DESCRIPTOR_HANDLE sHandle(m_sDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-    m_commandList->SetGraphicsRootDescriptorTable(3, // nmero de root parameter
-        sHandle); //manejador a la posicin del heap donde comenzara el rango de descriptores
-    
-     // Todo: Establecemos la vista para el buffer de indices
-
-     // Es necesario pasar un array de buffer views
-    D3D12_VERTEX_BUFFER_VIEW vView[1] = { m_vBufferView };
-    D3D12_INDEX_BUFFER_VIEW iView[1] = { m_iBufferView };
-
-    m_commandList->IASetVertexBuffers(0, 1, vView);
-
-    
-    m_commandList->IASetIndexBuffer(iView);
-
-
-    /* Establecemos la topologa: es obligatorio*/
-    m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-
-
-
+    // The index buffer view is set per mesh (16 or 32 bit indices).
+    state.vertexBufferView = m_vBufferView;
+    return state;
 }
 
 // Submits the command list to the GPU and presents the back buffer contents to the screen.
-void Game::Present()
+void Game::Present(UINT64 fenceValue)
 {
     // Transition the render target to the state that allows it to be presented to the display.
     //D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_backBufferIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
@@ -433,15 +679,16 @@ void Game::Present()
     HRESULT hr = m_swapChain->Present(1, 0);
 
     // If the device was reset we must completely reinitialize the renderer.
+    // This runs on the render thread: Tick rebuilds the device once the pipeline is idle.
     if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
     {
-        OnDeviceLost();
+        m_deviceLost = true;
     }
     else
     {
         DX::ThrowIfFailed(hr);
 
-        MoveToNextFrame();
+        MoveToNextFrame(fenceValue);
     }
 }
 
@@ -458,6 +705,9 @@ void Game::OnDeactivated()
 
 void Game::OnSuspending()
 {
+    if (m_pipeline)
+        m_pipeline->Flush();
+
     // TODO: Game is being power-suspended.
 }
 
@@ -470,6 +720,10 @@ void Game::OnResuming()
 
 void Game::OnWindowSizeChanged(int width, int height, DXGI_MODE_ROTATION rotation)
 {
+    // The render thread must not be using the swap chain while it is resized.
+    if (m_pipeline)
+        m_pipeline->Flush();
+
     m_outputWidth = std::max(width, 1);
     m_outputHeight = std::max(height, 1);
     m_outputRotation = rotation;
@@ -483,6 +737,8 @@ void Game::ValidateDevice()
 {
     // The D3D Device is no longer valid if the default adapter changed since the device
     // was created or if the device has been removed.
+    if (m_pipeline)
+        m_pipeline->Flush();
 
     DXGI_ADAPTER_DESC previousDesc;
     {
@@ -604,9 +860,14 @@ void Game::CreateDevice()
     
     //DX::ThrowIfFailed(m_commandList->Close());
 
+    // And one per recording thread for the draws, each with its own allocators (CommandRecorder.h).
+    m_recorder.Create(m_d3dDevice.Get(), m_recordJobs->ThreadCount());
+
     // Create a fence for tracking GPU execution progress.
-    DX::ThrowIfFailed(m_d3dDevice->CreateFence(m_fenceValues[m_backBufferIndex], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fence.ReleaseAndGetAddressOf())));
-    m_fenceValues[m_backBufferIndex]++;
+    // It starts at the last value handed out, so every frame and every back buffer counts as finished.
+    DX::ThrowIfFailed(m_d3dDevice->CreateFence(m_lastFenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fence.ReleaseAndGetAddressOf())));
+    for (UINT n = 0; n < c_swapBufferCount; n++)
+        m_fenceValues[n] = m_lastFenceValue;
 
     m_fenceEvent.Attach(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
     if (!m_fenceEvent.IsValid())
@@ -695,7 +956,7 @@ void Game::CreateResources()
             m_d2dRenderTargets[n].Reset();
         if (m_wrappedBackBuffers[n])
             m_wrappedBackBuffers[n].Reset();
-        m_fenceValues[n] = m_fenceValues[m_backBufferIndex];
+        m_fenceValues[n] = m_lastFenceValue; // WaitForGpu above finished every frame
     }
     if (m_d2dDeviceContext) {
         m_d2dDeviceContext->SetTarget(nullptr);
@@ -873,24 +1134,24 @@ void Game::CreateResources()
     // TODO: Initialize windows-size dependent objects here.
 }
 
+// Only called while the render thread is idle (FramePipeline::Flush), so it can take the next fence value itself.
 void Game::WaitForGpu()
 {
     // Schedule a Signal command in the GPU queue.
-    DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_fenceValues[m_backBufferIndex]));
+    const UINT64 fenceValue = ++m_lastFenceValue;
+    DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fenceValue));
 
     // Wait until the Signal has been processed.
-    DX::ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_backBufferIndex], m_fenceEvent.Get()));
+    DX::ThrowIfFailed(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent.Get()));
     WaitForSingleObjectEx(m_fenceEvent.Get(), INFINITE, FALSE);
-
-    // Increment the fence value for the current frame.
-    m_fenceValues[m_backBufferIndex]++;
 }
 
-void Game::MoveToNextFrame()
+// fenceValue is the one Update handed out for the frame; the upload ring waits on it too.
+void Game::MoveToNextFrame(UINT64 fenceValue)
 {
     // Schedule a Signal command in the queue.
-    const UINT64 currentFenceValue = m_fenceValues[m_backBufferIndex];
-    DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), currentFenceValue));
+    DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fenceValue));
+    m_fenceValues[m_backBufferIndex] = fenceValue;
 
     // Update the back buffer index.
     m_backBufferIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -901,9 +1162,6 @@ void Game::MoveToNextFrame()
         DX::ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_backBufferIndex], m_fenceEvent.Get()));
         WaitForSingleObjectEx(m_fenceEvent.Get(), INFINITE, FALSE);
     }
-
-    // Set the fence value for the next frame.
-    m_fenceValues[m_backBufferIndex] = currentFenceValue + 1;
 }
 
 // This method acquires the first available hardware adapter that supports Direct3D 12.
@@ -992,12 +1250,20 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
     D3D12_HEAP_PROPERTIES heapProperties;
     D3D12_RESOURCE_DESC resourceDescription;
     size_t vSize = 0; // Total size of resource for vertices
+    size_t vSizeFull = 0; // Size with the unpacked Vertex layout, for the memory report
     size_t iSize = 0; // Total size of resource for indices
+    size_t iSize32 = 0; // Size the indices would take all with 32 bits, for the memory report
+    std::vector<size_t> iOffsets(numberOfMeshes); // Start of every mesh in the index buffer
+    UINT vertexStride = static_cast<UINT>(c_packedVertices ? sizeof(PackedVertex) : sizeof(Vertex));
     for (int indMesh = 0; indMesh < numberOfMeshes; indMesh++) {
         //GameStatics::ShapeName shapeName = static_cast<GameStatics::ShapeName>(indMesh);
         std::shared_ptr<Mesh> mesh = vMesh[indMesh];
-        vSize += mesh->GetVSize();
-        iSize += mesh->GetISize();
+        vSize += mesh->GetVertexCount() * vertexStride;
+        vSizeFull += mesh->GetVSize();
+        // Index ranges of different widths share the buffer; keep every range 4 byte aligned.
+        iOffsets[indMesh] = iSize;
+        iSize += (size_t(mesh->GetIndexCountAllLods()) * mesh->GetIndexStride() + 3) & ~size_t(3);
+        iSize32 += mesh->GetIndexCountAllLods() * sizeof(unsigned int);
     }
 
     // Creacin de los resource buffers default y upload para los vrtices
@@ -1045,34 +1311,28 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
            IID_PPV_ARGS(m_iBufferUpload.GetAddressOf())));
 
     /*Tarea 2: Preparamos el origen de los datos de vrtices e ndices.*/
-     
-     D3D12_SUBRESOURCE_DATA origen_vertices_struct;
-     origen_vertices_struct.pData = nullptr;
-     origen_vertices_struct.RowPitch = 0;
-     origen_vertices_struct.SlicePitch = 0;
-     D3D12_SUBRESOURCE_DATA origen_indices_struct;
-     origen_indices_struct.pData = nullptr;
-     origen_indices_struct.RowPitch = 0;
-     origen_indices_struct.SlicePitch = 0;
-
-     std::vector<Vertex> vertexOrigin;
-     std::vector<UINT> indexOrigin;
+     // Meshes may point into mapped cache files, so their data is written straight into the
+     // upload heap instead of being concatenated first in an intermediate vector.
+     BYTE* vUploadData = nullptr;
+     BYTE* iUploadData = nullptr;
+     DX::ThrowIfFailed(m_vBufferUpload->Map(0, nullptr, reinterpret_cast<void**>(&vUploadData)));
+     DX::ThrowIfFailed(m_iBufferUpload->Map(0, nullptr, reinterpret_cast<void**>(&iUploadData)));
      // Concatenate vertex and index data
      for (int indMesh = 0; indMesh < numberOfMeshes; indMesh++) {
 
          std::shared_ptr<Mesh> mesh = vMesh[indMesh];
-         vertexOrigin.insert(vertexOrigin.end(), mesh->vertices.begin(), mesh->vertices.end());
-         indexOrigin.insert(indexOrigin.end(), mesh->indices.begin(), mesh->indices.end());
-         
-         origen_vertices_struct.RowPitch += mesh->GetVSize();
-         origen_indices_struct.RowPitch += mesh->GetISize();
+         UINT meshVSize = mesh->GetVertexCount() * vertexStride;
+         if (c_packedVertices)
+             VertexPacking::Encode(mesh->GetVertexData(), mesh->GetVertexCount(), mesh->GetBoundingBox(), reinterpret_cast<PackedVertex*>(vUploadData));
+         else
+             memcpy(vUploadData, mesh->GetVertexData(), meshVSize);
+         mesh->CopyIndices(iUploadData + iOffsets[indMesh]);
+         vUploadData += meshVSize;
         
      }
+     m_vBufferUpload->Unmap(0, nullptr);
+     m_iBufferUpload->Unmap(0, nullptr);
 
-     origen_vertices_struct.pData = vertexOrigin.data();
-     origen_vertices_struct.SlicePitch = origen_vertices_struct.RowPitch;
-     origen_indices_struct.pData = indexOrigin.data();
-     origen_indices_struct.SlicePitch = origen_indices_struct.RowPitch;
         /*Tarea 3: Realizamos la transferencia desde el origen hasta el buffer DEFAULT pasando por el buffer UPLOAD*/
         /*Vrtices*/
         // Cambio de estado en el recurso de destino
@@ -1081,7 +1341,7 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
             m_commandList->ResourceBarrier(1, &barrier);
 
     // Ordenamos la transferencia vertices
-        UpdateSubresources<1>(m_commandList.Get(), m_vBufferDefault.Get(), m_vBufferUpload.Get(), 0,0, 1, &origen_vertices_struct);
+        m_commandList->CopyBufferRegion(m_vBufferDefault.Get(), 0, m_vBufferUpload.Get(), 0, vSize);
     // Cambio de estado en el recurso de destino
         barrier = CD3DX12_RESOURCE_BARRIER::Transition(
             m_vBufferDefault.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
@@ -1094,15 +1354,13 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
             m_commandList->ResourceBarrier(1, &barrier);
 
         // Ordenamos la transferencia vertices
-        UpdateSubresources<1>(m_commandList.Get(), m_iBufferDefault.Get(), m_iBufferUpload.Get(), 0, 0, 1, &origen_indices_struct);
+        m_commandList->CopyBufferRegion(m_iBufferDefault.Get(), 0, m_iBufferUpload.Get(), 0, iSize);
         
         // Cambio de estado en el recurso de destino
         barrier = CD3DX12_RESOURCE_BARRIER::Transition(
         m_iBufferDefault.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
         m_commandList->ResourceBarrier(1, &barrier);
 
-        // The array of D3D12_SUBRESOURCE_DATA structures can deleted
-       
     
     /* Tarea 3: Establecemos una vista para vrtices e ndices*/
     // Establecemos la vista (descriptor) para el buffer de vrtices
@@ -1112,11 +1370,9 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
         D3D12_GPU_VIRTUAL_ADDRESS iBufferStart = m_iBufferDefault->GetGPUVirtualAddress();
         
         m_vBufferView.BufferLocation = vBufferStart;
-        m_vBufferView.StrideInBytes = sizeof(Vertex);
+        m_vBufferView.StrideInBytes = vertexStride;
         m_vBufferView.SizeInBytes = 0;
-        m_iBufferView.BufferLocation = iBufferStart;
-        m_iBufferView.Format = DXGI_FORMAT_R32_UINT;
-        m_iBufferView.SizeInBytes = 0;
+        m_iBufferViews.resize(numberOfMeshes);
 
         for (int indMesh=0; indMesh < numberOfMeshes; indMesh++) {
             
@@ -1124,18 +1380,30 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
             std::shared_ptr<Mesh> mesh = vMesh[indMesh];
 
             
-            m_vBufferView.SizeInBytes += mesh->GetVSize();
+            m_vBufferView.SizeInBytes += mesh->GetVertexCount() * vertexStride;
 
-            m_iBufferView.SizeInBytes += mesh->GetISize();
+            D3D12_INDEX_BUFFER_VIEW& iBufferView = m_iBufferViews[indMesh];
+            iBufferView.BufferLocation = iBufferStart + iOffsets[indMesh];
+            iBufferView.Format = mesh->GetIndexFormat();
+            iBufferView.SizeInBytes = mesh->GetIndexCountAllLods() * mesh->GetIndexStride();
 
             
         }
 
         D3D12_VERTEX_BUFFER_VIEW aVBufferView[1] = { m_vBufferView };  // Es necesario pasar un array de buffer views
-        D3D12_INDEX_BUFFER_VIEW aIBufferView[1] = { m_iBufferView };
 
         m_commandList->IASetVertexBuffers(0, 1, aVBufferView);
-        m_commandList->IASetIndexBuffer(aIBufferView);
+
+        wchar_t msgbuff[512];
+        swprintf(msgbuff, 512, L"Mesh buffers: vertices %zu bytes (%zu as Vertex), indices %zu bytes (%zu as 32 bits)\n",
+            vSize, vSizeFull, iSize, iSize32);
+        MYTRACE(msgbuff);
+        for (int indMesh = 0; indMesh < numberOfMeshes; indMesh++) {
+            swprintf(msgbuff, 512, L"  mesh %d: %u vertices, %u indices of %u bits in %u LODs\n", indMesh,
+                vMesh[indMesh]->GetVertexCount(), vMesh[indMesh]->GetIndexCountAllLods(), 8 * vMesh[indMesh]->GetIndexStride(),
+                vMesh[indMesh]->GetLodCount());
+            MYTRACE(msgbuff);
+        }
 
     
     /* Tarea 4: Cargamos las texturas de la malla*/
@@ -1157,60 +1425,24 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
 
     // Creacin de recursos para las constantes
 
-    // Constantes comunes
-    // Pass constants: RC0, RC1, RC2
-    unsigned int elementSizeConstants = CalcConstantBufferByteSize(sizeof(vConstants));
-
-    heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-    resourceDescription = CD3DX12_RESOURCE_DESC::Buffer(elementSizeConstants);
-    for (int i = 0; i < c_swapBufferCount; i++) {
-        m_d3dDevice->CreateCommittedResource(
-            &heapProperties,
-            D3D12_HEAP_FLAG_NONE,
-            &resourceDescription,
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(m_vConstantBuffer[i].GetAddressOf())
-        );
-    }
-
-    // Constantes por objeto
-    // Resources for RS00, RS01, ..., RS10,RS11, ..., RS20, RS21,...
-    // RSij is buffer resource for frame resource i, and object j. 
-    // Each RSij is for object instances Oj0, Oj1, ... Ojn.
-    // Number of instances
-    size_t numberOfInstances = 0;
-    numberOfInstances = c_NumberOfInstancesPerObject;
-    for (int i = 0; i < c_swapBufferCount; i++) {
-        m_vInstanceBuffer[i].clear();
-        m_vInstanceBuffer[i].resize(c_NumberOfObjects);
-
-        for (int j = 0; j < c_NumberOfObjects; j++) {
-            unsigned int instanceBufferSize = CalcConstantBufferByteSize(
-                static_cast<unsigned int>(sizeof(vInstance) * numberOfInstances));
-            //unsigned int instanceBufferSize = (sizeof(vInstance) * numberOfInstances);
-            heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-            resourceDescription = CD3DX12_RESOURCE_DESC::Buffer(instanceBufferSize);
-
-            m_d3dDevice->CreateCommittedResource(
-                &heapProperties,
-                D3D12_HEAP_FLAG_NONE,
-                &resourceDescription,
-                D3D12_RESOURCE_STATE_GENERIC_READ,
-                nullptr,
-                IID_PPV_ARGS(m_vInstanceBuffer[i][j].GetAddressOf())
-            );
+    // Pass constants and instances of every frame in flight, sub-allocated each frame from one ring (UploadRing.h).
+    // It starts with room for the current scene, one frame more than the swap chain for the space lost when an
+    // allocation wraps, and grows when instances are added.
+    // The GPU culling mode uploads every instance with its worldview, plus the shapes and their draws.
+    UINT64 frameUploadSize = CalcConstantBufferByteSize(sizeof(vConstants)) + m_instances.GetShapeCount() * D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT;
+    if (c_gpuCulling)
+        frameUploadSize += m_instances.Size() * sizeof(GpuCulling::CullInstance) +
+            m_instances.GetShapeCount() * (sizeof(GpuCulling::CullShape) + Mesh::c_maxLods * sizeof(GpuCulling::DrawCommand));
+    else
+        frameUploadSize += m_instances.Size() * sizeof(vInstance);
+    m_uploadRing.Create(std::make_shared<D3D12UploadBackend>(m_d3dDevice.Get()), frameUploadSize * (c_swapBufferCount + 1));
 
-        }
-
-    }
-   
 
 
     /* Tarea 2: crear un heap de descriptores CBV_SRV_UAV*/
 
     D3D12_DESCRIPTOR_HEAP_DESC cHeapDescriptor;
-    cHeapDescriptor.NumDescriptors = static_cast<UINT>((1+c_NumberOfObjects)*c_swapBufferCount+numTextures); // (CBV(Pass) + (number of Objects)* SRV(Instance)) por swap buffer + num of textures
+    cHeapDescriptor.NumDescriptors = static_cast<UINT>(numTextures); // Only textures: constants and instances are root descriptors
     cHeapDescriptor.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
     cHeapDescriptor.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
     cHeapDescriptor.NodeMask = 0;
@@ -1235,36 +1467,6 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
     m_cDescriptorSize = m_d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     
     
-    for (int i = 0; i < c_swapBufferCount; i++) {
-        // View for buffer of common constants for all objects: DCiRCi
-        D3D12_GPU_VIRTUAL_ADDRESS cAddress = m_vConstantBuffer[i]->GetGPUVirtualAddress();
-        D3D12_CONSTANT_BUFFER_VIEW_DESC cDescriptor;
-        cDescriptor.BufferLocation = cAddress;
-        cDescriptor.SizeInBytes = elementSizeConstants;
-        m_d3dDevice->CreateConstantBufferView(&cDescriptor, hDescriptor);
-        hDescriptor.Offset(1, m_cDescriptorSize);
-        
-        
-        // Views for buffer of constants per object: DSiRSi0, DSiRSi1, ... (one view por object)
-        
-        for (int j = 0; j < m_vInstanceBuffer[i].size(); j++) {
-            cAddress = m_vInstanceBuffer[i][j]->GetGPUVirtualAddress();
-            D3D12_SHADER_RESOURCE_VIEW_DESC sBDesc = {};
-            sBDesc = {};
-            sBDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            sBDesc.Format = m_vInstanceBuffer[i][j].Get()->GetDesc().Format;
-            sBDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-            sBDesc.Buffer.FirstElement = 0;
-            sBDesc.Buffer.NumElements = static_cast<UINT>(c_NumberOfInstancesPerObject);
-            sBDesc.Buffer.StructureByteStride = sizeof(vInstance);
-            sBDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-
-            m_d3dDevice->CreateShaderResourceView(m_vInstanceBuffer[i][j].Get(), &sBDesc, hDescriptor);
-            hDescriptor.Offset(1, m_cDescriptorSize);
-        }
-           
-    }
-
         /* Tarea 5 Creamos descriptores SRV para las texturas*/
     
         // Finally we create view for textures in the same CBV_SRV_UAV Descriptor Heap
@@ -1306,27 +1508,26 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
 
 /* Tarea 1: Crear un array de root parameters*/
 
-    CD3DX12_ROOT_PARAMETER rootParameters[4]; //Array de root parameters // CBT
+    CD3DX12_ROOT_PARAMETER rootParameters[5]; //Array de root parameters // CBT
     // Creamos un rango de tablas de descriptores
-    CD3DX12_DESCRIPTOR_RANGE descRange[4]; // CBT
-    descRange[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0); //1 CB to slot 0
-    descRange[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 1); //1 SRV for SB to Slot 0, space 1 f
-    descRange[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0); // 1 SRV to Slot 0, space 0 for texture
-    descRange[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 1, 0); // 1 Sampler to Slot 0
+    CD3DX12_DESCRIPTOR_RANGE descRange[2]; // CBT
+    descRange[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0); // 1 SRV to Slot 0, space 0 for texture
+    descRange[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 1, 0); // 1 Sampler to Slot 0
 
 
-    rootParameters[0].InitAsDescriptorTable(1, // Nmero de rangos 
-        &descRange[0],D3D12_SHADER_VISIBILITY_ALL); 
-    rootParameters[1].InitAsDescriptorTable(1, // Nmero de rangos 
-        &descRange[1], D3D12_SHADER_VISIBILITY_ALL);
+    // Pass constants (b0) and the instance structured buffer (t0, space 1) are root descriptors into the upload ring.
+    rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
+    rootParameters[1].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_ALL);
     rootParameters[2].InitAsDescriptorTable(1, // Nmero de rangos 
-        &descRange[2], D3D12_SHADER_VISIBILITY_PIXEL);
+        &descRange[0], D3D12_SHADER_VISIBILITY_PIXEL);
     rootParameters[3].InitAsDescriptorTable(1, // Nmero de rangos 
-        &descRange[3], D3D12_SHADER_VISIBILITY_PIXEL);
+        &descRange[1], D3D12_SHADER_VISIBILITY_PIXEL);
+    // First instance of the draw in the instance buffer (b1): SV_InstanceID does not include StartInstanceLocation.
+    rootParameters[4].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
 
 /* Tarea 2: Creamos una descripcin de la root signature y la serializamos */
     // Descripcin de la root signature //CBT
-    CD3DX12_ROOT_SIGNATURE_DESC rsDescription(4, rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+    CD3DX12_ROOT_SIGNATURE_DESC rsDescription(5, rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
     //Debemos serializar la descripcin root signature
     Microsoft::WRL::ComPtr<ID3DBlob> serializado = nullptr;
@@ -1353,11 +1554,7 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
     m_commandQueue->ExecuteCommandLists(1, CommandListCast(m_commandList.GetAddressOf()));
 
 
-    DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), 1));
-
-    // Wait until the Signal has been processed.
-    DX::ThrowIfFailed(m_fence->SetEventOnCompletion(1, m_fenceEvent.Get()));
-    WaitForSingleObjectEx(m_fenceEvent.Get(), INFINITE, FALSE);
+    WaitForGpu();
 
     
     // Create D2D/DWrite objects for rendering text.
@@ -1383,7 +1580,7 @@ void Game::CreateMainInputFlowResources(const std::vector<std::shared_ptr<Mesh>>
 void Game::LoadPrecompiledShaders() {
 
     DX::ThrowIfFailed(
-        D3DReadFileToBlob(L"vertex.cso", m_vsByteCode.GetAddressOf()));
+        D3DReadFileToBlob(c_packedVertices ? L"vertexpacked.cso" : L"vertex.cso", m_vsByteCode.GetAddressOf()));
 
     DX::ThrowIfFailed(
         D3DReadFileToBlob(L"pixel.cso", m_psByteCode.GetAddressOf()));
@@ -1413,14 +1610,25 @@ void Game::PSO()
     // Input data per instance is a way to have instance particular parameters when drawing multiple instances
     //
 
-    m_inputLayout = {
-
-        {"POSITION",0,DXGI_FORMAT_R32G32B32_FLOAT,0,0,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
-        {"COLOR",0,DXGI_FORMAT_R32G32B32A32_FLOAT,0,12,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
-    {"NORMAL",0,DXGI_FORMAT_R32G32B32_FLOAT,0,28,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
-    {"UV",0,DXGI_FORMAT_R32G32_FLOAT,0,40,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
-        {"MATINDEX",0,DXGI_FORMAT_R32_UINT,0,48,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0}
-    };
+    if (c_packedVertices) {
+        // PackedVertex (VertexPacking.h): no material, it comes from the instance data.
+        m_inputLayout = {
+            {"POSITION",0,DXGI_FORMAT_R16G16B16A16_UNORM,0,0,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+            {"COLOR",0,DXGI_FORMAT_R8G8B8A8_UNORM,0,8,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+            {"NORMAL",0,DXGI_FORMAT_R16G16_SNORM,0,12,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+            {"UV",0,DXGI_FORMAT_R16G16_FLOAT,0,16,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0}
+        };
+    }
+    else {
+        m_inputLayout = {
+
+            {"POSITION",0,DXGI_FORMAT_R32G32B32_FLOAT,0,0,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+            {"COLOR",0,DXGI_FORMAT_R32G32B32A32_FLOAT,0,12,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+        {"NORMAL",0,DXGI_FORMAT_R32G32B32_FLOAT,0,28,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+        {"UV",0,DXGI_FORMAT_R32G32_FLOAT,0,40,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+            {"MATINDEX",0,DXGI_FORMAT_R32_UINT,0,48,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0}
+        };
+    }
 
 
 
@@ -1455,14 +1663,22 @@ void Game::PSO()
 
 }
 
-void Game::RenderUI()
+void Game::RenderUI(const FrameResources& resources)
 {
     D2D1_SIZE_F rtSize = m_d2dRenderTargets[m_backBufferIndex]->GetSize();
     
     D2D1_RECT_F textRect = D2D1::RectF(0, 0, rtSize.width, rtSize.height);
    
-    wchar_t text[100];
-    size_t lenText = swprintf_s(text,100,L"Score: %d",m_score);
+    wchar_t text[560];
+    const UploadRing::Stats& uploadStats = resources.uploadStats;
+    const CommandRecorder::Stats& recorderStats = m_recorder.FrameStats();
+    const RenderQueue::Stats& queueStats = m_renderQueue.GetStats();
+    size_t lenText = swprintf_s(text,560,L"Score: %d\n%s: %zu/%zu\nUpload: %zu allocations, %llu bytes, ring %llu KB\nDraws: %u, instance buffer binds: %u, root constants: %u, index buffers: %u\nDraw sort: %zu items in %zu draws, state changes %u of %u\nDraw lists: %u of up to %zu draws, %zu allocators\nCommand calls: %u, redundant state dropped: %u",
+        m_score,c_gpuCulling ? L"Candidates (GPU culling)" : L"Visible",resources.cullStats.visible,resources.cullStats.tested,uploadStats.allocations,uploadStats.bytesWritten,resources.uploadRingSize/1024,
+        m_drawStats.draws,m_drawStats.instanceBufferBinds,m_drawStats.rootConstantSets,m_drawStats.indexBufferSets,
+        queueStats.items,queueStats.draws,queueStats.sorted.Total(),queueStats.submitted.Total(),
+        recorderStats.lists,recorderStats.itemsPerList,recorderStats.allocatorsCreated,
+        m_stateCounters.calls,m_stateCounters.filtered);
     
     // Acquire our wrapped render target resource for the current back buffer.
     m_d3d11On12Device->AcquireWrappedResources(m_wrappedBackBuffers[m_backBufferIndex].GetAddressOf(), 1);
@@ -6,6 +6,22 @@
 
 #include "StepTimer.h"
 #include "Mesh.h"
+#include "VertexPacking.h"
+#include "Culling.h"
+#include "TransformBatch.h"
+#include "InstanceUpdate.h"
+#include "FrameUpdate.h"
+#include "UploadRing.h"
+#include "InstanceStore.h"
+#include "GpuCulling.h"
+#include "FramePipeline.h"
+#include "CommandRecorder.h"
+#include "RenderQueue.h"
+#include "FrameCommands.h"
+#include "CommandEncoder.h"
+#include "CommandTrace.h"
+#include "StateCache.h"
+#include "SoftwareRasterizer.h"
 #include "HelperFunctions.h"
 #include "DDSTextureLoader.h"
 #include "Controller.h"
@@ -17,9 +33,13 @@
 // provides a game loop.
 class Game
 {
+    // What a frame's Update hands to its Render (defined with m_frames).
+    struct FrameResources;
+
 public:
 
     Game() noexcept ;
+    ~Game();
 
     // Initialization and management
     void Initialize(::IUnknown* window, int width, int height, DXGI_MODE_ROTATION rotation);
@@ -40,7 +60,7 @@ public:
     void GetDefaultSize( int& width, int& height ) const;
     void LoadMeshes();
     void LoadSprites();
-    void RenderUI();
+    void RenderUI(const FrameResources& resources);
     void SetDPI(float x, float y);
 
 private:
@@ -53,20 +73,24 @@ private:
     
     size_t m_NumberOfMeshes;
 
-    const size_t c_NumberOfObjects = 5;
-    const size_t c_NumberOfInstancesPerObject = 3;
+    // Vertex buffer in the compact PackedVertex layout instead of Vertex
+    const bool c_packedVertices = true;
+    // Largest LOD error on screen, in pixels
+    const float c_lodPixelError = 1.0f;
+    // Culling and LOD selection in a compute pass, drawn with ExecuteIndirect (GpuCulling.h)
+    const bool c_gpuCulling = false;
+    // Threads recording the draws of a frame, the render thread included, and the fewest draws worth a list of their own
+    const UINT c_recordThreads = 4;
+    const size_t c_minDrawsPerList = 32;
+    // Redundant state changes are dropped before they reach the command lists (StateCache.h)
+    const bool c_filterRedundantState = true;
+    // Frames Update may allocate in while its containers grow (AllocationCounter.h)
+    const UINT c_allocationWarmupFrames = 8;
 
 
 
-    // Per object particular information
-    struct ObjectData {
-        bool                                                isInstanced;
-        XMFLOAT4X4											matrixWorld;
-        UINT                                                matind;
-     };
-   
-    // One shape each time
-    std::vector<std::vector<ObjectData>> m_objects; // Each element is per shape information. Each per shape information is per instance data.
+    // Per instance information of every shape, one array per attribute; instances of a shape are contiguous.
+    InstanceStore                                       m_instances;
     
     std::vector<std::shared_ptr<Mesh>>					m_meshes; // One mesh per shape
 
@@ -84,7 +108,7 @@ private:
     Microsoft::WRL::ComPtr<ID3D12Resource>              m_iBufferDefault; // Buffer para indices
     Microsoft::WRL::ComPtr<ID3D12Resource>              m_iBufferUpload; // Buffer para indices
     D3D12_VERTEX_BUFFER_VIEW				m_vBufferView;
-    D3D12_INDEX_BUFFER_VIEW				m_iBufferView;
+    std::vector<D3D12_INDEX_BUFFER_VIEW>	m_iBufferViews; // One per mesh: 16 or 32 bit indices
     
     // Textures related stuff
 
@@ -107,27 +131,102 @@ private:
 
     };
 
-    // Instance object constants
-    struct vInstance {
-
-        DirectX::XMFLOAT4X4 Transform = { 1.0,0.0,0.0,0.0,0.0,1.0,0.0,0.0,0.0,0.0,1.0,0.0,0.0,0.0,0.0,1.0 };
-        DirectX::XMFLOAT4X4 NormalTransform = { 1.0,0.0,0.0,0.0,0.0,1.0,0.0,0.0,0.0,0.0,1.0,0.0,0.0,0.0,0.0,1.0 };
-        UINT MaterialIndex;
-        UINT Pad0;
-        UINT Pad1;
-        UINT Pad2;
-
-    };
+    // Instance object constants, written by FrameUpdate::WriteInstances
+    using vInstance = FrameUpdate::Instance;
 
     // Data:
     vConstants                                                       m_vConstants[c_swapBufferCount];
-    std::vector<std::vector<vInstance>>                              m_vInstances[c_swapBufferCount]; // Vector of instances per object.
 
-    // One pass constant buffer per frame resource.
-    Microsoft::WRL::ComPtr<ID3D12Resource>				m_vConstantBuffer[c_swapBufferCount]; // Buffer de constantes
-    
-    // One instance constant buffer per object and frame resource.
-    std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>>				m_vInstanceBuffer[c_swapBufferCount]; // Buffer de constantes
+    // Instances of a shape drawn with the same LOD are consecutive in the frame instance buffer.
+    using LodBucket = InstanceUpdate::LodBucket;
+
+    // Update splits the instances of every shape over these threads (InstanceUpdate.h).
+    std::unique_ptr<JobSystem>                                       m_jobs;
+    InstanceUpdate::Scratch                                          m_instanceScratch;
+
+    // Pass constants and the instance buffer of every frame are sub-allocated from one persistently mapped ring;
+    // Update writes instances straight into it and Render binds them as root descriptors.
+    // The instances of all the shapes share one buffer per frame; LOD buckets hold positions in it.
+    // Only the simulation thread touches the ring.
+    UploadRing                                          m_uploadRing;
+
+    // Command list calls of the last Render, to watch the cost of submitting draws.
+    using DrawStats = FrameCommands::DrawStats;
+    DrawStats                                           m_drawStats;
+
+    // Draws of the CPU culling path, sorted by the state they need and merged, then recorded on several threads
+    // into lists of contiguous draws (Render). The mesh of a draw selects its index buffer view.
+    RenderQueue                                         m_renderQueue;
+    std::unique_ptr<JobSystem>                          m_recordJobs;
+    CommandRecorder                                     m_recorder;
+    std::vector<DrawStats>                              m_listDrawStats; // One per recording context, summed into m_drawStats
+
+    // The encoders a list of Render is recorded through: the redundant state filter when it is on, the capture
+    // of the frame when it is the capture frame, and the list itself.
+    struct ListEncoders {
+        ListEncoders(ID3D12GraphicsCommandList* commandList, ID3D12PipelineState* initialState, bool filterState,
+            CommandTrace::Trace* captureTrace, CommandTrace::ObjectTable* captureObjects);
+        D3D12CommandEncoder direct;
+        std::unique_ptr<CommandTrace::RecordingCommandEncoder> capture;
+        StateCachingCommandEncoder stateCache;
+        CommandEncoder* encoder; // First of the chain
+    };
+    // Calls of the last Render and how many of them the state filter dropped, summed over its lists.
+    StateCachingCommandEncoder::Counters                m_stateCounters;
+    std::vector<StateCachingCommandEncoder::Counters>   m_listStateCounters; // One per recording context
+
+    // GPU driven mode: Update writes every instance and one draw per shape and LOD with no instances, the
+    // compute pass culls the instances into the draws and Render submits them with ExecuteIndirect.
+    struct GpuCullingFrame {
+        GpuCulling::CullConstants constants;
+        UploadRing::Allocation instances;
+        UploadRing::Allocation shapes;
+        UploadRing::Allocation commands;
+        UINT commandCount;
+        UINT outputCount; // Instances the output buffer must hold
+    };
+    GpuCulling::Culler                                  m_gpuCuller; // Render thread only
+
+    // Simulation of a frame runs while the render thread records and submits the previous one (FramePipeline.h).
+    // Everything Update hands to Render is in the frame's slot; Update owns it until the frame is handed over
+    // and Render until it has been submitted.
+    struct FrameResources {
+        UINT64 fenceValue; // Signalled after the frame's commands; its upload ring space is kept until then
+        D3D12_GPU_VIRTUAL_ADDRESS passAddress;
+        D3D12_GPU_VIRTUAL_ADDRESS instanceAddress;
+        UINT64 passSize;
+        UINT64 instanceSize;
+        const FrameUpdate::Instance* instances; // CPU view of the instances at instanceAddress; nullptr with c_gpuCulling
+        std::vector<std::vector<LodBucket>> lodBuckets; // Per object, one bucket per LOD
+        GpuCullingFrame gpuCulling;
+        Culling::Stats cullStats;
+        UploadRing::Stats uploadStats;
+        UINT64 uploadRingSize;
+    };
+    static const UINT                                   c_frameSlots = 2;
+    FrameResources                                      m_frames[c_frameSlots];
+    std::unique_ptr<FramePipeline>                      m_pipeline;
+    // Set by the render thread when Present finds the device removed; Tick rebuilds it.
+    std::atomic<bool>                                   m_deviceLost;
+#ifdef _TRACE_FRAME_TIMELINE
+    // Frame whose timeline goes to the debug output and to frame_timeline.json in the local folder
+    const UINT64 c_timelineTraceFrame = 600;
+#endif
+#ifdef _CAPTURE_COMMANDS
+    // Frame whose commands go to frame_commands.bin in the local folder, checked against
+    // frame_commands_reference.bin there when there is one (CommandTrace.h).
+    const UINT64 c_captureFrame = 300;
+    void ReportCommandCapture();
+#endif
+#ifdef _SOFTWARE_REFERENCE
+    // Frame drawn again by the software rasterizer to frame_reference.ppm in the local folder, checked against
+    // frame_reference_golden.ppm there when there is one (SoftwareRasterizer.h).
+    const UINT64 c_referenceFrame = 300;
+    void RenderSoftwareReference(const FrameResources& resources);
+#endif
+    // Traces of the capture frame, one per list in submission order; empty without _CAPTURE_COMMANDS.
+    CommandTrace::ObjectTable                           m_captureObjects;
+    std::vector<CommandTrace::Trace>                    m_captureTraces;
    
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>		m_cDescriptorHeap;
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>        m_sDescriptorHeap; // Descriptor HEap de Samplers
@@ -156,19 +255,22 @@ private:
     Microsoft::WRL::ComPtr<ID3D12PipelineState>		m_pso;
 
     // Updates
-    void Update(DX::StepTimer const& timer);
+    void Update(DX::StepTimer const& timer, FrameResources& resources);
     XMMATRIX UpdateView();
+    void UpdateGpuCulling(const InstanceUpdate::Frame& frame, FrameResources& resources);
 
-    void Render();
+    // Render thread
+    void Render(const FrameResources& resources, UINT64 frame);
 
-    void Clear();
-    void Present();
+    void Clear(CommandEncoder& commandList, const FrameResources& resources);
+    FrameCommands::DrawState GetDrawState() const;
+    void Present(UINT64 fenceValue);
 
     void CreateDevice();
     void CreateResources();
 
     void WaitForGpu();
-    void MoveToNextFrame();
+    void MoveToNextFrame(UINT64 fenceValue);
     void GetAdapter(IDXGIAdapter1** ppAdapter);
 
     void OnDeviceLost();
@@ -195,7 +297,8 @@ private:
 
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>   m_commandList;
     Microsoft::WRL::ComPtr<ID3D12Fence>                 m_fence;
-    UINT64                                              m_fenceValues[c_swapBufferCount];
+    UINT64                                              m_fenceValues[c_swapBufferCount]; // Of the last frame drawn to each back buffer
+    UINT64                                              m_lastFenceValue; // Last value handed out, by Update or WaitForGpu
 
     Microsoft::WRL::Wrappers::Event                     m_fenceEvent;
 
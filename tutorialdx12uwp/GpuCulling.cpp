@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "GpuCulling.h"
+
+namespace GpuCulling {
+
+	namespace {
+		// Relative size of the band around a plane or an LOD threshold where float rounding may decide either way.
+		const float c_boundaryTolerance = 1e-4f;
+
+		float dot3(const XMFLOAT4& plane, float x, float y, float z) {
+			return plane.x * x + plane.y * y + plane.z * z;
+		}
+	}
+
+	CullConstants MakeConstants(FXMMATRIX projection, UINT instanceCount, float pixelsPerUnit, float lodPixelError) {
+		// Planes from the columns of the projection (row vectors): a view space point is inside when
+		// 0 <= z' <= w' and -w' <= x', y' <= w'.
+		XMMATRIX columns = XMMatrixTranspose(projection);
+		XMVECTOR planes[6] = {
+			columns.r[3] + columns.r[0], // Left
+			columns.r[3] - columns.r[0], // Right
+			columns.r[3] + columns.r[1], // Bottom
+			columns.r[3] - columns.r[1], // Top
+			columns.r[2],                // Near
+			columns.r[3] - columns.r[2]  // Far
+		};
+		CullConstants constants = {};
+		for (size_t p = 0; p < 6; p++)
+			XMStoreFloat4(&constants.planes[p], XMPlaneNormalize(planes[p]));
+		constants.instanceCount = instanceCount;
+		constants.pixelsPerUnit = pixelsPerUnit;
+		constants.lodPixelError = lodPixelError;
+		return constants;
+	}
+
+	CullShape MakeShape(const Mesh& mesh, UINT firstCommand) {
+		CullShape shape = {};
+		const BoundingSphere& sphere = mesh.GetBoundingSphere();
+		const BoundingBox& box = mesh.GetBoundingBox();
+		shape.sphere = XMFLOAT4(sphere.Center.x, sphere.Center.y, sphere.Center.z, sphere.Radius);
+		shape.boxCenter = XMFLOAT4(box.Center.x, box.Center.y, box.Center.z, 1.0f);
+		shape.boxExtents = XMFLOAT4(box.Extents.x, box.Extents.y, box.Extents.z, 0.0f);
+		shape.lodCount = static_cast<UINT>(mesh.GetLodCount());
+		assert(shape.lodCount <= Mesh::c_maxLods);
+		for (UINT lod = 0; lod < shape.lodCount; lod++)
+			shape.lodError[lod] = mesh.GetLod(lod).error;
+		shape.firstCommand = firstCommand;
+		return shape;
+	}
+
+	CullResult Cull(const CullConstants& constants, const CullShape& shape, const XMFLOAT4X4& m) {
+		// Same operations in the same order as cull.hlsl.
+		CullResult result = { UINT_MAX, false };
+		float scale = std::sqrt(std::max(m._11 * m._11 + m._12 * m._12 + m._13 * m._13,
+			std::max(m._21 * m._21 + m._22 * m._22 + m._23 * m._23, m._31 * m._31 + m._32 * m._32 + m._33 * m._33)));
+
+		const XMFLOAT4& s = shape.sphere;
+		float sx = s.x * m._11 + s.y * m._21 + s.z * m._31 + m._41;
+		float sy = s.x * m._12 + s.y * m._22 + s.z * m._32 + m._42;
+		float sz = s.x * m._13 + s.y * m._23 + s.z * m._33 + m._43;
+		float radius = s.w * scale;
+
+		const XMFLOAT4& b = shape.boxCenter;
+		const XMFLOAT4& e = shape.boxExtents;
+		float bx = b.x * m._11 + b.y * m._21 + b.z * m._31 + m._41;
+		float by = b.x * m._12 + b.y * m._22 + b.z * m._32 + m._42;
+		float bz = b.x * m._13 + b.y * m._23 + b.z * m._33 + m._43;
+
+		float tolerance = c_boundaryTolerance * (1.0f + std::abs(sz) + radius);
+		bool visible = true;
+		for (const XMFLOAT4& plane : constants.planes) {
+			float sphereMargin = dot3(plane, sx, sy, sz) + plane.w + radius;
+			// Box radius along the plane normal: its axes are the scaled rows of the worldview.
+			float boxRadius = std::abs(dot3(plane, m._11, m._12, m._13)) * e.x + std::abs(dot3(plane, m._21, m._22, m._23)) * e.y +
+				std::abs(dot3(plane, m._31, m._32, m._33)) * e.z;
+			float boxMargin = dot3(plane, bx, by, bz) + plane.w + boxRadius;
+			if (std::abs(sphereMargin) < tolerance || std::abs(boxMargin) < tolerance)
+				result.nearBoundary = true;
+			if (sphereMargin < 0.0f || boxMargin < 0.0f)
+				visible = false;
+		}
+		if (!visible)
+			return result;
+
+		// LOD as in InstanceUpdate: the coarsest level whose error stays under lodPixelError on screen.
+		float z = m._43;
+		UINT lod = 0;
+		while (z > 0.0f && lod + 1 < shape.lodCount) {
+			float pixels = shape.lodError[lod + 1] * scale * constants.pixelsPerUnit / z;
+			if (std::abs(pixels - constants.lodPixelError) < c_boundaryTolerance * constants.lodPixelError)
+				result.nearBoundary = true;
+			if (!(pixels < constants.lodPixelError))
+				break;
+			lod++;
+		}
+		result.lod = lod;
+		return result;
+	}
+
+	void Run(const CullConstants& constants, const CullShape* shapes, const CullInstance* instances,
+		DrawCommand* commands, OutputInstance* output) {
+		for (UINT i = 0; i < constants.instanceCount; i++) {
+			const CullInstance& instance = instances[i];
+			const CullShape& shape = shapes[instance.shape];
+			CullResult result = Cull(constants, shape, instance.worldview);
+			if (result.lod == UINT_MAX)
+				continue;
+			DrawCommand& command = commands[shape.firstCommand + result.lod];
+			OutputInstance& out = output[command.firstInstance + command.draw.InstanceCount++];
+			out.transform = instance.transform;
+			out.normalTransform = instance.normalTransform;
+			out.material = instance.material;
+			out.source = instance.source;
+			out.pad[0] = out.pad[1] = 0;
+		}
+	}
+
+	void WriteInstances(JobSystem& jobs, const InstanceUpdate::Frame& frame, FXMMATRIX pre, const InstanceUpdate::Input& input,
+		UINT shape, UINT firstSource, CullInstance* output, InstanceUpdate::Scratch& scratch) {
+		const size_t count = input.count;
+		const size_t chunkCount = (count + InstanceUpdate::c_chunkSize - 1) / InstanceUpdate::c_chunkSize;
+		const XMMATRIX preMatrix = pre;
+		scratch.worldviews.resize(count);
+		scratch.sortedKinds.resize(count);
+
+		jobs.ParallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk) {
+			for (size_t c = firstChunk; c < lastChunk; c++) {
+				size_t first = c * InstanceUpdate::c_chunkSize;
+				size_t last = std::min(first + InstanceUpdate::c_chunkSize, count);
+				TransformBatch::WorldView(reinterpret_cast<const XMFLOAT4X4*>(reinterpret_cast<const BYTE*>(input.worlds) + first * input.worldStride),
+					last - first, input.worldStride, frame.model, frame.view, &scratch.worldviews[first]);
+				for (size_t k = first; k < last; k++)
+					scratch.sortedKinds[k] = *reinterpret_cast<const TransformBatch::TransformKind*>(reinterpret_cast<const BYTE*>(input.kinds) + k * input.kindStride);
+				TransformBatch::InstanceTransforms(&scratch.worldviews[first], &scratch.sortedKinds[first], last - first, preMatrix, frame.projection,
+					&output[first].transform, &output[first].normalTransform, sizeof(CullInstance));
+				for (size_t k = first; k < last; k++) {
+					output[k].material = *reinterpret_cast<const UINT*>(reinterpret_cast<const BYTE*>(input.materials) + k * input.materialStride);
+					output[k].shape = shape;
+					output[k].source = firstSource + static_cast<UINT>(k);
+					output[k].pad = 0;
+					output[k].worldview = scratch.worldviews[k];
+				}
+			}
+		});
+	}
+}
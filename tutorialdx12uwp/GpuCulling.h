@@ -0,0 +1,145 @@
+#pragma once
+#include "pch.h"
+#include "InstanceUpdate.h"
+#include "UploadRing.h"
+#include "CommandEncoder.h"
+
+// GPU driven drawing: a compute pass (cull.hlsl) culls every instance against the view frustum, picks its LOD
+// and appends it to the region of its shape and LOD in an instance buffer; each region has one indirect draw
+// whose instance count the pass increments, and the frame is submitted with a single ExecuteIndirect.
+// Visibility is the bounding sphere and then the bounding box against the six frustum planes, both in view
+// space; LOD selection is the one of InstanceUpdate. Cull is the same test on the CPU, kept as the reference
+// the pass is checked against (GpuCullingCheck.h).
+// Structs below match the ones in cull.hlsl byte for byte.
+
+namespace GpuCulling {
+
+	// Input of the pass, one per instance. Transforms are the ones the vertex shader reads (InstanceUpdate);
+	// the worldview is only for culling.
+	struct CullInstance {
+		XMFLOAT4X4 transform;
+		XMFLOAT4X4 normalTransform;
+		UINT material;
+		UINT shape;
+		UINT source;  // Copied to the output, so results can be compared instance by instance
+		UINT pad;
+		XMFLOAT4X4 worldview;
+	};
+
+	// Bounds and LODs of a shape, in model space.
+	struct CullShape {
+		XMFLOAT4 sphere;      // Center and radius
+		XMFLOAT4 boxCenter;
+		XMFLOAT4 boxExtents;
+		float lodError[Mesh::c_maxLods];
+		UINT lodCount;
+		UINT firstCommand;    // Draw of LOD 0; LOD l uses firstCommand + l
+		UINT pad[2];
+	};
+
+	// Root constants of the pass.
+	struct CullConstants {
+		XMFLOAT4 planes[6];   // View space, normals inwards and normalized
+		UINT instanceCount;
+		float pixelsPerUnit;  // Screen pixels of one unit at depth 1
+		float lodPixelError;  // Largest LOD error on screen, in pixels
+		UINT pad;
+	};
+
+	// Output of the pass, the InstanceData the vertex shader reads. source is in its first padding word.
+	struct OutputInstance {
+		XMFLOAT4X4 transform;
+		XMFLOAT4X4 normalTransform;
+		UINT material;
+		UINT source;
+		UINT pad[2];
+	};
+
+	// One indirect draw, in the order of the command signature: index buffer, first instance (root constant
+	// gInstanceBase) and the draw. The pass only touches draw.InstanceCount.
+	struct DrawCommand {
+		D3D12_INDEX_BUFFER_VIEW indexBuffer;
+		UINT firstInstance;
+		D3D12_DRAW_INDEXED_ARGUMENTS draw;
+	};
+
+	static_assert(sizeof(CullInstance) == 208, "CullInstance must match cull.hlsl");
+	static_assert(sizeof(CullShape) == 80, "CullShape must match cull.hlsl");
+	static_assert(sizeof(CullConstants) == 112, "CullConstants must match cull.hlsl");
+	static_assert(sizeof(OutputInstance) == 144, "OutputInstance must match InstanceData in Header.hlsli");
+	static_assert(sizeof(DrawCommand) == 40, "DrawCommand must match cull.hlsl");
+
+	// Result of culling one instance.
+	struct CullResult {
+		UINT lod;          // UINT_MAX when culled
+		bool nearBoundary; // Within rounding of a plane or an LOD threshold: the GPU may decide the other way
+	};
+
+	CullConstants MakeConstants(FXMMATRIX projection, UINT instanceCount, float pixelsPerUnit, float lodPixelError);
+	CullShape MakeShape(const Mesh& mesh, UINT firstCommand);
+
+	// CPU reference of the test in cull.hlsl.
+	CullResult Cull(const CullConstants& constants, const CullShape& shape, const XMFLOAT4X4& worldview);
+
+	// CPU reference of the whole pass. commands come with zero instance counts; output has room for the regions.
+	// Instances are appended in their input order, where the pass appends them in any order.
+	void Run(const CullConstants& constants, const CullShape* shapes, const CullInstance* instances,
+		DrawCommand* commands, OutputInstance* output);
+
+	// Writes the pass input for the instances of one shape: worldviews and transforms of every one of them,
+	// visible or not. Sources are firstSource onwards.
+	void WriteInstances(JobSystem& jobs, const InstanceUpdate::Frame& frame, FXMMATRIX pre, const InstanceUpdate::Input& input,
+		UINT shape, UINT firstSource, CullInstance* output, InstanceUpdate::Scratch& scratch);
+
+#ifndef _HEADLESS
+	// Pipeline objects and GPU buffers of the pass. The output and argument buffers live in a default heap and
+	// are shared by every frame: command lists run in order on the queue, and barriers order the pass with
+	// the draws of the previous frame.
+	class Culler
+	{
+	public:
+		static const UINT c_threadGroupSize = 64; // numthreads of cull.hlsl
+
+		// Loads cull.cso. graphicsRootSignature is the one of the draws: root parameter instanceBaseParameter
+		// holds gInstanceBase, set by every draw; the vertex shader reads instances from an SRV root parameter.
+		void Create(ID3D12Device* device, ID3D12RootSignature* graphicsRootSignature, UINT instanceBaseParameter);
+
+		// Room for outputCount output instances and commandCount draws. Buffers that are replaced stay alive
+		// until fenceValue, the fence of the frame that stops using them, is completed.
+		void Reserve(size_t outputCount, size_t commandCount, UINT64 fenceValue);
+		void ReleaseRetired(UINT64 completedFenceValue);
+
+		// Records the pass: copies commands (zero instance counts) to the argument buffer and culls instances.
+		// Leaves the compute pipeline state set; the caller sets its own before drawing.
+		void Record(CommandEncoder& commandList, const CullConstants& constants, const UploadRing::Allocation& instances,
+			const UploadRing::Allocation& shapes, const UploadRing::Allocation& commands, UINT commandCount);
+
+		// Draws the commands the last Record culled; instances are at OutputAddress.
+		void ExecuteDraws(CommandEncoder& commandList, UINT commandCount);
+
+		D3D12_GPU_VIRTUAL_ADDRESS OutputAddress() const { return m_output->GetGPUVirtualAddress(); }
+
+		// Between passes the output is in NON_PIXEL_SHADER_RESOURCE state and the arguments in INDIRECT_ARGUMENT.
+		ID3D12Resource* GetOutput() const { return m_output.Get(); }
+		ID3D12Resource* GetArguments() const { return m_arguments.Get(); }
+
+	private:
+		struct Retired {
+			Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+			UINT64 fenceValue;
+		};
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> createBuffer(UINT64 size, D3D12_RESOURCE_STATES state);
+
+		Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> m_rootSignature;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> m_pso;
+		Microsoft::WRL::ComPtr<ID3D12CommandSignature> m_commandSignature;
+		Microsoft::WRL::ComPtr<ID3D12Resource> m_output;
+		Microsoft::WRL::ComPtr<ID3D12Resource> m_arguments;
+		size_t m_outputCapacity = 0;
+		size_t m_commandCapacity = 0;
+		std::vector<Retired> m_retired;
+	};
+#endif
+}
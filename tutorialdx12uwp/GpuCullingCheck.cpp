@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "GpuCullingCheck.h"
+#include <random>
+
+namespace GpuCullingCheck {
+
+	using namespace GpuCulling;
+
+	namespace {
+
+		// Synthetic shapes: sphere and box a little off the origin, 1 to Mesh::c_maxLods LODs with growing errors.
+		std::vector<CullShape> makeShapes(UINT shapeCount) {
+			std::vector<CullShape> shapes(shapeCount);
+			for (UINT s = 0; s < shapeCount; s++) {
+				float size = 1.0f + 0.5f * s;
+				shapes[s] = {};
+				shapes[s].sphere = XMFLOAT4(0.1f * s, -0.05f * s, 0.0f, size);
+				shapes[s].boxCenter = XMFLOAT4(0.1f * s, -0.05f * s, 0.0f, 1.0f);
+				shapes[s].boxExtents = XMFLOAT4(0.6f * size, 0.4f * size, 0.5f * size, 0.0f);
+				shapes[s].lodCount = 1 + s % Mesh::c_maxLods;
+				for (UINT lod = 1; lod < shapes[s].lodCount; lod++)
+					shapes[s].lodError[lod] = 0.002f * std::pow(4.0f, static_cast<float>(lod));
+			}
+			return shapes;
+		}
+
+		// Worldview of an instance at position (view space) with a random rotation and scale.
+		XMFLOAT4X4 makeWorldview(std::mt19937& gen, FXMVECTOR position, bool uniformScale) {
+			std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+			std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+			float sx = scale(gen);
+			float sy = uniformScale ? sx : scale(gen);
+			float sz = uniformScale ? sx : scale(gen);
+			XMMATRIX worldview = XMMatrixScaling(sx, sy, sz) * XMMatrixRotationRollPitchYaw(angle(gen), angle(gen), angle(gen)) *
+				XMMatrixTranslationFromVector(position);
+			XMFLOAT4X4 result;
+			XMStoreFloat4x4(&result, worldview);
+			return result;
+		}
+
+		// Regions and draws once every instance has its shape: one draw per shape and LOD, each region sized
+		// for every instance of its shape.
+		void finishScene(Scene& scene) {
+			std::vector<size_t> shapeCounts(scene.shapes.size(), 0);
+			for (size_t i = 0; i < scene.instances.size(); i++) {
+				CullInstance& instance = scene.instances[i];
+				XMMATRIX worldview = XMLoadFloat4x4(&instance.worldview);
+				// Distinct data per instance, so copies can be checked.
+				XMStoreFloat4x4(&instance.transform, XMMatrixTranspose(worldview));
+				XMStoreFloat4x4(&instance.normalTransform, worldview * XMMatrixScaling(2.0f, 2.0f, 2.0f));
+				instance.material = static_cast<UINT>(i * 7 + 3);
+				instance.source = static_cast<UINT>(i);
+				instance.pad = 0;
+				shapeCounts[instance.shape]++;
+			}
+
+			scene.commands.clear();
+			scene.outputCount = 0;
+			for (size_t s = 0; s < scene.shapes.size(); s++) {
+				scene.shapes[s].firstCommand = static_cast<UINT>(scene.commands.size());
+				for (UINT lod = 0; lod < scene.shapes[s].lodCount; lod++) {
+					DrawCommand command = {};
+					command.firstInstance = static_cast<UINT>(scene.outputCount);
+					command.draw.IndexCountPerInstance = 3;
+					scene.commands.push_back(command);
+					scene.outputCount += shapeCounts[s];
+				}
+			}
+			scene.constants.instanceCount = static_cast<UINT>(scene.instances.size());
+		}
+
+		Scene makeScene(const wchar_t* name, Expect expect, FXMMATRIX projection, float pixelsPerUnit, UINT shapeCount) {
+			Scene scene;
+			scene.name = name;
+			scene.expect = expect;
+			scene.constants = MakeConstants(projection, 0, pixelsPerUnit, 1.0f);
+			scene.shapes = makeShapes(shapeCount);
+			scene.outputCount = 0;
+			return scene;
+		}
+
+		void addInstance(Scene& scene, UINT shape, const XMFLOAT4X4& worldview) {
+			CullInstance instance = {};
+			instance.shape = shape;
+			instance.worldview = worldview;
+			scene.instances.push_back(instance);
+		}
+
+		// Instances uniformly spread in a box of view space, around and behind the frustum too.
+		Scene randomScene(const wchar_t* name, Expect expect, FXMMATRIX projection, float pixelsPerUnit, UINT shapeCount,
+			size_t instanceCount, XMFLOAT3 lower, XMFLOAT3 upper, unsigned seed) {
+			Scene scene = makeScene(name, expect, projection, pixelsPerUnit, shapeCount);
+			std::mt19937 gen(seed);
+			std::uniform_real_distribution<float> x(lower.x, upper.x), y(lower.y, upper.y), z(lower.z, upper.z);
+			std::uniform_int_distribution<UINT> shape(0, shapeCount - 1);
+			for (size_t i = 0; i < instanceCount; i++)
+				addInstance(scene, shape(gen), makeWorldview(gen, XMVectorSet(x(gen), y(gen), z(gen), 1.0f), i % 2 == 0));
+			finishScene(scene);
+			return scene;
+		}
+
+		// Bounding spheres cut by one of the planes, centers within one and a half radii of it on either side.
+		Scene straddlingScene(FXMMATRIX projection, float pixelsPerUnit, UINT shapeCount, size_t instanceCount) {
+			Scene scene = makeScene(L"straddling", Expect::Any, projection, pixelsPerUnit, shapeCount);
+			std::mt19937 gen(3);
+			std::uniform_real_distribution<float> x(-200.0f, 200.0f), y(-200.0f, 200.0f), z(1.0f, 990.0f), offset(-1.5f, 1.5f);
+			std::uniform_int_distribution<UINT> shape(0, shapeCount - 1), plane(0, 5);
+			for (size_t i = 0; i < instanceCount; i++) {
+				UINT s = shape(gen);
+				XMVECTOR p = XMLoadFloat4(&scene.constants.planes[plane(gen)]);
+				XMVECTOR point = XMVectorSet(x(gen), y(gen), z(gen), 1.0f);
+				// Onto the plane, then along its normal; the rotation and scale come after, so the distance is approximate.
+				point -= XMPlaneDotCoord(p, point) * p;
+				point += offset(gen) * scene.shapes[s].sphere.w * p;
+				addInstance(scene, s, makeWorldview(gen, XMVectorSetW(point, 1.0f), true));
+			}
+			finishScene(scene);
+			return scene;
+		}
+
+		// Instances along the view axis from the near to the far plane, so every LOD threshold is crossed.
+		Scene lodScene(FXMMATRIX projection, float pixelsPerUnit, UINT shapeCount, size_t instanceCount) {
+			Scene scene = makeScene(L"LOD sweep", Expect::Any, projection, pixelsPerUnit, shapeCount);
+			std::mt19937 gen(4);
+			for (size_t i = 0; i < instanceCount; i++) {
+				float z = 1.0f + 998.0f * static_cast<float>(i) / static_cast<float>(instanceCount);
+				addInstance(scene, static_cast<UINT>(i % shapeCount), makeWorldview(gen, XMVectorSet(0.0f, 0.0f, z, 1.0f), true));
+			}
+			finishScene(scene);
+			return scene;
+		}
+	}
+
+	std::vector<Scene> MakeScenes() {
+		const float fovY = 0.25f * XM_PI;
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(fovY, 16.0f / 9.0f, 0.5f, 1000.0f);
+		float pixelsPerUnit = 720.0f / (2.0f * std::tan(0.5f * fovY));
+
+		std::vector<Scene> scenes;
+		scenes.push_back(randomScene(L"random", Expect::Any, projection, pixelsPerUnit, 3, 10000,
+			XMFLOAT3(-400.0f, -400.0f, -50.0f), XMFLOAT3(400.0f, 400.0f, 1050.0f), 1));
+		scenes.push_back(randomScene(L"all visible", Expect::AllVisible, projection, pixelsPerUnit, 3, 5000,
+			XMFLOAT3(-2.0f, -2.0f, 20.0f), XMFLOAT3(2.0f, 2.0f, 60.0f), 2));
+		scenes.push_back(randomScene(L"all culled", Expect::AllCulled, projection, pixelsPerUnit, 3, 5000,
+			XMFLOAT3(-100.0f, -100.0f, -500.0f), XMFLOAT3(100.0f, 100.0f, -10.0f), 5));
+		scenes.push_back(straddlingScene(projection, pixelsPerUnit, 4, 10000));
+		scenes.push_back(lodScene(projection, pixelsPerUnit, 4, 4000));
+		scenes.push_back(randomScene(L"empty", Expect::Any, projection, pixelsPerUnit, 2, 0,
+			XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f), 6));
+		scenes.push_back(randomScene(L"large", Expect::Any, projection, pixelsPerUnit, 8, 200000,
+			XMFLOAT3(-300.0f, -300.0f, -50.0f), XMFLOAT3(300.0f, 300.0f, 1050.0f), 7));
+		return scenes;
+	}
+
+	size_t CheckReference(const Scene& scene, std::vector<DrawCommand>& commands, std::vector<OutputInstance>& output) {
+		commands = scene.commands;
+		output.assign(scene.outputCount, OutputInstance());
+		GpuCulling::Run(scene.constants, scene.shapes.data(), scene.instances.data(), commands.data(), output.data());
+
+		// Where every instance went: the draw of its shape and LOD, once.
+		size_t mismatches = 0;
+		std::vector<UINT> seen(scene.instances.size(), 0);
+		for (size_t s = 0; s < scene.shapes.size(); s++) {
+			const CullShape& shape = scene.shapes[s];
+			for (UINT lod = 0; lod < shape.lodCount; lod++) {
+				UINT c = shape.firstCommand + lod;
+				const DrawCommand& command = commands[c];
+				size_t regionEnd = c + 1 < commands.size() ? commands[c + 1].firstInstance : scene.outputCount;
+				if (command.firstInstance != scene.commands[c].firstInstance || command.firstInstance + command.draw.InstanceCount > regionEnd) {
+					mismatches++;
+					continue;
+				}
+				for (UINT k = 0; k < command.draw.InstanceCount; k++) {
+					const OutputInstance& out = output[command.firstInstance + k];
+					if (out.source >= scene.instances.size()) {
+						mismatches++;
+						continue;
+					}
+					const CullInstance& in = scene.instances[out.source];
+					seen[out.source]++;
+					if (in.shape != s || Cull(scene.constants, shape, in.worldview).lod != lod ||
+						memcmp(&out.transform, &in.transform, sizeof(XMFLOAT4X4)) != 0 ||
+						memcmp(&out.normalTransform, &in.normalTransform, sizeof(XMFLOAT4X4)) != 0 || out.material != in.material)
+						mismatches++;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < scene.instances.size(); i++) {
+			const CullInstance& instance = scene.instances[i];
+			bool visible = Cull(scene.constants, scene.shapes[instance.shape], instance.worldview).lod != UINT_MAX;
+			if (seen[i] != (visible ? 1u : 0u) || (scene.expect == Expect::AllVisible && !visible) ||
+				(scene.expect == Expect::AllCulled && visible))
+				mismatches++;
+		}
+		return mismatches;
+	}
+}
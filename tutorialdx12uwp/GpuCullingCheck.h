@@ -0,0 +1,44 @@
+#pragma once
+#include "pch.h"
+#include "GpuCulling.h"
+
+// Checks the GPU culling pass (cull.hlsl) against its CPU reference, GpuCulling::Run, on synthetic scenes:
+// random instances, all of them visible, all of them culled, instances straddling the frustum planes, an LOD
+// sweep in depth, an empty scene and a large one. Per draw, both must find the same instance counts and the
+// same instances with their data copied untouched; instances within rounding of a plane or an LOD threshold
+// may go either way. Report goes through MYTRACE.
+// CheckReference needs no device: the CMake build runs it on every scene (GpuCullingCheckMain.cpp). Run compares
+// the pass with it on a device; it is compiled in when _VALIDATE_GPU_CULLING is defined in pch.h and runs once at
+// startup on an idle queue.
+
+namespace GpuCullingCheck {
+
+	// What every instance of a scene must come to, whatever the rounding.
+	enum class Expect { Any, AllVisible, AllCulled };
+
+	// Pass input and draws, one per shape and LOD with a zero instance count, each with a region sized for every
+	// instance of its shape.
+	struct Scene {
+		const wchar_t* name;
+		Expect expect;
+		GpuCulling::CullConstants constants;
+		std::vector<GpuCulling::CullShape> shapes;
+		std::vector<GpuCulling::CullInstance> instances;
+		std::vector<GpuCulling::DrawCommand> commands;
+		size_t outputCount;
+	};
+
+	// The scenes of the check, seen by a 16:9 camera 720 pixels high with a vertical field of view of 45 degrees.
+	std::vector<Scene> MakeScenes();
+
+	// Runs GpuCulling::Run on scene into commands and output, and checks it instance by instance against Cull:
+	// every visible instance once in the draw of its shape and LOD, copied untouched, culled ones in none, no draw
+	// past its region, and the scene's Expect. Returns the number of mismatches.
+	size_t CheckReference(const Scene& scene, std::vector<GpuCulling::DrawCommand>& commands,
+		std::vector<GpuCulling::OutputInstance>& output);
+
+#ifndef _HEADLESS
+	// graphicsRootSignature and instanceBaseParameter as in GpuCulling::Culler::Create. Returns whether every scene matched.
+	bool Run(ID3D12Device* device, ID3D12CommandQueue* queue, ID3D12RootSignature* graphicsRootSignature, UINT instanceBaseParameter);
+#endif
+}
@@ -0,0 +1,172 @@
+#include "pch.h"
+#include "GpuCullingCheck.h"
+#include "D3D12UploadBackend.h"
+#include <iterator>
+
+// GpuCullingCheck::Run, the comparison of the pass with its CPU reference on a device.
+
+namespace GpuCullingCheck {
+
+	using namespace GpuCulling;
+
+	namespace {
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> createReadback(ID3D12Device* device, UINT64 size) {
+			Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+			CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_READBACK);
+			CD3DX12_RESOURCE_DESC resourceDescription = CD3DX12_RESOURCE_DESC::Buffer(std::max<UINT64>(size, 1));
+			DX::ThrowIfFailed(device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDescription,
+				D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(buffer.GetAddressOf())));
+			return buffer;
+		}
+
+		// Sources of a draw's instances, sorted, without those near a boundary.
+		std::vector<UINT> drawSources(const DrawCommand& command, const OutputInstance* output, const std::vector<bool>& nearBoundary) {
+			std::vector<UINT> sources;
+			for (UINT k = 0; k < command.draw.InstanceCount; k++) {
+				UINT source = output[command.firstInstance + k].source;
+				if (source >= nearBoundary.size() || !nearBoundary[source])
+					sources.push_back(source);
+			}
+			std::sort(sources.begin(), sources.end());
+			return sources;
+		}
+
+		void report(const wchar_t* format, ...) {
+			wchar_t buffer[256];
+			va_list args;
+			va_start(args, format);
+			vswprintf_s(buffer, 256, format, args);
+			va_end(args);
+			MYTRACE(buffer);
+		}
+	}
+
+	bool Run(ID3D12Device* device, ID3D12CommandQueue* queue, ID3D12RootSignature* graphicsRootSignature, UINT instanceBaseParameter) {
+		std::vector<Scene> scenes = MakeScenes();
+
+		Culler culler;
+		culler.Create(device, graphicsRootSignature, instanceBaseParameter);
+		UploadRing ring;
+		ring.Create(std::make_shared<D3D12UploadBackend>(device), 1 << 20);
+
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList;
+		Microsoft::WRL::ComPtr<ID3D12Fence> fence;
+		DX::ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(allocator.GetAddressOf())));
+		DX::ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, allocator.Get(), nullptr, IID_PPV_ARGS(commandList.GetAddressOf())));
+		DX::ThrowIfFailed(commandList->Close());
+		DX::ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(fence.GetAddressOf())));
+		Microsoft::WRL::Wrappers::Event fenceEvent(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
+		if (!fenceEvent.IsValid())
+			throw std::exception("CreateEvent");
+		UINT64 fenceValue = 0;
+
+		bool allMatch = true;
+		for (const Scene& scene : scenes) {
+			UINT commandCount = static_cast<UINT>(scene.commands.size());
+
+			// CPU reference, itself checked against Cull.
+			std::vector<DrawCommand> expected;
+			std::vector<OutputInstance> expectedOutput;
+			size_t referenceMismatches = CheckReference(scene, expected, expectedOutput);
+			std::vector<bool> nearBoundary(scene.instances.size());
+			size_t nearCount = 0;
+			for (size_t i = 0; i < scene.instances.size(); i++) {
+				nearBoundary[i] = Cull(scene.constants, scene.shapes[scene.instances[i].shape], scene.instances[i].worldview).nearBoundary;
+				nearCount += nearBoundary[i] ? 1 : 0;
+			}
+
+			// The pass, with its results copied back.
+			ring.BeginFrame(fence->GetCompletedValue());
+			UploadRing::Allocation instances = ring.Allocate(scene.instances.size() * sizeof(CullInstance), D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+			UploadRing::Allocation shapes = ring.Allocate(scene.shapes.size() * sizeof(CullShape), D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+			UploadRing::Allocation commands = ring.Allocate(commandCount * sizeof(DrawCommand), D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+			if (!scene.instances.empty())
+				memcpy(instances.cpuAddress, scene.instances.data(), instances.size);
+			memcpy(shapes.cpuAddress, scene.shapes.data(), shapes.size);
+			memcpy(commands.cpuAddress, scene.commands.data(), commands.size);
+			culler.Reserve(std::max<size_t>(scene.outputCount, 1), commandCount, fenceValue);
+			culler.ReleaseRetired(fence->GetCompletedValue());
+
+			UINT64 outputBytes = scene.outputCount * sizeof(OutputInstance);
+			UINT64 commandBytes = commandCount * sizeof(DrawCommand);
+			Microsoft::WRL::ComPtr<ID3D12Resource> outputReadback = createReadback(device, outputBytes);
+			Microsoft::WRL::ComPtr<ID3D12Resource> commandReadback = createReadback(device, commandBytes);
+
+			DX::ThrowIfFailed(allocator->Reset());
+			DX::ThrowIfFailed(commandList->Reset(allocator.Get(), nullptr));
+			D3D12CommandEncoder encoder(commandList.Get());
+			culler.Record(encoder, scene.constants, instances, shapes, commands, commandCount);
+			D3D12_RESOURCE_BARRIER toCopy[] = {
+				CD3DX12_RESOURCE_BARRIER::Transition(culler.GetArguments(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_SOURCE),
+				CD3DX12_RESOURCE_BARRIER::Transition(culler.GetOutput(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE)
+			};
+			commandList->ResourceBarrier(_countof(toCopy), toCopy);
+			commandList->CopyBufferRegion(commandReadback.Get(), 0, culler.GetArguments(), 0, commandBytes);
+			if (outputBytes > 0)
+				commandList->CopyBufferRegion(outputReadback.Get(), 0, culler.GetOutput(), 0, outputBytes);
+			D3D12_RESOURCE_BARRIER back[] = {
+				CD3DX12_RESOURCE_BARRIER::Transition(culler.GetArguments(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+				CD3DX12_RESOURCE_BARRIER::Transition(culler.GetOutput(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
+			};
+			commandList->ResourceBarrier(_countof(back), back);
+			DX::ThrowIfFailed(commandList->Close());
+			ID3D12CommandList* lists[] = { commandList.Get() };
+			queue->ExecuteCommandLists(1, lists);
+			DX::ThrowIfFailed(queue->Signal(fence.Get(), ++fenceValue));
+			ring.EndFrame(fenceValue);
+			DX::ThrowIfFailed(fence->SetEventOnCompletion(fenceValue, fenceEvent.Get()));
+			WaitForSingleObjectEx(fenceEvent.Get(), INFINITE, FALSE);
+
+			// Per draw: same instances, unchanged, in a region that holds them.
+			void* commandData = nullptr;
+			void* outputData = nullptr;
+			CD3DX12_RANGE commandRange(0, static_cast<SIZE_T>(commandBytes));
+			CD3DX12_RANGE outputRange(0, static_cast<SIZE_T>(outputBytes));
+			CD3DX12_RANGE noWrite(0, 0);
+			DX::ThrowIfFailed(commandReadback->Map(0, &commandRange, &commandData));
+			DX::ThrowIfFailed(outputReadback->Map(0, &outputRange, &outputData));
+			const DrawCommand* gpuCommands = static_cast<const DrawCommand*>(commandData);
+			const OutputInstance* gpuOutput = static_cast<const OutputInstance*>(outputData);
+
+			size_t visible = 0;
+			size_t mismatches = referenceMismatches;
+			for (UINT c = 0; c < commandCount; c++) {
+				const DrawCommand& gpu = gpuCommands[c];
+				const DrawCommand& cpu = expected[c];
+				visible += cpu.draw.InstanceCount;
+				UINT regionEnd = c + 1 < commandCount ? expected[c + 1].firstInstance : static_cast<UINT>(scene.outputCount);
+				if (memcmp(&gpu.indexBuffer, &cpu.indexBuffer, sizeof(gpu.indexBuffer)) != 0 || gpu.firstInstance != cpu.firstInstance ||
+					gpu.draw.IndexCountPerInstance != cpu.draw.IndexCountPerInstance || gpu.firstInstance + gpu.draw.InstanceCount > regionEnd) {
+					mismatches++;
+					continue;
+				}
+				std::vector<UINT> gpuSources = drawSources(gpu, gpuOutput, nearBoundary);
+				std::vector<UINT> cpuSources = drawSources(cpu, expectedOutput.data(), nearBoundary);
+				std::vector<UINT> difference;
+				std::set_symmetric_difference(gpuSources.begin(), gpuSources.end(), cpuSources.begin(), cpuSources.end(), std::back_inserter(difference));
+				mismatches += difference.size();
+
+				for (UINT k = 0; k < gpu.draw.InstanceCount; k++) {
+					const OutputInstance& out = gpuOutput[gpu.firstInstance + k];
+					if (out.source >= scene.instances.size()) {
+						mismatches++;
+						continue;
+					}
+					const CullInstance& in = scene.instances[out.source];
+					if (memcmp(&out.transform, &in.transform, sizeof(XMFLOAT4X4)) != 0 ||
+						memcmp(&out.normalTransform, &in.normalTransform, sizeof(XMFLOAT4X4)) != 0 || out.material != in.material)
+						mismatches++;
+				}
+			}
+			commandReadback->Unmap(0, &noWrite);
+			outputReadback->Unmap(0, &noWrite);
+
+			report(L"GPU culling %s: %zu instances, %zu visible, %zu near a boundary, %zu mismatches\n",
+				scene.name, scene.instances.size(), visible, nearCount, mismatches);
+			allMatch = allMatch && mismatches == 0;
+		}
+		return allMatch;
+	}
+}
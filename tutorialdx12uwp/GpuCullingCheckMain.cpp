@@ -0,0 +1,25 @@
+#include "pch.h"
+#include "GpuCullingCheck.h"
+
+// Console check of the CPU reference of GPU culling (GpuCullingCheck::CheckReference) on the scenes of
+// GpuCullingCheck, built by CMakeLists.txt on the core library. The comparison with the pass itself needs a device
+// and runs in the app (_VALIDATE_GPU_CULLING). Exits with 1 when a scene has a mismatch.
+
+int main() {
+	size_t failed = 0;
+	for (const GpuCullingCheck::Scene& scene : GpuCullingCheck::MakeScenes()) {
+		std::vector<GpuCulling::DrawCommand> commands;
+		std::vector<GpuCulling::OutputInstance> output;
+		size_t mismatches = GpuCullingCheck::CheckReference(scene, commands, output);
+		size_t visible = 0;
+		for (const GpuCulling::DrawCommand& command : commands)
+			visible += command.draw.InstanceCount;
+
+		wchar_t msgbuff[256];
+		swprintf(msgbuff, 256, L"GPU culling reference %ls: %zu instances, %zu visible in %zu draws, %zu mismatches\n",
+			scene.name, scene.instances.size(), visible, commands.size(), mismatches);
+		MYTRACE(msgbuff);
+		failed += mismatches > 0 ? 1 : 0;
+	}
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "GpuCulling.h"
+
+// GpuCulling::Culler, the part of GPU culling that needs a device; the CPU reference is in GpuCulling.cpp.
+
+namespace GpuCulling {
+
+	void Culler::Create(ID3D12Device* device, ID3D12RootSignature* graphicsRootSignature, UINT instanceBaseParameter) {
+		m_device = device;
+		m_output.Reset();
+		m_arguments.Reset();
+		m_outputCapacity = 0;
+		m_commandCapacity = 0;
+		m_retired.clear();
+
+		// Constants, instances and shapes in, culled instances and draws out; all root parameters, so nothing
+		// goes through descriptor heaps.
+		CD3DX12_ROOT_PARAMETER parameters[5];
+		parameters[0].InitAsConstants(sizeof(CullConstants) / 4, 0);
+		parameters[1].InitAsShaderResourceView(0);
+		parameters[2].InitAsShaderResourceView(1);
+		parameters[3].InitAsUnorderedAccessView(0);
+		parameters[4].InitAsUnorderedAccessView(1);
+		CD3DX12_ROOT_SIGNATURE_DESC description(_countof(parameters), parameters);
+
+		Microsoft::WRL::ComPtr<ID3DBlob> serialized;
+		Microsoft::WRL::ComPtr<ID3DBlob> error;
+		DX::ThrowIfFailed(D3D12SerializeRootSignature(&description, D3D_ROOT_SIGNATURE_VERSION_1, serialized.GetAddressOf(), error.GetAddressOf()));
+		DX::ThrowIfFailed(device->CreateRootSignature(0, serialized->GetBufferPointer(), serialized->GetBufferSize(), IID_PPV_ARGS(m_rootSignature.ReleaseAndGetAddressOf())));
+
+		Microsoft::WRL::ComPtr<ID3DBlob> shader;
+		DX::ThrowIfFailed(D3DReadFileToBlob(L"cull.cso", shader.GetAddressOf()));
+		D3D12_COMPUTE_PIPELINE_STATE_DESC psoDescription = {};
+		psoDescription.pRootSignature = m_rootSignature.Get();
+		psoDescription.CS = { shader->GetBufferPointer(), shader->GetBufferSize() };
+		DX::ThrowIfFailed(device->CreateComputePipelineState(&psoDescription, IID_PPV_ARGS(m_pso.ReleaseAndGetAddressOf())));
+
+		// Layout of DrawCommand.
+		D3D12_INDIRECT_ARGUMENT_DESC arguments[3] = {};
+		arguments[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+		arguments[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+		arguments[1].Constant.RootParameterIndex = instanceBaseParameter;
+		arguments[1].Constant.DestOffsetIn32BitValues = 0;
+		arguments[1].Constant.Num32BitValuesToSet = 1;
+		arguments[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+		D3D12_COMMAND_SIGNATURE_DESC signatureDescription = {};
+		signatureDescription.ByteStride = sizeof(DrawCommand);
+		signatureDescription.NumArgumentDescs = _countof(arguments);
+		signatureDescription.pArgumentDescs = arguments;
+		DX::ThrowIfFailed(device->CreateCommandSignature(&signatureDescription, graphicsRootSignature, IID_PPV_ARGS(m_commandSignature.ReleaseAndGetAddressOf())));
+
+		Reserve(1, 1, 0);
+	}
+
+	void Culler::Reserve(size_t outputCount, size_t commandCount, UINT64 fenceValue) {
+		if (outputCount > m_outputCapacity) {
+			if (m_output != nullptr)
+				m_retired.push_back(Retired{ m_output, fenceValue });
+			m_outputCapacity = std::max(outputCount, 2 * m_outputCapacity);
+			m_output = createBuffer(m_outputCapacity * sizeof(OutputInstance), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		}
+		if (commandCount > m_commandCapacity) {
+			if (m_arguments != nullptr)
+				m_retired.push_back(Retired{ m_arguments, fenceValue });
+			m_commandCapacity = std::max(commandCount, 2 * m_commandCapacity);
+			m_arguments = createBuffer(m_commandCapacity * sizeof(DrawCommand), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+		}
+	}
+
+	void Culler::ReleaseRetired(UINT64 completedFenceValue) {
+		m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(), [completedFenceValue](const Retired& old) {
+			return old.fenceValue <= completedFenceValue;
+		}), m_retired.end());
+	}
+
+	void Culler::Record(CommandEncoder& commandList, const CullConstants& constants, const UploadRing::Allocation& instances,
+		const UploadRing::Allocation& shapes, const UploadRing::Allocation& commands, UINT commandCount) {
+		assert(commandCount <= m_commandCapacity);
+		if (commandCount == 0)
+			return;
+
+		commandList.Upload(commands.gpuAddress, commands.size);
+		if (constants.instanceCount > 0) {
+			commandList.Upload(instances.gpuAddress, instances.size);
+			commandList.Upload(shapes.gpuAddress, shapes.size);
+		}
+
+		// The draws of the previous frame are done with both buffers before they are written again.
+		D3D12_RESOURCE_BARRIER before[] = {
+			CD3DX12_RESOURCE_BARRIER::Transition(m_arguments.Get(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST),
+			CD3DX12_RESOURCE_BARRIER::Transition(m_output.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+		};
+		commandList.ResourceBarrier(_countof(before), before);
+		commandList.CopyBufferRegion(m_arguments.Get(), 0, commands.resource, commands.offset, commandCount * sizeof(DrawCommand));
+		D3D12_RESOURCE_BARRIER copied = CD3DX12_RESOURCE_BARRIER::Transition(m_arguments.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		commandList.ResourceBarrier(1, &copied);
+
+		if (constants.instanceCount > 0) {
+			commandList.SetComputeRootSignature(m_rootSignature.Get());
+			commandList.SetPipelineState(m_pso.Get());
+			commandList.SetComputeRoot32BitConstants(0, sizeof(CullConstants) / 4, &constants, 0);
+			commandList.SetComputeRootShaderResourceView(1, instances.gpuAddress);
+			commandList.SetComputeRootShaderResourceView(2, shapes.gpuAddress);
+			commandList.SetComputeRootUnorderedAccessView(3, m_output->GetGPUVirtualAddress());
+			commandList.SetComputeRootUnorderedAccessView(4, m_arguments->GetGPUVirtualAddress());
+			commandList.Dispatch((constants.instanceCount + c_threadGroupSize - 1) / c_threadGroupSize, 1, 1);
+		}
+
+		D3D12_RESOURCE_BARRIER after[] = {
+			CD3DX12_RESOURCE_BARRIER::Transition(m_arguments.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+			CD3DX12_RESOURCE_BARRIER::Transition(m_output.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
+		};
+		commandList.ResourceBarrier(_countof(after), after);
+	}
+
+	void Culler::ExecuteDraws(CommandEncoder& commandList, UINT commandCount) {
+		if (commandCount > 0)
+			commandList.ExecuteIndirect(m_commandSignature.Get(), commandCount, m_arguments.Get(), 0);
+	}
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> Culler::createBuffer(UINT64 size, D3D12_RESOURCE_STATES state) {
+		Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+		CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_DEFAULT);
+		CD3DX12_RESOURCE_DESC resourceDescription = CD3DX12_RESOURCE_DESC::Buffer(size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		DX::ThrowIfFailed(m_device->CreateCommittedResource(
+			&heapProperties,
+			D3D12_HEAP_FLAG_NONE,
+			&resourceDescription,
+			state,
+			nullptr,
+			IID_PPV_ARGS(buffer.GetAddressOf())));
+		return buffer;
+	}
+}
@@ -6,6 +6,15 @@ struct VertexIn {
 	nointerpolation uint mind : MATINDEX;
 };
 
+// Compact layout (PackedVertex in VertexPacking.h). Position arrives in [0,1] and the instance
+// transform includes the dequantization; normal is octahedral encoded.
+struct VertexInPacked {
+	float3 pos : POSITION;
+	float4 color : COLOR;
+	float2 normal : NORMAL;
+	float2 uvcoord : UV;
+};
+
 struct VertexOut {
 	float4 pos : SV_POSITION;
 	float4 color : COLOR;
@@ -29,7 +38,21 @@ cbuffer cb : register(b0)
 	float4x4 gPassTransform;
 };
 
+// Root constant: first instance of the current draw
+cbuffer cbDraw : register(b1)
+{
+	uint gInstanceBase;
+};
+
 Texture2D textcolor : register(t0);
 SamplerState textsampler : register(s0);
 
-StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
\ No newline at end of file
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+
+float3 OctahedralDecode(float2 e)
+{
+	float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "pch.h"
+#include "InstanceStore.h"
+
+void InstanceStore::Clear(size_t shapeCount) {
+	m_positions.clear();
+	m_rotations.clear();
+	m_scales.clear();
+	m_materials.clear();
+	m_shapes.clear();
+	m_flags.clear();
+	m_worlds.clear();
+	m_kinds.clear();
+	m_denseToSlot.clear();
+	m_slots.clear();
+	m_freeSlots.clear();
+	m_shapeFirst.assign(shapeCount + 1, 0);
+}
+
+void InstanceStore::Reserve(size_t instanceCount) {
+	m_positions.reserve(instanceCount);
+	m_rotations.reserve(instanceCount);
+	m_scales.reserve(instanceCount);
+	m_materials.reserve(instanceCount);
+	m_shapes.reserve(instanceCount);
+	m_flags.reserve(instanceCount);
+	m_worlds.reserve(instanceCount);
+	m_kinds.reserve(instanceCount);
+	m_denseToSlot.reserve(instanceCount);
+	m_slots.reserve(instanceCount);
+}
+
+InstanceStore::Handle InstanceStore::Add(UINT shape, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale, UINT material, uint8_t flags) {
+	assert(shape < GetShapeCount());
+
+	// The new instance goes at the end of its shape: every later shape moves its first instance to its end.
+	pushBack();
+	size_t hole = Size() - 1;
+	m_shapeFirst.back()++;
+	for (size_t t = GetShapeCount() - 1; t > shape; t--) {
+		if (m_shapeFirst[t] != hole)
+			move(m_shapeFirst[t], hole);
+		hole = m_shapeFirst[t];
+		m_shapeFirst[t]++;
+	}
+
+	UINT slot;
+	if (m_freeSlots.empty()) {
+		slot = static_cast<UINT>(m_slots.size());
+		m_slots.push_back(Slot{ c_invalidIndex, 0 });
+	}
+	else {
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	m_slots[slot].dense = static_cast<UINT>(hole);
+	m_denseToSlot[hole] = slot;
+
+	m_positions[hole] = position;
+	m_rotations[hole] = rotation;
+	m_scales[hole] = scale;
+	m_materials[hole] = material;
+	m_shapes[hole] = shape;
+	m_flags[hole] = flags;
+	updateWorld(hole);
+	return Handle{ slot, m_slots[slot].generation };
+}
+
+void InstanceStore::Remove(Handle handle) {
+	assert(IsValid(handle));
+	size_t index = m_slots[handle.index].dense;
+	UINT shape = m_shapes[index];
+	m_slots[handle.index].dense = c_invalidIndex;
+	m_slots[handle.index].generation++;
+	m_freeSlots.push_back(handle.index);
+
+	// The last instance of the shape fills the hole, then every later shape moves its last instance to its start.
+	size_t hole = index;
+	for (size_t t = shape; t < GetShapeCount(); t++) {
+		size_t last = m_shapeFirst[t + 1] - 1;
+		if (last != hole)
+			move(last, hole);
+		hole = last;
+		m_shapeFirst[t + 1]--;
+	}
+	popBack();
+}
+
+bool InstanceStore::IsValid(Handle handle) const {
+	return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation &&
+		m_slots[handle.index].dense != c_invalidIndex;
+}
+
+void InstanceStore::SetTransform(Handle handle, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale) {
+	size_t index = IndexOf(handle);
+	m_positions[index] = position;
+	m_rotations[index] = rotation;
+	m_scales[index] = scale;
+	updateWorld(index);
+}
+
+void InstanceStore::SetMaterial(Handle handle, UINT material) {
+	m_materials[IndexOf(handle)] = material;
+}
+
+size_t InstanceStore::IndexOf(Handle handle) const {
+	assert(IsValid(handle));
+	return m_slots[handle.index].dense;
+}
+
+void InstanceStore::pushBack() {
+	m_positions.emplace_back();
+	m_rotations.emplace_back();
+	m_scales.emplace_back();
+	m_materials.emplace_back();
+	m_shapes.emplace_back();
+	m_flags.emplace_back();
+	m_worlds.emplace_back();
+	m_kinds.emplace_back();
+	m_denseToSlot.emplace_back();
+}
+
+void InstanceStore::popBack() {
+	m_positions.pop_back();
+	m_rotations.pop_back();
+	m_scales.pop_back();
+	m_materials.pop_back();
+	m_shapes.pop_back();
+	m_flags.pop_back();
+	m_worlds.pop_back();
+	m_kinds.pop_back();
+	m_denseToSlot.pop_back();
+}
+
+void InstanceStore::move(size_t from, size_t to) {
+	m_positions[to] = m_positions[from];
+	m_rotations[to] = m_rotations[from];
+	m_scales[to] = m_scales[from];
+	m_materials[to] = m_materials[from];
+	m_shapes[to] = m_shapes[from];
+	m_flags[to] = m_flags[from];
+	m_worlds[to] = m_worlds[from];
+	m_kinds[to] = m_kinds[from];
+	m_denseToSlot[to] = m_denseToSlot[from];
+	m_slots[m_denseToSlot[to]].dense = static_cast<UINT>(to);
+}
+
+void InstanceStore::updateWorld(size_t index) {
+	const XMFLOAT3& scale = m_scales[index];
+	XMMATRIX world = XMMatrixScaling(scale.x, scale.y, scale.z) *
+		XMMatrixRotationQuaternion(XMLoadFloat4(&m_rotations[index])) *
+		XMMatrixTranslation(m_positions[index].x, m_positions[index].y, m_positions[index].z);
+	XMStoreFloat4x4(&m_worlds[index], world);
+
+	if (scale.x == 1.0f && scale.y == 1.0f && scale.z == 1.0f)
+		m_kinds[index] = TransformBatch::TransformKind::Rigid;
+	else if (scale.x == scale.y && scale.y == scale.z)
+		m_kinds[index] = TransformBatch::TransformKind::UniformScale;
+	else
+		m_kinds[index] = TransformBatch::TransformKind::General;
+}
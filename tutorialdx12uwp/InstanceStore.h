@@ -0,0 +1,75 @@
+#pragma once
+#include "pch.h"
+#include "TransformBatch.h"
+
+// Instances of every shape in structure of arrays form: one contiguous array per attribute.
+// Instances of a shape are a dense range of the arrays, so per shape passes read contiguous memory and the
+// batch code in TransformBatch works on them directly. Handles stay valid while other instances are added
+// or removed; removing an instance moves others inside the arrays, so dense indices are only valid until then.
+// World matrices and their kinds are derived from position, rotation and scale when those change.
+
+class InstanceStore
+{
+public:
+	struct Handle {
+		UINT index;      // Slot in the handle table
+		UINT generation; // Tells a removed instance from a new one in the same slot
+	};
+
+	static const UINT c_invalidIndex = UINT_MAX;
+
+	// Removes every instance and sets the number of shapes.
+	void Clear(size_t shapeCount);
+	void Reserve(size_t instanceCount);
+
+	Handle Add(UINT shape, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale, UINT material, uint8_t flags = 0);
+	void Remove(Handle handle);
+	bool IsValid(Handle handle) const;
+
+	// rotation is a quaternion.
+	void SetTransform(Handle handle, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale);
+	void SetMaterial(Handle handle, UINT material);
+
+	// Dense index of a valid handle.
+	size_t IndexOf(Handle handle) const;
+
+	size_t Size() const { return m_shapes.size(); }
+	size_t GetShapeCount() const { return m_shapeFirst.size() - 1; }
+	// Instances of shape are [ShapeFirst(shape), ShapeFirst(shape) + ShapeCount(shape)) in the arrays.
+	size_t ShapeFirst(UINT shape) const { return m_shapeFirst[shape]; }
+	size_t ShapeCount(UINT shape) const { return m_shapeFirst[shape + 1] - m_shapeFirst[shape]; }
+
+	const XMFLOAT3* Positions() const { return m_positions.data(); }
+	const XMFLOAT4* Rotations() const { return m_rotations.data(); }
+	const XMFLOAT3* Scales() const { return m_scales.data(); }
+	const UINT* Materials() const { return m_materials.data(); }
+	const UINT* Shapes() const { return m_shapes.data(); }
+	const uint8_t* Flags() const { return m_flags.data(); }
+	const XMFLOAT4X4* Worlds() const { return m_worlds.data(); }
+	const TransformBatch::TransformKind* Kinds() const { return m_kinds.data(); }
+
+private:
+	struct Slot {
+		UINT dense; // c_invalidIndex when free
+		UINT generation;
+	};
+
+	void pushBack();
+	void popBack();
+	void move(size_t from, size_t to);
+	void updateWorld(size_t index);
+
+	std::vector<XMFLOAT3> m_positions;
+	std::vector<XMFLOAT4> m_rotations;
+	std::vector<XMFLOAT3> m_scales;
+	std::vector<UINT> m_materials;
+	std::vector<UINT> m_shapes;
+	std::vector<uint8_t> m_flags;
+	std::vector<XMFLOAT4X4> m_worlds;
+	std::vector<TransformBatch::TransformKind> m_kinds;
+
+	std::vector<UINT> m_denseToSlot;
+	std::vector<Slot> m_slots;
+	std::vector<UINT> m_freeSlots;
+	std::vector<size_t> m_shapeFirst = std::vector<size_t>(1, 0); // One per shape plus the end
+};
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "InstanceUpdate.h"
+
+namespace InstanceUpdate {
+
+	size_t Run(JobSystem& jobs, const Mesh& mesh, const Frame& frame, FXMMATRIX pre, const Input& input, const Output& output,
+		std::vector<LodBucket>& buckets, Scratch& scratch, Culling::Stats& stats) {
+		const size_t count = input.count;
+		const size_t lodCount = mesh.GetLodCount();
+		const size_t chunkCount = (count + c_chunkSize - 1) / c_chunkSize;
+		const XMMATRIX preMatrix = pre;
+
+		scratch.worldviews.resize(count);
+		scratch.lods.resize(count);
+		scratch.chunkOffsets.assign(chunkCount * lodCount, 0);
+		scratch.chunkDepths.assign(chunkCount * lodCount, std::numeric_limits<float>::max());
+
+		// Worldview, culling and LOD of every instance; each chunk counts its instances per LOD and keeps the
+		// nearest one.
+		jobs.ParallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk) {
+			for (size_t c = firstChunk; c < lastChunk; c++) {
+				size_t first = c * c_chunkSize;
+				size_t last = std::min(first + c_chunkSize, count);
+				TransformBatch::WorldView(reinterpret_cast<const XMFLOAT4X4*>(reinterpret_cast<const BYTE*>(input.worlds) + first * input.worldStride),
+					last - first, input.worldStride, frame.model, frame.view, &scratch.worldviews[first]);
+				UINT* chunkCounts = &scratch.chunkOffsets[c * lodCount];
+				float* chunkDepths = &scratch.chunkDepths[c * lodCount];
+				for (size_t k = first; k < last; k++) {
+					XMMATRIX worldview = XMLoadFloat4x4(&scratch.worldviews[k]);
+					if (!Culling::IsVisible(frame.frustum, mesh.GetBoundingSphere(), mesh.GetBoundingBox(), worldview)) {
+						scratch.lods[k] = UINT_MAX;
+						continue;
+					}
+					// Largest scale of the world matrix (the view is rigid), to take the error to world units.
+					float z = scratch.worldviews[k]._43;
+					float scale = std::sqrt(std::max(XMVectorGetX(XMVector3LengthSq(worldview.r[0])),
+						std::max(XMVectorGetX(XMVector3LengthSq(worldview.r[1])), XMVectorGetX(XMVector3LengthSq(worldview.r[2])))));
+					UINT lod = 0;
+					while (z > 0.0f && lod + 1 < lodCount &&
+						mesh.GetLod(lod + 1).error * scale * frame.pixelsPerUnit / z < frame.lodPixelError)
+						lod++;
+					scratch.lods[k] = lod;
+					chunkCounts[lod]++;
+					chunkDepths[lod] = std::min(chunkDepths[lod], z);
+				}
+			}
+		});
+
+		// Buckets and the first slot of every chunk inside each bucket (counting sort across chunks).
+		buckets.assign(lodCount, LodBucket{ 0, 0, std::numeric_limits<float>::max() });
+		UINT visible = 0;
+		for (size_t lod = 0; lod < lodCount; lod++) {
+			buckets[lod].firstInstance = visible;
+			for (size_t c = 0; c < chunkCount; c++) {
+				UINT instances = scratch.chunkOffsets[c * lodCount + lod];
+				buckets[lod].minDepth = std::min(buckets[lod].minDepth, scratch.chunkDepths[c * lodCount + lod]);
+				scratch.chunkOffsets[c * lodCount + lod] = visible;
+				visible += instances;
+			}
+			buckets[lod].instanceCount = visible - buckets[lod].firstInstance;
+		}
+		stats.tested += count;
+		stats.visible += visible;
+
+		// Visible instances scattered to their slots, in the original order inside each bucket.
+		// Reserved for every instance, so the arrays stop growing once the largest shape has been seen.
+		scratch.sortedWorldviews.reserve(count);
+		scratch.sortedKinds.reserve(count);
+		scratch.sortedWorldviews.resize(visible);
+		scratch.sortedKinds.resize(visible);
+		jobs.ParallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk) {
+			for (size_t c = firstChunk; c < lastChunk; c++) {
+				size_t first = c * c_chunkSize;
+				size_t last = std::min(first + c_chunkSize, count);
+				UINT* next = &scratch.chunkOffsets[c * lodCount];
+				for (size_t k = first; k < last; k++) {
+					if (scratch.lods[k] == UINT_MAX)
+						continue;
+					UINT slot = next[scratch.lods[k]]++;
+					scratch.sortedWorldviews[slot] = scratch.worldviews[k];
+					scratch.sortedKinds[slot] = *reinterpret_cast<const TransformBatch::TransformKind*>(reinterpret_cast<const BYTE*>(input.kinds) + k * input.kindStride);
+					*reinterpret_cast<UINT*>(reinterpret_cast<BYTE*>(output.materials) + slot * output.stride) =
+						*reinterpret_cast<const UINT*>(reinterpret_cast<const BYTE*>(input.materials) + k * input.materialStride);
+				}
+			}
+		});
+
+		// Transforms in contiguous ranges of slots, so the batches stay full.
+		jobs.ParallelFor(visible, c_chunkSize, [&](size_t first, size_t last) {
+			TransformBatch::InstanceTransforms(&scratch.sortedWorldviews[first], &scratch.sortedKinds[first], last - first, preMatrix, frame.projection,
+				reinterpret_cast<XMFLOAT4X4*>(reinterpret_cast<BYTE*>(output.transforms) + first * output.stride),
+				reinterpret_cast<XMFLOAT4X4*>(reinterpret_cast<BYTE*>(output.normalTransforms) + first * output.stride), output.stride);
+		});
+
+		return visible;
+	}
+}
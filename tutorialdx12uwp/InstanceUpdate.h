@@ -0,0 +1,68 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+#include "Culling.h"
+#include "TransformBatch.h"
+#include "JobSystem.h"
+
+// Per frame instance work of a shape, split in chunks of c_chunkSize instances over the JobSystem threads:
+// worldview, frustum culling and LOD selection per chunk, an offset per chunk and LOD, then the visible
+// instances are scattered sorted by LOD and their transforms written in batches straight into the output.
+// Each ParallelFor is a fork/join, so the output is complete when Run returns.
+
+namespace InstanceUpdate {
+
+	const size_t c_chunkSize = 1024;
+
+	// Instances of a shape drawn with the same LOD are consecutive in the output.
+	struct LodBucket {
+		UINT firstInstance;
+		UINT instanceCount;
+		float minDepth; // Smallest view space z of the instances, the sort depth of their draw (RenderQueue.h)
+	};
+
+	// Values shared by every shape of a frame.
+	struct Frame {
+		XMMATRIX model;      // Applied before every world matrix
+		XMMATRIX view;
+		XMMATRIX projection;
+		BoundingFrustum frustum; // View space frustum of projection
+		float pixelsPerUnit; // Screen pixels of one unit at depth 1
+		float lodPixelError; // Largest LOD error on screen, in pixels
+	};
+
+	// Instances of a shape. Each array has its own stride, so they can be separate arrays (InstanceStore.h)
+	// or point into an array of structs.
+	struct Input {
+		const XMFLOAT4X4* worlds;
+		const TransformBatch::TransformKind* kinds;
+		const UINT* materials;
+		size_t count;
+		size_t worldStride;
+		size_t kindStride;
+		size_t materialStride;
+	};
+
+	// Where the visible instances go, stride bytes apart. It needs room for Input::count instances.
+	struct Output {
+		XMFLOAT4X4* transforms;
+		XMFLOAT4X4* normalTransforms;
+		UINT* materials;
+		size_t stride;
+	};
+
+	// Working arrays kept from frame to frame; they only grow, so steady frames do not allocate.
+	struct Scratch {
+		std::vector<XMFLOAT4X4> worldviews;
+		std::vector<UINT> lods; // Per instance, UINT_MAX when culled
+		std::vector<UINT> chunkOffsets; // Per chunk and LOD: counts, then first output slot
+		std::vector<float> chunkDepths; // Per chunk and LOD: smallest view space z
+		std::vector<XMFLOAT4X4> sortedWorldviews;
+		std::vector<TransformBatch::TransformKind> sortedKinds;
+	};
+
+	// Writes the visible instances of mesh sorted by LOD and fills one bucket per LOD of mesh.
+	// pre is applied before the world matrix (the dequantization of packed vertices). Returns the visible count.
+	size_t Run(JobSystem& jobs, const Mesh& mesh, const Frame& frame, FXMMATRIX pre, const Input& input, const Output& output,
+		std::vector<LodBucket>& buckets, Scratch& scratch, Culling::Stats& stats);
+}
@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "JobSystem.h"
+
+JobSystem::JobSystem(unsigned int workers) : m_queued(0), m_stop(false)
+{
+	for (unsigned int q = 0; q <= workers; q++)
+		m_queues.push_back(std::make_unique<Queue>());
+	for (unsigned int w = 1; w <= workers; w++)
+		m_threads.emplace_back(&JobSystem::workerLoop, this, w);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+}
+
+unsigned int JobSystem::ThreadCount() const {
+	return static_cast<unsigned int>(m_queues.size());
+}
+
+void JobSystem::run(size_t count, size_t grain, RangeFunction function, const void* context) {
+	grain = std::max<size_t>(grain, 1);
+	if (count <= grain || m_threads.empty()) {
+		if (count > 0)
+			function(context, 0, count);
+		return;
+	}
+
+	Group group;
+	group.function = function;
+	group.context = context;
+	group.grain = grain;
+	group.remaining = count;
+
+	// The caller starts with the whole range; the halves it leaves behind are stolen by the workers.
+	execute(0, Job{ &group, 0, count });
+	Job job;
+	while (group.remaining.load() > 0) {
+		if (pop(0, job) || steal(0, job))
+			execute(0, job);
+		else
+			std::this_thread::yield();
+	}
+	if (group.error)
+		std::rethrow_exception(group.error);
+}
+
+void JobSystem::workerLoop(unsigned int index) {
+	Job job;
+	for (;;) {
+		if (pop(index, job) || steal(index, job)) {
+			execute(index, job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(m_wakeMutex);
+		m_wake.wait(lock, [this]() { return m_stop || m_queued.load() > 0; });
+		if (m_stop)
+			return;
+	}
+}
+
+bool JobSystem::push(unsigned int queue, const Job& job) {
+	{
+		Queue& q = *m_queues[queue];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.count == c_queueCapacity)
+			return false;
+		q.jobs[(q.front + q.count) % c_queueCapacity] = job;
+		q.count++;
+	}
+	{
+		// Taking the lock orders the increment with a worker about to wait.
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_queued++;
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+bool JobSystem::pop(unsigned int queue, Job& job) {
+	Queue& q = *m_queues[queue];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	if (q.count == 0)
+		return false;
+	q.count--;
+	job = q.jobs[(q.front + q.count) % c_queueCapacity];
+	m_queued--;
+	return true;
+}
+
+bool JobSystem::steal(unsigned int thief, Job& job) {
+	unsigned int queues = ThreadCount();
+	for (unsigned int k = 1; k < queues; k++) {
+		Queue& victim = *m_queues[(thief + k) % queues];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.count == 0)
+			continue;
+		job = victim.jobs[victim.front];
+		victim.front = (victim.front + 1) % c_queueCapacity;
+		victim.count--;
+		m_queued--;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::execute(unsigned int queue, Job job) {
+	Group& group = *job.group;
+	while (job.last - job.first > group.grain) {
+		size_t middle = job.first + (job.last - job.first) / 2;
+		if (!push(queue, Job{ job.group, middle, job.last }))
+			break;
+		job.last = middle;
+	}
+	try {
+		group.function(group.context, job.first, job.last);
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(group.errorMutex);
+		if (!group.error)
+			group.error = std::current_exception();
+	}
+	// Last access to the group: the caller may return as soon as remaining reaches zero.
+	group.remaining -= job.last - job.first;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "pch.h"
+
+// Work stealing scheduler for the per frame CPU work.
+// Every thread owns a deque of ranges. A thread splits the range it takes in halves, keeps the first one and
+// pushes the second one at the back of its deque; idle threads steal from the front of the others, so they
+// take the biggest pieces left. ParallelFor is a fork/join: the caller works too and returns when every
+// range is done.
+
+class JobSystem
+{
+public:
+	// workers: threads created besides the calling one (0 runs everything on the caller).
+	explicit JobSystem(unsigned int workers);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Threads taking part in a ParallelFor, the caller included.
+	unsigned int ThreadCount() const;
+
+	// Runs function(first, last) over [0, count) in ranges of at most grain elements.
+	// It has to be called from a single thread at a time and not from inside a job.
+	// The first exception thrown by a range reaches the caller once all ranges are done.
+	// function is called through a pointer, so a ParallelFor does not allocate.
+	template <typename Function>
+	void ParallelFor(size_t count, size_t grain, const Function& function) {
+		run(count, grain, [](const void* context, size_t first, size_t last) {
+			(*static_cast<const Function*>(context))(first, last);
+		}, &function);
+	}
+
+private:
+	using RangeFunction = void (*)(const void* context, size_t first, size_t last);
+
+	// Jobs a queue holds. A thread only pushes the halves of the range it runs, so a queue needs about
+	// log2(count / grain) entries; when it is full the range runs without splitting.
+	static const size_t c_queueCapacity = 128;
+
+	struct Group {
+		RangeFunction function;
+		const void* context;
+		size_t grain;
+		std::atomic<size_t> remaining; // Elements not processed yet
+		std::mutex errorMutex;
+		std::exception_ptr error;
+	};
+
+	struct Job {
+		Group* group;
+		size_t first;
+		size_t last;
+	};
+
+	// Fixed ring of jobs: the owner works at the back, thieves take from the front.
+	struct Queue {
+		std::mutex mutex;
+		Job jobs[c_queueCapacity];
+		size_t front = 0;
+		size_t count = 0;
+	};
+
+	void run(size_t count, size_t grain, RangeFunction function, const void* context);
+	void workerLoop(unsigned int index);
+	bool push(unsigned int queue, const Job& job);
+	bool pop(unsigned int queue, Job& job);
+	bool steal(unsigned int thief, Job& job);
+	void execute(unsigned int queue, Job job);
+
+	std::vector<std::unique_ptr<Queue>> m_queues; // m_queues[0] belongs to the calling thread
+	std::vector<std::thread> m_threads;
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wake;
+	std::atomic<size_t> m_queued;
+	bool m_stop;
+};
@@ -1,13 +1,17 @@
 #include "pch.h"
 #include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #define TINYOBJLOADER_IMPLEMENTATION 
 #include "tiny_obj_loader.h"
-#include "Error.h"
+#include "FileSystem.h"
 #include <iostream>
 
 
 
-Mesh::Mesh() : defaultColor (XMFLOAT4(Colors::White))
+Mesh::Mesh() : defaultColor (XMFLOAT4(Colors::White)),
+	cacheVertices(nullptr), cacheIndices(nullptr), cacheVertexCount(0), cacheIndexCount(0),
+	cacheLodIndices(nullptr), cacheLodIndexCount(0)
 {
 	vertices = {
 		{XMFLOAT3(-1.0f,-1.0f,-1.0f),XMFLOAT4(Colors::Red)},
@@ -43,23 +47,46 @@ Mesh::Mesh() : defaultColor (XMFLOAT4(Colors::White))
 	size_t sind = sizeof(unsigned int);
 	size_t nindices = indices.size();
 	isize = static_cast<UINT>(nindices * sind);
+	computeBounds();
+	buildLods("cube");
 	
 }
 
-Mesh::Mesh(std::string const fileName) : defaultColor(XMFLOAT4(Colors::Coral)) {
+Mesh::Mesh(std::string const fileName, JobSystem* jobs, bool useCache) : defaultColor(XMFLOAT4(Colors::Coral)),
+	cacheVertices(nullptr), cacheIndices(nullptr), cacheVertexCount(0), cacheIndexCount(0),
+	cacheLodIndices(nullptr), cacheLodIndexCount(0) {
 	
-	try {
-		readObjFile(fileName);
+	// A binary cache built from the same OBJ contents is used instead of parsing and simplifying.
+	// Caches are looked for in the local folder (written at run time, with the LODs) and next to the OBJ
+	// (the objcache tool, ObjCacheMain.cpp).
+	uint64_t sourceHash = useCache ? MeshCache::HashFile(fileName) : 0;
+	bool localCached = sourceHash != 0 && readCacheFile(MeshCache::LocalCacheFileName(fileName), sourceHash);
+	bool cached = localCached || (sourceHash != 0 && readCacheFile(MeshCache::CacheFileName(fileName), sourceHash));
 
+	if (cached) {
+		computeBounds();
+		// The LODs of a cache without them are built once and kept in a complete local cache.
+		if (lods.empty()) {
+			buildLods(fileName);
+			if (!localCached && !writeCacheFile(MeshCache::LocalCacheFileName(fileName), sourceHash))
+				MYTRACE(L"Mesh cache could not be written\n");
+		}
 	}
-	catch (winrt::hresult_error &error) {
-		ShowWinRTError(error);
+	else {
+		// An OBJ that fails to parse throws (FileSystem::ThrowLoadError) before anything is cached: its cache would
+		// match the hash and load as an empty mesh on every later launch, without the error.
+		readObjFile(fileName, jobs);
+		optimize(fileName);
+		computeBounds();
+		buildLods(fileName);
+		if (sourceHash != 0 && !writeCacheFile(MeshCache::LocalCacheFileName(fileName), sourceHash))
+			MYTRACE(L"Mesh cache could not be written\n");
 	}
 	size_t sv = sizeof(Vertex);
-	size_t nvertices = vertices.size();
+	size_t nvertices = GetVertexCount();
 	vsize = static_cast<UINT>(nvertices * sv);
 	size_t sind = sizeof(unsigned int);
-	size_t nindices = indices.size();
+	size_t nindices = GetIndexCount();
 	isize = static_cast<UINT>(nindices * sind);
 }
 
@@ -76,6 +103,184 @@ UINT Mesh::GetISize() const {
 	return isize;
 }
 
+const Vertex* Mesh::GetVertexData() const {
+	return IsCached() ? cacheVertices : vertices.data();
+}
+
+const unsigned int* Mesh::GetIndexData() const {
+	return IsCached() ? cacheIndices : indices.data();
+}
+
+UINT Mesh::GetVertexCount() const {
+	return IsCached() ? cacheVertexCount : static_cast<UINT>(vertices.size());
+}
+
+UINT Mesh::GetIndexCount() const {
+	return IsCached() ? cacheIndexCount : static_cast<UINT>(indices.size());
+}
+
+bool Mesh::IsCached() const {
+	return cacheFile != nullptr;
+}
+
+const BoundingBox& Mesh::GetBoundingBox() const {
+	return bounds;
+}
+
+const BoundingSphere& Mesh::GetBoundingSphere() const {
+	return sphere;
+}
+
+bool Mesh::Has16BitIndices() const {
+	// 0xFFFF is left out: it is the strip cut value.
+	return GetVertexCount() <= 0xFFFF;
+}
+
+DXGI_FORMAT Mesh::GetIndexFormat() const {
+	return Has16BitIndices() ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+UINT Mesh::GetIndexStride() const {
+	return Has16BitIndices() ? sizeof(uint16_t) : sizeof(unsigned int);
+}
+
+void Mesh::CopyIndices(void* destination) const {
+	const unsigned int* ranges[2] = { GetIndexData(), getLodIndexData() };
+	UINT counts[2] = { GetIndexCount(), getLodIndexCount() };
+	BYTE* write = reinterpret_cast<BYTE*>(destination);
+	for (int r = 0; r < 2; r++) {
+		if (Has16BitIndices()) {
+			uint16_t* narrow = reinterpret_cast<uint16_t*>(write);
+			for (UINT i = 0; i < counts[r]; i++)
+				narrow[i] = static_cast<uint16_t>(ranges[r][i]);
+		}
+		else {
+			memcpy(write, ranges[r], counts[r] * sizeof(unsigned int));
+		}
+		write += counts[r] * GetIndexStride();
+	}
+}
+
+UINT Mesh::GetLodCount() const {
+	return static_cast<UINT>(lods.size());
+}
+
+const Mesh::Lod& Mesh::GetLod(UINT lod) const {
+	return lods[lod];
+}
+
+UINT Mesh::GetIndexCountAllLods() const {
+	return GetIndexCount() + getLodIndexCount();
+}
+
+const unsigned int* Mesh::getLodIndexData() const {
+	return cacheLodIndices != nullptr ? cacheLodIndices : lodIndices.data();
+}
+
+UINT Mesh::getLodIndexCount() const {
+	return cacheLodIndices != nullptr ? cacheLodIndexCount : static_cast<UINT>(lodIndices.size());
+}
+
+void Mesh::computeBounds() {
+	const Vertex* data = GetVertexData();
+	if (GetVertexCount() == 0) {
+		bounds = BoundingBox();
+		sphere = BoundingSphere();
+		return;
+	}
+	BoundingBox::CreateFromPoints(bounds, GetVertexCount(), &data->pos, sizeof(Vertex));
+	BoundingSphere::CreateFromPoints(sphere, GetVertexCount(), &data->pos, sizeof(Vertex));
+}
+
+void Mesh::buildLods(std::string const name) {
+	lods.clear();
+	lodIndices.clear();
+	cacheLodIndices = nullptr;
+	cacheLodIndexCount = 0;
+	lods.push_back({ 0, GetIndexCount(), 0.0f });
+
+	// Levels are simplified from the previous one; their errors add up.
+	// Collapses are limited to a fraction of the mesh size, so thin parts are not erased.
+	XMFLOAT3 extents = bounds.Extents;
+	float maxError = 0.1f * std::max(extents.x, std::max(extents.y, extents.z));
+	std::vector<unsigned int> previous(GetIndexData(), GetIndexData() + GetIndexCount());
+	float error = 0.0f;
+	while (lods.size() < c_maxLods && previous.size() / 3 >= 2 * c_minLodTriangles) {
+		float levelError;
+		std::vector<unsigned int> level = MeshSimplifier::Simplify(previous.data(), previous.size(),
+			GetVertexData(), GetVertexCount(), previous.size() / 6 * 3, maxError, &levelError);
+		// A level that barely removes triangles is not worth its index memory.
+		if (level.size() * 10 > previous.size() * 9)
+			break;
+		std::vector<size_t> clusters;
+		level = MeshOptimizer::Tipsify(level.data(), level.size(), GetVertexCount(), MeshOptimizer::DefaultCacheSize, &clusters);
+		MeshOptimizer::OptimizeOverdraw(level, GetVertexData(), clusters);
+
+		error += levelError;
+		lods.push_back({ GetIndexCount() + static_cast<UINT>(lodIndices.size()), static_cast<UINT>(level.size()), error });
+		lodIndices.insert(lodIndices.end(), level.begin(), level.end());
+		previous.swap(level);
+	}
+
+	wchar_t msgbuff[512];
+	std::wstring wName(name.begin(), name.end());
+	for (size_t l = 0; l < lods.size(); l++) {
+		swprintf(msgbuff, 512, L"Mesh %ls LOD %zu: %u triangles, error %g\n", wName.c_str(), l, lods[l].indexCount / 3, lods[l].error);
+		MYTRACE(msgbuff);
+	}
+}
+
+void Mesh::optimize(std::string const name) {
+	// Index order for the post-transform cache and overdraw, then vertex order for fetch locality.
+	// The cache file stores the result.
+	MeshOptimizer::Report report = MeshOptimizer::Optimize(indices, vertices);
+
+	wchar_t msgbuff[512];
+	std::wstring wName(name.begin(), name.end());
+	swprintf(msgbuff, 512, L"Mesh %ls: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.3f -> %.3f, %zu unused vertices (%zu bytes) removed\n",
+		wName.c_str(), report.cacheBefore.acmr, report.cacheAfter.acmr, report.cacheBefore.atvr, report.cacheAfter.atvr,
+		report.fetchBefore.overfetch, report.fetchAfter.overfetch, report.verticesRemoved, report.bytesSaved);
+	MYTRACE(msgbuff);
+}
+
+bool Mesh::readCacheFile(std::string const fileName, uint64_t sourceHash) {
+	std::unique_ptr<MeshCache::MappedFile> file = std::make_unique<MeshCache::MappedFile>();
+	if (!file->Open(fileName))
+		return false;
+	const MeshCache::Header* header = MeshCache::Validate(*file, sourceHash, sizeof(Vertex));
+	if (header == nullptr)
+		return false;
+
+	// The mesh points into the mapped view; the file stays mapped while the mesh lives.
+	cacheVertices = reinterpret_cast<const Vertex*>(file->Data() + header->vertexOffset);
+	cacheIndices = reinterpret_cast<const unsigned int*>(file->Data() + header->indexOffset);
+	cacheVertexCount = header->vertexCount;
+	cacheIndexCount = header->indexCount;
+	// A cache without LODs leaves them to buildLods.
+	const MeshCache::LodRecord* records = reinterpret_cast<const MeshCache::LodRecord*>(file->Data() + header->lodOffset);
+	lods.clear();
+	for (uint32_t l = 0; l < header->lodCount; l++)
+		lods.push_back({ records[l].firstIndex, records[l].indexCount, records[l].error });
+	lodIndices.clear();
+	cacheLodIndices = header->lodCount > 0 ? reinterpret_cast<const unsigned int*>(file->Data() + header->lodIndexOffset) : nullptr;
+	cacheLodIndexCount = header->lodCount > 0 ? header->lodIndexCount : 0;
+	cacheFile = std::move(file);
+	vertices.clear();
+	indices.clear();
+	return true;
+}
+
+bool Mesh::writeCacheFile(std::string const fileName, uint64_t sourceHash) const {
+	std::vector<MeshCache::LodRecord> records;
+	for (const Lod& lod : lods)
+		records.push_back({ lod.firstIndex, lod.indexCount, lod.error });
+	return MeshCache::Write(fileName, sourceHash,
+		GetVertexData(), sizeof(Vertex), GetVertexCount(),
+		GetIndexData(), GetIndexCount(),
+		records.data(), static_cast<uint32_t>(records.size()),
+		getLodIndexData(), getLodIndexCount());
+}
+
 void Mesh::readFile(std::string const fileName) {
 	std::ifstream file(fileName, std::fstream::in);
 	if (!file.good())
@@ -118,12 +323,14 @@ void Mesh::readFile(std::string const fileName) {
 
 }
 
-void Mesh::readObjFile(std::string const  inputfile) {
+void Mesh::readObjFile(std::string const  inputfile, JobSystem* jobs) {
 	
 	tinyobj::ObjReaderConfig reader_config;
 	reader_config.mtl_search_path = "./"; // Path to material files
 
 	tinyobj::ObjReader reader;
+	vertices.clear();
+	indices.clear();
 	
 	if (!reader.ParseFromFile(inputfile, reader_config)) {
 		if (!reader.Error().empty()) {
@@ -134,9 +341,7 @@ void Mesh::readObjFile(std::string const  inputfile) {
 		std::wostringstream message;
 		message << L"Object File" << inputfileName << "not found or wrong format" << std::endl;
 	
-		winrt::hresult_error error{ HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), message.str() };
-		throw error;
-		//winrt::throw_last_error();
+		FileSystem::ThrowLoadError(FileSystem::LoadError::NotFound, message.str());
 	}
 	
 
@@ -149,61 +354,171 @@ void Mesh::readObjFile(std::string const  inputfile) {
 	//auto& materials = reader.GetMaterials(); Materials will be programmed in the game
 
 	// We don't loop over shapes, we are asuming one shape per file
-	size_t s = 0;
-	// Loop over faces(polygon) to get indexes
-	size_t index_offset = 0;
-	unsigned int countIndex = 0;
-	std::map<unsigned int, tinyobj::index_t> mapTOVITOGI; // Map connecting TinyObject vertex index to TinyObject general index
-	std::map<unsigned int, unsigned int>  mapTOVIIndex; // Map connecting Tiny Object Vertex index to out mesh vertices index
-	// This code requires these mapping to avoid assumming consecutive vertex indexes in the obj file
-	for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-		int fv = shapes[s].mesh.num_face_vertices[f];
-		for (size_t v = 0; v < fv; v++) {
-			unsigned int index;
-			tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-			index = static_cast<unsigned int>(idx.vertex_index);
-			
-			mapTOVITOGI[index] = idx;
-			if (mapTOVIIndex.find(index) == mapTOVIIndex.end()) { // if this Tinyobject vertex index has not been processed
-				mapTOVIIndex[index] = countIndex++;
+	if (!shapes.empty())
+		buildFromObj(attrib, shapes[0], jobs);
+}
+
+void Mesh::readObjString(std::string const& objText, JobSystem* jobs) {
+
+	tinyobj::ObjReaderConfig reader_config;
+	tinyobj::ObjReader reader;
+	vertices.clear();
+	indices.clear();
+
+	if (!reader.ParseFromString(objText, std::string(), reader_config)) {
+		FileSystem::ThrowLoadError(FileSystem::LoadError::WrongFormat, L"Object data in wrong format");
+	}
+	if (!reader.GetShapes().empty())
+		buildFromObj(reader.GetAttrib(), reader.GetShapes()[0], jobs);
+}
+
+void Mesh::buildFromObj(const tinyobj::attrib_t& attrib, const tinyobj::shape_t& shape, JobSystem* jobs) {
+
+	// Faces are already triangulated by tinyobj, so every corner produces one index.
+	const std::vector<tinyobj::index_t>& corners = shape.mesh.indices;
+	std::vector<tinyobj::index_t> welded;
+	// Small meshes are not worth splitting.
+	unsigned int threads = jobs != nullptr ? jobs->ThreadCount() : 1;
+	unsigned int chunks = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(threads, corners.size() / c_minCornersPerChunk)));
+	if (chunks > 1) {
+		weldChunks(corners, chunks, *jobs, welded);
+	}
+	else {
+		ObjVertexWelder welder(attrib.vertices.size() / 3);
+		indices.resize(corners.size());
+		for (size_t i = 0; i < corners.size(); i++) {
+			indices[i] = welder.Insert(corners[i]);
+		}
+		welded = welder.Corners();
+	}
+
+	// Compose vertex structures from the distinct corners.
+	vertices.resize(welded.size());
+	auto composeVertices = [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			const tinyobj::index_t& idx = welded[i];
+			Vertex& vertex = vertices[i];
+
+			vertex.pos.x = attrib.vertices[3 * idx.vertex_index + 0];
+			vertex.pos.y = attrib.vertices[3 * idx.vertex_index + 1];
+			vertex.pos.z = attrib.vertices[3 * idx.vertex_index + 2];
+			if (idx.normal_index >= 0) {
+				vertex.normal.x = attrib.normals[3 * idx.normal_index + 0];
+				vertex.normal.y = attrib.normals[3 * idx.normal_index + 1];
+				vertex.normal.z = attrib.normals[3 * idx.normal_index + 2];
+			}
+			else {
+				vertex.normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			}
+			if (idx.texcoord_index >= 0) {
+				vertex.uvcoords.x = attrib.texcoords[2 * idx.texcoord_index + 0];
+				vertex.uvcoords.y = attrib.texcoords[2 * idx.texcoord_index + 1];
 			}
-			this->indices.push_back(mapTOVIIndex[index]);
+			else {
+				vertex.uvcoords = XMFLOAT2(0.0f, 0.0f);
+			}
+			vertex.col = defaultColor;
+			vertex.material = XMUINT3(0, 0, 0);
 		}
-		index_offset += fv;
-	}
-	// Prepare vertice vector to allocate enough elements.
-	vertices.resize(mapTOVIIndex.size());
-	for (auto it = mapTOVIIndex.begin(); it != mapTOVIIndex.end(); it++) {
-		unsigned int vid = it->first;
-		unsigned int index = it->second;
-		auto fresult = mapTOVITOGI.find(vid);
-		if (fresult == mapTOVITOGI.end()) // The vertex index is not in the map
-			break;
-		// If everything is ok, we get the general index in tinyobj representation
-		tinyobj::index_t idx = fresult->second;
+	};
+	if (chunks > 1)
+		jobs->ParallelFor(welded.size(), (welded.size() + chunks - 1) / chunks, composeVertices);
+	else
+		composeVertices(0, welded.size());
+}
 
-		// With this general index we can compose the vertex structure
-		Vertex vertex;
+void Mesh::weldChunks(const std::vector<tinyobj::index_t>& corners, unsigned int chunks, JobSystem& jobs,
+	std::vector<tinyobj::index_t>& welded) {
 
-		vertex.pos.x = attrib.vertices[3 * idx.vertex_index + 0];
-		vertex.pos.y = attrib.vertices[3 * idx.vertex_index + 1];
-		vertex.pos.z = attrib.vertices[3 * idx.vertex_index + 2];
-		vertex.normal.x = attrib.normals[3 * idx.normal_index + 0];
-		vertex.normal.y = attrib.normals[3 * idx.normal_index + 1];
-		vertex.normal.z = attrib.normals[3 * idx.normal_index + 2];
-		vertex.uvcoords.x = attrib.texcoords[2 * idx.texcoord_index + 0];
-		vertex.uvcoords.y = attrib.texcoords[2 * idx.texcoord_index + 1];
-		vertex.col = defaultColor;
-		vertex.material = XMUINT3(0,0,0);
+	// 1. Every chunk of faces is welded on its own: local indices and local distinct corners.
+	// Chunk boundaries are multiples of 3 so no triangle is split.
+	size_t triangles = corners.size() / 3;
+	std::vector<size_t> chunkStart(chunks + 1);
+	for (unsigned int c = 0; c <= chunks; c++)
+		chunkStart[c] = 3 * (triangles * c / chunks);
+	chunkStart[chunks] = corners.size();
 
-		vertices[index] = vertex; //Copy vertex
+	indices.resize(corners.size());
+	std::vector<std::vector<tinyobj::index_t>> localCorners(chunks);
+	jobs.ParallelFor(chunks, 1, [&](size_t first, size_t last) {
+		for (size_t c = first; c < last; c++) {
+			ObjVertexWelder welder((chunkStart[c + 1] - chunkStart[c]) / 2);
+			for (size_t i = chunkStart[c]; i < chunkStart[c + 1]; i++)
+				indices[i] = welder.Insert(corners[i]);
+			localCorners[c] = welder.Corners();
+		}
+	});
 
+	// 2. Local corners are merged in chunk order. A corner gets its global index in the chunk where it
+	// first appears, in the same position it has in the serial weld, so the result is identical.
+	size_t distinct = 0;
+	for (auto& local : localCorners)
+		distinct += local.size();
+	ObjVertexWelder global(distinct / 2);
+	std::vector<std::vector<unsigned int>> localToGlobal(chunks);
+	for (unsigned int c = 0; c < chunks; c++) {
+		localToGlobal[c].resize(localCorners[c].size());
+		for (size_t i = 0; i < localCorners[c].size(); i++)
+			localToGlobal[c][i] = global.Insert(localCorners[c][i]);
 	}
 
-	
+	// 3. Remap local indices to global indices.
+	jobs.ParallelFor(chunks, 1, [&](size_t first, size_t last) {
+		for (size_t c = first; c < last; c++) {
+			const std::vector<unsigned int>& remap = localToGlobal[c];
+			for (size_t i = chunkStart[c]; i < chunkStart[c + 1]; i++)
+				indices[i] = remap[indices[i]];
+		}
+	});
 
+	welded = global.Corners();
+}
 
+ObjVertexWelder::ObjVertexWelder(size_t expectedVertices) {
+	// Load factor kept under 1/2.
+	size_t capacity = 16;
+	while (capacity < 2 * expectedVertices)
+		capacity <<= 1;
+	m_slots.assign(capacity, c_emptySlot);
+	m_mask = capacity - 1;
+	m_corners.reserve(expectedVertices);
+}
 
-	
-	
-}
\ No newline at end of file
+size_t ObjVertexWelder::Hash(const tinyobj::index_t& corner) {
+	uint64_t h = static_cast<uint32_t>(corner.vertex_index);
+	h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(corner.normal_index);
+	h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(corner.texcoord_index);
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ull;
+	h ^= h >> 32;
+	return static_cast<size_t>(h);
+}
+
+unsigned int ObjVertexWelder::Insert(const tinyobj::index_t& corner) {
+	size_t slot = Hash(corner) & m_mask;
+	while (m_slots[slot] != c_emptySlot) {
+		const tinyobj::index_t& other = m_corners[m_slots[slot]];
+		if (other.vertex_index == corner.vertex_index &&
+			other.normal_index == corner.normal_index &&
+			other.texcoord_index == corner.texcoord_index)
+			return m_slots[slot];
+		slot = (slot + 1) & m_mask;
+	}
+	unsigned int index = static_cast<unsigned int>(m_corners.size());
+	m_slots[slot] = index;
+	m_corners.push_back(corner);
+	if (2 * m_corners.size() > m_slots.size())
+		Grow();
+	return index;
+}
+
+void ObjVertexWelder::Grow() {
+	m_slots.assign(2 * m_slots.size(), c_emptySlot);
+	m_mask = m_slots.size() - 1;
+	for (unsigned int index = 0; index < m_corners.size(); index++) {
+		size_t slot = Hash(m_corners[index]) & m_mask;
+		while (m_slots[slot] != c_emptySlot)
+			slot = (slot + 1) & m_mask;
+		m_slots[slot] = index;
+	}
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include "pch.h"
+#include <DirectXCollision.h>
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "tiny_obj_loader.h"
 
 using namespace DirectX;
 
@@ -13,30 +17,110 @@ struct Vertex {
 
 };
 
+// Welds OBJ face corners into mesh vertices.
+// Two corners are the same vertex only when position, normal and texture coordinate indices all match,
+// so a position shared by faces with different normals or uvs is split into several vertices.
+// Open addressing with linear probing: one pass over the corners, O(1) per corner.
+class ObjVertexWelder
+{
+public:
+	explicit ObjVertexWelder(size_t expectedVertices);
+
+	// Returns the mesh vertex index of the corner. New corners get the next index, in order of appearance.
+	unsigned int Insert(const tinyobj::index_t& corner);
+	size_t Size() const { return m_corners.size(); }
+	// Distinct corners, indexed by mesh vertex index.
+	const std::vector<tinyobj::index_t>& Corners() const { return m_corners; }
+
+private:
+	static constexpr unsigned int c_emptySlot = 0xFFFFFFFF;
+	static size_t Hash(const tinyobj::index_t& corner);
+	void Grow();
+
+	std::vector<unsigned int> m_slots; // Mesh vertex index or c_emptySlot
+	std::vector<tinyobj::index_t> m_corners;
+	size_t m_mask;
+};
+
 class Mesh
 {
 public:
 	Mesh();
-	Mesh(std::string const fileName);
+	// jobs: threads used to weld a large OBJ (face ranges are split between them), nullptr welds on the caller.
+	// It is not called from inside one of its jobs. useCache: look for / write the binary cache of the OBJ.
+	Mesh(std::string const fileName, JobSystem* jobs = nullptr, bool useCache = true);
 	~Mesh();
 
 	UINT GetVSize() const;
 	UINT GetISize() const;
+	// Vertex and index data: either the vectors below or a mapped cache file.
+	const Vertex* GetVertexData() const;
+	const unsigned int* GetIndexData() const;
+	UINT GetVertexCount() const;
+	UINT GetIndexCount() const;
+	bool IsCached() const;
+	// Bounds of the vertex positions.
+	const BoundingBox& GetBoundingBox() const;
+	const BoundingSphere& GetBoundingSphere() const;
+	// Index buffer width: 16 bits when every index fits, 32 bits otherwise.
+	bool Has16BitIndices() const;
+	DXGI_FORMAT GetIndexFormat() const;
+	UINT GetIndexStride() const;
+	// Writes GetIndexCountAllLods() indices of GetIndexStride() bytes each: the LODs one after the other.
+	void CopyIndices(void* destination) const;
+
+	// Level of detail: a simplified index list over the same vertices (see MeshSimplifier.h). LOD 0 is the mesh.
+	struct Lod {
+		UINT firstIndex; // Position in the indices written by CopyIndices
+		UINT indexCount;
+		// Bound of the distance to the full resolution surface, in model units: the largest distance of a
+		// collapsed vertex to the planes of the triangles it replaced, added up over the levels.
+		float error;
+	};
+	// Most LODs a mesh has, LOD 0 included; caches with more are rejected (MeshCache::Validate).
+	static constexpr UINT c_maxLods = 4;
+	UINT GetLodCount() const;
+	const Lod& GetLod(UINT lod) const;
+	UINT GetIndexCountAllLods() const;
 	void readFile(std::string const fileName);
-	void readObjFile(std::string const fileName);
+	void readObjFile(std::string const fileName, JobSystem* jobs = nullptr);
+	void readObjString(std::string const& objText, JobSystem* jobs = nullptr);
+	bool readCacheFile(std::string const fileName, uint64_t sourceHash);
+	bool writeCacheFile(std::string const fileName, uint64_t sourceHash) const;
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
-	struct Texture {
-		std::string Name;
-		std::wstring Filename;
-		Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
-		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
-	};
-
-	std::unique_ptr<Texture> meshTexture;
 private:
+	static constexpr size_t c_minCornersPerChunk = 1 << 16;
+	static constexpr UINT c_minLodTriangles = 32;
+
+	void buildFromObj(const tinyobj::attrib_t& attrib, const tinyobj::shape_t& shape, JobSystem* jobs);
+	// Reorders indices and vertices after loading (see MeshOptimizer.h) and reports the gains.
+	void optimize(std::string const name);
+	void weldChunks(const std::vector<tinyobj::index_t>& corners, unsigned int chunks, JobSystem& jobs,
+		std::vector<tinyobj::index_t>& welded);
+	void computeBounds();
+	// Builds the LOD chain from the final indices, halving the triangles at every level.
+	void buildLods(std::string const name);
+	// Indices of LOD 1 and up: lodIndices or the mapped cache.
+	const unsigned int* getLodIndexData() const;
+	UINT getLodIndexCount() const;
+
 	UINT vsize;
 	UINT isize;
 	XMFLOAT4 defaultColor;
+	BoundingBox bounds;
+	BoundingSphere sphere;
+	std::vector<Lod> lods;
+	std::vector<unsigned int> lodIndices; // Indices of LOD 1 and up
+
+	// Binary cache mapped in memory (see MeshCache.h). Vectors are empty when it is in use.
+	std::unique_ptr<MeshCache::MappedFile> cacheFile;
+	const Vertex* cacheVertices;
+	const unsigned int* cacheIndices;
+	UINT cacheVertexCount;
+	UINT cacheIndexCount;
+	// LOD indices of the cache, nullptr when the cache has no LODs and they were built at load time.
+	const unsigned int* cacheLodIndices;
+	UINT cacheLodIndexCount;
 };
 
@@ -0,0 +1,110 @@
+#include "pch.h"
+#include "MeshCache.h"
+#include "Mesh.h"
+
+namespace MeshCache {
+
+	uint64_t HashBytes(const BYTE* data, size_t size) {
+		// FNV-1a 64 bits
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t HashFile(std::string const fileName) {
+		MappedFile file;
+		if (!file.Open(fileName))
+			return 0;
+		return HashBytes(file.Data(), file.Size());
+	}
+
+	std::string CacheFileName(std::string const sourceFileName) {
+		size_t dot = sourceFileName.find_last_of('.');
+		return sourceFileName.substr(0, dot) + Extension;
+	}
+
+	std::string LocalCacheFileName(std::string const sourceFileName) {
+		return FileSystem::LocalFileName(CacheFileName(sourceFileName));
+	}
+
+	const Header* Validate(const MappedFile& file, uint64_t sourceHash, uint32_t vertexStride) {
+		if (file.Data() == nullptr || file.Size() < sizeof(Header))
+			return nullptr;
+		const Header* header = reinterpret_cast<const Header*>(file.Data());
+		if (header->magic != Magic || header->version != Version)
+			return nullptr;
+		if (header->sourceHash != sourceHash || header->vertexStride != vertexStride)
+			return nullptr;
+		// All the arrays have to be inside the file and aligned for direct access.
+		uint64_t vertexEnd = uint64_t(header->vertexOffset) + uint64_t(header->vertexCount) * vertexStride;
+		uint64_t indexEnd = uint64_t(header->indexOffset) + uint64_t(header->indexCount) * sizeof(unsigned int);
+		uint64_t lodEnd = uint64_t(header->lodOffset) + uint64_t(header->lodCount) * sizeof(LodRecord);
+		uint64_t lodIndexEnd = uint64_t(header->lodIndexOffset) + uint64_t(header->lodIndexCount) * sizeof(unsigned int);
+		if (vertexEnd > file.Size() || indexEnd > file.Size() || lodEnd > file.Size() || lodIndexEnd > file.Size())
+			return nullptr;
+		if ((header->vertexOffset % 4) != 0 || (header->indexOffset % 4) != 0 ||
+			(header->lodOffset % 4) != 0 || (header->lodIndexOffset % 4) != 0)
+			return nullptr;
+		// No more levels than a Mesh holds, every one inside the mesh indices or the LOD indices.
+		if (header->lodCount > Mesh::c_maxLods)
+			return nullptr;
+		const LodRecord* lods = reinterpret_cast<const LodRecord*>(file.Data() + header->lodOffset);
+		uint64_t allIndices = uint64_t(header->indexCount) + header->lodIndexCount;
+		for (uint32_t l = 0; l < header->lodCount; l++) {
+			if (uint64_t(lods[l].firstIndex) + lods[l].indexCount > allIndices)
+				return nullptr;
+		}
+		// Every index has to name a vertex of the cache: the buffers are drawn straight from the view.
+		const unsigned int* indices = reinterpret_cast<const unsigned int*>(file.Data() + header->indexOffset);
+		const unsigned int* lodIndices = reinterpret_cast<const unsigned int*>(file.Data() + header->lodIndexOffset);
+		unsigned int largest = 0;
+		for (uint32_t i = 0; i < header->indexCount; i++)
+			largest = std::max(largest, indices[i]);
+		for (uint32_t i = 0; i < header->lodIndexCount; i++)
+			largest = std::max(largest, lodIndices[i]);
+		if (allIndices > 0 && largest >= header->vertexCount)
+			return nullptr;
+		return header;
+	}
+
+	bool Write(std::string const fileName, uint64_t sourceHash,
+		const void* vertices, uint32_t vertexStride, uint32_t vertexCount,
+		const unsigned int* indices, uint32_t indexCount,
+		const LodRecord* lods, uint32_t lodCount,
+		const unsigned int* lodIndices, uint32_t lodIndexCount) {
+
+		Header header = {};
+		header.magic = Magic;
+		header.version = Version;
+		header.sourceHash = sourceHash;
+		header.vertexStride = vertexStride;
+		header.vertexCount = vertexCount;
+		header.indexCount = indexCount;
+		header.vertexOffset = (sizeof(Header) + 15) & ~15;
+		header.indexOffset = (header.vertexOffset + vertexStride * vertexCount + 15) & ~15;
+		header.lodCount = lodCount;
+		uint32_t indexBytes = static_cast<uint32_t>(sizeof(unsigned int)) * indexCount;
+		uint32_t lodBytes = static_cast<uint32_t>(sizeof(LodRecord)) * lodCount;
+		header.lodOffset = (header.indexOffset + indexBytes + 15) & ~15;
+		header.lodIndexCount = lodIndexCount;
+		header.lodIndexOffset = (header.lodOffset + lodBytes + 15) & ~15;
+
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		if (!file.good())
+			return false;
+		const char padding[16] = {};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(padding, header.vertexOffset - sizeof(Header));
+		file.write(reinterpret_cast<const char*>(vertices), size_t(vertexStride) * vertexCount);
+		file.write(padding, header.indexOffset - (header.vertexOffset + vertexStride * vertexCount));
+		file.write(reinterpret_cast<const char*>(indices), indexBytes);
+		file.write(padding, header.lodOffset - (header.indexOffset + indexBytes));
+		file.write(reinterpret_cast<const char*>(lods), lodBytes);
+		file.write(padding, header.lodIndexOffset - (header.lodOffset + lodBytes));
+		file.write(reinterpret_cast<const char*>(lodIndices), sizeof(unsigned int) * lodIndexCount);
+		return file.good();
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "pch.h"
+#include "FileSystem.h"
+
+// Binary mesh cache.
+// A cache file is a MeshCacheHeader followed by the packed Vertex array, the index array and the LOD chain: a
+// LodRecord per level and the indices of the levels after the first.
+// The file is memory mapped, so the Mesh points straight into the view: no parsing, no copy.
+
+namespace MeshCache {
+
+	const uint32_t Magic = 0x4348534D; // 'MSHC'
+	const uint32_t Version = 5;
+	const char* const Extension = ".mbin";
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;   // FNV-1a of the source OBJ bytes. A mismatch invalidates the cache.
+		uint32_t vertexStride; // sizeof(Vertex) when the file was written
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t vertexOffset; // Offsets in bytes from the beginning of the file
+		uint32_t indexOffset;
+		uint32_t lodCount;     // 0 when the LODs were not built: they are built at load time
+		uint32_t lodOffset;
+		uint32_t lodIndexCount;
+		uint32_t lodIndexOffset;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(Header) == 56, "Cache header layout is part of the file format");
+
+	// A level of detail (Mesh::Lod). firstIndex counts from the first index of the mesh, so LOD 0 is
+	// { 0, indexCount } and the others start at indexCount.
+	struct LodRecord {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float error;
+	};
+	static_assert(sizeof(LodRecord) == 12, "LOD record layout is part of the file format");
+
+	using MappedFile = FileSystem::MappedFile;
+
+	uint64_t HashBytes(const BYTE* data, size_t size);
+	// Hash of the source file contents, 0 if the file cannot be read.
+	uint64_t HashFile(std::string const fileName);
+
+	// Cache file name for a source OBJ: Assets/mesh1.obj -> Assets/mesh1.mbin
+	std::string CacheFileName(std::string const sourceFileName);
+	// Writable location for caches generated at run time (FileSystem::LocalFileName).
+	std::string LocalCacheFileName(std::string const sourceFileName);
+
+	// Checks a mapped file and returns its header, or nullptr when the file is not a valid cache for sourceHash.
+	// Reads every index once, to check that it names a vertex of the cache.
+	const Header* Validate(const MappedFile& file, uint64_t sourceHash, uint32_t vertexStride);
+
+	bool Write(std::string const fileName, uint64_t sourceHash,
+		const void* vertices, uint32_t vertexStride, uint32_t vertexCount,
+		const unsigned int* indices, uint32_t indexCount,
+		const LodRecord* lods, uint32_t lodCount,
+		const unsigned int* lodIndices, uint32_t lodIndexCount);
+}
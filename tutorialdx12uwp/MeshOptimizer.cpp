@@ -0,0 +1,241 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+namespace MeshOptimizer {
+
+	CacheStats SimulateVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+		unsigned int cacheSize) {
+
+		// A vertex is in the cache when it was pushed less than cacheSize misses ago.
+		std::vector<size_t> pushedAt(vertexCount, 0);
+		size_t misses = 0;
+		for (size_t i = 0; i < indexCount; i++) {
+			unsigned int v = indices[i];
+			if (pushedAt[v] == 0 || misses - pushedAt[v] >= cacheSize) {
+				pushedAt[v] = ++misses;
+			}
+		}
+		CacheStats stats = {};
+		size_t triangles = indexCount / 3;
+		stats.acmr = triangles > 0 ? float(misses) / float(triangles) : 0.0f;
+		stats.atvr = vertexCount > 0 ? float(misses) / float(vertexCount) : 0.0f;
+		return stats;
+	}
+
+	std::vector<unsigned int> Tipsify(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+		unsigned int cacheSize, std::vector<size_t>* clusters) {
+
+		size_t triangleCount = indexCount / 3;
+		std::vector<unsigned int> output;
+		output.reserve(triangleCount * 3);
+		if (clusters != nullptr)
+			clusters->clear();
+
+		// Vertex-triangle adjacency in compressed rows. live[v] counts the triangles of v not yet emitted.
+		std::vector<unsigned int> live(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			live[indices[i]]++;
+		std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyStart[v + 1] = adjacencyStart[v] + live[v];
+		std::vector<unsigned int> adjacency(adjacencyStart[vertexCount]);
+		std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (size_t k = 0; k < 3; k++)
+				adjacency[fill[indices[3 * t + k]]++] = static_cast<unsigned int>(t);
+
+		std::vector<size_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<unsigned int> deadEnd;
+		std::vector<unsigned int> candidates;
+		size_t time = cacheSize + 1;
+		size_t cursor = 0; // Next vertex to try when the dead-end stack is empty
+
+		auto skipDeadEnd = [&]() -> long long {
+			while (!deadEnd.empty()) {
+				unsigned int d = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[d] > 0)
+					return d;
+			}
+			while (cursor < vertexCount) {
+				if (live[cursor] > 0)
+					return static_cast<long long>(cursor++);
+				cursor++;
+			}
+			return -1;
+		};
+
+		long long fanning = triangleCount > 0 ? skipDeadEnd() : -1;
+		bool newCluster = true;
+		while (fanning >= 0) {
+			if (newCluster && clusters != nullptr)
+				clusters->push_back(output.size() / 3);
+
+			// Emit every remaining triangle around the fanning vertex.
+			candidates.clear();
+			for (size_t a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+				unsigned int t = adjacency[a];
+				if (emitted[t])
+					continue;
+				for (size_t k = 0; k < 3; k++) {
+					unsigned int v = indices[3 * t + k];
+					output.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cacheTime[v] > cacheSize) {
+						cacheTime[v] = time;
+						time++;
+					}
+				}
+				emitted[t] = true;
+			}
+
+			// Next fanning vertex: the candidate that will still be in the cache and is the oldest there.
+			long long next = -1;
+			long long bestPriority = -1;
+			for (unsigned int v : candidates) {
+				if (live[v] == 0)
+					continue;
+				long long priority = 0;
+				if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+					priority = static_cast<long long>(time - cacheTime[v]);
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					next = v;
+				}
+			}
+			newCluster = next < 0;
+			fanning = newCluster ? skipDeadEnd() : next;
+		}
+		return output;
+	}
+
+	void OptimizeOverdraw(std::vector<unsigned int>& indices, const Vertex* vertices, const std::vector<size_t>& clusters) {
+
+		size_t triangleCount = indices.size() / 3;
+		if (clusters.size() < 2)
+			return;
+
+		// Area weighted centroid of the mesh.
+		auto triangle = [&](size_t t, XMVECTOR& centroid, XMVECTOR& normal) {
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[3 * t + 0]].pos);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[3 * t + 1]].pos);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[3 * t + 2]].pos);
+			normal = XMVector3Cross(p1 - p0, p2 - p0); // Length is twice the area
+			centroid = (p0 + p1 + p2) / 3.0f;
+		};
+		XMVECTOR meshCentroid = XMVectorZero();
+		float meshArea = 0.0f;
+		for (size_t t = 0; t < triangleCount; t++) {
+			XMVECTOR centroid, normal;
+			triangle(t, centroid, normal);
+			float area = XMVectorGetX(XMVector3Length(normal));
+			meshCentroid += centroid * area;
+			meshArea += area;
+		}
+		if (meshArea > 0.0f)
+			meshCentroid /= meshArea;
+
+		// A cluster whose average normal points away from the mesh center is likely to occlude the rest.
+		struct Cluster {
+			size_t first;
+			size_t last;
+			float outwards;
+		};
+		std::vector<Cluster> sorted(clusters.size());
+		for (size_t c = 0; c < clusters.size(); c++) {
+			Cluster& cluster = sorted[c];
+			cluster.first = clusters[c];
+			cluster.last = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+			XMVECTOR clusterCentroid = XMVectorZero();
+			XMVECTOR clusterNormal = XMVectorZero();
+			float clusterArea = 0.0f;
+			for (size_t t = cluster.first; t < cluster.last; t++) {
+				XMVECTOR centroid, normal;
+				triangle(t, centroid, normal);
+				float area = XMVectorGetX(XMVector3Length(normal));
+				clusterCentroid += centroid * area;
+				clusterNormal += normal;
+				clusterArea += area;
+			}
+			if (clusterArea > 0.0f)
+				clusterCentroid /= clusterArea;
+			cluster.outwards = XMVectorGetX(XMVector3Dot(clusterCentroid - meshCentroid, XMVector3Normalize(clusterNormal)));
+		}
+		std::stable_sort(sorted.begin(), sorted.end(),
+			[](const Cluster& a, const Cluster& b) { return a.outwards > b.outwards; });
+
+		std::vector<unsigned int> output;
+		output.reserve(indices.size());
+		for (const Cluster& cluster : sorted)
+			output.insert(output.end(), indices.begin() + 3 * cluster.first, indices.begin() + 3 * cluster.last);
+		indices.swap(output);
+	}
+
+	void OptimizeIndices(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, unsigned int cacheSize) {
+		std::vector<size_t> clusters;
+		indices = Tipsify(indices.data(), indices.size(), vertices.size(), cacheSize, &clusters);
+		OptimizeOverdraw(indices, vertices.data(), clusters);
+	}
+
+	FetchStats SimulateVertexFetch(const unsigned int* indices, size_t indexCount, size_t vertexCount, size_t vertexStride) {
+
+		// A line is in the cache when it was loaded less than FetchCacheLines loads ago.
+		size_t lineCount = (vertexCount * vertexStride + FetchCacheLineSize - 1) / FetchCacheLineSize;
+		std::vector<size_t> loadedAt(lineCount, 0);
+		std::vector<bool> referenced(vertexCount, false);
+		size_t loads = 0;
+		size_t referencedCount = 0;
+		for (size_t i = 0; i < indexCount; i++) {
+			unsigned int v = indices[i];
+			if (!referenced[v]) {
+				referenced[v] = true;
+				referencedCount++;
+			}
+			size_t firstLine = v * vertexStride / FetchCacheLineSize;
+			size_t lastLine = ((v + 1) * vertexStride - 1) / FetchCacheLineSize;
+			for (size_t line = firstLine; line <= lastLine; line++) {
+				if (loadedAt[line] == 0 || loads - loadedAt[line] >= FetchCacheLines)
+					loadedAt[line] = ++loads;
+			}
+		}
+		FetchStats stats = {};
+		stats.bytesFetched = loads * FetchCacheLineSize;
+		stats.overfetch = referencedCount > 0 ? float(stats.bytesFetched) / float(referencedCount * vertexStride) : 0.0f;
+		return stats;
+	}
+
+	size_t OptimizeVertexFetch(std::vector<unsigned int>& indices, std::vector<Vertex>& vertices) {
+
+		const unsigned int unused = 0xFFFFFFFF;
+		std::vector<unsigned int> remap(vertices.size(), unused);
+		std::vector<Vertex> reordered;
+		reordered.reserve(vertices.size());
+		for (unsigned int& index : indices) {
+			if (remap[index] == unused) {
+				remap[index] = static_cast<unsigned int>(reordered.size());
+				reordered.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		size_t removed = vertices.size() - reordered.size();
+		vertices.swap(reordered);
+		return removed;
+	}
+
+	Report Optimize(std::vector<unsigned int>& indices, std::vector<Vertex>& vertices) {
+		Report report = {};
+		report.cacheBefore = SimulateVertexCache(indices.data(), indices.size(), vertices.size());
+		report.fetchBefore = SimulateVertexFetch(indices.data(), indices.size(), vertices.size(), sizeof(Vertex));
+
+		OptimizeIndices(indices, vertices);
+		report.verticesRemoved = OptimizeVertexFetch(indices, vertices);
+		report.bytesSaved = report.verticesRemoved * sizeof(Vertex);
+
+		report.cacheAfter = SimulateVertexCache(indices.data(), indices.size(), vertices.size());
+		report.fetchAfter = SimulateVertexFetch(indices.data(), indices.size(), vertices.size(), sizeof(Vertex));
+		return report;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+
+// Index and vertex reordering passes run on meshes after they are loaded.
+
+namespace MeshOptimizer {
+
+	// Post-transform cache size assumed by the passes and by the simulator.
+	const unsigned int DefaultCacheSize = 16;
+
+	struct CacheStats {
+		float acmr; // Average cache miss ratio: transformed vertices per triangle (0.5 is ideal for large grids, 3 is worst)
+		float atvr; // Average transformed vertex ratio: transformed vertices per vertex (1 is ideal)
+	};
+
+	// FIFO post-transform cache simulation of a triangle list.
+	CacheStats SimulateVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+		unsigned int cacheSize = DefaultCacheSize);
+
+	// Tipsify (Sander, Nehab, Barczak 2007): reorders triangles for the post-transform cache in linear time.
+	// clusters receives the first triangle of every run that ends in a dead end (a cache flush).
+	std::vector<unsigned int> Tipsify(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+		unsigned int cacheSize, std::vector<size_t>* clusters);
+
+	// Sorts the Tipsify clusters so that the ones facing outwards are drawn first, which reduces overdraw
+	// from most view points. Triangle order inside a cluster, and so the cache behaviour, is preserved.
+	void OptimizeOverdraw(std::vector<unsigned int>& indices, const Vertex* vertices, const std::vector<size_t>& clusters);
+
+	// Both passes on a mesh index list.
+	void OptimizeIndices(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+		unsigned int cacheSize = DefaultCacheSize);
+
+	// Vertex fetch simulation with a FIFO cache of 64 byte lines.
+	const unsigned int FetchCacheLineSize = 64;
+	const unsigned int FetchCacheLines = 256; // 16 KB
+
+	struct FetchStats {
+		size_t bytesFetched; // Bytes of vertex buffer brought in the fetch cache
+		float overfetch;     // bytesFetched / bytes of the vertices referenced (1 is ideal)
+	};
+
+	FetchStats SimulateVertexFetch(const unsigned int* indices, size_t indexCount, size_t vertexCount, size_t vertexStride);
+
+	// Remaps vertices into the order of first use in indices so fetches walk the vertex buffer linearly.
+	// Vertices never referenced are dropped. Returns the number of vertices removed.
+	size_t OptimizeVertexFetch(std::vector<unsigned int>& indices, std::vector<Vertex>& vertices);
+
+	struct Report {
+		CacheStats cacheBefore;
+		CacheStats cacheAfter;
+		FetchStats fetchBefore;
+		FetchStats fetchAfter;
+		size_t verticesRemoved;
+		size_t bytesSaved;
+	};
+
+	// The whole stage: index order first, then vertex order.
+	Report Optimize(std::vector<unsigned int>& indices, std::vector<Vertex>& vertices);
+}
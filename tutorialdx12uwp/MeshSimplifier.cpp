@@ -0,0 +1,307 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+
+namespace MeshSimplifier {
+
+	// Symmetric 4x4 matrix of the sum of squared distances to a set of planes, divided by their weight.
+	struct Quadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		double weight;
+
+		void AddPlane(double a, double b, double c, double d, double w) {
+			a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+			b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+			c2 += w * c * c; cd += w * c * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& q) {
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+			weight += q.weight;
+		}
+
+		// Mean squared distance of p to the planes.
+		double Evaluate(const XMFLOAT3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double q = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+				b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+				c2 * z * z + 2.0 * cd * z + d2;
+			return weight > 0.0 ? std::max(q, 0.0) / weight : 0.0;
+		}
+	};
+
+	// Border edges are kept in place by planes through them, perpendicular to their triangle.
+	static const double c_borderWeight = 10.0;
+	// Collapse passes before giving up on the target.
+	static const int c_maxPasses = 64;
+
+	static XMVECTOR TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2) {
+		XMVECTOR v0 = XMLoadFloat3(&p0);
+		return XMVector3Cross(XMLoadFloat3(&p1) - v0, XMLoadFloat3(&p2) - v0);
+	}
+
+	static uint64_t EdgeKey(unsigned int a, unsigned int b) {
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	}
+
+	std::vector<unsigned int> Simplify(const unsigned int* indices, size_t indexCount,
+		const Vertex* vertices, size_t vertexCount, size_t targetIndexCount, float maxError, float* error) {
+
+		std::vector<unsigned int> result(indices, indices + indexCount - indexCount % 3);
+		if (error != nullptr)
+			*error = 0.0f;
+		if (result.size() <= targetIndexCount)
+			return result;
+
+		// Position classes: every vertex points to the first vertex with the same position.
+		std::vector<unsigned int> byPosition(vertexCount);
+		for (unsigned int v = 0; v < vertexCount; v++)
+			byPosition[v] = v;
+		auto positionLess = [&](unsigned int a, unsigned int b) {
+			const XMFLOAT3& pa = vertices[a].pos;
+			const XMFLOAT3& pb = vertices[b].pos;
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			if (pa.z != pb.z) return pa.z < pb.z;
+			return a < b;
+		};
+		std::sort(byPosition.begin(), byPosition.end(), positionLess);
+		std::vector<unsigned int> positionOf(vertexCount);
+		std::vector<size_t> classStart; // Members of a class are consecutive in byPosition
+		for (size_t i = 0; i < vertexCount; i++) {
+			unsigned int v = byPosition[i];
+			const XMFLOAT3& p = vertices[v].pos;
+			if (i == 0 || memcmp(&p, &vertices[byPosition[i - 1]].pos, sizeof(XMFLOAT3)) != 0)
+				classStart.push_back(i);
+			positionOf[v] = byPosition[classStart.back()];
+		}
+		classStart.push_back(vertexCount);
+		std::vector<size_t> classOf(vertexCount); // Class of a representative vertex, to find its members
+		for (size_t c = 0; c + 1 < classStart.size(); c++)
+			classOf[byPosition[classStart[c]]] = c;
+
+		// Face and border quadrics, accumulated on the representative vertices. The planes themselves are kept
+		// too, in a list per representative vertex: a collapse joins the lists in O(1).
+		std::vector<Quadric> quadrics(vertexCount, Quadric{});
+		struct Plane {
+			double a, b, c, d;
+		};
+		std::vector<Plane> planes;
+		std::vector<unsigned int> planeNext; // Next entry of the same vertex, UINT_MAX at the end
+		std::vector<unsigned int> planeOf;   // Entry -> plane
+		std::vector<unsigned int> planeHead(vertexCount, UINT_MAX);
+		std::vector<unsigned int> planeTail(vertexCount, UINT_MAX);
+		auto addPlane = [&](unsigned int v, unsigned int plane) {
+			unsigned int entry = static_cast<unsigned int>(planeOf.size());
+			planeOf.push_back(plane);
+			planeNext.push_back(UINT_MAX);
+			if (planeHead[v] == UINT_MAX)
+				planeHead[v] = entry;
+			else
+				planeNext[planeTail[v]] = entry;
+			planeTail[v] = entry;
+		};
+		auto largestDistance = [&](unsigned int v, const XMFLOAT3& p, double largest) {
+			for (unsigned int entry = planeHead[v]; entry != UINT_MAX; entry = planeNext[entry]) {
+				const Plane& plane = planes[planeOf[entry]];
+				largest = std::max(largest, std::abs(plane.a * p.x + plane.b * p.y + plane.c * p.z + plane.d));
+			}
+			return largest;
+		};
+		std::vector<uint64_t> edges;
+		edges.reserve(result.size());
+		for (size_t t = 0; t < result.size() / 3; t++) {
+			unsigned int c[3] = { positionOf[result[3 * t]], positionOf[result[3 * t + 1]], positionOf[result[3 * t + 2]] };
+			XMVECTOR n = TriangleNormal(vertices[c[0]].pos, vertices[c[1]].pos, vertices[c[2]].pos);
+			float area = 0.5f * XMVectorGetX(XMVector3Length(n));
+			if (area <= 0.0f)
+				continue;
+			XMFLOAT3 normal;
+			XMStoreFloat3(&normal, XMVector3Normalize(n));
+			const XMFLOAT3& p = vertices[c[0]].pos;
+			double d = -(double(normal.x) * p.x + double(normal.y) * p.y + double(normal.z) * p.z);
+			unsigned int plane = static_cast<unsigned int>(planes.size());
+			planes.push_back({ normal.x, normal.y, normal.z, d });
+			for (int k = 0; k < 3; k++) {
+				quadrics[c[k]].AddPlane(normal.x, normal.y, normal.z, d, area);
+				addPlane(c[k], plane);
+				edges.push_back(EdgeKey(c[k], c[(k + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t t = 0; t < result.size() / 3; t++) {
+			unsigned int c[3] = { positionOf[result[3 * t]], positionOf[result[3 * t + 1]], positionOf[result[3 * t + 2]] };
+			XMVECTOR n = TriangleNormal(vertices[c[0]].pos, vertices[c[1]].pos, vertices[c[2]].pos);
+			if (XMVectorGetX(XMVector3LengthSq(n)) <= 0.0f)
+				continue;
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = c[k];
+				unsigned int b = c[(k + 1) % 3];
+				auto range = std::equal_range(edges.begin(), edges.end(), EdgeKey(a, b));
+				if (range.second - range.first != 1)
+					continue;
+				XMVECTOR pa = XMLoadFloat3(&vertices[a].pos);
+				XMVECTOR edge = XMLoadFloat3(&vertices[b].pos) - pa;
+				XMFLOAT3 normal;
+				XMStoreFloat3(&normal, XMVector3Normalize(XMVector3Cross(edge, n)));
+				double d = -XMVectorGetX(XMVector3Dot(XMLoadFloat3(&normal), pa));
+				double w = c_borderWeight * XMVectorGetX(XMVector3LengthSq(edge));
+				quadrics[a].AddPlane(normal.x, normal.y, normal.z, d, w);
+				quadrics[b].AddPlane(normal.x, normal.y, normal.z, d, w);
+				unsigned int plane = static_cast<unsigned int>(planes.size());
+				planes.push_back({ normal.x, normal.y, normal.z, d });
+				addPlane(a, plane);
+				addPlane(b, plane);
+			}
+		}
+
+		struct Collapse {
+			double cost;
+			unsigned int from;
+			unsigned int to;
+		};
+		std::vector<Collapse> collapses;
+		std::vector<unsigned int> collapseTo(vertexCount);
+		std::vector<bool> locked(vertexCount);
+		std::vector<size_t> adjacencyStart(vertexCount + 1);
+		std::vector<unsigned int> adjacency;
+		// The mean squared distance is at most the largest one squared: edges above maxCost cannot pass.
+		double maxCost = double(maxError) * double(maxError);
+		double worstDistance = 0.0;
+
+		for (int pass = 0; pass < c_maxPasses && result.size() > targetIndexCount; pass++) {
+			size_t triangleCount = result.size() / 3;
+
+			// Triangles around every representative vertex.
+			std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+			for (unsigned int v : result)
+				adjacencyStart[positionOf[v] + 1]++;
+			for (size_t v = 0; v < vertexCount; v++)
+				adjacencyStart[v + 1] += adjacencyStart[v];
+			adjacency.resize(result.size());
+			std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				adjacency[fill[positionOf[result[i]]]++] = static_cast<unsigned int>(i / 3);
+
+			// Cheapest direction of every edge.
+			edges.clear();
+			for (size_t t = 0; t < triangleCount; t++)
+				for (int k = 0; k < 3; k++)
+					edges.push_back(EdgeKey(positionOf[result[3 * t + k]], positionOf[result[3 * t + (k + 1) % 3]]));
+			std::sort(edges.begin(), edges.end());
+			edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+			collapses.clear();
+			for (uint64_t key : edges) {
+				unsigned int a = static_cast<unsigned int>(key >> 32);
+				unsigned int b = static_cast<unsigned int>(key & 0xFFFFFFFF);
+				Quadric q = quadrics[a];
+				q.Add(quadrics[b]);
+				double toB = q.Evaluate(vertices[b].pos);
+				double toA = q.Evaluate(vertices[a].pos);
+				Collapse collapse = toB <= toA ? Collapse{ toB, a, b } : Collapse{ toA, b, a };
+				if (collapse.cost <= maxCost)
+					collapses.push_back(collapse);
+			}
+			std::sort(collapses.begin(), collapses.end(),
+				[](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+			// Greedy independent collapses. Every collapse removes about two triangles.
+			for (size_t v = 0; v < vertexCount; v++)
+				collapseTo[v] = static_cast<unsigned int>(v);
+			std::fill(locked.begin(), locked.end(), false);
+			size_t toRemove = (result.size() - targetIndexCount) / 3;
+			size_t removed = 0;
+			for (const Collapse& collapse : collapses) {
+				if (removed >= toRemove)
+					break;
+				if (locked[collapse.from] || locked[collapse.to])
+					continue;
+				// Reject collapses that flip a triangle around the vertex that goes away.
+				bool flips = false;
+				size_t dying = 0;
+				for (size_t a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1] && !flips; a++) {
+					unsigned int t = adjacency[a];
+					unsigned int c[3] = { positionOf[result[3 * t]], positionOf[result[3 * t + 1]], positionOf[result[3 * t + 2]] };
+					if (c[0] == collapse.to || c[1] == collapse.to || c[2] == collapse.to) {
+						dying++;
+						continue;
+					}
+					XMVECTOR before = TriangleNormal(vertices[c[0]].pos, vertices[c[1]].pos, vertices[c[2]].pos);
+					for (int k = 0; k < 3; k++)
+						if (c[k] == collapse.from)
+							c[k] = collapse.to;
+					XMVECTOR after = TriangleNormal(vertices[c[0]].pos, vertices[c[1]].pos, vertices[c[2]].pos);
+					flips = XMVectorGetX(XMVector3Dot(before, after)) <= 0.0f;
+				}
+				if (flips)
+					continue;
+				const XMFLOAT3& target = vertices[collapse.to].pos;
+				double distance = largestDistance(collapse.to, target, largestDistance(collapse.from, target, 0.0));
+				if (distance > maxError)
+					continue;
+				// Neighbours keep still until the next pass, so the flip test above stays valid.
+				for (size_t a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1]; a++) {
+					unsigned int t = adjacency[a];
+					for (int k = 0; k < 3; k++)
+						locked[positionOf[result[3 * t + k]]] = true;
+				}
+				collapseTo[collapse.from] = collapse.to;
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				if (planeHead[collapse.from] != UINT_MAX) {
+					if (planeHead[collapse.to] == UINT_MAX)
+						planeHead[collapse.to] = planeHead[collapse.from];
+					else
+						planeNext[planeTail[collapse.to]] = planeHead[collapse.from];
+					planeTail[collapse.to] = planeTail[collapse.from];
+					planeHead[collapse.from] = UINT_MAX;
+				}
+				worstDistance = std::max(worstDistance, distance);
+				removed += dying;
+			}
+			if (removed == 0)
+				break;
+
+			// Corners of a collapsed class move to the member of the target class with the closest attributes.
+			auto closestMember = [&](unsigned int v, unsigned int to) {
+				size_t c = classOf[to];
+				unsigned int best = to;
+				float bestScore = -std::numeric_limits<float>::max();
+				XMVECTOR n = XMLoadFloat3(&vertices[v].normal);
+				for (size_t i = classStart[c]; i < classStart[c + 1]; i++) {
+					const Vertex& member = vertices[byPosition[i]];
+					float score = XMVectorGetX(XMVector3Dot(n, XMLoadFloat3(&member.normal))) -
+						std::abs(member.uvcoords.x - vertices[v].uvcoords.x) - std::abs(member.uvcoords.y - vertices[v].uvcoords.y);
+					if (score > bestScore) {
+						bestScore = score;
+						best = byPosition[i];
+					}
+				}
+				return best;
+			};
+			size_t write = 0;
+			for (size_t t = 0; t < triangleCount; t++) {
+				unsigned int corner[3];
+				for (int k = 0; k < 3; k++) {
+					unsigned int v = result[3 * t + k];
+					unsigned int to = collapseTo[positionOf[v]];
+					corner[k] = to == positionOf[v] ? v : closestMember(v, to);
+				}
+				if (positionOf[corner[0]] == positionOf[corner[1]] || positionOf[corner[1]] == positionOf[corner[2]] ||
+					positionOf[corner[0]] == positionOf[corner[2]])
+					continue;
+				result[write++] = corner[0];
+				result[write++] = corner[1];
+				result[write++] = corner[2];
+			}
+			result.resize(write);
+		}
+
+		if (error != nullptr)
+			*error = static_cast<float>(worstDistance);
+		return result;
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+
+// Mesh simplification for the LOD chain of a Mesh.
+// Quadric error metric edge collapse (Garland, Heckbert 1997). Vertices are never moved: an edge
+// collapses onto one of its ends, so the result indexes the same vertex array and all the levels
+// of a mesh share its vertex buffer. Vertices with the same position but different normal or uv
+// (attribute seams) collapse together.
+// Collapses are ranked by their quadric, the area weighted mean squared distance to the planes of the triangles
+// around an edge, but accepted and reported by the largest distance: every vertex keeps the planes of the
+// triangles merged into it, and the vertex it collapses onto has to stay within maxError of all of them.
+
+namespace MeshSimplifier {
+
+	// Returns a triangle list of at most targetIndexCount indices when it can be reached without moving the
+	// surface more than maxError (model units). error receives the largest distance of a collapsed vertex
+	// to the planes of the triangles it replaced.
+	std::vector<unsigned int> Simplify(const unsigned int* indices, size_t indexCount,
+		const Vertex* vertices, size_t vertexCount, size_t targetIndexCount, float maxError, float* error);
+}
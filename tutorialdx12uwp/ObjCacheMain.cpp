@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "AssetLoader.h"
+#include "Mesh.h"
+
+// Offline converter from OBJ to the binary mesh cache (MeshCache.h), built by CMakeLists.txt on the core library.
+// objcache [--out folder] file.obj [more.obj ...]
+// Every mesh goes through the path the app takes when it has no cache: Mesh parses, optimizes and builds the LODs,
+// and writeCacheFile writes them next to the OBJ (Assets/mesh1.obj -> Assets/mesh1.mbin), or in folder. The file is
+// read back and must give the same vertices, indices and LODs. Exits with 1 when a mesh fails.
+
+namespace {
+	void report(const wchar_t* format, ...) {
+		wchar_t msgbuff[512];
+		va_list args;
+		va_start(args, format);
+		vswprintf(msgbuff, 512, format, args);
+		va_end(args);
+		MYTRACE(msgbuff);
+	}
+
+	std::wstring wide(const std::string& text) {
+		return std::wstring(text.begin(), text.end());
+	}
+
+	std::vector<BYTE> lodIndices(const Mesh& mesh) {
+		std::vector<BYTE> indices(size_t(mesh.GetIndexCountAllLods()) * mesh.GetIndexStride());
+		mesh.CopyIndices(indices.data());
+		return indices;
+	}
+
+	bool sameMesh(const Mesh& built, const Mesh& cached) {
+		if (built.GetVertexCount() != cached.GetVertexCount() || built.GetIndexCount() != cached.GetIndexCount() ||
+			built.GetLodCount() != cached.GetLodCount() || built.GetIndexCountAllLods() != cached.GetIndexCountAllLods())
+			return false;
+		if (memcmp(built.GetVertexData(), cached.GetVertexData(), size_t(built.GetVertexCount()) * sizeof(Vertex)) != 0 ||
+			memcmp(built.GetIndexData(), cached.GetIndexData(), size_t(built.GetIndexCount()) * sizeof(unsigned int)) != 0)
+			return false;
+		for (UINT l = 0; l < built.GetLodCount(); l++) {
+			const Mesh::Lod& a = built.GetLod(l);
+			const Mesh::Lod& b = cached.GetLod(l);
+			if (a.firstIndex != b.firstIndex || a.indexCount != b.indexCount || a.error != b.error)
+				return false;
+		}
+		return lodIndices(built) == lodIndices(cached);
+	}
+
+	bool convert(const std::string& fileName, const std::string& folder, JobSystem& jobs) {
+		uint64_t sourceHash = MeshCache::HashFile(fileName);
+		if (sourceHash == 0) {
+			report(L"Could not read %ls\n", wide(fileName).c_str());
+			return false;
+		}
+		std::string cacheFileName = MeshCache::CacheFileName(fileName);
+		if (!folder.empty())
+			cacheFileName = folder + "/" + cacheFileName.substr(cacheFileName.find_last_of("/\\") + 1);
+
+		Mesh mesh(fileName, &jobs, false);
+		if (!mesh.writeCacheFile(cacheFileName, sourceHash)) {
+			report(L"Could not write %ls\n", wide(cacheFileName).c_str());
+			return false;
+		}
+		Mesh cached;
+		if (!cached.readCacheFile(cacheFileName, sourceHash) || !sameMesh(mesh, cached)) {
+			report(L"%ls does not read back as the mesh written\n", wide(cacheFileName).c_str());
+			return false;
+		}
+		report(L"%ls: %u vertices, %u indices, %u LODs\n", wide(cacheFileName).c_str(), mesh.GetVertexCount(),
+			mesh.GetIndexCount(), mesh.GetLodCount());
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	std::string folder;
+	std::vector<std::string> fileNames;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--out" && i + 1 < argc)
+			folder = argv[++i];
+		else
+			fileNames.push_back(argument);
+	}
+	if (fileNames.empty()) {
+		report(L"Usage: objcache [--out folder] file.obj [more.obj ...]\n");
+		return 1;
+	}
+
+	JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+	size_t failed = 0;
+	for (const std::string& fileName : fileNames) {
+		try {
+			failed += convert(fileName, folder, jobs) ? 0 : 1;
+		}
+		catch (const std::exception& exception) {
+			report(L"%ls: %ls\n", wide(fileName).c_str(), wide(exception.what()).c_str());
+			failed++;
+		}
+	}
+	return failed > 0 ? 1 : 0;
+}
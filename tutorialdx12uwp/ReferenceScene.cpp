@@ -0,0 +1,38 @@
+#include "pch.h"
+#include "ReferenceScene.h"
+#include "FrameUpdate.h"
+
+namespace ReferenceScene {
+
+	std::vector<std::shared_ptr<Mesh>> MakeMeshes() {
+		std::vector<std::shared_ptr<Mesh>> meshes;
+		for (UINT shape = 0; shape < c_shapeCount; shape++)
+			meshes.push_back(std::make_shared<Mesh>());
+		return meshes;
+	}
+
+	InstanceStore MakeStore() {
+		InstanceStore store;
+		store.Clear(c_shapeCount);
+		const XMFLOAT4 rotation(0.0f, 0.0f, 0.0f, 1.0f);
+		const XMFLOAT3 scale(1.0f, 1.0f, 1.0f);
+		for (UINT shape = 0; shape < c_shapeCount; shape++) {
+			for (UINT grid = 0; grid <= shape; grid++) {
+				float z = 20.0f + 10.0f * grid;
+				for (int y = -1; y <= 1; y++) {
+					for (int x = -1; x <= 1; x++) {
+						store.Add(shape, XMFLOAT3(3.0f * x, 3.0f * y, z), rotation, scale, shape);
+						store.Add(shape, XMFLOAT3(3.0f * x, 3.0f * y, -z), rotation, scale, shape);
+					}
+				}
+			}
+		}
+		return store;
+	}
+
+	InstanceUpdate::Frame MakeFrame() {
+		XMMATRIX view = XMMatrixLookAtLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(c_fovY, static_cast<float>(c_width) / c_height, 0.5f, 1000.0f);
+		return FrameUpdate::MakeFrame(XMMatrixIdentity(), view, projection, c_fovY, static_cast<float>(c_height), 1.0f);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "pch.h"
+#include "InstanceStore.h"
+#include "InstanceUpdate.h"
+#include "Mesh.h"
+
+// The fixed frame of the console checks (CMakeLists.txt): frame_commands compares its commands with a reference
+// trace (CommandCheck.cpp) and software_reference its image with a golden one (SoftwareReferenceCheck.cpp).
+
+namespace ReferenceScene {
+
+	const UINT c_shapeCount = 6;
+	const UINT c_width = 1280;
+	const UINT c_height = 720;
+	const float c_fovY = 0.25f * XM_PI;
+
+	// The cube of Mesh() for every shape.
+	std::vector<std::shared_ptr<Mesh>> MakeMeshes();
+
+	// Cubes in 3x3 grids in front of the camera, every shape a grid more than the previous one, each grid further
+	// away, and as many grids behind the camera, which culling drops. Every cube is far from the frustum planes, so
+	// the visible instances are the same whatever the rounding of the math library.
+	InstanceStore MakeStore();
+
+	// A camera at the origin looking down +z, c_width x c_height pixels.
+	InstanceUpdate::Frame MakeFrame();
+}
@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "RenderQueue.h"
+
+namespace {
+	const UINT c_meshShift = RenderQueue::c_depthBits;
+	const UINT c_materialShift = c_meshShift + RenderQueue::c_meshBits;
+	const UINT c_pipelineShift = c_materialShift + RenderQueue::c_materialBits;
+	const UINT c_passShift = c_pipelineShift + RenderQueue::c_pipelineBits;
+	static_assert(c_passShift + RenderQueue::c_passBits == 64, "The key fields fill 64 bits");
+
+	UINT64 field(UINT64 value, UINT bits, UINT shift) {
+		return (value & ((1ull << bits) - 1)) << shift;
+	}
+
+	// Same state and geometry, instances right after the draw's: one instanced draw covers both.
+	bool canMerge(const RenderQueue::Draw& draw, const RenderQueue::Draw& next) {
+		return draw.pipeline == next.pipeline && draw.material == next.material && draw.mesh == next.mesh &&
+			draw.indexCount == next.indexCount && draw.firstIndex == next.firstIndex && draw.baseVertex == next.baseVertex &&
+			draw.firstInstance + draw.instanceCount == next.firstInstance;
+	}
+}
+
+UINT64 RenderQueue::MakeKey(Pass pass, UINT pipeline, UINT material, UINT mesh, float depth) {
+	// The bits of a positive float sort as the float does; the top ones are the exponent and the first bits of
+	// the mantissa.
+	UINT depthBits = 0;
+	if (depth > 0.0f) {
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+		depthBits >>= 32 - c_depthBits;
+	}
+	if (pass == Pass::Transparent)
+		depthBits = ~depthBits;
+	return field(static_cast<UINT>(pass), c_passBits, c_passShift) | field(pipeline, c_pipelineBits, c_pipelineShift) |
+		field(material, c_materialBits, c_materialShift) | field(mesh, c_meshBits, c_meshShift) | field(depthBits, c_depthBits, 0);
+}
+
+RenderQueue::RenderQueue() : m_stats{}
+{
+}
+
+void RenderQueue::Clear() {
+	m_items.clear();
+	m_entries.clear();
+	m_draws.clear();
+	m_stats = {};
+}
+
+void RenderQueue::Reserve(size_t count) {
+	m_items.reserve(count);
+	m_entries.reserve(count);
+	m_scratch.reserve(count);
+	m_draws.reserve(count);
+}
+
+void RenderQueue::Add(UINT64 key, const Draw& draw) {
+	m_entries.push_back(Entry{ key, static_cast<UINT>(m_items.size()) });
+	m_items.push_back(draw);
+}
+
+void RenderQueue::Sort() {
+	m_stats = {};
+	m_stats.items = m_entries.size();
+	m_stats.submitted = countChanges(m_entries.data(), m_entries.size());
+	radixSort();
+	m_stats.sorted = countChanges(m_entries.data(), m_entries.size());
+
+	// Merging only looks at the draws; keys of merged draws may differ in their depth.
+	m_draws.clear();
+	for (const Entry& entry : m_entries) {
+		const Draw& item = m_items[entry.item];
+		if (!m_draws.empty() && canMerge(m_draws.back(), item))
+			m_draws.back().instanceCount += item.instanceCount;
+		else
+			m_draws.push_back(item);
+	}
+	m_stats.draws = m_draws.size();
+}
+
+void RenderQueue::radixSort() {
+	// Least significant byte first, every pass stable. The histograms of all the bytes take one pass over the keys.
+	size_t count = m_entries.size();
+	if (count < 2)
+		return;
+	UINT histograms[c_radixPassCount][c_radixSize] = {};
+	for (const Entry& entry : m_entries) {
+		for (UINT pass = 0; pass < c_radixPassCount; pass++)
+			histograms[pass][(entry.key >> (pass * c_radixBits)) & (c_radixSize - 1)]++;
+	}
+
+	m_scratch.resize(count);
+	Entry* source = m_entries.data();
+	Entry* target = m_scratch.data();
+	for (UINT pass = 0; pass < c_radixPassCount; pass++) {
+		UINT* histogram = histograms[pass];
+		UINT shift = pass * c_radixBits;
+		// A byte every key shares leaves the order as it is.
+		if (histogram[(source[0].key >> shift) & (c_radixSize - 1)] == count)
+			continue;
+		UINT offset = 0;
+		for (UINT digit = 0; digit < c_radixSize; digit++) {
+			UINT digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+		for (size_t i = 0; i < count; i++)
+			target[histogram[(source[i].key >> shift) & (c_radixSize - 1)]++] = source[i];
+		std::swap(source, target);
+		m_stats.radixPasses++;
+	}
+	if (source != m_entries.data())
+		m_entries.swap(m_scratch);
+}
+
+RenderQueue::StateChanges RenderQueue::countChanges(const Entry* entries, size_t count) {
+	StateChanges changes = {};
+	for (size_t i = 0; i < count; i++) {
+		UINT64 changed = i == 0 ? ~0ull : entries[i].key ^ entries[i - 1].key;
+		if (field(changed >> c_passShift, c_passBits, 0))
+			changes.passes++;
+		if (field(changed >> c_pipelineShift, c_pipelineBits, 0))
+			changes.pipelines++;
+		if (field(changed >> c_materialShift, c_materialBits, 0))
+			changes.materials++;
+		if (field(changed >> c_meshShift, c_meshBits, 0))
+			changes.meshes++;
+	}
+	return changes;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "pch.h"
+
+// Orders the draws of a frame by the state they need. Every draw is added with a 64-bit sort key whose fields go
+// from the state that costs most to change to the one that costs least: pass, pipeline state, material (the
+// texture table), mesh (the index buffer), then depth. Sort orders the keys with a radix sort, stable so draws
+// with equal keys keep the order they were added in, and merges neighbours that differ only in their instances
+// into one instanced draw: the shaders read gInstanceData from gInstanceBase, so instances have to follow each
+// other in the instance buffer to share a draw.
+
+class RenderQueue
+{
+public:
+	// Width of the key fields, from the top bit down.
+	static const UINT c_passBits = 4;
+	static const UINT c_pipelineBits = 8;
+	static const UINT c_materialBits = 12;
+	static const UINT c_meshBits = 16;
+	static const UINT c_depthBits = 24;
+
+	// Opaque draws go front to back, so the depth test rejects what they hide; transparent ones back to front.
+	enum class Pass : UINT { Opaque, Transparent };
+
+	// A DrawIndexedInstanced and the state it needs. mesh selects the index buffer view, instances are read from
+	// firstInstance on.
+	struct Draw {
+		UINT pipeline;
+		UINT material;
+		UINT mesh;
+		UINT indexCount;
+		UINT instanceCount;
+		UINT firstIndex;
+		INT baseVertex;
+		UINT firstInstance;
+	};
+
+	// Changes of a key field between consecutive draws, the first draw included.
+	struct StateChanges {
+		UINT passes;
+		UINT pipelines;
+		UINT materials;
+		UINT meshes;
+
+		UINT Total() const { return passes + pipelines + materials + meshes; }
+	};
+
+	// Counters of the last Sort.
+	struct Stats {
+		size_t items;
+		size_t draws; // After merging
+		UINT radixPasses; // Byte passes run; a byte every key shares needs none
+		StateChanges submitted; // In the order the draws were added
+		StateChanges sorted;
+	};
+
+	// Fields wider than their bits are cut. depth: distance along the view direction, negative counts as 0.
+	static UINT64 MakeKey(Pass pass, UINT pipeline, UINT material, UINT mesh, float depth);
+
+	RenderQueue();
+
+	// Empties the queue; the storage is kept for the next frame.
+	void Clear();
+	void Reserve(size_t count);
+	void Add(UINT64 key, const Draw& draw);
+
+	// Sorts and merges the draws added since Clear; GetDraws holds the result until the next Clear.
+	void Sort();
+
+	const std::vector<Draw>& GetDraws() const { return m_draws; }
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	static const UINT c_radixBits = 8;
+	static const UINT c_radixSize = 1 << c_radixBits;
+	static const UINT c_radixPassCount = 64 / c_radixBits;
+
+	// Key and position in m_items, sorted together.
+	struct Entry {
+		UINT64 key;
+		UINT item;
+	};
+
+	void radixSort();
+	static StateChanges countChanges(const Entry* entries, size_t count);
+
+	std::vector<Draw> m_items;
+	std::vector<Entry> m_entries;
+	std::vector<Entry> m_scratch;
+	std::vector<Draw> m_draws;
+	Stats m_stats;
+};
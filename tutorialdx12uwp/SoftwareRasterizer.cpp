@@ -0,0 +1,863 @@
+#include "pch.h"
+#include "SoftwareRasterizer.h"
+#include <cctype>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SOFTWARE_RASTERIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace SoftwareRasterizer {
+
+	// DDS header fields, as offsets from the start of the file (after the magic number).
+	static const size_t c_ddsHeaderSize = 4 + 124;
+	static const UINT c_ddsMipMapCount = 0x20000; // DDSD_MIPMAPCOUNT
+	static const UINT c_ddsFourCC = 0x4;          // DDPF_FOURCC
+	static const UINT c_ddsRgb = 0x40;            // DDPF_RGB
+	static const UINT c_ddsAlphaPixels = 0x1;     // DDPF_ALPHAPIXELS
+
+	static UINT ReadUint(const std::vector<BYTE>& data, size_t offset) {
+		return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | (static_cast<UINT>(data[offset + 3]) << 24);
+	}
+
+	static UINT FourCC(char a, char b, char c, char d) {
+		return static_cast<UINT>(a) | (static_cast<UINT>(b) << 8) | (static_cast<UINT>(c) << 16) | (static_cast<UINT>(d) << 24);
+	}
+
+	static UINT PackRgba(UINT r, UINT g, UINT b, UINT a) {
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
+
+	// 5 and 6 bit channels are widened by repeating their high bits, as BC1 decoders do.
+	static void Expand565(UINT color, UINT rgb[3]) {
+		UINT r = (color >> 11) & 31;
+		UINT g = (color >> 5) & 63;
+		UINT b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	static void DecodeBC1(const BYTE* blocks, Texture::Level& level) {
+		UINT blocksX = std::max(1u, (level.width + 3) / 4);
+		UINT blocksY = std::max(1u, (level.height + 3) / 4);
+		for (UINT by = 0; by < blocksY; by++) {
+			for (UINT bx = 0; bx < blocksX; bx++) {
+				const BYTE* block = blocks + 8 * (static_cast<size_t>(by) * blocksX + bx);
+				UINT color0 = block[0] | (block[1] << 8);
+				UINT color1 = block[2] | (block[3] << 8);
+				UINT bits = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<UINT>(block[7]) << 24);
+				UINT c0[3];
+				UINT c1[3];
+				Expand565(color0, c0);
+				Expand565(color1, c1);
+				UINT palette[4];
+				palette[0] = PackRgba(c0[0], c0[1], c0[2], 255);
+				palette[1] = PackRgba(c1[0], c1[1], c1[2], 255);
+				if (color0 > color1) {
+					palette[2] = PackRgba((2 * c0[0] + c1[0] + 1) / 3, (2 * c0[1] + c1[1] + 1) / 3, (2 * c0[2] + c1[2] + 1) / 3, 255);
+					palette[3] = PackRgba((c0[0] + 2 * c1[0] + 1) / 3, (c0[1] + 2 * c1[1] + 1) / 3, (c0[2] + 2 * c1[2] + 1) / 3, 255);
+				}
+				else {
+					palette[2] = PackRgba((c0[0] + c1[0]) / 2, (c0[1] + c1[1]) / 2, (c0[2] + c1[2]) / 2, 255);
+					palette[3] = 0; // Transparent black
+				}
+				for (UINT y = 0; y < 4; y++) {
+					for (UINT x = 0; x < 4; x++) {
+						UINT px = 4 * bx + x;
+						UINT py = 4 * by + y;
+						if (px < level.width && py < level.height)
+							level.texels[static_cast<size_t>(py) * level.width + px] = palette[(bits >> (2 * (4 * y + x))) & 3];
+					}
+				}
+			}
+		}
+	}
+
+	Texture LoadDDS(const std::string& fileName) {
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("LoadDDS: cannot open " + fileName);
+		std::vector<BYTE> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (data.size() < c_ddsHeaderSize || ReadUint(data, 0) != FourCC('D', 'D', 'S', ' '))
+			throw std::runtime_error("LoadDDS: not a DDS file: " + fileName);
+
+		UINT flags = ReadUint(data, 8);
+		UINT height = ReadUint(data, 12);
+		UINT width = ReadUint(data, 16);
+		UINT mipCount = (flags & c_ddsMipMapCount) != 0 ? std::max(1u, ReadUint(data, 28)) : 1;
+		UINT formatFlags = ReadUint(data, 80);
+		UINT fourCC = ReadUint(data, 84);
+		UINT bitCount = ReadUint(data, 88);
+		UINT redMask = ReadUint(data, 92);
+		UINT alphaMask = ReadUint(data, 104);
+		if (width == 0 || height == 0)
+			throw std::runtime_error("LoadDDS: empty texture in " + fileName);
+
+		// BC1, or 32 bits per texel with red in the low or in the third byte.
+		bool bc1 = false;
+		bool bgra = false;
+		bool alpha = true;
+		size_t offset = c_ddsHeaderSize;
+		if ((formatFlags & c_ddsFourCC) != 0 && fourCC == FourCC('D', 'X', 'T', '1'))
+			bc1 = true;
+		else if ((formatFlags & c_ddsFourCC) != 0 && fourCC == FourCC('D', 'X', '1', '0') && data.size() >= c_ddsHeaderSize + 20) {
+			UINT dxgiFormat = ReadUint(data, c_ddsHeaderSize);
+			offset += 20;
+			if (dxgiFormat == DXGI_FORMAT_BC1_UNORM || dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB)
+				bc1 = true;
+			else if (dxgiFormat == DXGI_FORMAT_B8G8R8A8_UNORM || dxgiFormat == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB)
+				bgra = true;
+			else if (dxgiFormat != DXGI_FORMAT_R8G8B8A8_UNORM && dxgiFormat != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+				throw std::runtime_error("LoadDDS: unsupported format in " + fileName);
+		}
+		else if ((formatFlags & c_ddsRgb) != 0 && bitCount == 32 && (redMask == 0xFF || redMask == 0xFF0000)) {
+			bgra = redMask == 0xFF0000;
+			alpha = (formatFlags & c_ddsAlphaPixels) != 0 && alphaMask == 0xFF000000;
+		}
+		else
+			throw std::runtime_error("LoadDDS: unsupported format in " + fileName);
+
+		Texture texture;
+		texture.levels.resize(mipCount);
+		for (UINT mip = 0; mip < mipCount; mip++) {
+			Texture::Level& level = texture.levels[mip];
+			level.width = std::max(1u, width >> mip);
+			level.height = std::max(1u, height >> mip);
+			level.texels.resize(static_cast<size_t>(level.width) * level.height);
+			size_t bytes = bc1 ? 8 * static_cast<size_t>(std::max(1u, (level.width + 3) / 4)) * std::max(1u, (level.height + 3) / 4) :
+				4 * level.texels.size();
+			if (offset + bytes > data.size())
+				throw std::runtime_error("LoadDDS: truncated file " + fileName);
+			if (bc1)
+				DecodeBC1(data.data() + offset, level);
+			else {
+				for (size_t i = 0; i < level.texels.size(); i++) {
+					UINT texel = ReadUint(data, offset + 4 * i);
+					if (bgra)
+						texel = (texel & 0xFF00FF00) | ((texel >> 16) & 0xFF) | ((texel & 0xFF) << 16);
+					level.texels[i] = alpha ? texel : texel | 0xFF000000;
+				}
+			}
+			offset += bytes;
+		}
+		return texture;
+	}
+
+	bool WritePPM(const std::string& fileName, const Image& image) {
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file)
+			return false;
+		file << "P6\n" << image.width << " " << image.height << "\n255\n";
+		std::vector<char> row(3 * static_cast<size_t>(image.width));
+		for (UINT y = 0; y < image.height; y++) {
+			for (UINT x = 0; x < image.width; x++) {
+				UINT pixel = image.pixels[static_cast<size_t>(y) * image.width + x];
+				row[3 * x] = static_cast<char>(pixel & 0xFF);
+				row[3 * x + 1] = static_cast<char>((pixel >> 8) & 0xFF);
+				row[3 * x + 2] = static_cast<char>((pixel >> 16) & 0xFF);
+			}
+			file.write(row.data(), row.size());
+		}
+		return static_cast<bool>(file);
+	}
+
+	// Next number of a PPM header, past whitespace and comments.
+	static bool ReadHeaderNumber(std::istream& file, UINT& value) {
+		int c = file.get();
+		while (c == '#' || std::isspace(c)) {
+			if (c == '#')
+				while (c != '\n' && c != EOF)
+					c = file.get();
+			c = file.get();
+		}
+		if (c < '0' || c > '9')
+			return false;
+		value = 0;
+		while (c >= '0' && c <= '9') {
+			value = 10 * value + (c - '0');
+			c = file.get();
+		}
+		return std::isspace(c) != 0; // One whitespace character ends the header
+	}
+
+	bool ReadPPM(const std::string& fileName, Image& image) {
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file || file.get() != 'P' || file.get() != '6')
+			return false;
+		UINT width;
+		UINT height;
+		UINT maxValue;
+		if (!ReadHeaderNumber(file, width) || !ReadHeaderNumber(file, height) || !ReadHeaderNumber(file, maxValue) || maxValue != 255)
+			return false;
+		std::vector<BYTE> rgb(3 * static_cast<size_t>(width) * height);
+		file.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+		if (!file)
+			return false;
+		image.width = width;
+		image.height = height;
+		image.pixels.resize(static_cast<size_t>(width) * height);
+		for (size_t i = 0; i < image.pixels.size(); i++)
+			image.pixels[i] = PackRgba(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2], 255);
+		return true;
+	}
+
+	ImageDifference Compare(const Image& first, const Image& second) {
+		ImageDifference difference = {};
+		if (first.width != second.width || first.height != second.height) {
+			difference.pixels = std::max(first.pixels.size(), second.pixels.size());
+			difference.largest = 255;
+			return difference;
+		}
+		for (size_t i = 0; i < first.pixels.size(); i++) {
+			UINT largest = 0;
+			for (UINT shift = 0; shift < 24; shift += 8) {
+				int a = (first.pixels[i] >> shift) & 0xFF;
+				int b = (second.pixels[i] >> shift) & 0xFF;
+				largest = std::max(largest, static_cast<UINT>(std::abs(a - b)));
+			}
+			if (largest != 0)
+				difference.pixels++;
+			difference.largest = std::max(difference.largest, largest);
+		}
+		return difference;
+	}
+
+	static void CopyIndices(const void* indices, UINT indexCount, UINT indexStride, std::vector<UINT>& output) {
+		output.resize(indexCount);
+		if (indexStride == 2) {
+			const uint16_t* indices16 = static_cast<const uint16_t*>(indices);
+			for (UINT i = 0; i < indexCount; i++)
+				output[i] = indices16[i];
+		}
+		else
+			memcpy(output.data(), indices, indexCount * sizeof(UINT));
+	}
+
+	Geometry MakeGeometry(const Vertex* vertices, UINT vertexCount, const void* indices, UINT indexCount, UINT indexStride) {
+		Geometry geometry;
+		geometry.vertices.assign(vertices, vertices + vertexCount);
+		CopyIndices(indices, indexCount, indexStride, geometry.indices);
+		return geometry;
+	}
+
+	Geometry MakeGeometry(const PackedVertex* vertices, UINT vertexCount, const void* indices, UINT indexCount, UINT indexStride) {
+		Geometry geometry;
+		geometry.vertices.resize(vertexCount);
+		// Decoding against the unit box gives the UNORM values the input assembler reads.
+		BoundingBox unit(XMFLOAT3(0.5f, 0.5f, 0.5f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+		VertexPacking::Decode(vertices, vertexCount, unit, geometry.vertices.data());
+		CopyIndices(indices, indexCount, indexStride, geometry.indices);
+		return geometry;
+	}
+
+	// Bilinear filtering of a level with wrap addressing; (u, v) in texels, texel centers at half integers.
+	static void SampleLevel(const Texture::Level& level, float u, float v, float color[4]) {
+		float x = u - 0.5f;
+		float y = v - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		float wx = x - fx;
+		float wy = y - fy;
+		int w = static_cast<int>(level.width);
+		int h = static_cast<int>(level.height);
+		int x0 = static_cast<int>(fx) % w;
+		int y0 = static_cast<int>(fy) % h;
+		x0 += x0 < 0 ? w : 0;
+		y0 += y0 < 0 ? h : 0;
+		int x1 = x0 + 1 == w ? 0 : x0 + 1;
+		int y1 = y0 + 1 == h ? 0 : y0 + 1;
+		UINT t00 = level.texels[static_cast<size_t>(y0) * w + x0];
+		UINT t10 = level.texels[static_cast<size_t>(y0) * w + x1];
+		UINT t01 = level.texels[static_cast<size_t>(y1) * w + x0];
+		UINT t11 = level.texels[static_cast<size_t>(y1) * w + x1];
+		for (UINT c = 0; c < 4; c++) {
+			float a = static_cast<float>((t00 >> (8 * c)) & 0xFF);
+			float b = static_cast<float>((t10 >> (8 * c)) & 0xFF);
+			float d = static_cast<float>((t01 >> (8 * c)) & 0xFF);
+			float e = static_cast<float>((t11 >> (8 * c)) & 0xFF);
+			float top = a + wx * (b - a);
+			float bottom = d + wx * (e - d);
+			color[c] = (top + wy * (bottom - top)) * (1.0f / 255.0f);
+		}
+	}
+
+	// MIN_MAG_MIP_LINEAR with wrap addressing, the sampler of the root signature.
+	static void Sample(const Texture* texture, float u, float v, float lod, float color[4]) {
+		if (texture == nullptr || texture->levels.empty()) {
+			color[0] = color[1] = color[2] = color[3] = 1.0f;
+			return;
+		}
+		float maxLod = static_cast<float>(texture->levels.size() - 1);
+		lod = std::min(std::max(lod, 0.0f), maxLod);
+		UINT mip = static_cast<UINT>(lod);
+		float weight = lod - static_cast<float>(mip);
+		const Texture::Level& level = texture->levels[mip];
+		SampleLevel(level, u * level.width, v * level.height, color);
+		if (weight > 0.0f) {
+			const Texture::Level& next = texture->levels[mip + 1];
+			float nextColor[4];
+			SampleLevel(next, u * next.width, v * next.height, nextColor);
+			for (UINT c = 0; c < 4; c++)
+				color[c] += weight * (nextColor[c] - color[c]);
+		}
+	}
+
+	static UINT ToUnorm8(float value) {
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return static_cast<UINT>(value * 255.0f + 0.5f);
+	}
+
+	Rasterizer::Rasterizer() :
+		m_width(0),
+		m_height(0),
+		m_tilesX(0),
+		m_tilesY(0),
+		m_image{},
+		m_texture(nullptr),
+		m_unitCount(0),
+		m_stats{}
+	{
+	}
+
+	void Rasterizer::Create(UINT width, UINT height) {
+		if (width == 0 || height == 0 || width > c_maxSize || height > c_maxSize)
+			throw std::runtime_error("SoftwareRasterizer: unsupported target size");
+		m_width = width;
+		m_height = height;
+		m_tilesX = (width + c_tileSize - 1) / c_tileSize;
+		m_tilesY = (height + c_tileSize - 1) / c_tileSize;
+		m_image.width = width;
+		m_image.height = height;
+		m_image.pixels.resize(static_cast<size_t>(width) * height);
+		m_depth.resize(m_image.pixels.size());
+	}
+
+	void Rasterizer::Clear(const float color[4], float depth) {
+		std::fill(m_image.pixels.begin(), m_image.pixels.end(),
+			PackRgba(ToUnorm8(color[0]), ToUnorm8(color[1]), ToUnorm8(color[2]), ToUnorm8(color[3])));
+		std::fill(m_depth.begin(), m_depth.end(), depth);
+	}
+
+	void Rasterizer::SetTexture(const Texture* texture) {
+		m_texture = texture;
+	}
+
+	void Rasterizer::DrawIndexedInstanced(const Draw& draw) {
+		if (draw.indexCount < 3 || draw.instanceCount == 0)
+			return;
+		m_draws.push_back(QueuedDraw{ draw, m_texture, m_unitCount });
+		m_unitCount += draw.instanceCount;
+	}
+
+	void Rasterizer::Execute(JobSystem& jobs) {
+		m_stats = {};
+		// Chunks depend on the units only, so the order triangles reach a tile does not depend on the threads.
+		size_t chunkCount = m_unitCount < c_maxChunks ? m_unitCount : c_maxChunks;
+		if (m_chunks.size() < chunkCount)
+			m_chunks.resize(chunkCount);
+		size_t units = m_unitCount;
+		jobs.ParallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; c++)
+				runChunk(m_chunks[c], c * units / chunkCount, (c + 1) * units / chunkCount);
+		});
+
+		UINT tiles = m_tilesX * m_tilesY;
+		m_tileStats.assign(tiles, Stats{});
+		if (chunkCount > 0) {
+			jobs.ParallelFor(tiles, 1, [&](size_t first, size_t last) {
+				// Triangle each pixel of the tile shows, nullptr where the target keeps its clear color.
+				const Triangle* visible[c_tileSize * c_tileSize];
+				for (size_t tile = first; tile < last; tile++) {
+					std::fill(std::begin(visible), std::end(visible), nullptr);
+					for (size_t c = 0; c < chunkCount; c++) {
+						const Chunk& chunk = m_chunks[c];
+						for (UINT i = chunk.tileStarts[tile]; i < chunk.tileStarts[tile + 1]; i++)
+							rasterize(chunk.triangles[chunk.sorted[i]], static_cast<UINT>(tile), visible, m_tileStats[tile]);
+					}
+					shadeTile(static_cast<UINT>(tile), visible, m_tileStats[tile]);
+				}
+			});
+		}
+
+		for (size_t c = 0; c < chunkCount; c++) {
+			const Stats& stats = m_chunks[c].stats;
+			m_stats.triangles += stats.triangles;
+			m_stats.culled += stats.culled;
+			m_stats.clipped += stats.clipped;
+			m_stats.binned += stats.binned;
+		}
+		for (const Stats& stats : m_tileStats) {
+			m_stats.pixelsCovered += stats.pixelsCovered;
+			m_stats.pixelsWritten += stats.pixelsWritten;
+			m_stats.pixelsShaded += stats.pixelsShaded;
+		}
+		m_draws.clear();
+		m_unitCount = 0;
+	}
+
+	void Rasterizer::runChunk(Chunk& chunk, size_t firstUnit, size_t lastUnit) {
+		chunk.triangles.clear();
+		chunk.entries.clear();
+		chunk.stats = {};
+		std::fill(chunk.shadedUnit.begin(), chunk.shadedUnit.end(), 0);
+
+		for (size_t unit = firstUnit; unit < lastUnit; unit++) {
+			// The draw whose instances hold the unit.
+			auto next = std::upper_bound(m_draws.begin(), m_draws.end(), unit,
+				[](size_t u, const QueuedDraw& queued) { return u < queued.firstUnit; });
+			const QueuedDraw& queued = *(next - 1);
+			const Draw& draw = queued.draw;
+			const FrameUpdate::Instance& instance = draw.instances[unit - queued.firstUnit];
+			const Geometry& geometry = *draw.geometry;
+			size_t vertexCount = geometry.vertices.size();
+			if (chunk.shadedUnit.size() < vertexCount) {
+				chunk.shadedUnit.resize(vertexCount, 0);
+				chunk.shaded.resize(vertexCount * c_vertexFloats);
+			}
+			UINT stamp = static_cast<UINT>(unit + 1);
+
+			UINT triangleCount = draw.indexCount / 3;
+			chunk.stats.triangles += triangleCount;
+			for (UINT t = 0; t < triangleCount; t++) {
+				const float* corners[3];
+				bool valid = true;
+				for (UINT k = 0; k < 3; k++) {
+					size_t index = static_cast<size_t>(draw.firstIndex) + 3 * t + k;
+					INT64 vertex = index < geometry.indices.size() ? static_cast<INT64>(geometry.indices[index]) + draw.baseVertex : -1;
+					if (vertex < 0 || static_cast<size_t>(vertex) >= vertexCount) {
+						valid = false;
+						break;
+					}
+					float* shaded = &chunk.shaded[static_cast<size_t>(vertex) * c_vertexFloats];
+					if (chunk.shadedUnit[static_cast<size_t>(vertex)] != stamp) {
+						// vertex.hlsl: the instance matrices are stored for HLSL's column major layout, so
+						// mul(float4(pos, 1), transform) takes the dot products of their rows.
+						const Vertex& v = geometry.vertices[static_cast<size_t>(vertex)];
+						const XMFLOAT4X4& m = instance.transform;
+						const XMFLOAT4X4& n = instance.normalTransform;
+						for (UINT j = 0; j < 4; j++)
+							shaded[j] = m.m[j][0] * v.pos.x + m.m[j][1] * v.pos.y + m.m[j][2] * v.pos.z + m.m[j][3];
+						float normal[3];
+						for (UINT j = 0; j < 3; j++)
+							normal[j] = n.m[j][0] * v.normal.x + n.m[j][1] * v.normal.y + n.m[j][2] * v.normal.z;
+						shaded[4] = v.uvcoords.x;
+						shaded[5] = v.uvcoords.y;
+						shaded[6] = v.col.x;
+						shaded[7] = v.col.y;
+						shaded[8] = v.col.z;
+						shaded[9] = v.col.w;
+						// pixel.hlsl lights with dot(ldir, normal): linear in the normal, so it is interpolated instead.
+						shaded[10] = normal[0] + normal[1] - 1.5f * normal[2];
+						chunk.shadedUnit[static_cast<size_t>(vertex)] = stamp;
+					}
+					corners[k] = shaded;
+				}
+				if (!valid || !setup(chunk, corners, queued.texture))
+					chunk.stats.culled++;
+			}
+		}
+
+		// Counting sort of the entries by tile; it is stable, so every bin keeps the order of submission.
+		UINT tiles = m_tilesX * m_tilesY;
+		chunk.tileStarts.assign(tiles + 1, 0);
+		for (const std::pair<UINT, UINT>& entry : chunk.entries)
+			chunk.tileStarts[entry.first + 1]++;
+		for (UINT tile = 1; tile <= tiles; tile++)
+			chunk.tileStarts[tile] += chunk.tileStarts[tile - 1];
+		chunk.sorted.resize(chunk.entries.size());
+		for (const std::pair<UINT, UINT>& entry : chunk.entries)
+			chunk.sorted[chunk.tileStarts[entry.first]++] = entry.second;
+		for (UINT tile = tiles; tile > 0; tile--)
+			chunk.tileStarts[tile] = chunk.tileStarts[tile - 1];
+		chunk.tileStarts[0] = 0;
+		chunk.stats.binned = chunk.entries.size();
+	}
+
+	bool Rasterizer::setup(Chunk& chunk, const float* const vertices[3], const Texture* texture) {
+		// Clip planes as distances, inside when not negative: near (z >= 0), then the guard band in x and y.
+		float guardX = 1.0f + 2.0f * c_guardBand / m_width;
+		float guardY = 1.0f + 2.0f * c_guardBand / m_height;
+		auto distance = [&](const float* v, UINT plane) {
+			switch (plane) {
+			case 0: return v[2];
+			case 1: return guardX * v[3] - v[0];
+			case 2: return guardX * v[3] + v[0];
+			case 3: return guardY * v[3] - v[1];
+			default: return guardY * v[3] + v[1];
+			}
+		};
+
+		// Outside the view volume on one side: nothing to draw.
+		for (UINT axis = 0; axis < 3; axis++) {
+			bool allAbove = true;
+			bool allBelow = true;
+			for (UINT k = 0; k < 3; k++) {
+				const float* v = vertices[k];
+				allAbove = allAbove && v[axis] > v[3];
+				allBelow = allBelow && (axis == 2 ? v[2] < 0.0f : v[axis] < -v[3]);
+			}
+			if (allAbove || allBelow)
+				return false;
+		}
+
+		UINT outside = 0; // Planes some vertex is outside of
+		for (UINT plane = 0; plane < 5; plane++)
+			for (UINT k = 0; k < 3; k++)
+				if (distance(vertices[k], plane) < 0.0f)
+					outside |= 1u << plane;
+		if (outside == 0)
+			return emit(chunk, vertices[0], vertices[1], vertices[2], texture);
+
+		// Sutherland-Hodgman: every plane adds at most a vertex to the polygon.
+		chunk.stats.clipped++;
+		const UINT c_maxPolygon = 3 + 5;
+		float storage[2 * c_maxPolygon][c_vertexFloats];
+		const float* polygon[c_maxPolygon];
+		const float* clipped[c_maxPolygon];
+		UINT count = 3;
+		for (UINT k = 0; k < 3; k++)
+			polygon[k] = vertices[k];
+		UINT used = 0; // Rows of storage taken by new vertices
+		for (UINT plane = 0; plane < 5 && count >= 3; plane++) {
+			if ((outside & (1u << plane)) == 0)
+				continue;
+			UINT clippedCount = 0;
+			for (UINT k = 0; k < count; k++) {
+				const float* a = polygon[k];
+				const float* b = polygon[(k + 1) % count];
+				float da = distance(a, plane);
+				float db = distance(b, plane);
+				if (da >= 0.0f)
+					clipped[clippedCount++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f)) {
+					float t = da / (da - db);
+					float* v = storage[used++];
+					for (size_t f = 0; f < c_vertexFloats; f++)
+						v[f] = a[f] + t * (b[f] - a[f]);
+					clipped[clippedCount++] = v;
+				}
+			}
+			count = clippedCount;
+			std::copy(clipped, clipped + count, polygon);
+		}
+
+		bool binned = false;
+		for (UINT k = 2; k < count; k++)
+			binned = emit(chunk, polygon[0], polygon[k - 1], polygon[k], texture) || binned;
+		return binned;
+	}
+
+	bool Rasterizer::emit(Chunk& chunk, const float* a, const float* b, const float* c, const Texture* texture) {
+		const float* vertices[3] = { a, b, c };
+		Triangle triangle;
+		const float subpixels = static_cast<float>(1 << c_subpixelBits);
+		for (UINT k = 0; k < 3; k++) {
+			const float* v = vertices[k];
+			// Viewport transform of the whole target, y down, depth from 0 to 1.
+			float invW = 1.0f / v[3];
+			float x = (0.5f + 0.5f * v[0] * invW) * m_width;
+			float y = (0.5f - 0.5f * v[1] * invW) * m_height;
+			triangle.x[k] = static_cast<INT>(std::floor(x * subpixels + 0.5f));
+			triangle.y[k] = static_cast<INT>(std::floor(y * subpixels + 0.5f));
+			triangle.z[k] = v[2] * invW;
+			triangle.invW[k] = invW;
+			for (size_t f = 0; f < c_attributeCount; f++)
+				triangle.attributes[k][f] = v[4 + f] * invW;
+		}
+
+		// Clockwise on screen is front facing (FrontCounterClockwise is FALSE) and the back faces are culled.
+		triangle.area = static_cast<INT64>(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+			static_cast<INT64>(triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		if (triangle.area <= 0)
+			return false;
+
+		// Pixels whose center is inside the bounding box.
+		const INT half = 1 << (c_subpixelBits - 1);
+		INT minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+		INT maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+		INT minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+		INT maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+		triangle.minX = std::max(0, (minX - half + (1 << c_subpixelBits) - 1) >> c_subpixelBits);
+		triangle.maxX = std::min(static_cast<INT>(m_width) - 1, (maxX - half) >> c_subpixelBits);
+		triangle.minY = std::max(0, (minY - half + (1 << c_subpixelBits) - 1) >> c_subpixelBits);
+		triangle.maxY = std::min(static_cast<INT>(m_height) - 1, (maxY - half) >> c_subpixelBits);
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			return false;
+		triangle.texture = texture;
+
+		UINT index = static_cast<UINT>(chunk.triangles.size());
+		chunk.triangles.push_back(triangle);
+		for (UINT ty = static_cast<UINT>(triangle.minY) / c_tileSize; ty <= static_cast<UINT>(triangle.maxY) / c_tileSize; ty++)
+			for (UINT tx = static_cast<UINT>(triangle.minX) / c_tileSize; tx <= static_cast<UINT>(triangle.maxX) / c_tileSize; tx++)
+				chunk.entries.push_back(std::make_pair(ty * m_tilesX + tx, index));
+		return true;
+	}
+
+	INT64 Rasterizer::edgeAt(const Triangle& triangle, UINT k, INT x, INT y, INT64& stepX, INT64& stepY) {
+		const INT subpixels = 1 << c_subpixelBits;
+		UINT next = k == 2 ? 0 : k + 1;
+		INT dx = triangle.x[next] - triangle.x[k];
+		INT dy = triangle.y[next] - triangle.y[k];
+		stepX = -static_cast<INT64>(dy) * subpixels;
+		stepY = static_cast<INT64>(dx) * subpixels;
+		return static_cast<INT64>(y * subpixels + subpixels / 2 - triangle.y[k]) * dx -
+			static_cast<INT64>(x * subpixels + subpixels / 2 - triangle.x[k]) * dy;
+	}
+
+	void Rasterizer::setupPlanes(const Triangle& triangle, INT x, INT y, Planes& planes) {
+		float invArea = 1.0f / static_cast<float>(triangle.area);
+		float baryStart[3];
+		float baryStepX[3];
+		float baryStepY[3];
+		for (UINT k = 0; k < 3; k++) {
+			INT64 stepX;
+			INT64 stepY;
+			INT64 value = edgeAt(triangle, k, x, y, stepX, stepY);
+			UINT opposite = k == 0 ? 2 : k - 1;
+			baryStart[opposite] = static_cast<float>(value) * invArea;
+			baryStepX[opposite] = static_cast<float>(stepX) * invArea;
+			baryStepY[opposite] = static_cast<float>(stepY) * invArea;
+		}
+		for (size_t p = 0; p < c_planeCount; p++) {
+			float values[3];
+			for (UINT k = 0; k < 3; k++)
+				values[k] = p == 0 ? triangle.z[k] : p == 1 ? triangle.invW[k] : triangle.attributes[k][p - 2];
+			planes.start[p] = baryStart[0] * values[0] + baryStart[1] * values[1] + baryStart[2] * values[2];
+			planes.stepX[p] = baryStepX[0] * values[0] + baryStepX[1] * values[1] + baryStepX[2] * values[2];
+			planes.stepY[p] = baryStepY[0] * values[0] + baryStepY[1] * values[1] + baryStepY[2] * values[2];
+		}
+	}
+
+	static const INT c_laneX[4] = { 0, 1, 0, 1 };
+	static const INT c_laneY[4] = { 0, 0, 1, 1 };
+
+	void Rasterizer::rasterize(const Triangle& triangle, UINT tile, const Triangle** visible, Stats& stats) {
+		// Pixels of the tile in the bounding box, from an even pixel: quads are 2x2 pixels, lanes 0 and 1 on the
+		// first row, 2 and 3 on the second.
+		INT tileX = static_cast<INT>((tile % m_tilesX) * c_tileSize);
+		INT tileY = static_cast<INT>((tile / m_tilesX) * c_tileSize);
+		INT x0 = std::max(triangle.minX, tileX) & ~1;
+		INT y0 = std::max(triangle.minY, tileY) & ~1;
+		INT x1 = std::min(triangle.maxX, tileX + static_cast<INT>(c_tileSize) - 1);
+		INT y1 = std::min(triangle.maxY, tileY + static_cast<INT>(c_tileSize) - 1);
+		if (x0 > x1 || y0 > y1)
+			return;
+		INT lastX = x0 + ((x1 - x0) | 1); // Last pixel of the last quads
+		INT lastY = y0 + ((y1 - y0) | 1);
+
+		// Edge values at pixel centers are integers; edges that are not top or left are moved by one so pixels
+		// exactly on them are left out. Edges positive over the whole region are not tested; the others fit in
+		// 32 bits over a tile.
+		INT edgeStart[3];
+		INT edgeStepX[3];
+		INT edgeStepY[3];
+		for (UINT k = 0; k < 3; k++) {
+			UINT next = k == 2 ? 0 : k + 1;
+			INT dx = triangle.x[next] - triangle.x[k];
+			INT dy = triangle.y[next] - triangle.y[k];
+			bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+			INT64 stepX;
+			INT64 stepY;
+			INT64 value = edgeAt(triangle, k, x0, y0, stepX, stepY) - (topLeft ? 0 : 1);
+			INT64 low = value + std::min<INT64>(0, stepX * (lastX - x0)) + std::min<INT64>(0, stepY * (lastY - y0));
+			INT64 high = value + std::max<INT64>(0, stepX * (lastX - x0)) + std::max<INT64>(0, stepY * (lastY - y0));
+			if (high < 0)
+				return;
+			if (low >= 0) {
+				edgeStart[k] = 0;
+				edgeStepX[k] = 0;
+				edgeStepY[k] = 0;
+			}
+			else {
+				edgeStart[k] = static_cast<INT>(value);
+				edgeStepX[k] = static_cast<INT>(stepX);
+				edgeStepY[k] = static_cast<INT>(stepY);
+			}
+		}
+
+		// Depth is affine on screen.
+		float invArea = 1.0f / static_cast<float>(triangle.area);
+		float depthStart = 0.0f;
+		float depthStepX = 0.0f;
+		float depthStepY = 0.0f;
+		for (UINT k = 0; k < 3; k++) {
+			INT64 stepX;
+			INT64 stepY;
+			INT64 value = edgeAt(triangle, k, x0, y0, stepX, stepY);
+			float z = triangle.z[k == 0 ? 2 : k - 1] * invArea;
+			depthStart += static_cast<float>(value) * z;
+			depthStepX += static_cast<float>(stepX) * z;
+			depthStepY += static_cast<float>(stepY) * z;
+		}
+
+#ifdef SOFTWARE_RASTERIZER_SSE2
+		const __m128 laneX = _mm_setr_ps(0.0f, 1.0f, 0.0f, 1.0f);
+		const __m128 laneY = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+		const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+		const __m128 depthStartV = _mm_set1_ps(depthStart);
+		const __m128 depthStepXV = _mm_set1_ps(depthStepX);
+		const __m128 depthStepYV = _mm_set1_ps(depthStepY);
+#endif
+		for (INT qy = y0; qy <= y1; qy += 2) {
+			INT rowEdge[3];
+			for (UINT k = 0; k < 3; k++)
+				rowEdge[k] = edgeStart[k] + (qy - y0) * edgeStepY[k];
+#ifdef SOFTWARE_RASTERIZER_SSE2
+			__m128i edges[3];
+			__m128i quadStep[3];
+			for (UINT k = 0; k < 3; k++) {
+				edges[k] = _mm_setr_epi32(rowEdge[k], rowEdge[k] + edgeStepX[k], rowEdge[k] + edgeStepY[k],
+					rowEdge[k] + edgeStepX[k] + edgeStepY[k]);
+				quadStep[k] = _mm_set1_epi32(2 * edgeStepX[k]);
+			}
+#else
+			INT edges[3][4];
+			for (UINT k = 0; k < 3; k++)
+				for (UINT lane = 0; lane < 4; lane++)
+					edges[k][lane] = rowEdge[k] + c_laneX[lane] * edgeStepX[k] + c_laneY[lane] * edgeStepY[k];
+#endif
+			for (INT qx = x0; qx <= x1; qx += 2) {
+				// A lane is covered when no edge is negative: the sign bits of the three edges or-ed together.
+#ifdef SOFTWARE_RASTERIZER_SSE2
+				__m128i any = _mm_or_si128(_mm_or_si128(edges[0], edges[1]), edges[2]);
+				UINT mask = ~static_cast<UINT>(_mm_movemask_ps(_mm_castsi128_ps(any))) & 0xF;
+				for (UINT k = 0; k < 3; k++)
+					edges[k] = _mm_add_epi32(edges[k], quadStep[k]);
+#else
+				UINT mask = 0;
+				for (UINT lane = 0; lane < 4; lane++) {
+					if ((edges[0][lane] | edges[1][lane] | edges[2][lane]) >= 0)
+						mask |= 1u << lane;
+					for (UINT k = 0; k < 3; k++)
+						edges[k][lane] += 2 * edgeStepX[k];
+				}
+#endif
+				if (qx + 1 >= static_cast<INT>(m_width))
+					mask &= 0x5;
+				if (qy + 1 >= static_cast<INT>(m_height))
+					mask &= 0x3;
+				if (mask == 0)
+					continue;
+
+				stats.pixelsCovered += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + (mask >> 3);
+
+				// Depth clip to the viewport range, then the LESS test. Both paths compute the same depths.
+				UINT pass = 0;
+#ifdef SOFTWARE_RASTERIZER_SSE2
+				if (qx + 1 < static_cast<INT>(m_width) && qy + 1 < static_cast<INT>(m_height)) {
+					float* row = &m_depth[static_cast<size_t>(qy) * m_width + qx];
+					__m128 stored = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(row)),
+						reinterpret_cast<const __m64*>(row + m_width));
+					__m128 fx = _mm_add_ps(_mm_set1_ps(static_cast<float>(qx - x0)), laneX);
+					__m128 fy = _mm_add_ps(_mm_set1_ps(static_cast<float>(qy - y0)), laneY);
+					__m128 depth = _mm_add_ps(_mm_add_ps(depthStartV, _mm_mul_ps(fx, depthStepXV)), _mm_mul_ps(fy, depthStepYV));
+					__m128 passes = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(depth, _mm_setzero_ps()), _mm_cmple_ps(depth, _mm_set1_ps(1.0f))),
+						_mm_cmplt_ps(depth, stored));
+					pass = static_cast<UINT>(_mm_movemask_ps(passes)) & mask;
+					if (pass != 0) {
+						__m128 select = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(_mm_set1_epi32(static_cast<int>(pass)), laneBits), _mm_setzero_si128()));
+						__m128 result = _mm_or_ps(_mm_and_ps(select, depth), _mm_andnot_ps(select, stored));
+						_mm_storel_pi(reinterpret_cast<__m64*>(row), result);
+						_mm_storeh_pi(reinterpret_cast<__m64*>(row + m_width), result);
+					}
+				}
+				else
+#endif
+				{
+					for (UINT lane = 0; lane < 4; lane++) {
+						if ((mask & (1u << lane)) == 0)
+							continue;
+						INT x = qx + c_laneX[lane];
+						INT y = qy + c_laneY[lane];
+						float depth = depthStart + static_cast<float>(x - x0) * depthStepX + static_cast<float>(y - y0) * depthStepY;
+						float& stored = m_depth[static_cast<size_t>(y) * m_width + x];
+						if (depth >= 0.0f && depth <= 1.0f && depth < stored) {
+							stored = depth;
+							pass |= 1u << lane;
+						}
+					}
+				}
+				for (UINT lane = 0; lane < 4; lane++) {
+					if ((pass & (1u << lane)) != 0) {
+						visible[(qy + c_laneY[lane] - tileY) * c_tileSize + (qx + c_laneX[lane] - tileX)] = &triangle;
+						stats.pixelsWritten++;
+					}
+				}
+			}
+		}
+	}
+
+	void Rasterizer::shadeTile(UINT tile, const Triangle* const* visible, Stats& stats) {
+		INT tileX = static_cast<INT>((tile % m_tilesX) * c_tileSize);
+		INT tileY = static_cast<INT>((tile / m_tilesX) * c_tileSize);
+		INT tileWidth = std::min(static_cast<INT>(c_tileSize), static_cast<INT>(m_width) - tileX);
+		INT tileHeight = std::min(static_cast<INT>(c_tileSize), static_cast<INT>(m_height) - tileY);
+		// Planes of the last triangle shaded, from the tile's first pixel; most quads belong to it.
+		const Triangle* planesOf = nullptr;
+		Planes planes;
+
+		for (INT qy = 0; qy < tileHeight; qy += 2) {
+			for (INT qx = 0; qx < tileWidth; qx += 2) {
+				const Triangle* lanes[4];
+				for (UINT lane = 0; lane < 4; lane++) {
+					INT x = qx + c_laneX[lane];
+					INT y = qy + c_laneY[lane];
+					lanes[lane] = x < tileWidth && y < tileHeight ? visible[y * c_tileSize + x] : nullptr;
+				}
+				// Each triangle of the quad is shaded over the whole quad, the pixels it does not own as helpers.
+				UINT done = 0;
+				for (UINT first = 0; first < 4; first++) {
+					const Triangle* triangle = lanes[first];
+					if (triangle == nullptr || (done & (1u << first)) != 0)
+						continue;
+					if (triangle != planesOf) {
+						setupPlanes(*triangle, tileX, tileY, planes);
+						planesOf = triangle;
+					}
+
+					// Perspective correct attributes.
+					float attributes[4][c_attributeCount];
+					for (UINT lane = 0; lane < 4; lane++) {
+						float fx = static_cast<float>(qx + c_laneX[lane]);
+						float fy = static_cast<float>(qy + c_laneY[lane]);
+						float oneOverW = 1.0f / (planes.start[1] + fx * planes.stepX[1] + fy * planes.stepY[1]);
+						for (size_t f = 0; f < c_attributeCount; f++)
+							attributes[lane][f] = (planes.start[2 + f] + fx * planes.stepX[2 + f] + fy * planes.stepY[2 + f]) * oneOverW;
+					}
+					// Mip level from the coarse derivatives of the quad, as ddx and ddy of the uvs in texels.
+					const Texture* texture = triangle->texture;
+					bool textured = texture != nullptr && !texture->levels.empty();
+					float textureWidth = textured ? static_cast<float>(texture->levels[0].width) : 1.0f;
+					float textureHeight = textured ? static_cast<float>(texture->levels[0].height) : 1.0f;
+					float dxU = (attributes[1][0] - attributes[0][0]) * textureWidth;
+					float dxV = (attributes[1][1] - attributes[0][1]) * textureHeight;
+					float dyU = (attributes[2][0] - attributes[0][0]) * textureWidth;
+					float dyV = (attributes[2][1] - attributes[0][1]) * textureHeight;
+					float rho2 = std::max(dxU * dxU + dxV * dxV, dyU * dyU + dyV * dyV);
+					float lod = rho2 > 0.0f ? 0.5f * std::log2(rho2) : 0.0f;
+
+					for (UINT lane = first; lane < 4; lane++) {
+						if (lanes[lane] != triangle)
+							continue;
+						done |= 1u << lane;
+						const float* a = attributes[lane];
+						// pixel.hlsl with la = ld = 1: color1 + float4(cl * color1.rgb, color1.a).
+						float color[4];
+						Sample(texture, a[0], a[1], lod, color);
+						for (UINT c = 0; c < 4; c++)
+							color[c] *= a[2 + c];
+						float cl = std::max(a[6], 0.0f);
+						UINT r = ToUnorm8(color[0] + cl * color[0]);
+						UINT g = ToUnorm8(color[1] + cl * color[1]);
+						UINT b = ToUnorm8(color[2] + cl * color[2]);
+						UINT alpha = ToUnorm8(color[3] + color[3]);
+						size_t pixel = static_cast<size_t>(tileY + qy + c_laneY[lane]) * m_width + (tileX + qx + c_laneX[lane]);
+						m_image.pixels[pixel] = PackRgba(r, g, b, alpha);
+						stats.pixelsShaded++;
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+#include "VertexPacking.h"
+#include "FrameUpdate.h"
+#include "JobSystem.h"
+
+// CPU reference of the scene pipeline, for frames without a GPU: the draws Render records, run through the math of
+// vertex.hlsl / vertexpacked.hlsl and pixel.hlsl with the pipeline state Game sets (back face culling of clockwise
+// front faces, LESS depth test on a 32-bit float depth buffer, no blending, trilinear wrap sampling of t0).
+// Output is deterministic: the same draws give the same image bit for bit on any number of threads, so a frame can
+// be kept as a golden image (WritePPM, Compare). It is a reference, not a copy of a GPU: rasterization follows the
+// D3D rules (pixel centers, top-left fill rule, near plane clipping) on 4 bits of subpixel precision instead of 8,
+// so edges and texture filtering can differ from a GPU in the last bits.
+// Execute runs in two passes over a JobSystem. The instances of the draws are split in chunks, each chunk shades
+// their vertices, clips and sets up their triangles and bins them to the 64x64 pixel tiles they touch; then every
+// tile rasterizes its triangles in submission order, chunk after chunk, and shades the pixels left visible. The pixel
+// shader has no side effects and blending is off, so shading once per pixel gives the image shading every depth
+// test pass would. Edge functions are evaluated on 2x2 pixel quads, one pixel per SSE2 lane (4 scalar lanes without
+// SSE2), and quads give the uv derivatives for mip selection.
+
+namespace SoftwareRasterizer {
+
+	// RGBA8 texels, red in the low byte, as the images below.
+	struct Texture {
+		struct Level {
+			UINT width;
+			UINT height;
+			std::vector<UINT> texels;
+		};
+		std::vector<Level> levels; // Mip 0 first
+	};
+
+	// Every mip of a BC1 (DXT1) or uncompressed 32-bit DDS file. Throws std::runtime_error for other formats.
+	Texture LoadDDS(const std::string& fileName);
+
+	struct Image {
+		UINT width;
+		UINT height;
+		std::vector<UINT> pixels; // RGBA8, red in the low byte, rows top to bottom
+	};
+
+	// Binary PPM (P6): RGB, alpha is dropped.
+	bool WritePPM(const std::string& fileName, const Image& image);
+	bool ReadPPM(const std::string& fileName, Image& image);
+
+	// Pixels whose RGB differ, and the largest difference of a channel. Images of different sizes differ everywhere.
+	struct ImageDifference {
+		size_t pixels;
+		UINT largest;
+	};
+	ImageDifference Compare(const Image& first, const Image& second);
+
+	// A vertex buffer as the input assembler reads it and the 32-bit indices of a shape.
+	struct Geometry {
+		std::vector<Vertex> vertices;
+		std::vector<UINT> indices;
+	};
+	// indexStride: 2 or 4 bytes, as in Mesh::CopyIndices.
+	Geometry MakeGeometry(const Vertex* vertices, UINT vertexCount, const void* indices, UINT indexCount, UINT indexStride);
+	// Packed positions are left in [0,1] (their UNORM value); the instance transforms hold the dequantization.
+	Geometry MakeGeometry(const PackedVertex* vertices, UINT vertexCount, const void* indices, UINT indexCount, UINT indexStride);
+
+	// A DrawIndexedInstanced with the instances it reads: gInstanceData from gInstanceBase on.
+	// The geometry and the instances have to stay valid until Execute returns.
+	struct Draw {
+		const Geometry* geometry;
+		UINT indexCount;
+		UINT firstIndex;
+		INT baseVertex;
+		const FrameUpdate::Instance* instances;
+		UINT instanceCount;
+	};
+
+	// Counters of the last Execute.
+	struct Stats {
+		size_t triangles;      // Every triangle of every instance
+		size_t culled;         // Back facing, degenerate, outside the frustum or between pixel centers
+		size_t clipped;        // Crossing the near plane or the guard band
+		size_t binned;         // Triangle and tile pairs
+		size_t pixelsCovered;
+		size_t pixelsWritten;  // Covered and passing the depth test
+		size_t pixelsShaded;   // Visible at the end: every pixel is shaded once
+	};
+
+	class Rasterizer
+	{
+	public:
+		static const UINT c_tileSize = 64; // Pixels, even: quads never straddle tiles
+
+		Rasterizer();
+
+		// Size of the render target, up to 4096 pixels a side; the contents are undefined until Clear.
+		void Create(UINT width, UINT height);
+		void Clear(const float color[4], float depth);
+
+		// The texture of the draws that follow (the texture table holds t0 only); nullptr samples white.
+		void SetTexture(const Texture* texture);
+		// Queued until Execute.
+		void DrawIndexedInstanced(const Draw& draw);
+		// Runs the queued draws and empties the queue.
+		void Execute(JobSystem& jobs);
+
+		const Image& GetImage() const { return m_image; }
+		const Stats& GetStats() const { return m_stats; }
+
+	private:
+		// Clip space positions are clipped to the guard band: screen coordinates stay within c_guardBand pixels
+		// of the target, so edge functions fit in 64 bits and in 32 bits within a tile.
+		static const int c_subpixelBits = 4;
+		static const int c_guardBand = 4096;
+		static const UINT c_maxSize = 4096;
+		static const size_t c_maxChunks = 256;
+		static const size_t c_attributeCount = 7;
+		static const size_t c_vertexFloats = 4 + c_attributeCount;
+
+		struct QueuedDraw {
+			Draw draw;
+			const Texture* texture;
+			size_t firstUnit; // Units are the instances of all the draws, in order
+		};
+
+		// A triangle ready to rasterize. Attributes are divided by w for perspective correct interpolation.
+		struct Triangle {
+			INT x[3]; // Subpixels
+			INT y[3];
+			INT minX, minY, maxX, maxY; // Pixels, inside the target
+			INT64 area; // Twice the area, in subpixels squared, positive
+			float z[3];
+			float invW[3];
+			float attributes[3][c_attributeCount]; // u, v, r, g, b, a, light (dot of the light direction and the normal)
+			const Texture* texture;
+		};
+
+		// Output of a range of units, tiles in order: bin i is sorted[tileStarts[i], tileStarts[i + 1]).
+		struct Chunk {
+			std::vector<Triangle> triangles;
+			std::vector<std::pair<UINT, UINT>> entries; // Tile, triangle
+			std::vector<UINT> tileStarts;
+			std::vector<UINT> sorted;
+			std::vector<float> shaded; // Vertices of the instance being drawn: clip space position, then attributes
+			std::vector<UINT> shadedUnit; // Unit + 1 a vertex of shaded was shaded for, 0 for none yet
+			Stats stats;
+		};
+
+		void runChunk(Chunk& chunk, size_t firstUnit, size_t lastUnit);
+		// Clips, sets up and bins a triangle; false when it reaches no tile.
+		bool setup(Chunk& chunk, const float* const vertices[3], const Texture* texture);
+		// A triangle of the clipped polygon: projects, culls and bins it.
+		bool emit(Chunk& chunk, const float* a, const float* b, const float* c, const Texture* texture);
+		// Edge k goes from vertex k to the next one and is positive inside: its value at the center of pixel (x, y)
+		// and the steps to the next pixel, in subpixels squared. It gives the weight of the vertex opposite it.
+		static INT64 edgeAt(const Triangle& triangle, UINT k, INT x, INT y, INT64& stepX, INT64& stepY);
+		// Depth test of a triangle over a tile; visible gets the triangle where it passes.
+		void rasterize(const Triangle& triangle, UINT tile, const Triangle** visible, Stats& stats);
+		void shadeTile(UINT tile, const Triangle* const* visible, Stats& stats);
+
+		// Depth, 1/w and the attributes over w are affine on screen: values at the center of a pixel and steps
+		// to the next one.
+		static const size_t c_planeCount = 2 + c_attributeCount;
+		struct Planes {
+			float start[c_planeCount];
+			float stepX[c_planeCount];
+			float stepY[c_planeCount];
+		};
+		static void setupPlanes(const Triangle& triangle, INT x, INT y, Planes& planes);
+
+		UINT m_width;
+		UINT m_height;
+		UINT m_tilesX;
+		UINT m_tilesY;
+		Image m_image;
+		std::vector<float> m_depth;
+		const Texture* m_texture;
+		std::vector<QueuedDraw> m_draws;
+		size_t m_unitCount;
+		std::vector<Chunk> m_chunks;
+		std::vector<Stats> m_tileStats;
+		Stats m_stats;
+	};
+}
@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "AssetLoader.h"
+#include "FrameCommands.h"
+#include "FrameUpdate.h"
+#include "ReferenceScene.h"
+#include "SoftwareRasterizer.h"
+#include "UploadBackend.h"
+
+// Console check of the software rasterizer (SoftwareRasterizer.h), built by CMakeLists.txt on the core library.
+// software_reference [--write] [referenceFile]
+// Renders the frame of ReferenceScene.h as Game::RenderSoftwareReference does: the draws Render would queue, packed
+// vertices and the first texture of the app. The image is compared with referenceFile
+// (Reference/software_reference.ppm of the source tree by default). Triangle edges may move by a pixel with the
+// rounding of the math library, so up to c_maxDifferingPixels pixels may differ. --write makes the image the new
+// reference; do it when the rasterizer or the scene change on purpose. Exits with 1 when the image differs.
+
+namespace {
+	using namespace ReferenceScene;
+
+	const size_t c_maxDifferingPixels = c_width * c_height / 1000;
+
+	void report(const wchar_t* format, ...) {
+		wchar_t msgbuff[512];
+		va_list args;
+		va_start(args, format);
+		vswprintf(msgbuff, 512, format, args);
+		va_end(args);
+		MYTRACE(msgbuff);
+	}
+
+	std::wstring wide(const std::string& text) {
+		return std::wstring(text.begin(), text.end());
+	}
+
+	SoftwareRasterizer::Image renderFrame(const std::string& textureFileName) {
+		std::vector<std::shared_ptr<Mesh>> meshes = MakeMeshes();
+		InstanceStore store = MakeStore();
+
+		UploadRing ring;
+		ring.Create(std::make_shared<NullUploadBackend>(), 64 * 1024);
+		JobSystem jobs(AssetLoader::DefaultThreadCount() - 1);
+		std::vector<std::vector<InstanceUpdate::LodBucket>> buckets;
+		InstanceUpdate::Scratch scratch;
+		Culling::Stats cullStats = {};
+		ring.BeginFrame(0);
+		UploadRing::Allocation allocation = FrameUpdate::WriteInstances(jobs, meshes, store, MakeFrame(), true, ring, buckets,
+			scratch, cullStats);
+		ring.EndFrame(1);
+		const FrameUpdate::Instance* instances = reinterpret_cast<const FrameUpdate::Instance*>(allocation.cpuAddress);
+		RenderQueue queue;
+		FrameCommands::QueueDraws(meshes, buckets, queue);
+
+		// Every shape gets its own vertices, so draws start at vertex 0.
+		std::vector<SoftwareRasterizer::Geometry> geometries(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const Mesh& mesh = *meshes[i];
+			std::vector<BYTE> indices(static_cast<size_t>(mesh.GetIndexCountAllLods()) * mesh.GetIndexStride());
+			mesh.CopyIndices(indices.data());
+			std::vector<PackedVertex> packed(mesh.GetVertexCount());
+			VertexPacking::Encode(mesh.GetVertexData(), mesh.GetVertexCount(), mesh.GetBoundingBox(), packed.data());
+			geometries[i] = SoftwareRasterizer::MakeGeometry(packed.data(), mesh.GetVertexCount(), indices.data(),
+				mesh.GetIndexCountAllLods(), mesh.GetIndexStride());
+		}
+		SoftwareRasterizer::Texture texture = SoftwareRasterizer::LoadDDS(textureFileName);
+
+		SoftwareRasterizer::Rasterizer rasterizer;
+		rasterizer.Create(c_width, c_height);
+		rasterizer.Clear(Colors::CornflowerBlue, 1.0f);
+		rasterizer.SetTexture(&texture);
+		for (const RenderQueue::Draw& item : queue.GetDraws()) {
+			SoftwareRasterizer::Draw draw = { &geometries[item.mesh], item.indexCount, item.firstIndex, 0,
+				instances + item.firstInstance, item.instanceCount };
+			rasterizer.DrawIndexedInstanced(draw);
+		}
+		rasterizer.Execute(jobs);
+
+		const SoftwareRasterizer::Stats& stats = rasterizer.GetStats();
+		report(L"Frame: %zu visible in %zu draws, %zu triangles, %zu culled, %zu clipped, %zu pixels shaded\n",
+			cullStats.visible, queue.GetDraws().size(), stats.triangles, stats.culled, stats.clipped, stats.pixelsShaded);
+		return rasterizer.GetImage();
+	}
+}
+
+int main(int argc, char* argv[]) {
+	bool write = false;
+	std::string referenceFileName = TUTORIAL_REFERENCE_FOLDER "/software_reference.ppm";
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--write")
+			write = true;
+		else
+			referenceFileName = argument;
+	}
+
+	try {
+		SoftwareRasterizer::Image image = renderFrame(TUTORIAL_ASSET_FOLDER "/tex1.dds");
+
+		if (write) {
+			if (!SoftwareRasterizer::WritePPM(referenceFileName, image)) {
+				report(L"Could not write %ls\n", wide(referenceFileName).c_str());
+				return 1;
+			}
+			report(L"Reference written to %ls\n", wide(referenceFileName).c_str());
+			return 0;
+		}
+
+		SoftwareRasterizer::Image reference;
+		if (!SoftwareRasterizer::ReadPPM(referenceFileName, reference)) {
+			report(L"No reference image in %ls; --write makes one\n", wide(referenceFileName).c_str());
+			return 1;
+		}
+		SoftwareRasterizer::ImageDifference difference = SoftwareRasterizer::Compare(reference, image);
+		bool matches = difference.pixels <= c_maxDifferingPixels;
+		report(L"Image %ls %ls: %zu pixels differ (%zu allowed), by up to %u\n", matches ? L"matches" : L"DIFFERS from",
+			wide(referenceFileName).c_str(), difference.pixels, c_maxDifferingPixels, difference.largest);
+		return matches ? 0 : 1;
+	}
+	catch (const std::exception& exception) {
+		report(L"Software reference stopped: %ls\n", wide(exception.what()).c_str());
+		return 1;
+	}
+}
@@ -0,0 +1,324 @@
+#include "pch.h"
+#include "StateCache.h"
+
+namespace {
+	bool sameViewport(const D3D12_VIEWPORT& a, const D3D12_VIEWPORT& b) {
+		return a.TopLeftX == b.TopLeftX && a.TopLeftY == b.TopLeftY && a.Width == b.Width && a.Height == b.Height &&
+			a.MinDepth == b.MinDepth && a.MaxDepth == b.MaxDepth;
+	}
+
+	bool sameRect(const D3D12_RECT& a, const D3D12_RECT& b) {
+		return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+	}
+
+	bool sameVertexBuffer(const D3D12_VERTEX_BUFFER_VIEW& a, const D3D12_VERTEX_BUFFER_VIEW& b) {
+		return a.BufferLocation == b.BufferLocation && a.SizeInBytes == b.SizeInBytes && a.StrideInBytes == b.StrideInBytes;
+	}
+
+	bool sameIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& a, const D3D12_INDEX_BUFFER_VIEW& b) {
+		return a.BufferLocation == b.BufferLocation && a.SizeInBytes == b.SizeInBytes && a.Format == b.Format;
+	}
+}
+
+void StateCachingCommandEncoder::Counters::Add(const Counters& other) {
+	calls += other.calls;
+	filtered += other.filtered;
+	for (size_t i = 0; i < c_stateCount; i++) {
+		stateCalls[i] += other.stateCalls[i];
+		filteredStateCalls[i] += other.filteredStateCalls[i];
+	}
+}
+
+const wchar_t* StateCachingCommandEncoder::StateName(State state) {
+	switch (state) {
+	case State::PipelineState: return L"PipelineState";
+	case State::RootSignature: return L"RootSignature";
+	case State::DescriptorHeaps: return L"DescriptorHeaps";
+	case State::RootArgument: return L"RootArgument";
+	case State::Topology: return L"Topology";
+	case State::VertexBuffers: return L"VertexBuffers";
+	case State::IndexBuffer: return L"IndexBuffer";
+	case State::Viewports: return L"Viewports";
+	case State::ScissorRects: return L"ScissorRects";
+	case State::RenderTargets: return L"RenderTargets";
+	default: return L"Unknown";
+	}
+}
+
+StateCachingCommandEncoder::StateCachingCommandEncoder(CommandEncoder& next, ID3D12PipelineState* initialState) :
+	m_next(next), m_counters{}
+{
+	Invalidate();
+	m_knownPipelineState = true;
+	m_pipelineState = initialState;
+}
+
+void StateCachingCommandEncoder::Invalidate() {
+	m_knownPipelineState = false;
+	m_graphics.knownSignature = false;
+	forgetArguments(m_graphics);
+	m_compute.knownSignature = false;
+	forgetArguments(m_compute);
+	m_heapCount = UINT_MAX;
+	m_knownTopology = false;
+	m_knownVertexBuffers = 0;
+	m_knownIndexBuffer = false;
+	m_viewportCount = UINT_MAX;
+	m_scissorRectCount = UINT_MAX;
+	m_knownRenderTargets = false;
+}
+
+bool StateCachingCommandEncoder::filter(State state, bool redundant) {
+	size_t index = static_cast<size_t>(state);
+	m_counters.calls++;
+	m_counters.stateCalls[index]++;
+	if (!redundant)
+		return false;
+	m_counters.filtered++;
+	m_counters.filteredStateCalls[index]++;
+	return true;
+}
+
+void StateCachingCommandEncoder::forgetArguments(RootState& root) {
+	for (RootArgument& argument : root.arguments) {
+		argument.kind = ArgumentKind::Unknown;
+		argument.knownConstants = 0;
+	}
+}
+
+bool StateCachingCommandEncoder::setSignature(RootState& root, ID3D12RootSignature* signature) {
+	if (root.knownSignature && root.signature == signature)
+		return true;
+	// Arguments only outlive a root signature that is set again.
+	root.knownSignature = true;
+	root.signature = signature;
+	forgetArguments(root);
+	return false;
+}
+
+bool StateCachingCommandEncoder::setDescriptor(RootState& root, UINT parameter, ArgumentKind kind, UINT64 value) {
+	if (parameter >= c_maxRootParameters)
+		return false;
+	RootArgument& argument = root.arguments[parameter];
+	if (argument.kind == kind && argument.value == value)
+		return true;
+	argument.kind = kind;
+	argument.value = value;
+	argument.knownConstants = 0;
+	return false;
+}
+
+bool StateCachingCommandEncoder::setConstants(RootState& root, UINT parameter, UINT count, const UINT* values, UINT offset) {
+	if (parameter >= c_maxRootParameters)
+		return false;
+	RootArgument& argument = root.arguments[parameter];
+	if (argument.kind != ArgumentKind::Constants) {
+		argument.kind = ArgumentKind::Constants;
+		argument.knownConstants = 0;
+	}
+	if (offset + count > c_maxRootConstants) {
+		argument.knownConstants = 0;
+		return false;
+	}
+	bool redundant = true;
+	for (UINT i = 0; i < count; i++) {
+		UINT bit = 1u << (offset + i);
+		redundant = redundant && (argument.knownConstants & bit) != 0 && argument.constants[offset + i] == values[i];
+		argument.constants[offset + i] = values[i];
+		argument.knownConstants |= bit;
+	}
+	return redundant;
+}
+
+void StateCachingCommandEncoder::ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) {
+	pass();
+	m_next.ResourceBarrier(count, barriers);
+}
+
+void StateCachingCommandEncoder::CopyBufferRegion(ID3D12Resource* destination, UINT64 destinationOffset, ID3D12Resource* source, UINT64 sourceOffset, UINT64 bytes) {
+	pass();
+	m_next.CopyBufferRegion(destination, destinationOffset, source, sourceOffset, bytes);
+}
+
+void StateCachingCommandEncoder::Upload(D3D12_GPU_VIRTUAL_ADDRESS gpuAddress, UINT64 size) {
+	pass();
+	m_next.Upload(gpuAddress, size);
+}
+
+void StateCachingCommandEncoder::SetPipelineState(ID3D12PipelineState* pipelineState) {
+	bool redundant = m_knownPipelineState && m_pipelineState == pipelineState;
+	m_knownPipelineState = true;
+	m_pipelineState = pipelineState;
+	if (!filter(State::PipelineState, redundant))
+		m_next.SetPipelineState(pipelineState);
+}
+
+void StateCachingCommandEncoder::SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) {
+	bool redundant = m_heapCount == count && std::equal(heaps, heaps + count, m_heaps);
+	if (!redundant) {
+		// Tables point into the heaps that were bound when they were set.
+		for (RootState* root : { &m_graphics, &m_compute }) {
+			for (RootArgument& argument : root->arguments) {
+				if (argument.kind == ArgumentKind::Table)
+					argument.kind = ArgumentKind::Unknown;
+			}
+		}
+		m_heapCount = count <= c_maxHeaps ? count : UINT_MAX;
+		if (m_heapCount != UINT_MAX)
+			std::copy(heaps, heaps + count, m_heaps);
+	}
+	if (!filter(State::DescriptorHeaps, redundant))
+		m_next.SetDescriptorHeaps(count, heaps);
+}
+
+void StateCachingCommandEncoder::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) {
+	if (!filter(State::RootSignature, setSignature(m_graphics, rootSignature)))
+		m_next.SetGraphicsRootSignature(rootSignature);
+}
+
+void StateCachingCommandEncoder::SetGraphicsRootDescriptorTable(UINT parameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor) {
+	if (!filter(State::RootArgument, setDescriptor(m_graphics, parameter, ArgumentKind::Table, baseDescriptor.ptr)))
+		m_next.SetGraphicsRootDescriptorTable(parameter, baseDescriptor);
+}
+
+void StateCachingCommandEncoder::SetGraphicsRoot32BitConstant(UINT parameter, UINT value, UINT offset) {
+	if (!filter(State::RootArgument, setConstants(m_graphics, parameter, 1, &value, offset)))
+		m_next.SetGraphicsRoot32BitConstant(parameter, value, offset);
+}
+
+void StateCachingCommandEncoder::SetGraphicsRootConstantBufferView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	if (!filter(State::RootArgument, setDescriptor(m_graphics, parameter, ArgumentKind::ConstantBufferView, address)))
+		m_next.SetGraphicsRootConstantBufferView(parameter, address);
+}
+
+void StateCachingCommandEncoder::SetGraphicsRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	if (!filter(State::RootArgument, setDescriptor(m_graphics, parameter, ArgumentKind::ShaderResourceView, address)))
+		m_next.SetGraphicsRootShaderResourceView(parameter, address);
+}
+
+void StateCachingCommandEncoder::SetComputeRootSignature(ID3D12RootSignature* rootSignature) {
+	if (!filter(State::RootSignature, setSignature(m_compute, rootSignature)))
+		m_next.SetComputeRootSignature(rootSignature);
+}
+
+void StateCachingCommandEncoder::SetComputeRoot32BitConstants(UINT parameter, UINT count, const void* values, UINT offset) {
+	if (!filter(State::RootArgument, setConstants(m_compute, parameter, count, static_cast<const UINT*>(values), offset)))
+		m_next.SetComputeRoot32BitConstants(parameter, count, values, offset);
+}
+
+void StateCachingCommandEncoder::SetComputeRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	if (!filter(State::RootArgument, setDescriptor(m_compute, parameter, ArgumentKind::ShaderResourceView, address)))
+		m_next.SetComputeRootShaderResourceView(parameter, address);
+}
+
+void StateCachingCommandEncoder::SetComputeRootUnorderedAccessView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) {
+	if (!filter(State::RootArgument, setDescriptor(m_compute, parameter, ArgumentKind::UnorderedAccessView, address)))
+		m_next.SetComputeRootUnorderedAccessView(parameter, address);
+}
+
+void StateCachingCommandEncoder::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) {
+	bool redundant = m_knownTopology && m_topology == topology;
+	m_knownTopology = true;
+	m_topology = topology;
+	if (!filter(State::Topology, redundant))
+		m_next.IASetPrimitiveTopology(topology);
+}
+
+void StateCachingCommandEncoder::IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) {
+	bool redundant = views != nullptr && count > 0;
+	for (UINT i = 0; i < count; i++) {
+		UINT slot = startSlot + i;
+		if (slot >= c_maxVertexBuffers) {
+			redundant = false;
+			continue;
+		}
+		if (views == nullptr) {
+			m_knownVertexBuffers &= ~(1u << slot);
+			continue;
+		}
+		redundant = redundant && (m_knownVertexBuffers & (1u << slot)) != 0 && sameVertexBuffer(m_vertexBuffers[slot], views[i]);
+		m_vertexBuffers[slot] = views[i];
+		m_knownVertexBuffers |= 1u << slot;
+	}
+	if (!filter(State::VertexBuffers, redundant))
+		m_next.IASetVertexBuffers(startSlot, count, views);
+}
+
+void StateCachingCommandEncoder::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) {
+	bool redundant = m_knownIndexBuffer && m_hasIndexBuffer == (view != nullptr) &&
+		(view == nullptr || sameIndexBuffer(m_indexBuffer, *view));
+	m_knownIndexBuffer = true;
+	m_hasIndexBuffer = view != nullptr;
+	if (view != nullptr)
+		m_indexBuffer = *view;
+	if (!filter(State::IndexBuffer, redundant))
+		m_next.IASetIndexBuffer(view);
+}
+
+void StateCachingCommandEncoder::RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) {
+	bool redundant = m_viewportCount == count && std::equal(viewports, viewports + count, m_viewports, sameViewport);
+	m_viewportCount = count <= c_maxViewports ? count : UINT_MAX;
+	if (m_viewportCount != UINT_MAX)
+		std::copy(viewports, viewports + count, m_viewports);
+	if (!filter(State::Viewports, redundant))
+		m_next.RSSetViewports(count, viewports);
+}
+
+void StateCachingCommandEncoder::RSSetScissorRects(UINT count, const D3D12_RECT* rects) {
+	bool redundant = m_scissorRectCount == count && std::equal(rects, rects + count, m_scissorRects, sameRect);
+	m_scissorRectCount = count <= c_maxViewports ? count : UINT_MAX;
+	if (m_scissorRectCount != UINT_MAX)
+		std::copy(rects, rects + count, m_scissorRects);
+	if (!filter(State::ScissorRects, redundant))
+		m_next.RSSetScissorRects(count, rects);
+}
+
+void StateCachingCommandEncoder::OMSetRenderTargets(UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL singleHandle,
+	const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil) {
+	// A single handle is the first of count consecutive descriptors.
+	UINT handles = count == 0 ? 0 : singleHandle ? 1 : count;
+	bool redundant = m_knownRenderTargets && m_renderTargetCount == count && (m_singleHandle != 0) == (singleHandle != 0) &&
+		m_hasDepthStencil == (depthStencil != nullptr) && (depthStencil == nullptr || m_depthStencil.ptr == depthStencil->ptr);
+	for (UINT i = 0; redundant && i < handles; i++)
+		redundant = m_renderTargets[i].ptr == renderTargets[i].ptr;
+
+	m_knownRenderTargets = count <= c_maxRenderTargets;
+	m_renderTargetCount = count;
+	m_singleHandle = singleHandle;
+	if (m_knownRenderTargets)
+		std::copy(renderTargets, renderTargets + handles, m_renderTargets);
+	m_hasDepthStencil = depthStencil != nullptr;
+	if (depthStencil != nullptr)
+		m_depthStencil = *depthStencil;
+	if (!filter(State::RenderTargets, redundant))
+		m_next.OMSetRenderTargets(count, renderTargets, singleHandle, depthStencil);
+}
+
+void StateCachingCommandEncoder::ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4]) {
+	pass();
+	m_next.ClearRenderTargetView(renderTarget, color);
+}
+
+void StateCachingCommandEncoder::ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil) {
+	pass();
+	m_next.ClearDepthStencilView(depthStencil, flags, depth, stencil);
+}
+
+void StateCachingCommandEncoder::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT firstIndex, INT baseVertex, UINT firstInstance) {
+	pass();
+	m_next.DrawIndexedInstanced(indexCount, instanceCount, firstIndex, baseVertex, firstInstance);
+}
+
+void StateCachingCommandEncoder::Dispatch(UINT x, UINT y, UINT z) {
+	pass();
+	m_next.Dispatch(x, y, z);
+}
+
+void StateCachingCommandEncoder::ExecuteIndirect(ID3D12CommandSignature* signature, UINT maxCommands, ID3D12Resource* arguments, UINT64 argumentOffset) {
+	pass();
+	m_next.ExecuteIndirect(signature, maxCommands, arguments, argumentOffset);
+	// The command signature may set views and graphics root arguments.
+	m_knownVertexBuffers = 0;
+	m_knownIndexBuffer = false;
+	forgetArguments(m_graphics);
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "pch.h"
+#include "CommandEncoder.h"
+
+// Drops state changes that bind what is already bound. StateCachingCommandEncoder keeps the pipeline state, root
+// signatures, descriptor heaps, root arguments, input assembler views, viewports, scissor rects and render targets
+// set on a command list, and passes on only the calls that change them; every other call goes through.
+// One encoder per command list, from the Reset of the list: lists inherit no state, so an encoder starts knowing
+// only the initial pipeline state. Calls made to the list behind the encoder's back need an Invalidate.
+// What the D3D12 runtime resets on its own is forgotten the same way: root arguments when the root signature
+// changes, descriptor tables when the heaps change, and views and graphics root arguments after ExecuteIndirect,
+// whose command signature may set them.
+
+class StateCachingCommandEncoder : public CommandEncoder
+{
+public:
+	enum class State {
+		PipelineState,
+		RootSignature,
+		DescriptorHeaps,
+		RootArgument,
+		Topology,
+		VertexBuffers,
+		IndexBuffer,
+		Viewports,
+		ScissorRects,
+		RenderTargets,
+		Count
+	};
+	static const size_t c_stateCount = static_cast<size_t>(State::Count);
+
+	// Calls of a list, or of a frame once the lists are added up.
+	struct Counters {
+		UINT calls; // Every call made to the encoder
+		UINT filtered; // Not passed on
+		UINT stateCalls[c_stateCount];
+		UINT filteredStateCalls[c_stateCount];
+
+		void Add(const Counters& other);
+	};
+
+	static const wchar_t* StateName(State state);
+
+	// initialState: the pipeline state the list was reset with, nullptr for none.
+	StateCachingCommandEncoder(CommandEncoder& next, ID3D12PipelineState* initialState);
+
+	// Forgets every state, as after a call made straight to the list.
+	void Invalidate();
+
+	const Counters& GetCounters() const { return m_counters; }
+
+	void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) override;
+	void CopyBufferRegion(ID3D12Resource* destination, UINT64 destinationOffset, ID3D12Resource* source, UINT64 sourceOffset, UINT64 bytes) override;
+	void Upload(D3D12_GPU_VIRTUAL_ADDRESS gpuAddress, UINT64 size) override;
+
+	void SetPipelineState(ID3D12PipelineState* pipelineState) override;
+	void SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) override;
+
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetGraphicsRootDescriptorTable(UINT parameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor) override;
+	void SetGraphicsRoot32BitConstant(UINT parameter, UINT value, UINT offset) override;
+	void SetGraphicsRootConstantBufferView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+	void SetGraphicsRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+
+	void SetComputeRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetComputeRoot32BitConstants(UINT parameter, UINT count, const void* values, UINT offset) override;
+	void SetComputeRootShaderResourceView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+	void SetComputeRootUnorderedAccessView(UINT parameter, D3D12_GPU_VIRTUAL_ADDRESS address) override;
+
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) override;
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) override;
+	void RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) override;
+	void RSSetScissorRects(UINT count, const D3D12_RECT* rects) override;
+	void OMSetRenderTargets(UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargets, BOOL singleHandle,
+		const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencil) override;
+
+	void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, const FLOAT color[4]) override;
+	void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencil, D3D12_CLEAR_FLAGS flags, FLOAT depth, UINT8 stencil) override;
+
+	void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT firstIndex, INT baseVertex, UINT firstInstance) override;
+	void Dispatch(UINT x, UINT y, UINT z) override;
+	void ExecuteIndirect(ID3D12CommandSignature* signature, UINT maxCommands, ID3D12Resource* arguments, UINT64 argumentOffset) override;
+
+private:
+	// Larger settings are passed on untracked.
+	static const UINT c_maxRootParameters = 16;
+	static const UINT c_maxRootConstants = 16; // Per parameter
+	static const UINT c_maxVertexBuffers = 4;
+	static const UINT c_maxViewports = 4;
+	static const UINT c_maxRenderTargets = D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT;
+	static const UINT c_maxHeaps = 2; // One CBV/SRV/UAV heap and one sampler heap
+
+	enum class ArgumentKind : UINT { Unknown, Table, ConstantBufferView, ShaderResourceView, UnorderedAccessView, Constants };
+
+	struct RootArgument {
+		ArgumentKind kind;
+		UINT64 value; // Descriptor handle or GPU address
+		UINT knownConstants; // Bit i: constants[i] is known
+		UINT constants[c_maxRootConstants];
+	};
+
+	// The root signature and arguments of the graphics or the compute pipeline.
+	struct RootState {
+		bool knownSignature;
+		ID3D12RootSignature* signature;
+		RootArgument arguments[c_maxRootParameters];
+	};
+
+	// Counts the call; true when state is already what it sets, and the call is dropped.
+	bool filter(State state, bool redundant);
+	// Calls that are not state changes.
+	void pass() { m_counters.calls++; }
+
+	bool setSignature(RootState& root, ID3D12RootSignature* signature);
+	bool setDescriptor(RootState& root, UINT parameter, ArgumentKind kind, UINT64 value);
+	bool setConstants(RootState& root, UINT parameter, UINT count, const UINT* values, UINT offset);
+	static void forgetArguments(RootState& root);
+
+	CommandEncoder& m_next;
+	Counters m_counters;
+
+	bool m_knownPipelineState;
+	ID3D12PipelineState* m_pipelineState;
+	RootState m_graphics;
+	RootState m_compute;
+
+	UINT m_heapCount; // UINT_MAX: unknown
+	ID3D12DescriptorHeap* m_heaps[c_maxHeaps];
+
+	bool m_knownTopology;
+	D3D12_PRIMITIVE_TOPOLOGY m_topology;
+
+	UINT m_knownVertexBuffers; // Bit i: slot i is known
+	D3D12_VERTEX_BUFFER_VIEW m_vertexBuffers[c_maxVertexBuffers];
+
+	bool m_knownIndexBuffer;
+	bool m_hasIndexBuffer;
+	D3D12_INDEX_BUFFER_VIEW m_indexBuffer;
+
+	UINT m_viewportCount; // UINT_MAX: unknown
+	D3D12_VIEWPORT m_viewports[c_maxViewports];
+	UINT m_scissorRectCount; // UINT_MAX: unknown
+	D3D12_RECT m_scissorRects[c_maxViewports];
+
+	bool m_knownRenderTargets;
+	UINT m_renderTargetCount;
+	BOOL m_singleHandle;
+	D3D12_CPU_DESCRIPTOR_HANDLE m_renderTargets[c_maxRenderTargets];
+	bool m_hasDepthStencil;
+	D3D12_CPU_DESCRIPTOR_HANDLE m_depthStencil;
+};
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <cmath>
 #include <exception>
 #include <stdint.h>
@@ -11,6 +12,8 @@
 namespace DX
 {
     // Helper class for animation and simulation timing.
+    // The clock is std::chrono::steady_clock (QueryPerformanceCounter on Windows), so the timer builds on any
+    // platform; Advance runs the same step logic on time given by the caller, for headless runs.
     class StepTimer
     {
     public:
@@ -25,18 +28,10 @@ namespace DX
             m_isFixedTimeStep(false),
             m_targetElapsedTicks(TicksPerSecond / 60)
         {
-            if (!QueryPerformanceFrequency(&m_qpcFrequency))
-            {
-                throw std::exception( "QueryPerformanceFrequency" );
-            }
-
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            m_qpcLastTime = std::chrono::steady_clock::now();
 
             // Initialize max delta to 1/10 of a second.
-            m_qpcMaxDelta = static_cast<uint64_t>(m_qpcFrequency.QuadPart / 10);
+            m_qpcMaxDelta = TicksPerSecond / 10;
         }
 
         // Get elapsed time since the previous Update call.
@@ -72,10 +67,7 @@ namespace DX
 
         void ResetElapsedTime()
         {
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception("QueryPerformanceCounter");
-            }
+            m_qpcLastTime = std::chrono::steady_clock::now();
 
             m_leftOverTicks = 0;
             m_framesPerSecond = 0;
@@ -88,16 +80,21 @@ namespace DX
         void Tick(const TUpdate& update)
         {
             // Query the current time.
-            LARGE_INTEGER currentTime;
-
-            if (!QueryPerformanceCounter(&currentTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
 
-            uint64_t timeDelta = static_cast<uint64_t>(currentTime.QuadPart - m_qpcLastTime.QuadPart);
+            // Convert clock units into a canonical tick format.
+            uint64_t timeDelta = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::duration<int64_t, std::ratio<1, TicksPerSecond>>>(
+                currentTime - m_qpcLastTime).count());
 
             m_qpcLastTime = currentTime;
+
+            Advance(timeDelta, update);
+        }
+
+        // Tick with timeDelta ticks elapsed since the previous one, whatever the clock says.
+        template<typename TUpdate>
+        void Advance(uint64_t timeDelta, const TUpdate& update)
+        {
             m_qpcSecondCounter += timeDelta;
 
             // Clamp excessively large time deltas (e.g. after paused in the debugger).
@@ -106,10 +103,6 @@ namespace DX
                 timeDelta = m_qpcMaxDelta;
             }
 
-            // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
-            timeDelta *= TicksPerSecond;
-            timeDelta /= static_cast<uint64_t>(m_qpcFrequency.QuadPart);
-
             uint32_t lastFrameCount = m_frameCount;
 
             if (m_isFixedTimeStep)
@@ -157,18 +150,17 @@ namespace DX
                 m_framesThisSecond++;
             }
 
-            if (m_qpcSecondCounter >= static_cast<uint64_t>(m_qpcFrequency.QuadPart))
+            if (m_qpcSecondCounter >= TicksPerSecond)
             {
                 m_framesPerSecond = m_framesThisSecond;
                 m_framesThisSecond = 0;
-                m_qpcSecondCounter %= static_cast<uint64_t>(m_qpcFrequency.QuadPart);
+                m_qpcSecondCounter %= TicksPerSecond;
             }
         }
 
     private:
-        // Source timing data uses QPC units.
-        LARGE_INTEGER m_qpcFrequency;
-        LARGE_INTEGER m_qpcLastTime;
+        // Source timing data; the maximum delta is in canonical ticks.
+        std::chrono::steady_clock::time_point m_qpcLastTime;
         uint64_t m_qpcMaxDelta;
 
         // Derived timing data uses a canonical tick format.
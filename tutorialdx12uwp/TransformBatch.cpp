@@ -0,0 +1,330 @@
+#include "pch.h"
+#include "TransformBatch.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_BATCH_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace TransformBatch {
+
+	static XMFLOAT4X4* Advance(XMFLOAT4X4* matrix, size_t stride) {
+		return reinterpret_cast<XMFLOAT4X4*>(reinterpret_cast<BYTE*>(matrix) + stride);
+	}
+
+#ifdef TRANSFORM_BATCH_AVX2
+	static void Cpuid(int info[4], int leaf, int subleaf) {
+#ifdef _MSC_VER
+		__cpuidex(info, leaf, subleaf);
+#else
+		unsigned int eax, ebx, ecx, edx;
+		__cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+		info[0] = static_cast<int>(eax);
+		info[1] = static_cast<int>(ebx);
+		info[2] = static_cast<int>(ecx);
+		info[3] = static_cast<int>(edx);
+#endif
+	}
+
+	// XCR0: the register states the OS saves.
+	static unsigned long long Xgetbv0() {
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+	}
+
+	static bool CpuHasAvx2() {
+		int info[4];
+		Cpuid(info, 0, 0);
+		if (info[0] < 7)
+			return false;
+		Cpuid(info, 1, 0);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (Xgetbv0() & 0x6) != 0x6) // The OS saves the ymm registers
+			return false;
+		Cpuid(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}
+
+	static bool useAvx2 = CpuHasAvx2();
+
+	// GCC and clang only compile the intrinsics below for an AVX2 target; the code runs only when CpuHasAvx2 says
+	// so, whatever the target of the build. MSVC compiles them for any target.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+	// Eight 4x4 matrices, element e of matrix lane in m[e].m256_f32[lane].
+	struct Matrix8 {
+		__m256 m[16];
+	};
+
+	static void Load8(const XMFLOAT4X4* matrices, size_t stride, Matrix8& soa) {
+		alignas(32) float lanes[16][8];
+		for (int lane = 0; lane < 8; lane++) {
+			const float* source = &matrices->m[0][0];
+			for (int e = 0; e < 16; e++)
+				lanes[e][lane] = source[e];
+			matrices = reinterpret_cast<const XMFLOAT4X4*>(reinterpret_cast<const BYTE*>(matrices) + stride);
+		}
+		for (int e = 0; e < 16; e++)
+			soa.m[e] = _mm256_load_ps(lanes[e]);
+	}
+
+	static void Store8(const Matrix8& soa, XMFLOAT4X4* matrices, size_t stride, bool transpose) {
+		alignas(32) float lanes[16][8];
+		for (int e = 0; e < 16; e++)
+			_mm256_store_ps(lanes[e], soa.m[e]);
+		for (int lane = 0; lane < 8; lane++) {
+			for (int r = 0; r < 4; r++)
+				for (int c = 0; c < 4; c++)
+					matrices->m[r][c] = transpose ? lanes[4 * c + r][lane] : lanes[4 * r + c][lane];
+			matrices = Advance(matrices, stride);
+		}
+	}
+
+	static void Broadcast(FXMMATRIX matrix, __m256 out[16]) {
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, matrix);
+		for (int e = 0; e < 16; e++)
+			out[e] = _mm256_set1_ps((&m._11)[e]);
+	}
+
+	// a * b with the additions of XMMatrixMultiply: (x*r0 + z*r2) + (y*r1 + w*r3)
+	static __m256 Dot4(__m256 a0, __m256 a1, __m256 a2, __m256 a3, __m256 b0, __m256 b1, __m256 b2, __m256 b3) {
+		__m256 x = _mm256_mul_ps(a0, b0);
+		__m256 y = _mm256_mul_ps(a1, b1);
+		__m256 z = _mm256_mul_ps(a2, b2);
+		__m256 w = _mm256_mul_ps(a3, b3);
+		return _mm256_add_ps(_mm256_add_ps(x, z), _mm256_add_ps(y, w));
+	}
+
+	static void MultiplyShared(const __m256 a[16], const Matrix8& b, Matrix8& out) {
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				out.m[4 * r + c] = Dot4(a[4 * r], a[4 * r + 1], a[4 * r + 2], a[4 * r + 3],
+					b.m[c], b.m[4 + c], b.m[8 + c], b.m[12 + c]);
+	}
+
+	static void MultiplyBySharedMatrix(const Matrix8& a, const __m256 b[16], Matrix8& out) {
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				out.m[4 * r + c] = Dot4(a.m[4 * r], a.m[4 * r + 1], a.m[4 * r + 2], a.m[4 * r + 3],
+					b[c], b[4 + c], b[8 + c], b[12 + c]);
+	}
+
+	// Inverse of affine matrices whose upper 3x3 is a rotation times a uniform scale:
+	// transpose(A) / s^2 and the translation taken back through it.
+	static void InverseUniformScale(const Matrix8& matrix, Matrix8& out) {
+		const __m256* m = matrix.m;
+		__m256 scale2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], m[0]), _mm256_mul_ps(m[1], m[1])), _mm256_mul_ps(m[2], m[2]));
+		__m256 invScale2 = _mm256_div_ps(_mm256_set1_ps(1.0f), scale2);
+		__m256* o = out.m;
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++)
+				o[4 * r + c] = _mm256_mul_ps(m[4 * c + r], invScale2);
+			o[4 * r + 3] = _mm256_setzero_ps();
+		}
+		for (int c = 0; c < 3; c++) {
+			__m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[12], o[c]), _mm256_mul_ps(m[13], o[4 + c])), _mm256_mul_ps(m[14], o[8 + c]));
+			o[12 + c] = _mm256_sub_ps(_mm256_setzero_ps(), t);
+		}
+		o[15] = _mm256_set1_ps(1.0f);
+	}
+
+	static __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+	static __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+	static __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+
+	// Inverse by cofactors; every lane is independent.
+	static void Inverse(const Matrix8& matrix, Matrix8& out) {
+		const __m256* m = matrix.m;
+
+		// 2x2 determinants of the two upper rows (s) and the two lower rows (c).
+		__m256 s0 = sub(mul(m[0], m[5]), mul(m[4], m[1]));
+		__m256 s1 = sub(mul(m[0], m[6]), mul(m[4], m[2]));
+		__m256 s2 = sub(mul(m[0], m[7]), mul(m[4], m[3]));
+		__m256 s3 = sub(mul(m[1], m[6]), mul(m[5], m[2]));
+		__m256 s4 = sub(mul(m[1], m[7]), mul(m[5], m[3]));
+		__m256 s5 = sub(mul(m[2], m[7]), mul(m[6], m[3]));
+		__m256 c5 = sub(mul(m[10], m[15]), mul(m[14], m[11]));
+		__m256 c4 = sub(mul(m[9], m[15]), mul(m[13], m[11]));
+		__m256 c3 = sub(mul(m[9], m[14]), mul(m[13], m[10]));
+		__m256 c2 = sub(mul(m[8], m[15]), mul(m[12], m[11]));
+		__m256 c1 = sub(mul(m[8], m[14]), mul(m[12], m[10]));
+		__m256 c0 = sub(mul(m[8], m[13]), mul(m[12], m[9]));
+
+		__m256 det = add(sub(add(add(sub(mul(s0, c5), mul(s1, c4)), mul(s2, c3)), mul(s3, c2)), mul(s4, c1)), mul(s5, c0));
+		__m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+		__m256* o = out.m;
+		o[0] = mul(add(sub(mul(m[5], c5), mul(m[6], c4)), mul(m[7], c3)), invDet);
+		o[1] = mul(sub(sub(mul(m[2], c4), mul(m[1], c5)), mul(m[3], c3)), invDet);
+		o[2] = mul(add(sub(mul(m[13], s5), mul(m[14], s4)), mul(m[15], s3)), invDet);
+		o[3] = mul(sub(sub(mul(m[10], s4), mul(m[9], s5)), mul(m[11], s3)), invDet);
+		o[4] = mul(sub(sub(mul(m[6], c2), mul(m[4], c5)), mul(m[7], c1)), invDet);
+		o[5] = mul(add(sub(mul(m[0], c5), mul(m[2], c2)), mul(m[3], c1)), invDet);
+		o[6] = mul(sub(sub(mul(m[14], s2), mul(m[12], s5)), mul(m[15], s1)), invDet);
+		o[7] = mul(add(sub(mul(m[8], s5), mul(m[10], s2)), mul(m[11], s1)), invDet);
+		o[8] = mul(add(sub(mul(m[4], c4), mul(m[5], c2)), mul(m[7], c0)), invDet);
+		o[9] = mul(sub(sub(mul(m[1], c2), mul(m[0], c4)), mul(m[3], c0)), invDet);
+		o[10] = mul(add(sub(mul(m[12], s4), mul(m[13], s2)), mul(m[15], s0)), invDet);
+		o[11] = mul(sub(sub(mul(m[9], s2), mul(m[8], s4)), mul(m[11], s0)), invDet);
+		o[12] = mul(sub(sub(mul(m[5], c1), mul(m[4], c3)), mul(m[6], c0)), invDet);
+		o[13] = mul(add(sub(mul(m[0], c3), mul(m[1], c1)), mul(m[2], c0)), invDet);
+		o[14] = mul(sub(sub(mul(m[13], s1), mul(m[12], s3)), mul(m[14], s0)), invDet);
+		o[15] = mul(add(sub(mul(m[8], s3), mul(m[9], s1)), mul(m[10], s0)), invDet);
+	}
+
+	// WorldView eight instances at a time; returns the instances done, the rest are left to the scalar loop.
+	static size_t WorldView8(const XMFLOAT4X4* worlds, size_t count, size_t worldStride, FXMMATRIX model, CXMMATRIX view, XMFLOAT4X4* worldviews) {
+		__m256 a[16], b[16];
+		Broadcast(model, a);
+		Broadcast(view, b);
+		Matrix8 world, temp, worldview;
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			Load8(worlds, worldStride, world);
+			MultiplyShared(a, world, temp);
+			MultiplyBySharedMatrix(temp, b, worldview);
+			Store8(worldview, worldviews + i, sizeof(XMFLOAT4X4), false);
+			worlds = reinterpret_cast<const XMFLOAT4X4*>(reinterpret_cast<const BYTE*>(worlds) + 8 * worldStride);
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+
+	// InstanceTransforms eight instances at a time, as WorldView8.
+	static size_t InstanceTransforms8(const XMFLOAT4X4* worldviews, const TransformKind* kinds, size_t count, FXMMATRIX pre,
+		CXMMATRIX projection, XMFLOAT4X4* transforms, XMFLOAT4X4* normalTransforms, size_t outputStride) {
+		__m256 a[16], b[16];
+		Broadcast(pre, a);
+		Broadcast(projection, b);
+		Matrix8 worldview, temp, result;
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			Load8(worldviews + i, sizeof(XMFLOAT4X4), worldview);
+			MultiplyShared(a, worldview, temp);
+			MultiplyBySharedMatrix(temp, b, result);
+			Store8(result, transforms, outputStride, true);
+			bool cheap = kinds != nullptr;
+			for (size_t k = 0; k < 8 && cheap; k++)
+				cheap = kinds[i + k] != TransformKind::General;
+			if (cheap)
+				InverseUniformScale(worldview, result);
+			else
+				Inverse(worldview, result);
+			Store8(result, normalTransforms, outputStride, false);
+			for (int k = 0; k < 8; k++) {
+				transforms = Advance(transforms, outputStride);
+				normalTransforms = Advance(normalTransforms, outputStride);
+			}
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#else
+	static bool useAvx2 = false;
+#endif
+
+	TransformKind Classify(FXMMATRIX matrix, float tolerance) {
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, matrix);
+		if (std::abs(m._14) > tolerance || std::abs(m._24) > tolerance || std::abs(m._34) > tolerance || std::abs(m._44 - 1.0f) > tolerance)
+			return TransformKind::General;
+		XMVECTOR r0 = matrix.r[0], r1 = matrix.r[1], r2 = matrix.r[2];
+		float l0 = XMVectorGetX(XMVector3LengthSq(r0));
+		float l1 = XMVectorGetX(XMVector3LengthSq(r1));
+		float l2 = XMVectorGetX(XMVector3LengthSq(r2));
+		float d01 = XMVectorGetX(XMVector3Dot(r0, r1));
+		float d02 = XMVectorGetX(XMVector3Dot(r0, r2));
+		float d12 = XMVectorGetX(XMVector3Dot(r1, r2));
+		float scale = std::max(l0, std::max(l1, l2));
+		// Orthogonal rows of the same length.
+		if (std::abs(l0 - l1) > tolerance * scale || std::abs(l0 - l2) > tolerance * scale ||
+			std::abs(d01) > tolerance * scale || std::abs(d02) > tolerance * scale || std::abs(d12) > tolerance * scale)
+			return TransformKind::General;
+		return std::abs(l0 - 1.0f) <= tolerance ? TransformKind::Rigid : TransformKind::UniformScale;
+	}
+
+	XMMATRIX InverseOf(FXMMATRIX matrix, TransformKind kind) {
+		if (kind == TransformKind::General)
+			return XMMatrixInverse(nullptr, matrix);
+		// Upper 3x3 transposed (divided by the squared scale), then the translation taken back through it.
+		XMMATRIX inverse = matrix;
+		inverse.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		inverse = XMMatrixTranspose(inverse);
+		if (kind == TransformKind::UniformScale) {
+			XMVECTOR invScale2 = XMVectorReciprocal(XMVector3LengthSq(matrix.r[0]));
+			inverse.r[0] = XMVectorMultiply(inverse.r[0], invScale2);
+			inverse.r[1] = XMVectorMultiply(inverse.r[1], invScale2);
+			inverse.r[2] = XMVectorMultiply(inverse.r[2], invScale2);
+		}
+		inverse.r[3] = XMVectorSelect(g_XMIdentityR3, XMVectorNegate(XMVector3TransformNormal(matrix.r[3], inverse)), g_XMSelect1110);
+		return inverse;
+	}
+
+	bool UsesAvx2() {
+		return useAvx2;
+	}
+
+	void EnableAvx2(bool enable) {
+#ifdef TRANSFORM_BATCH_AVX2
+		useAvx2 = enable && CpuHasAvx2();
+#endif
+	}
+
+	void WorldView(const XMFLOAT4X4* worlds, size_t count, size_t worldStride, FXMMATRIX model, CXMMATRIX view, XMFLOAT4X4* worldviews) {
+		size_t i = 0;
+#ifdef TRANSFORM_BATCH_AVX2
+		if (useAvx2) {
+			i = WorldView8(worlds, count, worldStride, model, view, worldviews);
+			worlds = reinterpret_cast<const XMFLOAT4X4*>(reinterpret_cast<const BYTE*>(worlds) + i * worldStride);
+		}
+#endif
+		for (; i < count; i++) {
+			XMStoreFloat4x4(&worldviews[i], model * XMLoadFloat4x4(worlds) * view);
+			worlds = reinterpret_cast<const XMFLOAT4X4*>(reinterpret_cast<const BYTE*>(worlds) + worldStride);
+		}
+	}
+
+	void InstanceTransforms(const XMFLOAT4X4* worldviews, const TransformKind* kinds, size_t count, FXMMATRIX pre,
+		CXMMATRIX projection, XMFLOAT4X4* transforms, XMFLOAT4X4* normalTransforms, size_t outputStride) {
+		size_t i = 0;
+#ifdef TRANSFORM_BATCH_AVX2
+		if (useAvx2) {
+			i = InstanceTransforms8(worldviews, kinds, count, pre, projection, transforms, normalTransforms, outputStride);
+			for (size_t k = 0; k < i; k++) {
+				transforms = Advance(transforms, outputStride);
+				normalTransforms = Advance(normalTransforms, outputStride);
+			}
+		}
+#endif
+		for (; i < count; i++) {
+			XMMATRIX worldview = XMLoadFloat4x4(&worldviews[i]);
+			XMStoreFloat4x4(transforms, XMMatrixTranspose(pre * worldview * projection));
+			XMStoreFloat4x4(normalTransforms, InverseOf(worldview, kinds != nullptr ? kinds[i] : TransformKind::General));
+			transforms = Advance(transforms, outputStride);
+			normalTransforms = Advance(normalTransforms, outputStride);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "pch.h"
+
+// Batched instance transforms for Game::Update.
+// Matrices are processed eight at a time in structure of arrays form with AVX2 when the CPU has it
+// (x86 and x64 only), and one at a time with DirectXMath otherwise. Products are summed in the same
+// order as the SSE XMMatrixMultiply, so transforms match the per instance code bit for bit. The AVX2
+// inverse is a cofactor expansion and may differ from XMMatrixInverse in the last bits.
+
+namespace TransformBatch {
+
+	// What a matrix does to normals. Rigid and uniformly scaled matrices get their normal matrix from the
+	// transposed upper 3x3; only General ones need the full inverse.
+	enum class TransformKind : uint8_t {
+		Rigid,        // Rotation and translation
+		UniformScale, // Rotation, translation and the same scale on every axis
+		General
+	};
+
+	// Finds the kind from the rows of an affine matrix, for matrices whose origin is unknown.
+	TransformKind Classify(FXMMATRIX matrix, float tolerance = 1e-4f);
+
+	// Inverse of matrix, cheap for Rigid and UniformScale affine matrices.
+	XMMATRIX InverseOf(FXMMATRIX matrix, TransformKind kind);
+
+	// worldviews[i] = model * worlds[i] * view. Input matrices are worldStride bytes apart.
+	void WorldView(const XMFLOAT4X4* worlds, size_t count, size_t worldStride, FXMMATRIX model, CXMMATRIX view, XMFLOAT4X4* worldviews);
+
+	// transforms[i] = transpose(pre * worldviews[i] * projection), normalTransforms[i] = inverse(worldviews[i]).
+	// kinds[i] is the kind of worldviews[i]; nullptr treats all of them as General.
+	// Outputs are outputStride bytes apart, so they can be written straight into an array of instance structs.
+	void InstanceTransforms(const XMFLOAT4X4* worldviews, const TransformKind* kinds, size_t count, FXMMATRIX pre,
+		CXMMATRIX projection, XMFLOAT4X4* transforms, XMFLOAT4X4* normalTransforms, size_t outputStride);
+
+	// Whether the AVX2 path is in use. It can be turned off to compare both paths.
+	bool UsesAvx2();
+	void EnableAvx2(bool enable);
+}
@@ -0,0 +1,33 @@
+#include "pch.h"
+#include "UploadBackend.h"
+
+NullUploadBackend::NullUploadBackend() : m_nextAddress(c_firstAddress), m_stats{}
+{
+}
+
+NullUploadBackend::~NullUploadBackend()
+{
+	assert(m_stats.buffersCreated == m_stats.buffersReleased);
+}
+
+UploadBackend::Buffer NullUploadBackend::CreateBuffer(UINT64 size) {
+	// Aligned like an upload heap buffer, so the offsets UploadRing aligns are aligned addresses too.
+	void* memory = ::operator new(static_cast<size_t>(size), std::align_val_t(c_alignment));
+	Buffer buffer;
+	buffer.cpuAddress = static_cast<BYTE*>(memory);
+	buffer.gpuAddress = m_nextAddress;
+	buffer.size = size;
+	buffer.resource = nullptr;
+	m_nextAddress += (size + c_alignment - 1) & ~(c_alignment - 1);
+
+	m_stats.buffersCreated++;
+	m_stats.bytesLive += size;
+	m_stats.bytesPeak = std::max(m_stats.bytesPeak, m_stats.bytesLive);
+	return buffer;
+}
+
+void NullUploadBackend::ReleaseBuffer(const Buffer& buffer) {
+	::operator delete(buffer.cpuAddress, std::align_val_t(c_alignment));
+	m_stats.buffersReleased++;
+	m_stats.bytesLive -= buffer.size;
+}
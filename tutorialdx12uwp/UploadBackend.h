@@ -0,0 +1,54 @@
+#pragma once
+#include "pch.h"
+
+// Where UploadRing gets its buffers from. D3D12UploadBackend creates upload heap buffers on a device;
+// NullUploadBackend hands out system memory with made up GPU addresses, so the CPU side of a frame can run
+// and be measured with no device at all (Benchmark::HeadlessFrames). UploadRing only sees this interface.
+
+struct ID3D12Resource; // Only carried along for the D3D12 backend, null otherwise
+
+class UploadBackend
+{
+public:
+	// A buffer mapped for writing for its whole life.
+	struct Buffer {
+		BYTE* cpuAddress;
+		UINT64 gpuAddress;
+		UINT64 size;
+		ID3D12Resource* resource;
+	};
+
+	virtual ~UploadBackend() = default;
+
+	virtual Buffer CreateBuffer(UINT64 size) = 0;
+	// Called once the GPU is done with every allocation in the buffer.
+	virtual void ReleaseBuffer(const Buffer& buffer) = 0;
+};
+
+// System memory buffers. GPU addresses are increasing offsets in an address space that is never reused, so
+// they can be told apart in a trace. Counts what it hands out.
+class NullUploadBackend : public UploadBackend
+{
+public:
+	struct Stats {
+		size_t buffersCreated;
+		size_t buffersReleased;
+		UINT64 bytesLive;
+		UINT64 bytesPeak;
+	};
+
+	NullUploadBackend();
+	~NullUploadBackend();
+
+	Buffer CreateBuffer(UINT64 size) override;
+	void ReleaseBuffer(const Buffer& buffer) override;
+
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	static const UINT64 c_alignment = 256; // Of constant buffers, the largest placement alignment UploadRing is asked for
+	static const UINT64 c_firstAddress = 0x10000;
+
+	UINT64 m_nextAddress;
+	Stats m_stats;
+};
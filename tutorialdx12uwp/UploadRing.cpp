@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "UploadRing.h"
+
+UploadRing::UploadRing() : m_buffer{}, m_size(0), m_head(0), m_tail(0), m_growCount(0), m_stats{}
+{
+}
+
+UploadRing::~UploadRing()
+{
+	releaseBuffers();
+}
+
+void UploadRing::Create(std::shared_ptr<UploadBackend> backend, UINT64 size) {
+	releaseBuffers();
+	m_backend = std::move(backend);
+	m_growCount = 0;
+	createBuffer(size);
+	m_frames.clear();
+	m_frames.reserve(c_maxFramesInFlight);
+	m_stats = {};
+}
+
+void UploadRing::BeginFrame(UINT64 completedFenceValue) {
+	size_t retired = 0;
+	while (retired < m_frames.size() && m_frames[retired].fenceValue <= completedFenceValue)
+		m_tail = m_frames[retired++].end;
+	m_frames.erase(m_frames.begin(), m_frames.begin() + retired);
+
+	m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(), [this, completedFenceValue](const Retired& old) {
+		if (!old.frameEnded || old.fenceValue > completedFenceValue)
+			return false;
+		m_backend->ReleaseBuffer(old.buffer);
+		return true;
+	}), m_retired.end());
+	m_stats = {};
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 size, UINT64 alignment) {
+	UINT64 offset = m_head % m_size;
+	UINT64 padding = ((offset + alignment - 1) & ~(alignment - 1)) - offset;
+	if (offset + padding + size > m_size)
+		padding = m_size - offset; // Wraps to the start, which is aligned
+	if (m_head + padding + size - m_tail > m_size) {
+		// The new buffer is empty and starts aligned.
+		grow(m_stats.bytesWritten + m_stats.bytesPadding + size + alignment);
+		padding = 0;
+	}
+
+	m_head += padding;
+	Allocation allocation;
+	allocation.cpuAddress = m_buffer.cpuAddress + m_head % m_size;
+	allocation.gpuAddress = m_buffer.gpuAddress + m_head % m_size;
+	allocation.size = size;
+	allocation.resource = m_buffer.resource;
+	allocation.offset = m_head % m_size;
+	m_head += size;
+
+	m_stats.allocations++;
+	m_stats.bytesWritten += size;
+	m_stats.bytesPadding += padding;
+	return allocation;
+}
+
+void UploadRing::ShrinkLast(Allocation& allocation, UINT64 size) {
+	assert(size <= allocation.size && m_buffer.cpuAddress + (m_head - allocation.size) % m_size == allocation.cpuAddress);
+	m_head -= allocation.size - size;
+	m_stats.bytesWritten -= allocation.size - size;
+	allocation.size = size;
+}
+
+void UploadRing::EndFrame(UINT64 fenceValue) {
+	m_frames.push_back(Frame{ fenceValue, m_head });
+	for (Retired& old : m_retired) {
+		if (!old.frameEnded) {
+			old.fenceValue = fenceValue;
+			old.frameEnded = true;
+		}
+	}
+}
+
+UINT64 UploadRing::GrownSize(UINT64 size, UINT64 required) {
+	size = std::max<UINT64>(size, 1) * 2;
+	while (size < 2 * required)
+		size *= 2;
+	return size;
+}
+
+void UploadRing::createBuffer(UINT64 size) {
+	m_buffer = m_backend->CreateBuffer(size);
+	m_size = size;
+	m_head = 0;
+	m_tail = 0;
+}
+
+void UploadRing::grow(UINT64 required) {
+	// Frames in flight, the current one included, keep reading the old buffer until the current frame's fence.
+	// It stays mapped: allocations of the current frame may still be written.
+	m_retired.push_back(Retired{ m_buffer, 0, false });
+	createBuffer(GrownSize(m_size, required));
+	m_frames.clear();
+	m_growCount++;
+}
+
+void UploadRing::releaseBuffers() {
+	// Only once the GPU is idle: Create runs at startup and the destructor after the last frame was waited for.
+	for (const Retired& old : m_retired)
+		m_backend->ReleaseBuffer(old.buffer);
+	m_retired.clear();
+	if (m_buffer.cpuAddress != nullptr)
+		m_backend->ReleaseBuffer(m_buffer);
+	m_buffer = {};
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "pch.h"
+#include "UploadBackend.h"
+
+// Per frame data for the GPU in a single upload heap buffer, mapped once for its whole life.
+// The buffer is a ring: every frame sub-allocates after the previous one and its bytes come back when the
+// fence value signalled after that frame is completed. Upload heaps are write-combined on most adapters, so
+// allocations must be written sequentially and never read back.
+// When the frames in flight leave no room the ring moves to a buffer at least twice as big; the old one is
+// released once the GPU has finished the frames that used it, so earlier allocations stay valid.
+// Buffers come from an UploadBackend, so the ring runs the same with or without a device.
+
+class UploadRing
+{
+public:
+	struct Allocation {
+		BYTE* cpuAddress;
+		UINT64 gpuAddress; // D3D12_GPU_VIRTUAL_ADDRESS
+		UINT64 size;
+		ID3D12Resource* resource; // Buffer and position in it, for copies such as CopyBufferRegion
+		UINT64 offset;
+	};
+
+	// Counters of one frame, from BeginFrame to EndFrame.
+	struct Stats {
+		size_t allocations;
+		UINT64 bytesWritten;   // Requested sizes, all written by the caller
+		UINT64 bytesPadding;   // Lost to alignment and to the wrap at the end of the buffer
+	};
+
+	UploadRing();
+	~UploadRing();
+
+	// size is the starting capacity.
+	void Create(std::shared_ptr<UploadBackend> backend, UINT64 size);
+
+	// Starts a frame. Frames whose fence value the GPU has reached give their space back.
+	void BeginFrame(UINT64 completedFenceValue);
+
+	// Space for size bytes at a multiple of alignment (a power of two), valid until the frame is retired.
+	// Grows the ring when the frames in flight leave no room.
+	Allocation Allocate(UINT64 size, UINT64 alignment);
+
+	// Gives back the end of the last allocation when fewer bytes than requested were written.
+	void ShrinkLast(Allocation& allocation, UINT64 size);
+
+	// Ends the frame; its space is kept until fenceValue is completed.
+	void EndFrame(UINT64 fenceValue);
+
+	const Stats& FrameStats() const { return m_stats; }
+	UINT64 GetSize() const { return m_size; }
+	size_t GetGrowCount() const { return m_growCount; }
+
+	// Capacity after growing from size to fit at least required bytes: size doubled until it holds twice required.
+	static UINT64 GrownSize(UINT64 size, UINT64 required);
+
+private:
+	static const size_t c_maxFramesInFlight = 16;
+
+	struct Frame {
+		UINT64 fenceValue;
+		UINT64 end; // m_head when the frame ended
+	};
+
+	// Buffer replaced by a bigger one, kept alive until the GPU passes fenceValue.
+	struct Retired {
+		UploadBackend::Buffer buffer;
+		UINT64 fenceValue;
+		bool frameEnded; // fenceValue is only known once the frame that replaced it ends
+	};
+
+	void createBuffer(UINT64 size);
+	void grow(UINT64 required);
+	void releaseBuffers();
+
+	std::shared_ptr<UploadBackend> m_backend;
+	UploadBackend::Buffer m_buffer;
+	UINT64 m_size;
+	// Bytes handed out and bytes given back since Create; the offset in the buffer is the count modulo m_size.
+	UINT64 m_head;
+	UINT64 m_tail;
+	std::vector<Frame> m_frames; // Frames in flight, oldest first; reserved in Create so frames do not allocate
+	std::vector<Retired> m_retired;
+	size_t m_growCount;
+	Stats m_stats;
+};
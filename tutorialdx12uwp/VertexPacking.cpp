@@ -0,0 +1,123 @@
+#include "pch.h"
+#include "VertexPacking.h"
+#include <DirectXPackedVector.h>
+
+using namespace DirectX::PackedVector;
+
+namespace VertexPacking {
+
+	static uint16_t QuantizeUnorm16(float value) {
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return static_cast<uint16_t>(value * 65535.0f + 0.5f);
+	}
+
+	static int16_t QuantizeSnorm16(float value) {
+		value = std::min(std::max(value, -1.0f), 1.0f);
+		return static_cast<int16_t>(value >= 0.0f ? value * 32767.0f + 0.5f : value * 32767.0f - 0.5f);
+	}
+
+	static uint32_t QuantizeUnorm8(float value) {
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return static_cast<uint32_t>(value * 255.0f + 0.5f);
+	}
+
+	// Box size with a minimum, so flat meshes do not divide by zero.
+	static XMFLOAT3 BoxSize(const BoundingBox& bounds) {
+		return XMFLOAT3(std::max(2.0f * bounds.Extents.x, 1e-6f),
+			std::max(2.0f * bounds.Extents.y, 1e-6f),
+			std::max(2.0f * bounds.Extents.z, 1e-6f));
+	}
+
+	XMMATRIX DequantizeMatrix(const BoundingBox& bounds) {
+		XMFLOAT3 size = BoxSize(bounds);
+		return XMMatrixScaling(size.x, size.y, size.z) *
+			XMMatrixTranslation(bounds.Center.x - bounds.Extents.x, bounds.Center.y - bounds.Extents.y, bounds.Center.z - bounds.Extents.z);
+	}
+
+	XMFLOAT2 EncodeOctahedral(XMFLOAT3 n) {
+		float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (l1 == 0.0f)
+			return XMFLOAT2(0.0f, 0.0f);
+		float x = n.x / l1;
+		float y = n.y / l1;
+		if (n.z < 0.0f) {
+			float ox = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float oy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = ox;
+			y = oy;
+		}
+		return XMFLOAT2(x, y);
+	}
+
+	XMFLOAT3 DecodeOctahedral(XMFLOAT2 e) {
+		// Same decode as OctahedralDecode in Header.hlsli
+		XMFLOAT3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+		float t = std::max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&n)));
+		return n;
+	}
+
+	void Encode(const Vertex* vertices, size_t count, const BoundingBox& bounds, PackedVertex* packed) {
+		XMFLOAT3 size = BoxSize(bounds);
+		XMFLOAT3 corner(bounds.Center.x - bounds.Extents.x, bounds.Center.y - bounds.Extents.y, bounds.Center.z - bounds.Extents.z);
+		for (size_t i = 0; i < count; i++) {
+			const Vertex& v = vertices[i];
+			PackedVertex& p = packed[i];
+			p.pos[0] = QuantizeUnorm16((v.pos.x - corner.x) / size.x);
+			p.pos[1] = QuantizeUnorm16((v.pos.y - corner.y) / size.y);
+			p.pos[2] = QuantizeUnorm16((v.pos.z - corner.z) / size.z);
+			p.pos[3] = 0;
+			p.col = QuantizeUnorm8(v.col.x) | (QuantizeUnorm8(v.col.y) << 8) |
+				(QuantizeUnorm8(v.col.z) << 16) | (QuantizeUnorm8(v.col.w) << 24);
+			XMFLOAT2 oct = EncodeOctahedral(v.normal);
+			p.normal[0] = QuantizeSnorm16(oct.x);
+			p.normal[1] = QuantizeSnorm16(oct.y);
+			p.uvcoords[0] = XMConvertFloatToHalf(v.uvcoords.x);
+			p.uvcoords[1] = XMConvertFloatToHalf(v.uvcoords.y);
+		}
+	}
+
+	void Decode(const PackedVertex* packed, size_t count, const BoundingBox& bounds, Vertex* vertices) {
+		XMFLOAT3 size = BoxSize(bounds);
+		XMFLOAT3 corner(bounds.Center.x - bounds.Extents.x, bounds.Center.y - bounds.Extents.y, bounds.Center.z - bounds.Extents.z);
+		for (size_t i = 0; i < count; i++) {
+			const PackedVertex& p = packed[i];
+			Vertex& v = vertices[i];
+			v.pos.x = corner.x + size.x * (p.pos[0] / 65535.0f);
+			v.pos.y = corner.y + size.y * (p.pos[1] / 65535.0f);
+			v.pos.z = corner.z + size.z * (p.pos[2] / 65535.0f);
+			v.col = XMFLOAT4((p.col & 0xFF) / 255.0f, ((p.col >> 8) & 0xFF) / 255.0f,
+				((p.col >> 16) & 0xFF) / 255.0f, ((p.col >> 24) & 0xFF) / 255.0f);
+			v.normal = DecodeOctahedral(XMFLOAT2(std::max(p.normal[0] / 32767.0f, -1.0f), std::max(p.normal[1] / 32767.0f, -1.0f)));
+			v.uvcoords = XMFLOAT2(XMConvertHalfToFloat(p.uvcoords[0]), XMConvertHalfToFloat(p.uvcoords[1]));
+			v.material = XMUINT3(0, 0, 0);
+		}
+	}
+
+	ErrorReport MeasureError(const Vertex* vertices, size_t count, const BoundingBox& bounds) {
+		std::vector<PackedVertex> packed(count);
+		std::vector<Vertex> decoded(count);
+		Encode(vertices, count, bounds, packed.data());
+		Decode(packed.data(), count, bounds, decoded.data());
+
+		ErrorReport report = {};
+		for (size_t i = 0; i < count; i++) {
+			const Vertex& a = vertices[i];
+			const Vertex& b = decoded[i];
+			XMVECTOR posError = XMVector3Length(XMLoadFloat3(&a.pos) - XMLoadFloat3(&b.pos));
+			report.position = std::max(report.position, XMVectorGetX(posError));
+			XMVECTOR na = XMVector3Normalize(XMLoadFloat3(&a.normal));
+			XMVECTOR nb = XMLoadFloat3(&b.normal);
+			float cosAngle = std::min(std::max(XMVectorGetX(XMVector3Dot(na, nb)), -1.0f), 1.0f);
+			if (XMVectorGetX(XMVector3LengthSq(na)) > 0.0f)
+				report.normalDegrees = std::max(report.normalDegrees, XMConvertToDegrees(std::acos(cosAngle)));
+			report.uv = std::max(report.uv, std::max(std::abs(a.uvcoords.x - b.uvcoords.x), std::abs(a.uvcoords.y - b.uvcoords.y)));
+			report.color = std::max(report.color, XMVectorGetX(XMVector4Length(XMLoadFloat4(&a.col) - XMLoadFloat4(&b.col))));
+		}
+		float largest = 2.0f * std::max(bounds.Extents.x, std::max(bounds.Extents.y, bounds.Extents.z));
+		report.positionRelative = largest > 0.0f ? report.position / largest : 0.0f;
+		return report;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "pch.h"
+#include "Mesh.h"
+
+// Compact vertex layout: 20 bytes instead of the 60 of Vertex.
+// Positions are quantized to 16 bits relative to the mesh bounding box; the box is folded into the
+// instance transform (DequantizeMatrix), so the shader reads them as plain UNORM values.
+// Normals are octahedral encoded in two SNORM16, uvs are half floats, color is RGBA8.
+// Material is not stored: it is already per instance (vInstance::MaterialIndex).
+struct PackedVertex {
+	uint16_t pos[4];    // DXGI_FORMAT_R16G16B16A16_UNORM, w unused
+	uint32_t col;       // DXGI_FORMAT_R8G8B8A8_UNORM
+	int16_t normal[2];  // DXGI_FORMAT_R16G16_SNORM, octahedral
+	uint16_t uvcoords[2]; // DXGI_FORMAT_R16G16_FLOAT
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must match the packed input layout");
+
+namespace VertexPacking {
+
+	// Maps quantized positions in [0,1] back to model space: scale by the box size and offset by its corner.
+	XMMATRIX DequantizeMatrix(const BoundingBox& bounds);
+
+	void Encode(const Vertex* vertices, size_t count, const BoundingBox& bounds, PackedVertex* packed);
+	void Decode(const PackedVertex* packed, size_t count, const BoundingBox& bounds, Vertex* vertices);
+
+	XMFLOAT2 EncodeOctahedral(XMFLOAT3 normal);
+	XMFLOAT3 DecodeOctahedral(XMFLOAT2 encoded);
+
+	// Largest round trip errors of a set of vertices.
+	struct ErrorReport {
+		float position;     // Model units
+		float positionRelative; // Position error over the largest box dimension
+		float normalDegrees;
+		float uv;
+		float color;
+	};
+	ErrorReport MeasureError(const Vertex* vertices, size_t count, const BoundingBox& bounds);
+}
@@ -0,0 +1,116 @@
+// Frustum culling and LOD selection of every instance on the GPU (GpuCulling.h).
+// Visible instances are appended to the region of their shape and LOD in gOutput; the instance count of the
+// region's draw in gCommands is the append counter. GpuCulling::Cull is the CPU reference of this shader:
+// both must do the same operations in the same order.
+
+// GpuCulling::CullInstance. Matrices are rows, as DirectXMath stores them; transforms are copied untouched.
+struct CullInstance
+{
+	float4 transform[4];
+	float4 normaltransform[4];
+	uint matind;
+	uint shape;
+	uint source;
+	uint pad;
+	float4 worldview[4];
+};
+
+// GpuCulling::CullShape
+struct CullShape
+{
+	float4 sphere;
+	float4 boxCenter;
+	float4 boxExtents;
+	float lodError[4];
+	uint lodCount;
+	uint firstCommand;
+	uint pad0;
+	uint pad1;
+};
+
+// InstanceData of Header.hlsli, with the source index in pad0.
+struct OutputInstance
+{
+	float4 transform[4];
+	float4 normaltransform[4];
+	uint matind;
+	uint source;
+	uint pad1;
+	uint pad2;
+};
+
+// GpuCulling::CullConstants, as root constants.
+cbuffer cbCull : register(b0)
+{
+	float4 gPlanes[6];
+	uint gInstanceCount;
+	float gPixelsPerUnit;
+	float gLodPixelError;
+	uint gPad;
+};
+
+StructuredBuffer<CullInstance> gInstances : register(t0);
+StructuredBuffer<CullShape> gShapes : register(t1);
+RWStructuredBuffer<OutputInstance> gOutput : register(u0);
+// GpuCulling::DrawCommand array: index buffer view (16 bytes), first instance, then the indexed draw arguments.
+RWByteAddressBuffer gCommands : register(u1);
+
+static const uint c_commandStride = 40;
+static const uint c_firstInstanceOffset = 16;
+static const uint c_instanceCountOffset = 24;
+
+float3 TransformPoint(float3 p, float4 m[4])
+{
+	return p.x * m[0].xyz + p.y * m[1].xyz + p.z * m[2].xyz + m[3].xyz;
+}
+
+[numthreads(64, 1, 1)]
+void CS(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= gInstanceCount)
+		return;
+	CullInstance instance = gInstances[id.x];
+	CullShape shape = gShapes[instance.shape];
+	float4 m[4] = instance.worldview;
+
+	float scale = sqrt(max(dot(m[0].xyz, m[0].xyz), max(dot(m[1].xyz, m[1].xyz), dot(m[2].xyz, m[2].xyz))));
+	float3 sphereCenter = TransformPoint(shape.sphere.xyz, m);
+	float radius = shape.sphere.w * scale;
+	float3 boxCenter = TransformPoint(shape.boxCenter.xyz, m);
+
+	[unroll]
+	for (uint p = 0; p < 6; p++) {
+		float4 plane = gPlanes[p];
+		float sphereMargin = dot(plane.xyz, sphereCenter) + plane.w + radius;
+		// Box radius along the plane normal: its axes are the scaled rows of the worldview.
+		float boxRadius = abs(dot(plane.xyz, m[0].xyz)) * shape.boxExtents.x + abs(dot(plane.xyz, m[1].xyz)) * shape.boxExtents.y +
+			abs(dot(plane.xyz, m[2].xyz)) * shape.boxExtents.z;
+		float boxMargin = dot(plane.xyz, boxCenter) + plane.w + boxRadius;
+		if (sphereMargin < 0.0f || boxMargin < 0.0f)
+			return;
+	}
+
+	// The coarsest LOD whose error stays under gLodPixelError on screen (InstanceUpdate.h).
+	float z = m[3].z;
+	uint lod = 0;
+	while (z > 0.0f && lod + 1 < shape.lodCount) {
+		float pixels = shape.lodError[lod + 1] * scale * gPixelsPerUnit / z;
+		if (!(pixels < gLodPixelError))
+			break;
+		lod++;
+	}
+
+	uint command = (shape.firstCommand + lod) * c_commandStride;
+	uint slot;
+	gCommands.InterlockedAdd(command + c_instanceCountOffset, 1, slot);
+	uint first = gCommands.Load(command + c_firstInstanceOffset);
+
+	OutputInstance output;
+	output.transform = instance.transform;
+	output.normaltransform = instance.normaltransform;
+	output.matind = instance.matind;
+	output.source = instance.source;
+	output.pad1 = 0;
+	output.pad2 = 0;
+	gOutput[first + slot] = output;
+}
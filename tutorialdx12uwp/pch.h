@@ -6,6 +6,28 @@
 #pragma once
 //Comment the following define for previous versions of SDK to 1941, for example SDK18362
 #define _SDK19041
+//Uncomment the following define to run the CPU benchmarks (Benchmark.h) at startup, results go to the debug output
+//#define _BENCHMARK
+//Uncomment the following define to write the frame timeline of the simulation and render threads (FramePipeline.h) as a Chrome trace in LocalFolder
+//#define _TRACE_FRAME_TIMELINE
+//Uncomment the following define to capture the commands of one frame (CommandTrace.h) to LocalFolder and compare them with a reference capture there
+//#define _CAPTURE_COMMANDS
+//Uncomment the following define to render one frame with the software rasterizer (SoftwareRasterizer.h) to LocalFolder and compare it with a golden image there
+//#define _SOFTWARE_REFERENCE
+//Heap allocations are counted in debug builds; Game::Tick asserts that steady frames of Update do not allocate (AllocationCounter.h)
+#if defined(_DEBUG) && !defined(_COUNT_ALLOCATIONS)
+#define _COUNT_ALLOCATIONS
+#endif
+//Debug builds check the GPU culling pass against its CPU reference at startup (GpuCullingCheck.h)
+#ifdef _DEBUG
+#define _VALIDATE_GPU_CULLING
+#endif
+
+//_HEADLESS is defined by the CMake build (CMakeLists.txt) of the core library and its console tools: pchHeadless.h
+//replaces the Windows and WinRT headers
+#ifdef _HEADLESS
+#include "pchHeadless.h"
+#else
 
 #define MYTRACE OutputDebugString
 
@@ -39,10 +61,18 @@
 
 // Cabeceras de la C++ STL
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #include <fstream>
 
 #ifdef _DEBUG
@@ -67,6 +97,7 @@ namespace winrt::impl
 #include "winrt/Windows.UI.Input.h"
 #include "winrt/Windows.UI.ViewManagement.h"
 #include "winrt/Windows.Devices.Input.h"
+#include "winrt/Windows.Storage.h"
 
 // Windows Imaging Component (WIC) to load sprites
 #include "wincodec.h"
@@ -83,4 +114,6 @@ namespace DX
             throw std::exception();
         }
     }
-}
\ No newline at end of file
+}
+
+#endif // _HEADLESS
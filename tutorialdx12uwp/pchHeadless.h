@@ -0,0 +1,73 @@
+//
+// pchHeadless.h
+// pch.h of the CMake build (CMakeLists.txt): the core library and its console tools, without WinRT, a window or
+// a device. Types and constants of d3d12.h come from DirectX-Headers, which also builds on Linux.
+//
+
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <d3d12.h>
+#include "d3dx12.h"
+#else
+#include <wsl/winadapter.h>
+#include <directx/d3d12.h>
+#include <directx/d3dx12.h>
+#endif
+
+#include <DirectXMath.h>
+#include <DirectXColors.h>
+
+// The headers of the renderer use the DirectXMath types unqualified.
+using namespace DirectX;
+
+// Cabeceras de la C++ STL
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define MYTRACE OutputDebugString
+#else
+// Console tools report on the standard output. It is byte oriented (tinyobj writes to std::cout), so the wide
+// message is narrowed; traces are ASCII.
+inline void HeadlessTrace(const wchar_t* message) {
+    char text[512];
+    size_t length = 0;
+    for (; *message != L'\0'; message++) {
+        text[length++] = *message < 0x80 ? static_cast<char>(*message) : '?';
+        if (length == sizeof(text) - 1) {
+            fwrite(text, 1, length, stdout);
+            length = 0;
+        }
+    }
+    fwrite(text, 1, length, stdout);
+}
+#define MYTRACE HeadlessTrace
+#endif
@@ -4,7 +4,7 @@
 VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
-	InstanceData idata = gInstanceData[instanceID];
+	InstanceData idata = gInstanceData[gInstanceBase + instanceID];
 	vout.pos = mul(float4(vin.pos, 1.0f), idata.transform);
 	vout.normal = mul(float4(vin.normal, 0.0f), idata.normaltransform);
 	vout.color = vin.color;
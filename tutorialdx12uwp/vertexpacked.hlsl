@@ -0,0 +1,14 @@
+#include "Header.hlsli"
+
+
+VertexOut VS(VertexInPacked vin, uint instanceID : SV_InstanceID)
+{
+	VertexOut vout = (VertexOut)0.0f;
+	InstanceData idata = gInstanceData[gInstanceBase + instanceID];
+	vout.pos = mul(float4(vin.pos, 1.0f), idata.transform);
+	vout.normal = mul(float4(OctahedralDecode(vin.normal), 0.0f), idata.normaltransform);
+	vout.color = vin.color;
+	vout.uvcoord = vin.uvcoord;
+	vout.mind = idata.matind;
+	return vout;
+}